@@ -0,0 +1,522 @@
+/*
+ * Synthetic firmware ACPI tables for the host harness.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <png.h>
+#include <grub/acpi.h>
+#include <grub/efi/api.h>
+#include <grub/smbios.h>
+#include "acpi_gen.h"
+#include "host.h"
+#include "types.h"
+
+#define HOST_ACPI_MAX_BLOCKS 4096
+
+static void* host_acpi_blocks[HOST_ACPI_MAX_BLOCKS];
+static unsigned host_acpi_block_count;
+
+static void*
+host_acpi_alloc (grub_size_t size)
+{
+  void* p = calloc (1, size);
+  if (host_acpi_block_count < HOST_ACPI_MAX_BLOCKS)
+    host_acpi_blocks[host_acpi_block_count++] = p;
+  return p;
+}
+
+void
+host_acpi_release (void)
+{
+  host_set_configuration_table (NULL, 0);
+  while (host_acpi_block_count)
+    free (host_acpi_blocks[--host_acpi_block_count]);
+}
+
+static void
+host_acpi_fill_header (struct grub_acpi_table_header* header, const char* signature, grub_uint32_t length)
+{
+  memcpy (header->signature, signature, 4);
+  header->length = length;
+  header->revision = 1;
+  memcpy (header->oemid, "HOSTFW", 6);
+  memcpy (header->oemtable, "HACKHOST", 8);
+  header->oemrev = 1;
+  memcpy (header->creator_id, "HOST", 4);
+  header->creator_rev = 1;
+  set_acpi_sdt_checksum (header);
+}
+
+static bitmap_t
+host_make_logo (grub_uint32_t width, grub_uint32_t height)
+{
+  grub_uint32_t size = get_bitmap_total_size (width, height);
+  bitmap_t bmp = host_acpi_alloc (size);
+  memcpy (&bmp->header.signature, BMP_MAGIC, BMP_MAGIC_SIZE);
+  bmp->header.size = size;
+  bmp->header.pixel_data_offset = BMP_PIXEL_DATA_OFFSET;
+  bmp->header.dib_header_size = BMP_DIB_HEADER_SIZE;
+  bmp->header.width = width;
+  bmp->header.height = height;
+  bmp->header.planes = 1;
+  bmp->header.bpp = BMP_888_BPP;
+  bmp->header.compression = BMP_NO_COMPRESSION;
+  bmp->header.data_size = get_bitmap_pixels_size (width, height);
+  bmp->header.ppm_horiz = BMP_72_DPI;
+  bmp->header.ppm_vert = BMP_72_DPI;
+  memset ((grub_uint8_t*) &bmp->pixels, 0x40, bmp->header.data_size);
+  return bmp;
+}
+
+/**
+ * Append an SMBIOS structure with a manufacturer and a product string.
+ *
+ * @return The end of the structure.
+ */
+static grub_uint8_t*
+host_smbios_structure (grub_uint8_t* p, grub_uint8_t type, const char* manufacturer, const char* product)
+{
+  struct smbios_header* header = (struct smbios_header*) p;
+  grub_uint8_t length = SMBIOS_PRODUCT + 4; // up to the version and serial numbers, left out
+  memset (p, 0, length);
+  header->type = type;
+  header->length = length;
+  header->handle = type;
+  p[SMBIOS_MANUFACTURER] = 1;
+  p[SMBIOS_PRODUCT] = 2;
+  p += length;
+  p = (grub_uint8_t*) stpcpy ((char*) p, manufacturer) + 1;
+  p = (grub_uint8_t*) stpcpy ((char*) p, product) + 1;
+  *p++ = '\0';
+  return p;
+}
+
+/**
+ * Build an SMBIOS 3.0 entry point and its structures.
+ */
+static struct grub_smbios_eps3*
+host_make_smbios (const struct host_acpi_spec* spec)
+{
+  struct grub_smbios_eps3* eps3 = host_acpi_alloc (sizeof (*eps3));
+  grub_size_t size = 64 + sizeof (struct smbios_header) * 2;
+  grub_uint8_t* structures;
+  grub_uint8_t* p;
+
+  if (spec->system_manufacturer)
+    size += SMBIOS_PRODUCT + 7 + strlen (spec->system_manufacturer) + strlen (spec->system_product);
+  if (spec->board_manufacturer)
+    size += SMBIOS_PRODUCT + 7 + strlen (spec->board_manufacturer) + strlen (spec->board_product);
+  structures = p = host_acpi_alloc (size);
+  // an unrelated structure first, like the BIOS information
+  p = host_smbios_structure (p, 0, "HostFW", "1.0");
+  if (spec->system_manufacturer)
+    p = host_smbios_structure (p, SMBIOS_TYPE_SYSTEM, spec->system_manufacturer, spec->system_product);
+  if (spec->board_manufacturer)
+    p = host_smbios_structure (p, SMBIOS_TYPE_BASEBOARD, spec->board_manufacturer, spec->board_product);
+  ((struct smbios_header*) p)->type = SMBIOS_TYPE_END;
+  ((struct smbios_header*) p)->length = sizeof (struct smbios_header);
+  p += sizeof (struct smbios_header) + 2;
+  memcpy (eps3->anchor, SMBIOS3_ANCHOR, sizeof (eps3->anchor));
+  eps3->length = sizeof (*eps3);
+  eps3->version_major = 3;
+  eps3->revision = 1;
+  eps3->maximum_table_length = p - structures;
+  eps3->table_address = (grub_uint64_t) (grub_addr_t) structures;
+  eps3->checksum = 0;
+  eps3->checksum = -grub_byte_checksum (eps3, sizeof (*eps3));
+  return eps3;
+}
+
+void
+host_acpi_generate (const struct host_acpi_spec* spec)
+{
+  static const grub_efi_packed_guid_t smbios3_guid = GRUB_EFI_SMBIOS3_TABLE_GUID;
+  static const grub_efi_packed_guid_t acpi20_guid = GRUB_EFI_ACPI_20_TABLE_GUID;
+  static const grub_efi_packed_guid_t acpi10_guid = GRUB_EFI_ACPI_TABLE_GUID;
+  grub_uint32_t rsdp_count = spec->shared_rsdp ? 1 : spec->acpi20_entries;
+  grub_uint32_t sdt_count = spec->xsdt_entries;
+  struct grub_acpi_table_header* sdts;
+  grub_acpi_bgrt_t bgrt = NULL;
+  struct grub_acpi_rsdp_v20** rsdps;
+  grub_efi_configuration_table_t* table;
+  grub_uint32_t table_count = spec->other_entries + spec->acpi20_entries;
+  int smbios = spec->system_manufacturer || spec->board_manufacturer;
+
+  host_acpi_release ();
+  sdts = host_acpi_alloc (sizeof (*sdts) * (sdt_count ? sdt_count : 1));
+  for (grub_uint32_t i = 0; i < sdt_count; i++)
+    host_acpi_fill_header (&sdts[i], (i % 2) ? "SSDT" : "APIC", sizeof (sdts[i]));
+  if (spec->bgrt_count)
+  {
+    bgrt = host_acpi_alloc (sizeof (*bgrt));
+    bgrt->version = BGRT_VERSION;
+    bgrt->status = BGRT_STATUS_VALID;
+    bgrt->image_type = BGRT_IMAGE_TYPE_BMP;
+    if (spec->logo_width && spec->logo_height)
+    {
+      bgrt->image_address = (grub_uint64_t) (grub_addr_t) host_make_logo (spec->logo_width, spec->logo_height);
+      bgrt->image_offset_x = 100;
+      bgrt->image_offset_y = 100;
+    }
+    host_acpi_fill_header (&bgrt->header, BGRT_MAGIC, BGRT_HEADER_SIZE);
+  }
+  rsdps = host_acpi_alloc (sizeof (*rsdps) * (rsdp_count ? rsdp_count : 1));
+  for (grub_uint32_t r = 0; r < rsdp_count; r++)
+  {
+    grub_uint32_t xsdt_len = sizeof (struct grub_acpi_table_header) + sdt_count * sizeof (grub_uint64_t);
+    struct grub_acpi_table_header* xsdt = host_acpi_alloc (xsdt_len);
+    grub_uint64_t* entries = (grub_uint64_t*) &xsdt[1];
+    for (grub_uint32_t i = 0; i < sdt_count; i++)
+      entries[i] = (grub_uint64_t) (grub_addr_t) &sdts[i];
+    // spread the BGRT entries over the array
+    for (grub_uint32_t b = 0; b < spec->bgrt_count && b < sdt_count; b++)
+      entries[(grub_uint64_t) (b + 1) * sdt_count / (spec->bgrt_count + 1)] = (grub_uint64_t) (grub_addr_t) bgrt;
+    host_acpi_fill_header (xsdt, "XSDT", xsdt_len);
+    struct grub_acpi_rsdp_v20* rsdp = host_acpi_alloc (sizeof (*rsdp));
+    memcpy (rsdp->rsdpv1.signature, GRUB_RSDP_SIGNATURE, GRUB_RSDP_SIGNATURE_SIZE);
+    memcpy (rsdp->rsdpv1.oemid, "HOSTFW", 6);
+    rsdp->rsdpv1.revision = 2;
+    rsdp->length = sizeof (*rsdp);
+    rsdp->xsdt_addr = (grub_uint64_t) (grub_addr_t) xsdt;
+    set_acpi_rsdp2_checksums (rsdp);
+    rsdps[r] = rsdp;
+  }
+  table = host_acpi_alloc (sizeof (*table) * (table_count + 1));
+  for (grub_uint32_t i = 0; i < spec->other_entries; i++)
+  {
+    memcpy (&table[i].vendor_guid, &acpi10_guid, sizeof (acpi10_guid));
+    table[i].vendor_guid.data1 += i + 1; // unrelated vendor GUIDs
+    table[i].vendor_table = NULL;
+  }
+  for (grub_uint32_t i = 0; i < spec->acpi20_entries; i++)
+  {
+    grub_efi_configuration_table_t* entry = &table[spec->other_entries + i];
+    memcpy (&entry->vendor_guid, &acpi20_guid, sizeof (acpi20_guid));
+    entry->vendor_table = rsdps[spec->shared_rsdp ? 0 : i];
+  }
+  if (smbios)
+  {
+    memcpy (&table[table_count].vendor_guid, &smbios3_guid, sizeof (smbios3_guid));
+    table[table_count++].vendor_table = host_make_smbios (spec);
+  }
+  host_set_configuration_table (table, table_count);
+}
+
+/**
+ * Walk the BGRT entries reachable from the installed tables.
+ *
+ * @param first Set to the first one, NULL if none.
+ * @return How many there are.
+ */
+static grub_uint32_t
+host_acpi_scan_bgrt (int* checksums_ok, grub_acpi_bgrt_t* first)
+{
+  extern grub_efi_system_table_t* grub_efi_system_table;
+  static const grub_efi_packed_guid_t acpi20_guid = GRUB_EFI_ACPI_20_TABLE_GUID;
+  grub_uint32_t count = 0;
+
+  *checksums_ok = 1;
+  *first = NULL;
+  for (grub_efi_uintn_t i = 0; i < grub_efi_system_table->num_table_entries; i++)
+  {
+    grub_efi_configuration_table_t* entry = &grub_efi_system_table->configuration_table[i];
+    if (memcmp (&entry->vendor_guid, &acpi20_guid, sizeof (acpi20_guid)) != 0)
+      continue;
+    struct grub_acpi_rsdp_v20* rsdp = entry->vendor_table;
+    if (!verify_acpi_rsdp2_checksums (rsdp))
+      *checksums_ok = 0;
+    struct grub_acpi_table_header* xsdt = (void*) (grub_addr_t) rsdp->xsdt_addr;
+    if (!verify_acpi_sdt_checksum (xsdt))
+      *checksums_ok = 0;
+    grub_uint64_t* entries = (grub_uint64_t*) &xsdt[1];
+    grub_uint32_t n = (xsdt->length - sizeof (*xsdt)) / sizeof (grub_uint64_t);
+    for (grub_uint32_t j = 0; j < n; j++)
+    {
+      struct grub_acpi_table_header* sdt = (void*) (grub_addr_t) entries[j];
+      if (memcmp (sdt->signature, BGRT_MAGIC, BGRT_MAGIC_SIZE) != 0)
+        continue;
+      if (!verify_acpi_sdt_checksum (sdt))
+        *checksums_ok = 0;
+      if (!count++)
+        *first = (grub_acpi_bgrt_t) sdt;
+    }
+  }
+  return count;
+}
+
+grub_uint32_t
+host_acpi_count_bgrt (int* checksums_ok)
+{
+  grub_acpi_bgrt_t first;
+  return host_acpi_scan_bgrt (checksums_ok, &first);
+}
+
+struct grub_acpi_bgrt*
+host_acpi_first_bgrt (void)
+{
+  grub_acpi_bgrt_t first;
+  int checksums_ok;
+  host_acpi_scan_bgrt (&checksums_ok, &first);
+  return first;
+}
+
+int
+host_write_bmp (const char* path, grub_uint32_t width, grub_uint32_t height)
+{
+  struct bitmap_header header;
+  grub_uint32_t stride = BMP_888_BPP / 8 * width + width % 4;
+  grub_uint8_t* row;
+  FILE* fp = fopen (path, "wb");
+
+  if (!fp)
+    return -1;
+  memset (&header, 0, sizeof (header));
+  memcpy (&header.signature, BMP_MAGIC, BMP_MAGIC_SIZE);
+  header.size = get_bitmap_total_size (width, height);
+  header.pixel_data_offset = BMP_PIXEL_DATA_OFFSET;
+  header.dib_header_size = BMP_DIB_HEADER_SIZE;
+  header.width = width;
+  header.height = height;
+  header.planes = 1;
+  header.bpp = BMP_888_BPP;
+  header.compression = BMP_NO_COMPRESSION;
+  header.data_size = get_bitmap_pixels_size (width, height);
+  header.ppm_horiz = BMP_72_DPI;
+  header.ppm_vert = BMP_72_DPI;
+  fwrite (&header, sizeof (header), 1, fp);
+  row = calloc (1, stride);
+  for (grub_uint32_t y = 0; y < height; y++)
+  {
+    // a centered light square on black, the typical splash
+    int in_y = y >= height / 4 && y < height * 3 / 4;
+    for (grub_uint32_t x = 0; x < width; x++)
+    {
+      grub_uint8_t v = (in_y && x >= width / 4 && x < width * 3 / 4) ? 0xe0 : 0;
+      row[3 * x] = v;
+      row[3 * x + 1] = v;
+      row[3 * x + 2] = v;
+    }
+    fwrite (row, 1, stride, fp);
+  }
+  free (row);
+  return fclose (fp);
+}
+
+static const char* const host_bmp_format_names[] = {
+  "1bpp", "4bpp", "8bpp", "rle4", "rle8", "32bpp", "32bpp-alpha", "24bpp-topdown",
+};
+
+const char*
+host_bmp_format_name (enum host_bmp_format format)
+{
+  return host_bmp_format_names[format];
+}
+
+/** Palette index of the host_write_bmp picture: 1 in the square, 0 around. */
+static int
+host_bmp_index (grub_uint32_t x, grub_uint32_t y, grub_uint32_t width, grub_uint32_t height)
+{
+  return y >= height / 4 && y < height * 3 / 4 && x >= width / 4 && x < width * 3 / 4;
+}
+
+static void
+put32 (grub_uint8_t* p, grub_uint32_t v)
+{
+  memcpy (p, &v, sizeof (v));
+}
+
+/**
+ * RLE encode one row: the first pixels in absolute mode, when the row is wide
+ * enough, so both modes are exercised, then runs.
+ */
+static grub_uint8_t*
+host_rle_row (grub_uint8_t* p, const grub_uint8_t* index, grub_uint32_t width, int rle4)
+{
+  grub_uint32_t x = 0;
+  if (width >= 8)
+  {
+    grub_uint32_t bytes = rle4 ? 3 : 5;
+    *p++ = 0;
+    *p++ = 5;
+    for (grub_uint32_t i = 0; i < bytes; i++)
+      *p++ = !rle4 ? index[i] : index[2 * i] << 4 | (2 * i + 1 < 5 ? index[2 * i + 1] : 0);
+    if (bytes & 1)
+      *p++ = 0;
+    x = 5;
+  }
+  while (x < width)
+  {
+    grub_uint32_t run = 1;
+    while (x + run < width && run < 255 && index[x + run] == index[x])
+      run++;
+    *p++ = run;
+    *p++ = rle4 ? index[x] << 4 | index[x] : index[x];
+    x += run;
+  }
+  *p++ = 0;
+  *p++ = 0;
+  return p;
+}
+
+int
+host_write_bmp_format (const char* path, grub_uint32_t width, grub_uint32_t height, enum host_bmp_format format)
+{
+  static const grub_uint16_t bpps[] = { 1, 4, 8, 4, 8, 32, 32, 24 };
+  static const grub_uint32_t compressions[] = {
+    BMP_NO_COMPRESSION, BMP_NO_COMPRESSION, BMP_NO_COMPRESSION, BMP_RLE4, BMP_RLE8,
+    BMP_NO_COMPRESSION, BMP_BITFIELDS, BMP_NO_COMPRESSION,
+  };
+  grub_uint16_t bpp = bpps[format];
+  grub_uint32_t dib_size = format >= HOST_BMP_32BPP_ALPHA ? 124 : BMP_DIB_HEADER_SIZE;
+  grub_uint32_t palette_count = bpp <= 8 ? 2 : 0;
+  grub_uint32_t pixel_offset = 14 + dib_size + 4 * palette_count;
+  grub_uint32_t stride = (width * bpp + 31) / 32 * 4;
+  grub_size_t capacity = pixel_offset + (grub_size_t) stride * height
+                         + (grub_size_t) height * (12 + 2 * (width / 255 + 2)) + 2;
+  grub_uint8_t* file = calloc (1, capacity);
+  grub_uint8_t* row = calloc (1, width + 8);
+  grub_uint8_t* p = file + pixel_offset;
+  FILE* fp;
+  int ret;
+
+  for (grub_uint32_t y = 0; y < height; y++)
+  {
+    // rows are stored bottom-up, except the top-down format
+    grub_uint32_t py = format == HOST_BMP_24BPP_TOPDOWN ? height - 1 - y : y;
+    for (grub_uint32_t x = 0; x < width; x++)
+      row[x] = host_bmp_index (x, py, width, height);
+    switch (format)
+    {
+      case HOST_BMP_RLE4:
+      case HOST_BMP_RLE8:
+        p = host_rle_row (p, row, width, format == HOST_BMP_RLE4);
+        continue;
+      case HOST_BMP_1BPP:
+        for (grub_uint32_t x = 0; x < width; x++)
+          p[x / 8] |= row[x] << (7 - x % 8);
+        break;
+      case HOST_BMP_4BPP:
+        for (grub_uint32_t x = 0; x < width; x++)
+          p[x / 2] |= row[x] << (x % 2 ? 0 : 4);
+        break;
+      case HOST_BMP_8BPP:
+        memcpy (p, row, width);
+        break;
+      case HOST_BMP_32BPP:
+        for (grub_uint32_t x = 0; x < width; x++)
+          put32 (p + 4 * x, row[x] ? 0x5ae0e0e0 : 0x5a000000);
+        break;
+      case HOST_BMP_32BPP_ALPHA:
+        for (grub_uint32_t x = 0; x < width; x++)
+          put32 (p + 4 * x, row[x] ? 0xffe0e0e0 : 0xff000000);
+        break;
+      default:
+        for (grub_uint32_t x = 0; x < width; x++)
+          memset (p + 3 * x, row[x] ? 0xe0 : 0, 3);
+    }
+    p += stride;
+  }
+  if (format == HOST_BMP_RLE4 || format == HOST_BMP_RLE8)
+  {
+    *p++ = 0;
+    *p++ = 1;
+  }
+
+  memcpy (file, BMP_MAGIC, BMP_MAGIC_SIZE);
+  put32 (file + 2, p - file);
+  put32 (file + 10, pixel_offset);
+  put32 (file + 14, dib_size);
+  put32 (file + 18, width);
+  put32 (file + 22, format == HOST_BMP_24BPP_TOPDOWN ? -(grub_int32_t) height : (grub_int32_t) height);
+  file[26] = 1;
+  file[28] = bpp;
+  put32 (file + 30, compressions[format]);
+  put32 (file + 34, p - file - pixel_offset);
+  put32 (file + 38, BMP_72_DPI);
+  put32 (file + 42, BMP_72_DPI);
+  put32 (file + 46, palette_count);
+  if (format == HOST_BMP_32BPP_ALPHA)
+  {
+    put32 (file + 54, 0x00ff0000);
+    put32 (file + 58, 0x0000ff00);
+    put32 (file + 62, 0x000000ff);
+    put32 (file + 66, 0xff000000);
+  }
+  if (palette_count)
+    put32 (file + 14 + dib_size + 4, 0xe0e0e0);
+
+  fp = fopen (path, "wb");
+  ret = !fp || fwrite (file, 1, p - file, fp) != (grub_size_t) (p - file);
+  if (fp && fclose (fp) != 0)
+    ret = 1;
+  free (row);
+  free (file);
+  return ret ? -1 : 0;
+}
+
+int
+host_write_badge (const char* path, grub_uint32_t width, grub_uint32_t height)
+{
+  grub_uint32_t dib_size = 124, pixel_offset = 14 + dib_size;
+  grub_size_t size = pixel_offset + (grub_size_t) width * height * 4;
+  grub_uint8_t* file = calloc (1, size);
+  FILE* fp;
+  int ret;
+
+  for (grub_uint32_t y = 0; y < height; y++)
+    for (grub_uint32_t x = 0; x < width; x++)
+      put32 (file + pixel_offset + ((grub_size_t) y * width + x) * 4,
+             host_bmp_index (x, y, width, height) ? 0xffe0e0e0 : 0x80ffffff);
+  memcpy (file, BMP_MAGIC, BMP_MAGIC_SIZE);
+  put32 (file + 2, size);
+  put32 (file + 10, pixel_offset);
+  put32 (file + 14, dib_size);
+  put32 (file + 18, width);
+  put32 (file + 22, height);
+  file[26] = 1;
+  file[28] = 32;
+  put32 (file + 30, BMP_BITFIELDS);
+  put32 (file + 34, size - pixel_offset);
+  put32 (file + 38, BMP_72_DPI);
+  put32 (file + 42, BMP_72_DPI);
+  put32 (file + 54, 0x00ff0000);
+  put32 (file + 58, 0x0000ff00);
+  put32 (file + 62, 0x000000ff);
+  put32 (file + 66, 0xff000000);
+
+  fp = fopen (path, "wb");
+  ret = !fp || fwrite (file, 1, size, fp) != size;
+  if (fp && fclose (fp) != 0)
+    ret = 1;
+  free (file);
+  return ret ? -1 : 0;
+}
+
+int
+host_write_png (const char* path, grub_uint32_t width, grub_uint32_t height, int alpha)
+{
+  png_image image;
+  unsigned channels = alpha ? 4 : 3;
+  grub_uint8_t* pixels = malloc ((grub_size_t) width * height * channels);
+  int ok;
+
+  for (grub_uint32_t y = 0; y < height; y++)
+    for (grub_uint32_t x = 0; x < width; x++)
+    {
+      // PNG rows are top-down
+      grub_uint8_t* p = pixels + ((grub_size_t) y * width + x) * channels;
+      int in = host_bmp_index (x, height - 1 - y, width, height);
+      memset (p, in ? 0xe0 : alpha ? 0xff : 0, 3);
+      if (alpha)
+        p[3] = in ? 0xff : 0;
+    }
+  memset (&image, 0, sizeof (image));
+  image.version = PNG_IMAGE_VERSION;
+  image.width = width;
+  image.height = height;
+  image.format = alpha ? PNG_FORMAT_RGBA : PNG_FORMAT_RGB;
+  ok = png_image_write_to_file (&image, path, 0, pixels, 0, NULL);
+  free (pixels);
+  return ok ? 0 : -1;
+}
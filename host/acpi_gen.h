@@ -0,0 +1,96 @@
+/*
+ * Synthetic RSDP/XSDT generator for the host harness.
+ */
+#pragma once
+
+#include <grub/types.h>
+#include <grub/efi/api.h>
+
+/** Shape of the generated firmware tables. */
+struct host_acpi_spec
+{
+  grub_uint32_t xsdt_entries;   // SDT entries in each XSDT, BGRT included
+  grub_uint32_t acpi20_entries; // ACPI 2.0 configuration table entries
+  grub_uint32_t other_entries;  // unrelated configuration table entries
+  grub_uint32_t bgrt_count;     // BGRT entries per XSDT (0 = missing)
+  int shared_rsdp;              // all ACPI 2.0 entries point to the same RSDP
+  grub_uint32_t logo_width;     // firmware logo, 0 = none
+  grub_uint32_t logo_height;
+  const char* system_manufacturer; // SMBIOS type 1 strings; no SMBIOS table if all four are NULL
+  const char* system_product;
+  const char* board_manufacturer;  // SMBIOS type 2 strings, NULL leaves the structure out
+  const char* board_product;
+};
+
+/**
+ * Build the tables and install them in the fake system table.
+ *
+ * The SMBIOS structures, when asked for, are published through a 64-bit
+ * entry point after the ACPI entries: a host pointer does not fit the 32-bit
+ * one.
+ *
+ * Any previously generated tables are released first.
+ */
+void host_acpi_generate (const struct host_acpi_spec* spec);
+
+/** Release the generated tables. */
+void host_acpi_release (void);
+
+/**
+ * Count the BGRT entries reachable from the installed tables.
+ *
+ * @param checksums_ok Set to 0 if any RSDP/XSDT checksum is wrong.
+ */
+grub_uint32_t host_acpi_count_bgrt (int* checksums_ok);
+
+/** The first BGRT reachable from the installed tables, or NULL. */
+struct grub_acpi_bgrt* host_acpi_first_bgrt (void);
+
+/**
+ * Write a 24-bit bottom-up BMP file.
+ *
+ * @return 0 on success.
+ */
+int host_write_bmp (const char* path, grub_uint32_t width, grub_uint32_t height);
+
+/** Encodings of the same picture as host_write_bmp, for the BMP decoder. */
+enum host_bmp_format
+{
+  HOST_BMP_1BPP,
+  HOST_BMP_4BPP,
+  HOST_BMP_8BPP,
+  HOST_BMP_RLE4,
+  HOST_BMP_RLE8,
+  HOST_BMP_32BPP,        // BI_RGB, the unused byte set
+  HOST_BMP_32BPP_ALPHA,  // BITFIELDS with a V5 header, opaque alpha
+  HOST_BMP_24BPP_TOPDOWN, // V5 header, negative height
+  HOST_BMP_FORMATS
+};
+
+/** Short name of a format, for file names and labels. */
+const char* host_bmp_format_name (enum host_bmp_format format);
+
+/**
+ * Write the host_write_bmp picture in another encoding.
+ *
+ * @return 0 on success.
+ */
+int host_write_bmp_format (const char* path, grub_uint32_t width, grub_uint32_t height, enum host_bmp_format format);
+
+/**
+ * Write a 32-bit BMP with alpha (BITFIELDS, V5 header) to overlay: the
+ * host_write_bmp square opaque, in 0xe0 gray, and around it white at half
+ * opacity (alpha 0x80).
+ *
+ * @return 0 on success.
+ */
+int host_write_badge (const char* path, grub_uint32_t width, grub_uint32_t height);
+
+/**
+ * Write the host_write_bmp picture as a PNG, with libpng.
+ *
+ * @param alpha 0 for RGB; 1 for RGBA with a transparent white background,
+ *        which blends to the same black.
+ * @return 0 on success.
+ */
+int host_write_png (const char* path, grub_uint32_t width, grub_uint32_t height, int alpha);
@@ -0,0 +1,2299 @@
+/*
+ * Benchmark runner for the hackbgrt boot path.
+ *
+ * The module sources are included directly so their static functions can be
+ * timed phase by phase against the fake firmware of the host harness.
+ */
+#include "hackbgrt.c"
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <grub/env.h>
+#include "acpi_gen.h"
+#include "host.h"
+#include "lz4enc.h"
+#include "pack_build.h"
+#include "profile_build.h"
+
+struct bench_options
+{
+  const char* phase;
+  grub_uint64_t target_ns;
+  unsigned min_iterations;
+  unsigned max_iterations;
+  int quick;
+  unsigned processors;
+  struct host_disk_spec disk;
+};
+
+static struct bench_options bench_opts = {
+  .phase = NULL,
+  .target_ns = 200000000ull,
+  .min_iterations = 3,
+  .max_iterations = 100000,
+  .quick = 0,
+  .processors = 4,
+  .disk = { .fat_bits = 32 },
+};
+
+struct bench_case
+{
+  void (*setup) (void* arg);
+  void (*run) (void* arg);
+  void (*teardown) (void* arg);
+  void* arg;
+};
+
+/**
+ * Run a case until the time target is met and print one report line.
+ *
+ * Only run() is timed; the counters are averaged per iteration.
+ */
+static void
+bench_run (const char* phase, const char* label, const struct bench_case* c, const char* check)
+{
+  struct host_counters sum;
+  grub_uint64_t total_ns = 0, min_ns = UINT64_MAX;
+  unsigned n = 0;
+
+  memset (&sum, 0, sizeof (sum));
+  while (n < bench_opts.max_iterations && (n < bench_opts.min_iterations || total_ns < bench_opts.target_ns))
+  {
+    if (c->setup)
+      c->setup (c->arg);
+    host_counters_reset ();
+    grub_uint64_t t0 = host_now_ns ();
+    c->run (c->arg);
+    grub_uint64_t dt = host_now_ns () - t0;
+    sum.malloc_calls += host_counters.malloc_calls;
+    sum.pool_calls += host_counters.pool_calls;
+    sum.pages_calls += host_counters.pages_calls;
+    sum.pool_bytes += host_counters.pool_bytes + host_counters.pages_bytes;
+    sum.file_bytes_read += host_counters.file_bytes_read;
+    sum.stall_us += host_counters.stall_us;
+    if (c->teardown)
+      c->teardown (c->arg);
+    total_ns += dt;
+    if (dt < min_ns)
+      min_ns = dt;
+    n++;
+  }
+  printf ("%-14s %-28s %7u %12.1f %12.1f %7" PRIu64 " %7" PRIu64 " %12" PRIu64 " %12" PRIu64 " %9" PRIu64 "  %s\n",
+          phase, label, n,
+          total_ns / 1000.0 / n, min_ns / 1000.0,
+          sum.malloc_calls / n, (sum.pool_calls + sum.pages_calls) / n,
+          sum.pool_bytes / n, sum.file_bytes_read / n, sum.stall_us / n,
+          check ? check : "");
+  fflush (stdout);
+}
+
+static void
+bench_header (void)
+{
+  printf ("%-14s %-28s %7s %12s %12s %7s %7s %12s %12s %9s  %s\n",
+          "phase", "case", "iters", "avg_us", "min_us", "mallocs", "efi_al", "efi_bytes", "read_bytes", "stall_us", "check");
+}
+
+static int
+bench_selected (const char* phase)
+{
+  return !bench_opts.phase || strcmp (bench_opts.phase, phase) == 0;
+}
+
+struct image_size
+{
+  grub_uint32_t width;
+  grub_uint32_t height;
+  const char* name;
+};
+
+static const struct image_size image_sizes[] = {
+  { 1, 1, "1x1" },
+  { 640, 480, "VGA" },
+  { 1366, 768, "WXGA" },
+  { 1920, 1080, "FHD" },
+  { 3840, 2160, "4K" },
+  { 7680, 4320, "8K" },
+};
+
+static const grub_uint32_t xsdt_sizes[] = { 10, 100, 1000, 10000 };
+
+static char esp_root[] = "/tmp/hackbgrt-bench-XXXXXX";
+
+static void
+image_path (char* buf, grub_size_t len, const struct image_size* size, int esp_relative)
+{
+  snprintf (buf, len, "%s/%ux%u.bmp", esp_relative ? "" : esp_root, size->width, size->height);
+}
+
+static void
+bmz_path (char* buf, grub_size_t len, const struct image_size* size, int esp_relative)
+{
+  snprintf (buf, len, "%s/%ux%u.bmz", esp_relative ? "" : esp_root, size->width, size->height);
+}
+
+/** Other encodings are written up to 4K. */
+#define FORMAT_MAX_WIDTH 3840
+
+static void
+format_path (char* buf, grub_size_t len, const struct image_size* size, enum host_bmp_format format, int esp_relative)
+{
+  snprintf (buf, len, "%s/%ux%u-%s.bmp", esp_relative ? "" : esp_root, size->width, size->height,
+            host_bmp_format_name (format));
+}
+
+static void
+png_path (char* buf, grub_size_t len, const struct image_size* size, int alpha, int esp_relative)
+{
+  snprintf (buf, len, "%s/%ux%u%s.png", esp_relative ? "" : esp_root, size->width, size->height, alpha ? "-alpha" : "");
+}
+
+/** Badges to overlay are written up to FHD. */
+#define BADGE_MAX_WIDTH 1920
+
+static void
+badge_path (char* buf, grub_size_t len, const struct image_size* size, int esp_relative)
+{
+  snprintf (buf, len, "%s/%ux%u-badge.bmp", esp_relative ? "" : esp_root, size->width, size->height);
+}
+
+static void
+pack_path (char* buf, grub_size_t len, int esp_relative)
+{
+  snprintf (buf, len, "%s/splash.bpk", esp_relative ? "" : esp_root);
+}
+
+/** Images of the gallery directories; the manifest one lists every fourth as 4K. */
+#define GALLERY_IMAGES 200
+
+static void
+gallery_path (char* buf, grub_size_t len, int manifest, int esp_relative)
+{
+  snprintf (buf, len, "%s/%s/", esp_relative ? "" : esp_root, manifest ? "gallery-lst" : "gallery");
+}
+
+/** Systems and baseboards of the profile table, plus a default entry. */
+#define PROFILE_SYSTEMS 10000
+#define PROFILE_BOARDS 1000
+
+static void
+profile_path (char* buf, grub_size_t len, int esp_relative)
+{
+  snprintf (buf, len, "%s/fleet.hbp", esp_relative ? "" : esp_root);
+}
+
+static grub_uint8_t*
+read_host_file (const char* path, grub_size_t* size)
+{
+  FILE* fp = fopen (path, "rb");
+  grub_uint8_t* data;
+  long len;
+
+  if (!fp)
+    return NULL;
+  fseek (fp, 0, SEEK_END);
+  len = ftell (fp);
+  fseek (fp, 0, SEEK_SET);
+  data = malloc (len);
+  if (data && fread (data, 1, len, fp) != (size_t) len)
+  {
+    free (data);
+    data = NULL;
+  }
+  fclose (fp);
+  *size = len;
+  return data;
+}
+
+/**
+ * Write the BMP of every size, its .bmz container and its other encodings next to it.
+ */
+static void
+prepare_images (void)
+{
+  char path[4096];
+  for (unsigned i = 0; i < ARRAY_SIZE (image_sizes); i++)
+  {
+    grub_size_t bmp_size, bmz_size;
+    grub_uint8_t* bmp;
+    grub_uint8_t* bmz = NULL;
+    FILE* fp;
+
+    image_path (path, sizeof (path), &image_sizes[i], 0);
+    if (host_write_bmp (path, image_sizes[i].width, image_sizes[i].height) != 0
+        || !(bmp = read_host_file (path, &bmp_size)))
+    {
+      perror (path);
+      exit (1);
+    }
+    bmz = bmz_encode (bmp, bmp_size, &bmz_size);
+    free (bmp);
+    bmz_path (path, sizeof (path), &image_sizes[i], 0);
+    if (!bmz || !(fp = fopen (path, "wb")) || fwrite (bmz, 1, bmz_size, fp) != bmz_size || fclose (fp) != 0)
+    {
+      perror (path);
+      exit (1);
+    }
+    free (bmz);
+    for (int f = 0; f < HOST_BMP_FORMATS && image_sizes[i].width <= FORMAT_MAX_WIDTH; f++)
+    {
+      format_path (path, sizeof (path), &image_sizes[i], f, 0);
+      if (host_write_bmp_format (path, image_sizes[i].width, image_sizes[i].height, f) != 0)
+      {
+        perror (path);
+        exit (1);
+      }
+    }
+    for (int alpha = 0; alpha <= 1 && image_sizes[i].width <= FORMAT_MAX_WIDTH; alpha++)
+    {
+      png_path (path, sizeof (path), &image_sizes[i], alpha, 0);
+      if (host_write_png (path, image_sizes[i].width, image_sizes[i].height, alpha) != 0)
+      {
+        perror (path);
+        exit (1);
+      }
+    }
+    badge_path (path, sizeof (path), &image_sizes[i], 0);
+    if (image_sizes[i].width <= BADGE_MAX_WIDTH && host_write_badge (path, image_sizes[i].width, image_sizes[i].height) != 0)
+    {
+      perror (path);
+      exit (1);
+    }
+  }
+  // VGA to 4K, the FHD variant compressed
+  struct pack_input inputs[4];
+  char paths[4][4096];
+  const char* error;
+  for (unsigned i = 0; i < 4; i++)
+  {
+    if (i + 1 == 3)
+      bmz_path (paths[i], sizeof (paths[i]), &image_sizes[i + 1], 0);
+    else
+      image_path (paths[i], sizeof (paths[i]), &image_sizes[i + 1], 0);
+    inputs[i].screen_width = image_sizes[i + 1].width;
+    inputs[i].screen_height = image_sizes[i + 1].height;
+    inputs[i].path = paths[i];
+  }
+  pack_path (path, sizeof (path), 0);
+  if (pack_build (path, inputs, 4, &error) != 0)
+  {
+    fprintf (stderr, "%s: %s\n", path, error);
+    exit (1);
+  }
+  // two galleries of small images, with a file to leave out, one with a manifest
+  for (int manifest = 0; manifest <= 1; manifest++)
+  {
+    char dir[1024];
+    FILE* fp;
+    FILE* lst = NULL;
+    gallery_path (dir, sizeof (dir), manifest, 0);
+    mkdir (dir, 0755);
+    snprintf (path, sizeof (path), "%sREADME.TXT", dir);
+    if (!(fp = fopen (path, "w")) || fclose (fp) != 0)
+    {
+      perror (path);
+      exit (1);
+    }
+    if (manifest)
+    {
+      snprintf (path, sizeof (path), "%sgallery.lst", dir);
+      if (!(lst = fopen (path, "w")))
+      {
+        perror (path);
+        exit (1);
+      }
+      fprintf (lst, "# name weight WIDTHxHEIGHT\n\n");
+    }
+    for (unsigned i = 0; i < GALLERY_IMAGES; i++)
+    {
+      snprintf (path, sizeof (path), "%sIMG%03u.BMP", dir, i);
+      if (host_write_bmp (path, 64, 64) != 0)
+      {
+        perror (path);
+        exit (1);
+      }
+      if (lst)
+        fprintf (lst, "IMG%03u.BMP %u %s\n", i, i % 3 + 1, i % 4 ? "64x64" : "3840x2160");
+    }
+    if (lst && fclose (lst) != 0)
+    {
+      perror (path);
+      exit (1);
+    }
+  }
+  // a fleet: 10 systems per vendor, the even ones with a second, heavier image
+  struct profile_input* lines = calloc (PROFILE_SYSTEMS * 3 / 2 + PROFILE_BOARDS + 1, sizeof (*lines));
+  unsigned line_count = 0;
+  for (unsigned i = 0; i < PROFILE_SYSTEMS + PROFILE_BOARDS; i++)
+  {
+    char key[128], param[128];
+    int board = i >= PROFILE_SYSTEMS;
+    unsigned n = board ? i - PROFILE_SYSTEMS : i;
+    snprintf (key, sizeof (key), "%s\tVendor %u\t%s %u", board ? PROFILE_KEY_BOARD : PROFILE_KEY_SYSTEM, n / 10,
+              board ? "Board" : "Model", n);
+    snprintf (param, sizeof (param), "image=/EFI/fleet/%s%05u.bmp,x=center,y=%u", board ? "b" : "", n, n % 500);
+    lines[line_count].key = strdup (key);
+    lines[line_count++].param = strdup (param);
+    if (!board && n % 2 == 0)
+    {
+      snprintf (param, sizeof (param), "image=/EFI/fleet/%05u-alt.bmp,weight=3", n);
+      lines[line_count].key = strdup (key);
+      lines[line_count++].param = strdup (param);
+    }
+  }
+  lines[line_count].key = strdup (PROFILE_KEY_DEFAULT);
+  lines[line_count++].param = strdup ("image=/EFI/fleet/default.bmp");
+  profile_path (path, sizeof (path), 0);
+  if (profile_build (path, lines, line_count, &error) != 0)
+  {
+    fprintf (stderr, "%s: %s\n", path, error);
+    exit (1);
+  }
+  for (unsigned i = 0; i < line_count; i++)
+  {
+    free ((char*) lines[i].key);
+    free ((char*) lines[i].param);
+  }
+  free (lines);
+}
+
+static void
+cleanup_images (void)
+{
+  char path[4096];
+  for (unsigned i = 0; i < ARRAY_SIZE (image_sizes); i++)
+  {
+    image_path (path, sizeof (path), &image_sizes[i], 0);
+    unlink (path);
+    bmz_path (path, sizeof (path), &image_sizes[i], 0);
+    unlink (path);
+    for (int f = 0; f < HOST_BMP_FORMATS && image_sizes[i].width <= FORMAT_MAX_WIDTH; f++)
+    {
+      format_path (path, sizeof (path), &image_sizes[i], f, 0);
+      unlink (path);
+    }
+    for (int alpha = 0; alpha <= 1 && image_sizes[i].width <= FORMAT_MAX_WIDTH; alpha++)
+    {
+      png_path (path, sizeof (path), &image_sizes[i], alpha, 0);
+      unlink (path);
+    }
+    badge_path (path, sizeof (path), &image_sizes[i], 0);
+    unlink (path);
+  }
+  pack_path (path, sizeof (path), 0);
+  unlink (path);
+  profile_path (path, sizeof (path), 0);
+  unlink (path);
+  for (int manifest = 0; manifest <= 1; manifest++)
+  {
+    char dir[1024];
+    gallery_path (dir, sizeof (dir), manifest, 0);
+    for (unsigned i = 0; i < GALLERY_IMAGES; i++)
+    {
+      snprintf (path, sizeof (path), "%sIMG%03u.BMP", dir, i);
+      unlink (path);
+    }
+    snprintf (path, sizeof (path), "%sREADME.TXT", dir);
+    unlink (path);
+    snprintf (path, sizeof (path), "%sgallery.lst", dir);
+    unlink (path);
+    rmdir (dir);
+  }
+  rmdir (esp_root);
+}
+
+/*
+ * hackbgrt_read_config
+ */
+
+struct config_arg
+{
+  const char** params;
+  grub_size_t count;
+};
+
+static void
+run_read_config (void* arg)
+{
+  struct config_arg* a = arg;
+  hackbgrt_config_t config = hackbgrt_read_config ("(hd0,gpt1)", a->params, a->count);
+  if (config)
+    hackbgrt_free_config (config);
+}
+
+/**
+ * The number of the image a parameter list selects, the seed= one included.
+ */
+static unsigned
+selected_image (struct config_arg* a)
+{
+  hackbgrt_config_t config = hackbgrt_read_config ("(hd0,gpt1)", a->params, a->count + 1);
+  unsigned image = (unsigned) strtoul (strrchr (config->image_path, '/') + 1, NULL, 10);
+  hackbgrt_free_config (config);
+  return image;
+}
+
+/**
+ * Draw the images of a parameter list with seeds 0 to 9999 and compare how
+ * often each one wins with its weight (p % 7 + 1); a seed must always
+ * select the same image.
+ */
+static void
+check_selection (struct config_arg* a, char* check, grub_size_t len)
+{
+  enum { DRAWS = 10000 };
+  unsigned* wins = calloc (a->count, sizeof (*wins));
+  grub_size_t weight_sum = 0;
+  double worst = 0;
+  int reproducible = 1;
+  char seed[32];
+
+  a->params[a->count] = seed;
+  for (unsigned d = 0; d < DRAWS; d++)
+  {
+    snprintf (seed, sizeof (seed), "seed=%u", d);
+    unsigned image = selected_image (a);
+    if (image < a->count)
+      wins[image]++;
+    if (d < 100)
+      reproducible &= selected_image (a) == image;
+  }
+  a->params[a->count] = NULL;
+  for (grub_size_t p = 0; p < a->count; p++)
+    weight_sum += p % 7 + 1;
+  for (grub_size_t p = 0; p < a->count; p++)
+  {
+    double expected = (double) DRAWS * (p % 7 + 1) / weight_sum;
+    double deviation = wins[p] > expected ? wins[p] / expected - 1 : 1 - wins[p] / expected;
+    if (deviation > worst)
+      worst = deviation;
+  }
+  snprintf (check, len, "wins/weight within %.0f%%%s%s", 100 * worst, worst < 0.25 ? "" : " BAD",
+            reproducible ? "" : " seed BAD");
+  free (wins);
+}
+
+static void
+bench_read_config (void)
+{
+  static const grub_size_t counts[] = { 1, 16, 256 };
+  for (unsigned i = 0; i < ARRAY_SIZE (counts); i++)
+  {
+    struct config_arg a = { .count = counts[i] };
+    char label[64], check[64] = "";
+    // room for a seed= parameter
+    a.params = calloc (a.count + 1, sizeof (char*));
+    for (grub_size_t p = 0; p < a.count; p++)
+    {
+      char buf[128];
+      snprintf (buf, sizeof (buf), "image=/EFI/splash/%04zu.bmp,x=center,y=%zu,weight=%zu", p, p, p % 7 + 1);
+      a.params[p] = strdup (buf);
+    }
+    if (a.count == 16)
+      check_selection (&a, check, sizeof (check));
+    struct bench_case c = { .run = run_read_config, .arg = &a };
+    snprintf (label, sizeof (label), "%zu image params", a.count);
+    bench_run ("read_config", label, &c, check);
+    for (grub_size_t p = 0; p < a.count; p++)
+      free ((char*) a.params[p]);
+    free (a.params);
+  }
+}
+
+/*
+ * load_bmp
+ */
+
+struct load_arg
+{
+  const char* path;
+  enum hackbgrt_io_backend backend;
+  grub_uint32_t screen_width; // for packs, 0 if unknown
+  grub_uint32_t screen_height;
+  enum hackbgrt_scale scale;
+  int trim;
+};
+
+static void
+run_load_bmp (void* arg)
+{
+  struct load_arg* a = arg;
+  if (!load_bmp (a->path, a->backend, a->screen_width, a->screen_height, a->scale, a->trim))
+    fprintf (stderr, "load_bmp(%s) failed\n", a->path);
+}
+
+static void
+run_load_refused (void* arg)
+{
+  struct load_arg* a = arg;
+  if (load_bmp (a->path, a->backend, a->screen_width, a->screen_height, a->scale, a->trim))
+    fprintf (stderr, "load_bmp(%s) was not refused\n", a->path);
+  grub_errno = GRUB_ERR_NONE;
+}
+
+static void
+teardown_efi (void* arg __attribute__ ((unused)))
+{
+  // the cache must not outlive the EFI allocations it points to
+  hackbgrt_cache_fini ();
+  hackbgrt_cache_init ();
+  hackbgrt_alloc_fini ();
+  hackbgrt_alloc_init ();
+  // one load per boot: resolve the extents and race the backends again
+  hackbgrt_io_fini ();
+  host_efi_release_all ();
+}
+
+/**
+ * Compare a loaded bitmap with the file on the host.
+ */
+static int
+same_as_file (bitmap_t bmp, const struct image_size* size)
+{
+  char path[4096];
+  FILE* fp;
+  int same = 0;
+
+  image_path (path, sizeof (path), size, 0);
+  fp = fopen (path, "rb");
+  if (!fp)
+    return 0;
+  grub_uint8_t* data = malloc (bmp->header.size);
+  if (fread (data, 1, bmp->header.size, fp) == bmp->header.size && fgetc (fp) == EOF)
+    same = memcmp (data, bmp, bmp->header.size) == 0;
+  free (data);
+  fclose (fp);
+  return same;
+}
+
+static void
+bench_load_bmp (void)
+{
+  static const enum hackbgrt_io_backend backends[] = { HACKBGRT_IO_GRUB, HACKBGRT_IO_EFI, HACKBGRT_IO_BLOCKLIST, HACKBGRT_IO_AUTO };
+  for (unsigned i = 0; i < ARRAY_SIZE (image_sizes); i++)
+    for (unsigned b = 0; b < ARRAY_SIZE (backends); b++)
+    {
+      char path[4096], label[64], check[64];
+      if (bench_opts.quick && image_sizes[i].width > 1920)
+        continue;
+      snprintf (path, sizeof (path), "(hd0,gpt1)");
+      image_path (path + strlen (path), sizeof (path) - strlen (path), &image_sizes[i], 1);
+      struct load_arg a = { .path = path, .backend = backends[b] };
+      struct bench_case c = { .run = run_load_bmp, .teardown = teardown_efi, .arg = &a };
+      // one untimed pass to check the bitmap and count the reads
+      host_counters_reset ();
+      bitmap_t bmp = load_bmp (path, backends[b], 0, 0, HACKBGRT_SCALE_NONE, 0);
+      snprintf (check, sizeof (check), "reads=%" PRIu64 " %s%s%s", host_counters.read_calls,
+                bmp && same_as_file (bmp, &image_sizes[i]) ? "ok" : "MISMATCH",
+                backends[b] != HACKBGRT_IO_AUTO ? "" : hackbgrt_io_auto_choice () == HACKBGRT_IO_AUTO ? " too small to race" : " won by ",
+                backends[b] != HACKBGRT_IO_AUTO || hackbgrt_io_auto_choice () == HACKBGRT_IO_AUTO ? "" : hackbgrt_io_backend_name (hackbgrt_io_auto_choice ()));
+      teardown_efi (NULL);
+      snprintf (label, sizeof (label), "%s %s", image_sizes[i].name, hackbgrt_io_backend_name (backends[b]));
+      bench_run ("load_bmp", label, &c, check);
+    }
+
+  // a path without (device) is on $root, for every backend as for grub_file_open
+  grub_env_set ("root", "hd0,gpt1");
+  for (unsigned b = 0; b < ARRAY_SIZE (backends); b++)
+  {
+    char path[4096], label[64], check[64];
+    image_path (path, sizeof (path), &image_sizes[1], 1);
+    struct load_arg a = { .path = path, .backend = backends[b] };
+    struct bench_case c = { .run = run_load_bmp, .teardown = teardown_efi, .arg = &a };
+    bitmap_t bmp = load_bmp (path, backends[b], 0, 0, HACKBGRT_SCALE_NONE, 0);
+    snprintf (check, sizeof (check), "%s", bmp && same_as_file (bmp, &image_sizes[1]) ? "ok" : "MISMATCH");
+    grub_errno = GRUB_ERR_NONE;
+    teardown_efi (NULL);
+    snprintf (label, sizeof (label), "%s on $root %s", image_sizes[1].name, hackbgrt_io_backend_name (backends[b]));
+    bench_run ("load_bmp", label, &c, check);
+  }
+  grub_env_unset ("root");
+}
+
+/*
+ * hackbgrt_lz4_decode, and load_bmp of the .bmz containers
+ */
+
+struct decode_arg
+{
+  const grub_uint8_t* payload;
+  grub_size_t payload_size;
+  grub_uint8_t* out;
+  grub_size_t out_size;
+  grub_ssize_t decoded;
+};
+
+static void
+run_decode (void* arg)
+{
+  struct decode_arg* a = arg;
+  a->decoded = hackbgrt_lz4_decode (a->payload, a->payload_size, a->out, a->out_size);
+}
+
+static void
+bench_decode (void)
+{
+  static const enum hackbgrt_io_backend backends[] = { HACKBGRT_IO_GRUB, HACKBGRT_IO_BLOCKLIST };
+  for (unsigned i = 0; i < ARRAY_SIZE (image_sizes); i++)
+  {
+    char path[4096], label[64], check[64];
+    grub_size_t bmz_size;
+    grub_uint8_t* bmz;
+    struct splash_header splash;
+
+    if (bench_opts.quick && image_sizes[i].width > 1920)
+      continue;
+    bmz_path (path, sizeof (path), &image_sizes[i], 0);
+    bmz = read_host_file (path, &bmz_size);
+    if (!bmz)
+    {
+      perror (path);
+      exit (1);
+    }
+    memcpy (&splash, bmz, sizeof (splash));
+    struct decode_arg a = {
+      .payload = bmz + sizeof (splash),
+      .payload_size = splash.payload_size,
+      .out = malloc (splash.bmp_size),
+      .out_size = splash.bmp_size,
+    };
+    struct bench_case c = { .run = run_decode, .arg = &a };
+    run_decode (&a);
+    snprintf (check, sizeof (check), "ratio=%.1fx %s", (double) splash.bmp_size / bmz_size,
+              a.decoded == (grub_ssize_t) splash.bmp_size && same_as_file ((bitmap_t) a.out, &image_sizes[i]) ? "ok" : "MISMATCH");
+    snprintf (label, sizeof (label), "%s lz4", image_sizes[i].name);
+    bench_run ("decode", label, &c, check);
+    free (a.out);
+    free (bmz);
+
+    for (unsigned b = 0; b < ARRAY_SIZE (backends); b++)
+    {
+      snprintf (path, sizeof (path), "(hd0,gpt1)");
+      bmz_path (path + strlen (path), sizeof (path) - strlen (path), &image_sizes[i], 1);
+      struct load_arg l = { .path = path, .backend = backends[b] };
+      struct bench_case lc = { .run = run_load_bmp, .teardown = teardown_efi, .arg = &l };
+      host_counters_reset ();
+      bitmap_t bmp = load_bmp (path, backends[b], 0, 0, HACKBGRT_SCALE_NONE, 0);
+      snprintf (check, sizeof (check), "reads=%" PRIu64 " %s", host_counters.read_calls,
+                bmp && same_as_file (bmp, &image_sizes[i]) ? "ok" : "MISMATCH");
+      teardown_efi (NULL);
+      snprintf (label, sizeof (label), "%s bmz %s", image_sizes[i].name, hackbgrt_io_backend_name (backends[b]));
+      bench_run ("decode", label, &lc, check);
+    }
+  }
+}
+
+/*
+ * load_bmp of the other BMP encodings, converted to 24 bpp
+ */
+
+/**
+ * Write a copy of a host file with its header sizes patched and cut to a length.
+ */
+static void
+write_damaged (const char* from, const char* to, grub_size_t length, grub_uint32_t size, grub_uint32_t data_size)
+{
+  grub_size_t from_size;
+  grub_uint8_t* data = read_host_file (from, &from_size);
+  struct bitmap_header header;
+  FILE* fp;
+
+  if (!data || from_size < sizeof (header))
+  {
+    perror (from);
+    exit (1);
+  }
+  memcpy (&header, data, sizeof (header));
+  header.size = size;
+  header.data_size = data_size;
+  memcpy (data, &header, sizeof (header));
+  length = length < from_size ? length : from_size;
+  if (!(fp = fopen (to, "wb")) || fwrite (data, 1, length, fp) != length || fclose (fp) != 0)
+  {
+    perror (to);
+    exit (1);
+  }
+  free (data);
+}
+
+/**
+ * Damaged headers: a file cut short is refused from its first chunk, and
+ * 24 bpp sizes left at 0 are converted rather than trusted.
+ */
+static void
+bench_convert_damaged (void)
+{
+  const struct image_size* fhd = &image_sizes[3];
+  const struct image_size* uhd = &image_sizes[4];
+  char from[4096], path[4096], check[64];
+  bitmap_t bmp;
+
+  format_path (from, sizeof (from), uhd, HOST_BMP_32BPP, 0);
+  snprintf (path, sizeof (path), "%s/cut.bmp", esp_root);
+  write_damaged (from, path, 2 * HACKBGRT_BMP_STREAM_CHUNK, get_bitmap_total_size (uhd->width, uhd->height), 0);
+  snprintf (path, sizeof (path), "(hd0,gpt1)/cut.bmp");
+  struct load_arg a = { .path = path, .backend = HACKBGRT_IO_GRUB };
+  struct bench_case c = { .run = run_load_refused, .teardown = teardown_efi, .arg = &a };
+  host_counters_reset ();
+  bmp = load_bmp (path, HACKBGRT_IO_GRUB, 0, 0, HACKBGRT_SCALE_NONE, 0);
+  grub_errno = GRUB_ERR_NONE;
+  // the head and the first chunk, not the whole file
+  snprintf (check, sizeof (check), "refused after %" PRIu64 " bytes %s", host_counters.file_bytes_read,
+            !bmp && host_counters.file_bytes_read < 2 * HACKBGRT_BMP_STREAM_CHUNK ? "ok" : "BAD");
+  teardown_efi (NULL);
+  bench_run ("convert", "4K 32bpp cut at 2 MiB", &c, check);
+  c.run = run_load_bmp;
+  snprintf (path, sizeof (path), "%s/cut.bmp", esp_root);
+  unlink (path);
+
+  image_path (from, sizeof (from), fhd, 0);
+  snprintf (path, sizeof (path), "%s/unsized.bmp", esp_root);
+  write_damaged (from, path, get_bitmap_total_size (fhd->width, fhd->height), 0, 0);
+  snprintf (path, sizeof (path), "(hd0,gpt1)/unsized.bmp");
+  host_counters_reset ();
+  bmp = load_bmp (path, HACKBGRT_IO_GRUB, 0, 0, HACKBGRT_SCALE_NONE, 0);
+  snprintf (check, sizeof (check), "heap=%.1f%% %s",
+            100.0 * host_counters.heap_peak / get_bitmap_total_size (fhd->width, fhd->height),
+            bmp && same_as_file (bmp, fhd) ? "ok" : "MISMATCH");
+  teardown_efi (NULL);
+  bench_run ("convert", "FHD 24bpp sizes at 0", &c, check);
+  snprintf (path, sizeof (path), "%s/unsized.bmp", esp_root);
+  unlink (path);
+}
+
+static void
+bench_convert (void)
+{
+  for (unsigned i = 0; i < ARRAY_SIZE (image_sizes); i++)
+    for (int f = 0; f < HOST_BMP_FORMATS; f++)
+    {
+      char path[4096], label[64], check[64];
+      struct stat st;
+      if (image_sizes[i].width > FORMAT_MAX_WIDTH || (bench_opts.quick && image_sizes[i].width > 1920))
+        continue;
+      format_path (path, sizeof (path), &image_sizes[i], f, 0);
+      if (stat (path, &st) != 0)
+        st.st_size = 0;
+      snprintf (path, sizeof (path), "(hd0,gpt1)");
+      format_path (path + strlen (path), sizeof (path) - strlen (path), &image_sizes[i], f, 1);
+      struct load_arg a = { .path = path, .backend = HACKBGRT_IO_GRUB };
+      struct bench_case c = { .run = run_load_bmp, .teardown = teardown_efi, .arg = &a };
+      host_counters_reset ();
+      bitmap_t bmp = load_bmp (path, HACKBGRT_IO_GRUB, 0, 0, HACKBGRT_SCALE_NONE, 0);
+      snprintf (check, sizeof (check), "file=%.1f%% heap=%.1f%% %s",
+                100.0 * st.st_size / get_bitmap_total_size (image_sizes[i].width, image_sizes[i].height),
+                100.0 * host_counters.heap_peak / get_bitmap_total_size (image_sizes[i].width, image_sizes[i].height),
+                bmp && same_as_file (bmp, &image_sizes[i]) ? "ok" : "MISMATCH");
+      teardown_efi (NULL);
+      snprintf (label, sizeof (label), "%s %s", image_sizes[i].name, host_bmp_format_name (f));
+      bench_run ("convert", label, &c, check);
+    }
+  bench_convert_damaged ();
+}
+
+/*
+ * PNG: GRUB bitmap decoding and the RGB(A) to BGR conversion, against the BMP
+ */
+
+struct png_arg
+{
+  const char* path;
+  struct grub_video_bitmap* image;
+  bitmap_t out;
+};
+
+static void
+run_png_decode (void* arg)
+{
+  struct png_arg* a = arg;
+  if (grub_video_bitmap_load (&a->image, a->path))
+    fprintf (stderr, "grub_video_bitmap_load(%s) failed\n", a->path);
+  grub_video_bitmap_destroy (a->image);
+}
+
+static void
+run_png_convert (void* arg)
+{
+  struct png_arg* a = arg;
+  hackbgrt_bmp_from_rgb (a->out, grub_video_bitmap_get_data (a->image), a->image->mode_info.width,
+                         a->image->mode_info.height, a->image->mode_info.pitch,
+                         a->image->mode_info.blit_format == GRUB_VIDEO_BLIT_FORMAT_RGBA_8888);
+}
+
+static void
+bench_png (void)
+{
+  for (unsigned i = 0; i < ARRAY_SIZE (image_sizes); i++)
+  {
+    char path[4096], label[64], check[64];
+    struct stat st;
+    if (image_sizes[i].width > FORMAT_MAX_WIDTH || (bench_opts.quick && image_sizes[i].width > 1920))
+      continue;
+
+    // the BMP reference, read straight into the BGRT buffer
+    snprintf (path, sizeof (path), "(hd0,gpt1)");
+    image_path (path + strlen (path), sizeof (path) - strlen (path), &image_sizes[i], 1);
+    struct load_arg l = { .path = path, .backend = HACKBGRT_IO_GRUB };
+    struct bench_case lc = { .run = run_load_bmp, .teardown = teardown_efi, .arg = &l };
+    snprintf (label, sizeof (label), "%s bmp", image_sizes[i].name);
+    bench_run ("png", label, &lc, "file=100.0%");
+
+    for (int alpha = 0; alpha <= 1; alpha++)
+    {
+      png_path (path, sizeof (path), &image_sizes[i], alpha, 0);
+      if (stat (path, &st) != 0)
+        st.st_size = 0;
+      snprintf (path, sizeof (path), "(hd0,gpt1)");
+      png_path (path + strlen (path), sizeof (path) - strlen (path), &image_sizes[i], alpha, 1);
+      host_counters_reset ();
+      bitmap_t bmp = load_bmp (path, HACKBGRT_IO_GRUB, 0, 0, HACKBGRT_SCALE_NONE, 0);
+      snprintf (check, sizeof (check), "file=%.1f%% %s",
+                100.0 * st.st_size / get_bitmap_total_size (image_sizes[i].width, image_sizes[i].height),
+                bmp && same_as_file (bmp, &image_sizes[i]) ? "ok" : "MISMATCH");
+      teardown_efi (NULL);
+      snprintf (label, sizeof (label), "%s png%s", image_sizes[i].name, alpha ? "-alpha" : "");
+      bench_run ("png", label, &lc, check);
+
+      struct png_arg a = { .path = path };
+      struct bench_case dc = { .run = run_png_decode, .arg = &a };
+      snprintf (label, sizeof (label), "%s png%s decode", image_sizes[i].name, alpha ? "-alpha" : "");
+      bench_run ("png", label, &dc, NULL);
+
+      grub_video_bitmap_load (&a.image, path);
+      a.out = malloc (get_bitmap_total_size (image_sizes[i].width, image_sizes[i].height));
+      struct bench_case cc = { .run = run_png_convert, .arg = &a };
+      snprintf (label, sizeof (label), "%s png%s convert", image_sizes[i].name, alpha ? "-alpha" : "");
+      bench_run ("png", label, &cc, NULL);
+      free (a.out);
+      grub_video_bitmap_destroy (a.image);
+    }
+  }
+}
+
+/*
+ * load_bmp of a splash pack, for several screens
+ */
+
+/**
+ * Load the pack for a 1366x768 screen first, leaving its variant in the cache.
+ */
+static void
+setup_pack_cached (void* arg)
+{
+  struct load_arg* a = arg;
+  if (!load_bmp (a->path, a->backend, 1366, 768, HACKBGRT_SCALE_NONE, 0))
+    fprintf (stderr, "load_bmp(%s) failed\n", a->path);
+}
+
+static void
+bench_pack (void)
+{
+  static const struct
+  {
+    grub_uint32_t width;
+    grub_uint32_t height;
+    unsigned expected; // in image_sizes
+  } screens[] = {
+    { 320, 200, 1 },   // smaller than every variant: the smallest
+    { 800, 600, 1 },   // the largest smaller one
+    { 1366, 768, 2 },
+    { 1920, 1080, 3 }, // compressed variant
+    { 2560, 1440, 3 },
+    { 3840, 2160, 4 },
+  };
+  static const enum hackbgrt_io_backend backends[] = { HACKBGRT_IO_GRUB, HACKBGRT_IO_BLOCKLIST };
+  for (unsigned i = 0; i < ARRAY_SIZE (screens); i++)
+    for (unsigned b = 0; b < ARRAY_SIZE (backends); b++)
+    {
+      char path[4096], label[64], check[64];
+      snprintf (path, sizeof (path), "(hd0,gpt1)");
+      pack_path (path + strlen (path), sizeof (path) - strlen (path), 1);
+      struct load_arg a = {
+        .path = path,
+        .backend = backends[b],
+        .screen_width = screens[i].width,
+        .screen_height = screens[i].height,
+      };
+      struct bench_case c = { .run = run_load_bmp, .teardown = teardown_efi, .arg = &a };
+      host_counters_reset ();
+      bitmap_t bmp = load_bmp (path, a.backend, a.screen_width, a.screen_height, HACKBGRT_SCALE_NONE, 0);
+      snprintf (check, sizeof (check), "%s %s", image_sizes[screens[i].expected].name,
+                bmp && same_as_file (bmp, &image_sizes[screens[i].expected]) ? "ok" : "MISMATCH");
+      teardown_efi (NULL);
+      snprintf (label, sizeof (label), "%ux%u %s", screens[i].width, screens[i].height,
+                hackbgrt_io_backend_name (backends[b]));
+      bench_run ("pack", label, &c, check);
+    }
+
+  // a second screen in the same boot gets its own variant, not the cached one of the first
+  char path[4096], check[64];
+  snprintf (path, sizeof (path), "(hd0,gpt1)");
+  pack_path (path + strlen (path), sizeof (path) - strlen (path), 1);
+  struct load_arg a = { .path = path, .backend = HACKBGRT_IO_GRUB, .screen_width = 3840, .screen_height = 2160 };
+  struct bench_case c = { .setup = setup_pack_cached, .run = run_load_bmp, .teardown = teardown_efi, .arg = &a };
+  setup_pack_cached (&a);
+  bitmap_t bmp = load_bmp (path, a.backend, a.screen_width, a.screen_height, HACKBGRT_SCALE_NONE, 0);
+  snprintf (check, sizeof (check), "%s %s", image_sizes[4].name,
+            bmp && same_as_file (bmp, &image_sizes[4]) ? "ok" : "MISMATCH");
+  teardown_efi (NULL);
+  bench_run ("pack", "3840x2160 after 1366x768", &c, check);
+}
+
+/*
+ * load_bmp of image=builtin, against the same image read from the ESP
+ */
+
+/**
+ * Load image=builtin from a module without an image.
+ *
+ * @return 1 if a bitmap was loaded anyway.
+ */
+static int
+run_load_builtin_missing (void* arg)
+{
+  bitmap_t bmp = load_bmp (HACKBGRT_BUILTIN_PATH, HACKBGRT_IO_GRUB, 0, 0, HACKBGRT_SCALE_NONE, 0);
+  grub_errno = GRUB_ERR_NONE;
+  return bmp != 0;
+}
+
+static void
+run_builtin_missing (void* arg)
+{
+  run_load_builtin_missing (arg);
+}
+
+static void
+bench_builtin (void)
+{
+  for (unsigned i = 1; i < ARRAY_SIZE (image_sizes); i++)
+  {
+    const struct image_size* size = &image_sizes[i];
+    char path[4096], label[64], check[64];
+    struct load_arg a = { .path = path, .backend = HACKBGRT_IO_GRUB };
+    struct bench_case c = { .run = run_load_bmp, .teardown = teardown_efi, .arg = &a };
+    bitmap_t bmp;
+
+    if (size->width > 3840 || (bench_opts.quick && size->width > 1920))
+      continue;
+    snprintf (path, sizeof (path), "(hd0,gpt1)");
+    image_path (path + strlen (path), sizeof (path) - strlen (path), size, 1);
+    snprintf (label, sizeof (label), "%s ESP", size->name);
+    bench_run ("builtin", label, &c, NULL);
+    // plain, compressed, and plain with bytes past the pixels
+    for (int variant = 0; variant <= 2; variant++)
+    {
+      int compressed = variant == 1;
+      if (compressed)
+        bmz_path (path, sizeof (path), size, 0);
+      else
+        image_path (path, sizeof (path), size, 0);
+      if (host_set_builtin_image (path) != 0)
+      {
+        perror (path);
+        continue;
+      }
+      if (variant == 2)
+        host_pad_builtin_image (64);
+      a.path = HACKBGRT_BUILTIN_PATH;
+      host_counters_reset ();
+      bmp = load_bmp (a.path, a.backend, 0, 0, HACKBGRT_SCALE_NONE, 0);
+      snprintf (check, sizeof (check), "%s%s", bmp && same_as_file (bmp, size) ? "ok" : "MISMATCH",
+                host_counters.file_opens || host_counters.read_calls ? " ESP read BAD" : "");
+      teardown_efi (NULL);
+      snprintf (label, sizeof (label), "%s builtin%s", size->name, compressed ? " lz4" : variant ? " padded" : "");
+      bench_run ("builtin", label, &c, check);
+      a.path = path;
+    }
+  }
+  // a module built without an image
+  host_set_builtin_image (NULL);
+  host_counters_reset ();
+  int missing = !run_load_builtin_missing (NULL) && host_counters.errors;
+  struct bench_case c = { .run = run_builtin_missing, .teardown = teardown_efi };
+  bench_run ("builtin", "none", &c, missing ? "error ok" : "MISMATCH");
+}
+
+/*
+ * Scaling of a loaded bitmap for the screen
+ */
+
+struct scale_arg
+{
+  bitmap_t src;
+  bitmap_t dst;
+  grub_uint32_t width;
+  grub_uint32_t height;
+  int crop;
+};
+
+static void
+run_scale (void* arg)
+{
+  struct scale_arg* a = arg;
+  if (hackbgrt_scale_bitmap (a->src, a->dst, a->width, a->height, a->crop))
+    fprintf (stderr, "hackbgrt_scale_bitmap(%ux%u) failed\n", a->width, a->height);
+}
+
+/**
+ * Share of the pixels of a scaled bitmap that differ from the host picture
+ * drawn at its size; bilinear filtering only blurs the edges of the square.
+ */
+static double
+scaled_difference (bitmap_t bmp)
+{
+  char path[4096];
+  grub_size_t size;
+  grub_uint8_t* ref;
+  grub_uint32_t width = bmp->header.width, height = bmp->header.height;
+  grub_uint32_t stride = get_bitmap_pixels_size (width, 1);
+  grub_uint64_t differ = 0;
+
+  snprintf (path, sizeof (path), "%s/scale-reference.bmp", esp_root);
+  if (host_write_bmp (path, width, height) != 0 || !(ref = read_host_file (path, &size)))
+  {
+    unlink (path);
+    return 100.0;
+  }
+  unlink (path);
+  if (size != bmp->header.size || memcmp (ref, bmp, BMP_PIXEL_DATA_OFFSET) != 0)
+  {
+    free (ref);
+    return 100.0;
+  }
+  for (grub_uint32_t y = 0; y < height; y++)
+  {
+    const grub_uint8_t* r = ref + BMP_PIXEL_DATA_OFFSET + (grub_size_t) y * stride;
+    const grub_uint8_t* b = (const grub_uint8_t*) bmp + BMP_PIXEL_DATA_OFFSET + (grub_size_t) y * stride;
+    for (grub_uint32_t x = 0; x < width; x++)
+      differ += memcmp (r + 3 * x, b + 3 * x, 3) != 0;
+  }
+  free (ref);
+  return 100.0 * differ / ((grub_uint64_t) width * height);
+}
+
+static void
+bench_scale (void)
+{
+  static const struct
+  {
+    unsigned source; // in image_sizes
+    enum hackbgrt_scale scale;
+    grub_uint32_t screen_width;
+    grub_uint32_t screen_height;
+  } cases[] = {
+    { 3, HACKBGRT_SCALE_2X, 0, 0 },         // 1080p to 4K, replicated
+    { 3, HACKBGRT_SCALE_FIT, 3840, 2160 },  // the same, from the screen size
+    { 3, HACKBGRT_SCALE_FIT, 3840, 2400 },  // 16:10 screen, still 3840x2160
+    { 2, HACKBGRT_SCALE_FIT, 1920, 1080 },  // bilinear upscale
+    { 2, HACKBGRT_SCALE_FILL, 3840, 2160 }, // bilinear upscale, cropped
+    { 4, HACKBGRT_SCALE_FIT, 1920, 1080 },  // downscale
+    { 1, HACKBGRT_SCALE_3X, 0, 0 },
+  };
+  char path[4096], label[64], check[64];
+
+  // the reference: the 4K image read from the ESP
+  snprintf (path, sizeof (path), "(hd0,gpt1)");
+  image_path (path + strlen (path), sizeof (path) - strlen (path), &image_sizes[4], 1);
+  struct load_arg l = { .path = path, .backend = HACKBGRT_IO_GRUB };
+  struct bench_case lc = { .run = run_load_bmp, .teardown = teardown_efi, .arg = &l };
+  bench_run ("scale", "4K load", &lc, NULL);
+
+  // 1080p read and scaled to the 4K screen instead, cache included
+  snprintf (path, sizeof (path), "(hd0,gpt1)");
+  image_path (path + strlen (path), sizeof (path) - strlen (path), &image_sizes[3], 1);
+  struct load_arg f = {
+    .path = path,
+    .backend = HACKBGRT_IO_GRUB,
+    .screen_width = 3840,
+    .screen_height = 2160,
+    .scale = HACKBGRT_SCALE_FIT,
+  };
+  struct bench_case fc = { .run = run_load_bmp, .teardown = teardown_efi, .arg = &f };
+  host_counters_reset ();
+  bitmap_t bmp = load_bmp (path, f.backend, f.screen_width, f.screen_height, f.scale, 0);
+  snprintf (check, sizeof (check), "4K %s", bmp && same_as_file (bmp, &image_sizes[4]) ? "ok" : "MISMATCH");
+  teardown_efi (NULL);
+  bench_run ("scale", "FHD load fit 3840x2160", &fc, check);
+
+  for (unsigned i = 0; i < ARRAY_SIZE (cases); i++)
+  {
+    const struct image_size* source = &image_sizes[cases[i].source];
+    struct scale_arg a = {
+      .width = source->width,
+      .height = source->height,
+      .crop = cases[i].scale == HACKBGRT_SCALE_FILL,
+    };
+    double differ;
+
+    snprintf (path, sizeof (path), "(hd0,gpt1)");
+    image_path (path + strlen (path), sizeof (path) - strlen (path), source, 1);
+    a.src = load_bmp (path, HACKBGRT_IO_GRUB, 0, 0, HACKBGRT_SCALE_NONE, 0);
+    if (!a.src)
+    {
+      fprintf (stderr, "load_bmp(%s) failed\n", path);
+      continue;
+    }
+    hackbgrt_scale_size (cases[i].scale, &a.width, &a.height, cases[i].screen_width, cases[i].screen_height);
+    a.dst = malloc (get_bitmap_total_size (a.width, a.height));
+    run_scale (&a);
+    differ = scaled_difference (a.dst);
+    if (differ == 0)
+      snprintf (check, sizeof (check), "%ux%u ok", a.width, a.height);
+    else
+      snprintf (check, sizeof (check), "%ux%u edges=%.2f%%%s", a.width, a.height, differ, differ < 1 ? "" : " MISMATCH");
+    if (cases[i].screen_width)
+      snprintf (label, sizeof (label), "%s %s %ux%u", source->name, hackbgrt_scale_name (cases[i].scale),
+                cases[i].screen_width, cases[i].screen_height);
+    else
+      snprintf (label, sizeof (label), "%s %s", source->name, hackbgrt_scale_name (cases[i].scale));
+    struct bench_case c = { .run = run_scale, .arg = &a };
+    bench_run ("scale", label, &c, check);
+    free (a.dst);
+    teardown_efi (NULL);
+  }
+}
+
+/*
+ * hackbgrt_gallery_pick, listing the directory or reading its manifest
+ */
+
+struct gallery_arg
+{
+  char dir[4096];
+  grub_uint64_t draw;
+};
+
+static void
+run_gallery_pick (void* arg)
+{
+  struct gallery_arg* a = arg;
+  char* image = hackbgrt_gallery_pick (a->dir, a->draw++, 1920, 1080);
+  if (!image)
+    fprintf (stderr, "hackbgrt_gallery_pick(%s) failed\n", a->dir);
+  grub_free (image);
+}
+
+static void
+bench_gallery (void)
+{
+  for (int manifest = 0; manifest <= 1; manifest++)
+  {
+    struct gallery_arg a = { .draw = 0 };
+    char label[64], check[96];
+    unsigned opens = 0, walks = 0, entries = 0, picked = 0, too_large = 0;
+    int missing = 0;
+
+    snprintf (a.dir, sizeof (a.dir), "(hd0,gpt1)");
+    gallery_path (a.dir + strlen (a.dir), sizeof (a.dir) - strlen (a.dir), manifest, 1);
+    // every draw gives an image of the directory, never a 4K one of the manifest on the FHD screen
+    for (grub_uint64_t d = 0; d < 1000; d++)
+    {
+      char host[4096];
+      struct stat st;
+      host_counters_reset ();
+      char* image = hackbgrt_gallery_pick (a.dir, d * 0x9e3779b97f4a7c15ull, 1920, 1080);
+      opens += host_counters.file_opens;
+      walks += host_counters.dir_walks;
+      entries += host_counters.dir_entries;
+      if (!image)
+      {
+        missing++;
+        continue;
+      }
+      snprintf (host, sizeof (host), "%s%s", esp_root, strchr (image, ')') + 1);
+      missing += stat (host, &st) != 0;
+      too_large += manifest && strtoul (strrchr (image, 'G') + 1, NULL, 10) % 4 == 0;
+      picked++;
+      grub_free (image);
+    }
+    snprintf (check, sizeof (check), "%u opens %u walks %u entries/pick%s%s", opens / 1000, walks / 1000,
+              entries / 1000, missing ? " MISMATCH" : "", too_large ? " too large BAD" : "");
+    snprintf (label, sizeof (label), "%u images, %s", GALLERY_IMAGES, manifest ? "manifest" : "directory");
+    struct bench_case c = { .run = run_gallery_pick, .arg = &a };
+    bench_run ("gallery", label, &c, check);
+  }
+}
+
+/*
+ * hackbgrt_read_config with profile=: the SMBIOS identity looked up in a fleet table
+ */
+
+static void
+bench_profile (void)
+{
+  static const struct
+  {
+    const char* label;
+    struct host_acpi_spec spec;
+    const char* table;    // ESP-relative, or NULL for the fleet table
+    const char* expected; // the selected image, or one of two
+    const char* other;
+  } cases[] = {
+    { "system match", { .system_manufacturer = "Vendor 424", .system_product = "Model 4243  ",
+                        .board_manufacturer = "Vendor 1", .board_product = "Board 17" },
+      NULL, "/EFI/fleet/04243.bmp", NULL },
+    { "system match, 2 images", { .system_manufacturer = "Vendor 424", .system_product = "Model 4242",
+                                  .board_manufacturer = "Vendor 1", .board_product = "Board 17" },
+      NULL, "/EFI/fleet/04242.bmp", "/EFI/fleet/04242-alt.bmp" },
+    { "board match", { .system_manufacturer = "To Be Filled By O.E.M.", .system_product = "To Be Filled By O.E.M.",
+                       .board_manufacturer = "Vendor 1", .board_product = "Board 17" },
+      NULL, "/EFI/fleet/b00017.bmp", NULL },
+    { "default", { .system_manufacturer = "Unknown", .system_product = "Unknown" },
+      NULL, "/EFI/fleet/default.bmp", NULL },
+    { "no SMBIOS", { .xsdt_entries = 0 }, NULL, "/EFI/fleet/default.bmp", NULL },
+    { "missing table", { .system_manufacturer = "Vendor 424", .system_product = "Model 4243" },
+      "/missing.hbp", "/EFI/fallback.bmp", NULL },
+  };
+  char table[256], param[300];
+  const char* params[2] = { "image=/EFI/fallback.bmp", param };
+
+  profile_path (table, sizeof (table), 1);
+  for (unsigned i = 0; i < ARRAY_SIZE (cases); i++)
+  {
+    struct config_arg a = { .params = params, .count = 2 };
+    char check[96];
+    unsigned seen = 0, seen_other = 0, wrong = 0;
+
+    snprintf (param, sizeof (param), "profile=%s", cases[i].table ? cases[i].table : table);
+    host_acpi_generate (&cases[i].spec);
+    hackbgrt_profile_init ();
+    for (unsigned d = 0; d < 100; d++)
+    {
+      hackbgrt_config_t config;
+      host_counters_reset ();
+      host_seed_random (d);
+      config = hackbgrt_read_config ("(hd0,gpt1)", params, 2);
+      const char* path = config && config->image_path ? strchr (config->image_path, ')') + 1 : "";
+      if (strcmp (path, cases[i].expected) == 0)
+        seen++;
+      else if (cases[i].other && strcmp (path, cases[i].other) == 0)
+        seen_other++;
+      else
+        wrong++;
+      if (config)
+        hackbgrt_free_config (config);
+    }
+    grub_errno = GRUB_ERR_NONE;
+    snprintf (check, sizeof (check), "%s%s", strrchr (cases[i].expected, '/') + 1,
+              wrong || (cases[i].other && (!seen || !seen_other)) ? " MISMATCH" : "");
+    struct bench_case c = { .run = run_read_config, .arg = &a };
+    bench_run ("profile", cases[i].label, &c, check);
+  }
+  host_acpi_release ();
+  hackbgrt_profile_init ();
+  host_seed_random (1);
+}
+
+/*
+ * load_bmp with trim=auto: the square of the host picture cut off its black canvas
+ */
+
+static void
+run_bmp_bounds (void* arg)
+{
+  struct hackbgrt_bmp_rect rect;
+  hackbgrt_bmp_bounds (arg, &rect);
+}
+
+/**
+ * Tell whether the pixels of a bitmap are all of one gray level.
+ */
+static int
+bitmap_is_gray (bitmap_t bmp, grub_uint8_t level)
+{
+  grub_uint32_t stride = get_bitmap_pixels_size (bmp->header.width, 1);
+  for (grub_uint32_t y = 0; y < bmp->header.height; y++)
+  {
+    const grub_uint8_t* row = (const grub_uint8_t*) bmp + BMP_PIXEL_DATA_OFFSET + (grub_size_t) y * stride;
+    for (grub_uint32_t x = 0; x < 3 * bmp->header.width; x++)
+      if (row[x] != level)
+        return 0;
+  }
+  return 1;
+}
+
+static void
+bench_trim (void)
+{
+  for (unsigned i = 0; i < ARRAY_SIZE (image_sizes); i++)
+  {
+    const struct image_size* size = &image_sizes[i];
+    char path[4096], label[64], check[96];
+    struct hackbgrt_cache_origin origin;
+    // host_write_bmp draws the square over the middle half, rows bottom-up
+    grub_uint32_t x = size->width / 4, width = size->width * 3 / 4 - x;
+    grub_uint32_t y = size->height - size->height * 3 / 4, height = size->height * 3 / 4 - size->height / 4;
+    int ok;
+
+    if (bench_opts.quick && size->width > 1920)
+      continue;
+    if (!width || !height)
+    {
+      // no square: the whole image is kept
+      x = y = 0;
+      width = size->width;
+      height = size->height;
+    }
+    snprintf (path, sizeof (path), "(hd0,gpt1)");
+    image_path (path + strlen (path), sizeof (path) - strlen (path), size, 1);
+
+    bitmap_t bmp = load_bmp (path, HACKBGRT_IO_GRUB, 0, 0, HACKBGRT_SCALE_NONE, 0);
+    if (!bmp)
+    {
+      fprintf (stderr, "load_bmp(%s) failed\n", path);
+      continue;
+    }
+    snprintf (label, sizeof (label), "%s bounds", size->name);
+    struct bench_case bc = { .run = run_bmp_bounds, .arg = bmp };
+    bench_run ("trim", label, &bc, NULL);
+    teardown_efi (NULL);
+
+    struct load_arg a = { .path = path, .backend = HACKBGRT_IO_GRUB, .trim = 1 };
+    struct bench_case c = { .run = run_load_bmp, .teardown = teardown_efi, .arg = &a };
+    bmp = load_bmp (path, a.backend, 0, 0, HACKBGRT_SCALE_NONE, 1);
+    if (!bmp)
+    {
+      fprintf (stderr, "load_bmp(%s) failed\n", path);
+      continue;
+    }
+    hackbgrt_cache_get_origin (bmp, &origin);
+    ok = bmp->header.width == width && bmp->header.height == height && origin.x == x && origin.y == y
+         && origin.image_width == size->width && origin.image_height == size->height
+         && (width == size->width || bitmap_is_gray (bmp, 0xe0));
+    snprintf (check, sizeof (check), "%ux%u at %u,%u, %.1f%% of the bytes %s", bmp->header.width,
+              bmp->header.height, origin.x, origin.y,
+              100.0 * bmp->header.size / get_bitmap_total_size (size->width, size->height), ok ? "ok" : "MISMATCH");
+    teardown_efi (NULL);
+    snprintf (label, sizeof (label), "%s load trim", size->name);
+    bench_run ("trim", label, &c, check);
+  }
+}
+
+/*
+ * The pixel kernels, serial and spread over the APs of the fake MP services
+ */
+
+struct convert_arg
+{
+  struct hackbgrt_bmp_info info;
+  const grub_uint8_t* file;
+  bitmap_t out;
+};
+
+static void
+run_bmp_convert (void* arg)
+{
+  struct convert_arg* a = arg;
+  if (hackbgrt_bmp_convert (&a->info, a->file, a->out))
+    fprintf (stderr, "hackbgrt_bmp_convert failed\n");
+}
+
+/**
+ * Time one kernel with 1 (no MP services) to bench_opts.processors
+ * processors, checking the output against the serial one.
+ */
+static void
+bench_parallel_kernel (const char* name, void (*run) (void*), void* arg, bitmap_t out)
+{
+  grub_uint8_t* serial = NULL;
+  for (unsigned processors = 1; processors <= bench_opts.processors; processors *= 2)
+  {
+    char label[64], check[64];
+    host_set_processors (processors > 1 ? processors : 0);
+    hackbgrt_parallel_init (processors > 1);
+    host_counters_reset ();
+    run (arg);
+    if (!serial)
+    {
+      serial = malloc (out->header.size);
+      memcpy (serial, out, out->header.size);
+      snprintf (check, sizeof (check), "reference");
+    }
+    else
+      snprintf (check, sizeof (check), "%s%s", memcmp (serial, out, out->header.size) == 0 ? "same" : "MISMATCH",
+                host_counters.ap_runs ? "" : " serial");
+    snprintf (label, sizeof (label), "%s %u cpu%s", name, processors, processors > 1 ? "s" : "");
+    struct bench_case c = { .run = run, .arg = arg };
+    bench_run ("parallel", label, &c, check);
+  }
+  free (serial);
+  host_set_processors (0);
+  hackbgrt_parallel_init (0);
+}
+
+static void
+bench_parallel (void)
+{
+  const struct image_size* size = &image_sizes[bench_opts.quick ? 3 : 4];
+  static const enum host_bmp_format formats[] = { HOST_BMP_4BPP, HOST_BMP_32BPP_ALPHA };
+  char path[4096], name[64];
+
+  for (unsigned f = 0; f < ARRAY_SIZE (formats); f++)
+  {
+    struct convert_arg a;
+    grub_size_t file_size;
+    grub_uint8_t* file;
+    format_path (path, sizeof (path), size, formats[f], 0);
+    if (!(file = read_host_file (path, &file_size)) || hackbgrt_bmp_parse (file, file_size, &a.info))
+    {
+      fprintf (stderr, "cannot parse %s\n", path);
+      free (file);
+      continue;
+    }
+    a.file = file;
+    a.out = malloc (get_bitmap_total_size (size->width, size->height));
+    snprintf (name, sizeof (name), "%s %s", size->name, host_bmp_format_name (formats[f]));
+    bench_parallel_kernel (name, run_bmp_convert, &a, a.out);
+    free (a.out);
+    free (file);
+  }
+
+  struct png_arg p = { .path = path };
+  snprintf (path, sizeof (path), "(hd0,gpt1)");
+  png_path (path + strlen (path), sizeof (path) - strlen (path), size, 1, 1);
+  if (grub_video_bitmap_load (&p.image, path) == GRUB_ERR_NONE)
+  {
+    p.out = malloc (get_bitmap_total_size (size->width, size->height));
+    snprintf (name, sizeof (name), "%s png-alpha", size->name);
+    bench_parallel_kernel (name, run_png_convert, &p, p.out);
+    free (p.out);
+    grub_video_bitmap_destroy (p.image);
+  }
+  grub_errno = GRUB_ERR_NONE;
+
+  // scaled to the size, replicated then filtered
+  static const struct
+  {
+    unsigned source; // in image_sizes
+    enum hackbgrt_scale scale;
+  } scales[] = {
+    { 3, HACKBGRT_SCALE_FIT },
+    { 2, HACKBGRT_SCALE_FILL },
+  };
+  for (unsigned i = 0; i < ARRAY_SIZE (scales); i++)
+  {
+    const struct image_size* source = &image_sizes[scales[i].source];
+    struct scale_arg a = {
+      .width = source->width,
+      .height = source->height,
+      .crop = scales[i].scale == HACKBGRT_SCALE_FILL,
+    };
+    if (source->width >= size->width)
+      continue;
+    snprintf (path, sizeof (path), "(hd0,gpt1)");
+    image_path (path + strlen (path), sizeof (path) - strlen (path), source, 1);
+    if (!(a.src = load_bmp (path, HACKBGRT_IO_GRUB, 0, 0, HACKBGRT_SCALE_NONE, 0)))
+      continue;
+    hackbgrt_scale_size (scales[i].scale, &a.width, &a.height, size->width, size->height);
+    a.dst = malloc (get_bitmap_total_size (a.width, a.height));
+    snprintf (name, sizeof (name), "%s %s %ux%u", source->name, hackbgrt_scale_name (scales[i].scale), a.width, a.height);
+    bench_parallel_kernel (name, run_scale, &a, a.dst);
+    free (a.dst);
+    teardown_efi (NULL);
+  }
+}
+
+/*
+ * hackbgrt_acpi_scan/queue/commit
+ */
+
+struct acpi_arg
+{
+  struct host_acpi_spec spec;
+  enum hackbgrt_action action;
+  grub_acpi_bgrt_t bgrt;
+};
+
+static void
+setup_acpi (void* arg)
+{
+  struct acpi_arg* a = arg;
+  host_acpi_generate (&a->spec);
+}
+
+static void
+run_acpi (void* arg)
+{
+  struct acpi_arg* a = arg;
+  struct hackbgrt_acpi acpi;
+  hackbgrt_acpi_scan (&acpi);
+  switch (a->action)
+  {
+    case HACKBGRT_KEEP:
+      return;
+    case HACKBGRT_REPLACE:
+      hackbgrt_acpi_queue (&acpi, HACKBGRT_ACPI_REPLACE, a->bgrt);
+      hackbgrt_acpi_queue (&acpi, HACKBGRT_ACPI_APPEND, a->bgrt);
+      break;
+    case HACKBGRT_REMOVE:
+      hackbgrt_acpi_queue (&acpi, HACKBGRT_ACPI_REMOVE, 0);
+  }
+  hackbgrt_acpi_commit (&acpi);
+}
+
+static void
+bench_acpi (void)
+{
+  static const char* action_names[] = { "keep", "replace", "remove" };
+  static const grub_uint32_t bgrt_counts[] = { 1, 0, 4 };
+  static struct grub_acpi_bgrt new_bgrt;
+
+  grub_memcpy (new_bgrt.header.signature, BGRT_MAGIC, BGRT_MAGIC_SIZE);
+  new_bgrt.header.length = BGRT_HEADER_SIZE;
+  set_acpi_sdt_checksum (&new_bgrt);
+  for (int action = HACKBGRT_KEEP; action <= HACKBGRT_REMOVE; action++)
+    for (unsigned i = 0; i < ARRAY_SIZE (xsdt_sizes); i++)
+      for (unsigned b = 0; b < ARRAY_SIZE (bgrt_counts); b++)
+        for (int shared = 0; shared <= 1; shared++)
+        {
+          char phase[32], label[64], check[32];
+          int checksums_ok;
+          if (bench_opts.quick && xsdt_sizes[i] > 1000)
+            continue;
+          if (shared && bgrt_counts[b] != 1)
+            continue;
+          struct acpi_arg a = {
+            .spec = {
+              .xsdt_entries = xsdt_sizes[i],
+              .acpi20_entries = 3,
+              .other_entries = 8,
+              .bgrt_count = bgrt_counts[b],
+              .shared_rsdp = shared,
+            },
+            .action = action,
+            .bgrt = &new_bgrt,
+          };
+          struct bench_case c = { .setup = setup_acpi, .run = run_acpi, .teardown = teardown_efi, .arg = &a };
+          snprintf (phase, sizeof (phase), "acpi_%s", action_names[action]);
+          snprintf (label, sizeof (label), "xsdt=%u bgrt=%u%s", xsdt_sizes[i], bgrt_counts[b], shared ? " shared" : "");
+          // one untimed pass to check the resulting tables
+          setup_acpi (&a);
+          run_acpi (&a);
+          grub_uint32_t bgrt_after = host_acpi_count_bgrt (&checksums_ok);
+          host_efi_release_all ();
+          snprintf (check, sizeof (check), "bgrt=%u%s", bgrt_after, checksums_ok ? "" : " BAD-CHECKSUM");
+          bench_run (phase, label, &c, check);
+        }
+  host_acpi_release ();
+}
+
+/*
+ * hack_bgrt
+ */
+
+struct hack_arg
+{
+  struct host_acpi_spec spec;
+  hackbgrt_config_t config;
+};
+
+static void
+setup_hack (void* arg)
+{
+  struct hack_arg* a = arg;
+  host_acpi_generate (&a->spec);
+}
+
+static void
+run_hack (void* arg)
+{
+  struct hack_arg* a = arg;
+  hack_bgrt (a->config);
+  grub_print_error ();
+}
+
+static void
+bench_hack_bgrt (void)
+{
+  static const grub_uint32_t entries[] = { 10, 1000, 10000 };
+  for (unsigned i = 0; i < ARRAY_SIZE (image_sizes); i++)
+    for (unsigned e = 0; e < ARRAY_SIZE (entries); e++)
+      for (int prepared = 0; prepared <= 1; prepared++)
+    {
+      char param[4096], label[64], check[48];
+      const char* params[1] = { param };
+      int checksums_ok;
+      if (i == 1 || i == 2)
+        continue; // 1x1, FHD, 4K and 8K are enough here
+      if (bench_opts.quick && (image_sizes[i].width > 1920 || entries[e] > 1000))
+        continue;
+      // as hackbgrt-prepare writes it: the screen given, the GOP left alone
+      if (prepared && entries[e] != 10)
+        continue;
+      snprintf (param, sizeof (param), "image=");
+      image_path (param + strlen (param), sizeof (param) - strlen (param), &image_sizes[i], 1);
+      if (prepared)
+        snprintf (param + strlen (param), sizeof (param) - strlen (param), ",screen=1920x1080");
+      struct hack_arg a = {
+        .spec = {
+          .xsdt_entries = entries[e],
+          .acpi20_entries = 3,
+          .other_entries = 8,
+          .bgrt_count = 1,
+          .logo_width = 300,
+          .logo_height = 200,
+        },
+        .config = hackbgrt_read_config ("(hd0,gpt1)", params, 1),
+      };
+      struct bench_case c = { .setup = setup_hack, .run = run_hack, .teardown = teardown_efi, .arg = &a };
+      struct hackbgrt_alloc_stats before, after;
+      setup_hack (&a);
+      hackbgrt_alloc_get_stats (&before);
+      host_counters_reset ();
+      run_hack (&a);
+      hackbgrt_alloc_get_stats (&after);
+      grub_uint32_t bgrt_after = host_acpi_count_bgrt (&checksums_ok);
+      teardown_efi (NULL);
+      snprintf (check, sizeof (check), "bgrt=%u%s%s", bgrt_after, checksums_ok ? "" : " BAD-CHECKSUM",
+                after.reused > before.reused ? " in-place" : "");
+      if (prepared)
+        snprintf (check + strlen (check), sizeof (check) - strlen (check), " gop-queries=%llu",
+                  (unsigned long long) host_counters.gop_query_modes);
+      snprintf (label, sizeof (label), "%s xsdt=%u%s", image_sizes[i].name, entries[e], prepared ? " screen=" : "");
+      bench_run ("hack_bgrt", label, &c, check);
+      hackbgrt_free_config (a.config);
+    }
+  host_acpi_release ();
+}
+
+/*
+ * grub_cmd_hackbgrt, immediate and deferred
+ */
+
+struct command_arg
+{
+  struct host_acpi_spec spec;
+  char* argv[3]; // the ESP, an image parameter and an optional budget=
+  int defer;
+  int telemetry;
+  const char* replace_first; // an image= run without --defer before the command, for setup_replace_first
+};
+
+static void
+run_command (void* arg)
+{
+  struct command_arg* a = arg;
+  struct grub_extcmd* extcmd = host_registered_extcmd ("hackbgrt");
+  struct grub_arg_list state[ARRAY_SIZE (options) - 1];
+  struct grub_extcmd_context ctxt = { .extcmd = extcmd, .state = state };
+
+  grub_memset (state, 0, sizeof (state));
+  state[HACKBGRT_OPTION_DEFER].set = a->defer;
+  state[HACKBGRT_OPTION_TELEMETRY].set = a->telemetry;
+  extcmd->func (&ctxt, a->argv[2] ? 3 : 2, a->argv);
+  grub_print_error ();
+}
+
+static void
+setup_command (void* arg)
+{
+  struct command_arg* a = arg;
+  host_acpi_generate (&a->spec);
+}
+
+/**
+ * Replace the firmware's logo first, as a global hackbgrt call does before the one of a menu entry.
+ */
+static void
+setup_replace_first (void* arg)
+{
+  struct command_arg* a = arg;
+  struct command_arg first = { .argv = { a->argv[0], (char*) a->replace_first, NULL } };
+  host_acpi_generate (&a->spec);
+  run_command (&first);
+}
+
+static void
+setup_preboot (void* arg)
+{
+  struct command_arg* a = arg;
+  host_acpi_generate (&a->spec);
+  a->defer = 1;
+  run_command (a);
+}
+
+static void
+run_preboot (void* arg __attribute__ ((unused)))
+{
+  host_loader_boot ();
+}
+
+static void
+setup_repeat (void* arg)
+{
+  struct command_arg* a = arg;
+  host_acpi_generate (&a->spec);
+  run_command (a);
+}
+
+static void
+bench_command (void)
+{
+  static const char* modes[] = { "immediate", "defer", "preboot", "repeat" };
+  static void (*const setups[]) (void*) = { setup_command, setup_command, setup_preboot, setup_repeat };
+  static void (*const runs[]) (void*) = { run_command, run_command, run_preboot, run_command };
+  static const struct
+  {
+    unsigned image; // in image_sizes, or ARRAY_SIZE (image_sizes) for the gallery with a manifest
+    const char* options;
+  } commands[] = {
+    { 0, "" },
+    { 3, "" },
+    { 4, "" },
+    { 1, ",scale=fit" }, // to the 1920x1080 GOP
+    { 3, ",trim=auto" },
+    { ARRAY_SIZE (image_sizes), "" },
+  };
+  for (unsigned k = 0; k < ARRAY_SIZE (commands); k++)
+    for (unsigned m = 0; m < ARRAY_SIZE (modes); m++)
+    {
+      char param[4096], label[64];
+      unsigned i = commands[k].image;
+      int gallery = i == ARRAY_SIZE (image_sizes);
+      if (!gallery && bench_opts.quick && image_sizes[i].width > 1920)
+        continue;
+      snprintf (param, sizeof (param), "image=%s", gallery ? "dir:" : "");
+      if (gallery)
+        gallery_path (param + strlen (param), sizeof (param) - strlen (param), 1, 1);
+      else
+        image_path (param + strlen (param), sizeof (param) - strlen (param), &image_sizes[i], 1);
+      strcat (param, commands[k].options);
+      struct command_arg a = {
+        .spec = {
+          .xsdt_entries = 100,
+          .acpi20_entries = 1,
+          .bgrt_count = 1,
+          .logo_width = 300,
+          .logo_height = 200,
+        },
+        .argv = { (char*) "(hd0,gpt1)", param },
+        .defer = m == 1,
+      };
+      struct bench_case c = {
+        .setup = setups[m],
+        .run = runs[m],
+        .teardown = teardown_efi,
+        .arg = &a,
+      };
+      struct hackbgrt_cache_stats before, after;
+      char check[64];
+      // one untimed pass to count the cache hits of the timed call
+      setups[m] (&a);
+      hackbgrt_cache_get_stats (&before);
+      runs[m] (&a);
+      hackbgrt_cache_get_stats (&after);
+      teardown_efi (&a);
+      snprintf (check, sizeof (check), "cache hits=%u misses=%u", after.hits - before.hits, after.misses - before.misses);
+      snprintf (label, sizeof (label), "%s%s %s", gallery ? "gallery" : image_sizes[i].name, commands[k].options, modes[m]);
+      bench_run ("command", label, &c, check);
+      // leave no deferred config behind
+      host_loader_boot ();
+      teardown_efi (&a);
+    }
+  host_acpi_release ();
+}
+
+/*
+ * --stats figures, through the environment variables
+ */
+
+static void
+bench_stats (void)
+{
+  static const grub_uint32_t entries[] = { 100, 10000 };
+  for (unsigned i = 3; i < ARRAY_SIZE (image_sizes); i++)
+    for (unsigned e = 0; e < ARRAY_SIZE (entries); e++)
+    {
+      char param[4096], label[64], check[96];
+      struct hackbgrt_stats stats;
+      grub_uint64_t sum = 0;
+      const char* load_us;
+      if (bench_opts.quick && (image_sizes[i].width > 1920 || entries[e] > 1000))
+        continue;
+      snprintf (param, sizeof (param), "image=");
+      image_path (param + strlen (param), sizeof (param) - strlen (param), &image_sizes[i], 1);
+      struct command_arg a = {
+        .spec = {
+          .xsdt_entries = entries[e],
+          .acpi20_entries = 1,
+          .bgrt_count = 1,
+          .logo_width = 300,
+          .logo_height = 200,
+        },
+        .argv = { (char*) "(hd0,gpt1)", param },
+      };
+      struct bench_case c = { .setup = setup_command, .run = run_command, .teardown = teardown_efi, .arg = &a };
+      // one untimed pass on a cold cache, to check the figures of a real load
+      hackbgrt_cache_fini ();
+      hackbgrt_cache_init ();
+      setup_command (&a);
+      host_counters_reset ();
+      run_command (&a);
+      teardown_efi (&a);
+      hackbgrt_stats_get (&stats);
+      for (int phase = 0; phase < HACKBGRT_PHASE_TOTAL; phase++)
+        sum += stats.us[phase];
+      load_us = grub_env_get ("hackbgrt_load_us");
+      snprintf (check, sizeof (check), "load=%sus read=%llu xsdt=%llu%s%s", load_us ? load_us : "?",
+                (unsigned long long) stats.bytes_read, (unsigned long long) stats.xsdt_entries,
+                stats.bytes_read == host_counters.file_bytes_read ? "" : " BAD-BYTES",
+                load_us && sum <= stats.us[HACKBGRT_PHASE_TOTAL] ? "" : " BAD-PHASES");
+      snprintf (label, sizeof (label), "%s xsdt=%u", image_sizes[i].name, entries[e]);
+      bench_run ("stats", label, &c, check);
+    }
+  host_acpi_release ();
+}
+
+/*
+ * --telemetry record, immediate and deferred
+ */
+
+static void
+bench_telemetry (void)
+{
+  static const char* modes[] = { "immediate", "preboot" };
+  static void (*const setups[]) (void*) = { setup_command, setup_preboot };
+  static void (*const runs[]) (void*) = { run_command, run_preboot };
+  for (unsigned m = 0; m < ARRAY_SIZE (modes); m++)
+    for (int telemetry = 0; telemetry <= 1; telemetry++)
+    {
+      char param[4096], label[64], check[96];
+      struct telemetry_record record;
+      grub_uint32_t attributes = 0;
+      grub_size_t size = 0;
+      const void* data;
+      snprintf (param, sizeof (param), "image=");
+      image_path (param + strlen (param), sizeof (param) - strlen (param), &image_sizes[3], 1);
+      struct command_arg a = {
+        .spec = {
+          .xsdt_entries = 100,
+          .acpi20_entries = 1,
+          .bgrt_count = 1,
+          .logo_width = 300,
+          .logo_height = 200,
+        },
+        .argv = { (char*) "(hd0,gpt1)", param },
+        .telemetry = telemetry,
+      };
+      struct bench_case c = { .setup = setups[m], .run = runs[m], .teardown = teardown_efi, .arg = &a };
+      // one untimed pass to check the record against the harness
+      host_efi_clear_variable ();
+      setups[m] (&a);
+      host_counters_reset ();
+      runs[m] (&a);
+      data = host_efi_variable (TELEMETRY_VARIABLE, &attributes, &size);
+      if (data && size == sizeof (record))
+      {
+        memcpy (&record, data, sizeof (record));
+        snprintf (check, sizeof (check), "record load=%uus read=%llu%s%s%s", record.us[HACKBGRT_PHASE_LOAD],
+                  (unsigned long long) record.bytes_read,
+                  memcmp (record.signature, TELEMETRY_MAGIC, TELEMETRY_MAGIC_SIZE) == 0
+                  && record.image_size == get_bitmap_total_size (image_sizes[3].width, image_sizes[3].height)
+                  && record.bytes_read == host_counters.file_bytes_read && record.image_index == 0 ? "" : " BAD-RECORD",
+                  attributes & GRUB_EFI_VARIABLE_NON_VOLATILE ? " BAD-NON-VOLATILE" : "",
+                  !(record.flags & TELEMETRY_FLAG_DEFERRED) == (m == 0) ? "" : " BAD-FLAGS");
+      }
+      else
+        snprintf (check, sizeof (check), "%s", telemetry ? "BAD-NO-RECORD" : "no record");
+      teardown_efi (&a);
+      snprintf (label, sizeof (label), "FHD %s%s", modes[m], telemetry ? " telemetry" : "");
+      bench_run ("telemetry", label, &c, check);
+      host_loader_boot ();
+      teardown_efi (&a);
+    }
+  host_acpi_release ();
+}
+
+/*
+ * budget=: giving up on a slow medium, and failing without a pause
+ */
+
+static void
+bench_budget (void)
+{
+  static const struct
+  {
+    const char* budget; // NULL for none
+    const char* image;  // NULL for the image of the size
+    grub_uint32_t bgrt; // BGRTs left
+    int out;            // runs out of budget
+    int on_logo;        // a 4K firmware logo the image fits in, to be left whole when kept
+  } cases[] = {
+    { NULL, NULL, 1, 0, 0 },
+    { "budget=40", NULL, 1, 1, 0 },
+    { "budget=40:keep", NULL, 1, 1, 0 },
+    { "budget=40:remove", NULL, 0, 1, 0 },
+    { "budget=100000", NULL, 1, 0, 0 },
+    { NULL, "image=/missing.bmp", 0, 0, 0 },
+    { "budget=40", "image=/missing.bmp", 0, 0, 0 },
+    { "budget=40", NULL, 1, 1, 1 },
+    { "budget=40:keep", NULL, 1, 1, 1 },
+  };
+  for (unsigned i = 3; i < ARRAY_SIZE (image_sizes); i++)
+    for (unsigned k = 0; k < ARRAY_SIZE (cases); k++)
+    {
+      char param[4096], label[64], check[128];
+      struct telemetry_record record;
+      grub_uint32_t attributes;
+      grub_size_t size = 0;
+      const void* data;
+      const char* error;
+      int checksums_ok, logo_whole = 1;
+      grub_uint32_t bgrt;
+      if (bench_opts.quick && image_sizes[i].width > 1920)
+        continue;
+      if (cases[k].image)
+        snprintf (param, sizeof (param), "%s", cases[k].image);
+      else
+      {
+        snprintf (param, sizeof (param), "image=");
+        image_path (param + strlen (param), sizeof (param) - strlen (param), &image_sizes[i], 1);
+      }
+      struct command_arg a = {
+        .spec = {
+          .xsdt_entries = 100,
+          .acpi20_entries = 1,
+          .bgrt_count = 1,
+          .logo_width = cases[k].on_logo ? 3840 : 300,
+          .logo_height = cases[k].on_logo ? 2160 : 200,
+        },
+        .argv = { (char*) "(hd0,gpt1)", param, (char*) cases[k].budget },
+        .telemetry = 1,
+      };
+      struct bench_case c = { .setup = setup_command, .run = run_command, .teardown = teardown_efi, .arg = &a };
+      // each read takes 10 ms: the budget runs out a few chunks into the image
+      host_set_read_latency (10);
+      // one untimed pass on a cold cache, to check where the BGRT is left
+      hackbgrt_cache_fini ();
+      hackbgrt_cache_init ();
+      host_efi_clear_variable ();
+      setup_command (&a);
+      host_counters_reset ();
+      run_command (&a);
+      bgrt = host_acpi_count_bgrt (&checksums_ok);
+      if (cases[k].on_logo && bgrt)
+      {
+        bitmap_t logo = (bitmap_t) (grub_addr_t) host_acpi_first_bgrt ()->image_address;
+        const grub_uint8_t* pixels = (const grub_uint8_t*) logo + BMP_PIXEL_DATA_OFFSET;
+        logo_whole = logo->header.width == 3840;
+        for (grub_uint32_t j = 0; logo_whole && j < logo->header.data_size; j++)
+          logo_whole = pixels[j] == 0x40;
+      }
+      data = host_efi_variable (TELEMETRY_VARIABLE, &attributes, &size);
+      memset (&record, 0, sizeof (record));
+      if (data && size == sizeof (record))
+        memcpy (&record, data, sizeof (record));
+      error = grub_env_get ("hackbgrt_error");
+      snprintf (check, sizeof (check), "bgrt=%u read=%llu%s%s%s%s%s%s", bgrt,
+                (unsigned long long) host_counters.file_bytes_read,
+                record.flags & TELEMETRY_FLAG_OUT_OF_BUDGET ? " out-of-budget" : "",
+                bgrt == cases[k].bgrt && checksums_ok ? "" : " BAD-BGRT",
+                !(record.flags & TELEMETRY_FLAG_OUT_OF_BUDGET) == !cases[k].out ? "" : " BAD-BUDGET",
+                !error == (!cases[k].out && !cases[k].image) ? "" : " BAD-ERROR",
+                host_counters.stall_us ? " BAD-STALL" : "",
+                logo_whole ? "" : " BAD-LOGO");
+      teardown_efi (&a);
+      snprintf (label, sizeof (label), "%s %s%s%s%s", image_sizes[i].name, cases[k].image ? "missing" : "image",
+                cases[k].budget ? " " : "", cases[k].budget ? cases[k].budget : "", cases[k].on_logo ? " on logo" : "");
+      bench_run ("budget", label, &c, check);
+      host_set_read_latency (0);
+    }
+  host_acpi_release ();
+}
+
+/*
+ * hackbgrt_display_get: the GOP searched once, its current mode read without a query
+ */
+
+struct display_arg
+{
+  int warm; // the GOP already searched
+  grub_uint32_t width;
+  grub_uint32_t height;
+  enum hackbgrt_display_source source;
+};
+
+static void
+setup_display (void* arg)
+{
+  struct display_arg* a = arg;
+  grub_uint32_t width, height;
+  hackbgrt_display_fini ();
+  if (a->warm)
+    hackbgrt_display_get (&width, &height);
+}
+
+static void
+run_display (void* arg)
+{
+  struct display_arg* a = arg;
+  a->source = hackbgrt_display_get (&a->width, &a->height);
+}
+
+static void
+bench_display (void)
+{
+  static const char* sources[] = { "none", "gop", "video" };
+  static const struct
+  {
+    const char* name;
+    grub_uint32_t gop_width, gop_height, gop_modes;
+    grub_uint32_t video_width, video_height;
+    enum hackbgrt_display_source source;
+    int lazy; // the GOP leaves its mode information empty: one query per lookup, its pool freed
+  } displays[] = {
+    { "gop modes=1", 1920, 1080, 1, 0, 0, HACKBGRT_DISPLAY_GOP, 0 },
+    { "gop modes=60", 3840, 2160, 60, 0, 0, HACKBGRT_DISPLAY_GOP, 0 },
+    { "gop no info", 1920, 1080, 30, 0, 0, HACKBGRT_DISPLAY_GOP, 1 },
+    { "gop+video", 1920, 1080, 30, 1024, 768, HACKBGRT_DISPLAY_GOP, 0 },
+    { "video", 0, 0, 0, 1024, 768, HACKBGRT_DISPLAY_VIDEO, 0 },
+    { "none", 0, 0, 0, 0, 0, HACKBGRT_DISPLAY_NONE, 0 },
+  };
+  for (unsigned d = 0; d < ARRAY_SIZE (displays); d++)
+    for (int warm = 0; warm <= 1; warm++)
+    {
+      struct display_arg a = { .warm = warm };
+      struct bench_case c = { .setup = setup_display, .run = run_display, .arg = &a };
+      struct hackbgrt_display_stats before, after;
+      grub_uint32_t width = displays[d].gop_width ? displays[d].gop_width : displays[d].video_width;
+      grub_uint32_t height = displays[d].gop_width ? displays[d].gop_height : displays[d].video_height;
+      char label[64], check[96];
+      host_set_gop (displays[d].gop_width, displays[d].gop_height, displays[d].gop_modes);
+      host_set_video (displays[d].video_width, displays[d].video_height);
+      host_set_gop_lazy (displays[d].lazy);
+      // one untimed pass to count the firmware calls of the timed one
+      setup_display (&a);
+      hackbgrt_display_get_stats (&before);
+      host_counters_reset ();
+      run_display (&a);
+      hackbgrt_display_get_stats (&after);
+      snprintf (check, sizeof (check), "%s %ux%u searches=%u queries=%llu%s%s", sources[a.source], a.width, a.height,
+                after.locates - before.locates, (unsigned long long) host_counters.gop_query_modes,
+                a.source == displays[d].source && a.width == width && a.height == height
+                && after.locates - before.locates == (unsigned) !warm
+                && host_counters.gop_query_modes == (grub_uint64_t) displays[d].lazy * (warm ? 1 : 2) ? "" : " BAD-DISPLAY",
+                host_counters.pool_calls == host_counters.pool_frees ? "" : " BAD-LEAK");
+      snprintf (label, sizeof (label), "%s %s", displays[d].name, warm ? "warm" : "cold");
+      bench_run ("display", label, &c, check);
+    }
+  hackbgrt_display_fini ();
+  host_set_gop (1920, 1080, 30);
+  host_set_gop_lazy (0);
+  host_set_video (0, 0);
+}
+
+/*
+ * mode=overlay: a badge with alpha composited onto the firmware's logo
+ */
+
+/** The gray level of a pixel of a gray bitmap, y from the top. */
+static grub_uint8_t
+bitmap_level (bitmap_t bmp, grub_uint32_t x, grub_uint32_t y)
+{
+  grub_uint32_t stride = get_bitmap_pixels_size (bmp->header.width, 1);
+  return ((const grub_uint8_t*) bmp)[BMP_PIXEL_DATA_OFFSET + (grub_size_t) (bmp->header.height - 1 - y) * stride + 3 * x];
+}
+
+static void
+bench_overlay (void)
+{
+  static const struct
+  {
+    const char* name;
+    unsigned size;                   // index in image_sizes
+    int png;                         // the RGBA PNG: transparent, not translucent, around the square
+    grub_uint32_t logo_width, logo_height;
+    const char* position;            // appended to the parameter
+    grub_uint32_t badge_x, badge_y;  // where the badge lands on the canvas
+    grub_uint32_t width, height;     // the canvas
+    int replaced;                    // the logo was first replaced by the VGA image, in its own buffer
+  } cases[] = {
+    { "VGA on logo", 1, 0, 1024, 768, "", 192, 144, 1024, 768, 0 },
+    { "VGA on replaced logo", 1, 0, 1024, 768, "", 192, 144, 1024, 768, 1 },
+    { "VGA past logo", 1, 0, 300, 200, ",x=200,y=100", 200, 100, 840, 580, 0 },
+    { "VGA no logo", 1, 0, 0, 0, "", 0, 0, 640, 480, 0 },
+    { "VGA png on logo", 1, 1, 1024, 768, "", 192, 144, 1024, 768, 0 },
+    { "FHD on logo", 3, 0, 1920, 1080, "", 0, 0, 1920, 1080, 0 },
+  };
+  for (unsigned k = 0; k < ARRAY_SIZE (cases); k++)
+  {
+    const struct image_size* size = &image_sizes[cases[k].size];
+    char param[4096], replace[4096], label[64], check[128];
+    grub_uint32_t logo = cases[k].logo_width ? 0x40 : 0;
+    int checksums_ok, ok;
+    snprintf (param, sizeof (param), "image=");
+    if (cases[k].png)
+      png_path (param + strlen (param), sizeof (param) - strlen (param), size, 1, 1);
+    else
+      badge_path (param + strlen (param), sizeof (param) - strlen (param), size, 1);
+    snprintf (param + strlen (param), sizeof (param) - strlen (param), ",mode=overlay%s", cases[k].position);
+    struct command_arg a = {
+      .spec = {
+        .xsdt_entries = 100,
+        .acpi20_entries = 1,
+        .bgrt_count = 1,
+        .logo_width = cases[k].logo_width,
+        .logo_height = cases[k].logo_height,
+      },
+      .argv = { (char*) "(hd0,gpt1)", param, NULL },
+      .replace_first = replace,
+    };
+    snprintf (replace, sizeof (replace), "image=");
+    image_path (replace + strlen (replace), sizeof (replace) - strlen (replace), &image_sizes[1], 1);
+    struct bench_case c = { .setup = cases[k].replaced ? setup_replace_first : setup_command, .run = run_command,
+                            .teardown = teardown_efi, .arg = &a };
+    // one untimed pass, to check the composite the BGRT points to
+    c.setup (&a);
+    run_command (&a);
+    grub_acpi_bgrt_t bgrt = host_acpi_first_bgrt ();
+    bitmap_t bmp = bgrt ? (bitmap_t) (grub_addr_t) bgrt->image_address : NULL;
+    host_acpi_count_bgrt (&checksums_ok);
+    ok = bmp && checksums_ok && bmp->header.width == cases[k].width && bmp->header.height == cases[k].height;
+    if (ok)
+    {
+      grub_uint32_t x = cases[k].badge_x, y = cases[k].badge_y;
+      // white at alpha 0x80 over gray 0x40 rounds to 0xa0, over black to 0x80; transparent leaves it
+      grub_uint8_t around = cases[k].png ? logo : logo ? 0xa0 : 0x80;
+      ok = bitmap_level (bmp, x, y) == around
+           && bitmap_level (bmp, x + size->width / 2, y + size->height / 2) == 0xe0
+           && (!x || bitmap_level (bmp, x - 1, y) == logo)
+           && (x + size->width == bmp->header.width || bitmap_level (bmp, bmp->header.width - 1, 0) == logo)
+           && (!cases[k].logo_width || (bgrt->image_offset_x == 100 && bgrt->image_offset_y == 100));
+      // grown past the logo: black where neither is
+      if (ok && cases[k].width > cases[k].logo_width && cases[k].logo_width)
+        ok = bitmap_level (bmp, 0, bmp->header.height - 1) == 0 && bitmap_level (bmp, bmp->header.width - 1, 0) == 0;
+    }
+    snprintf (check, sizeof (check), "%ux%u at %d,%d %s", bmp ? bmp->header.width : 0, bmp ? bmp->header.height : 0,
+              bgrt ? (int) bgrt->image_offset_x : -1, bgrt ? (int) bgrt->image_offset_y : -1, ok ? "ok" : "MISMATCH");
+    teardown_efi (&a);
+    if (bench_opts.quick && size->width > 1920)
+      continue;
+    snprintf (label, sizeof (label), "%s", cases[k].name);
+    bench_run ("overlay", label, &c, check);
+  }
+  host_acpi_release ();
+}
+
+static void
+usage (const char* argv0)
+{
+  fprintf (stderr,
+           "Usage: %s [-p PHASE] [-t MS] [-n MIN_ITERATIONS] [-F 16|32] [-f RUN] [-a ALIGN] [-j CPUS] [-q] [-v]\n"
+           "  -p PHASE  only run one phase: read_config, load_bmp, decode, convert, png, pack, builtin, gallery, profile, scale, trim, parallel, acpi, hack_bgrt, command, stats, telemetry, budget, display, overlay\n"
+           "  -t MS     time budget per case in milliseconds (default 200)\n"
+           "  -n N      minimum iterations per case (default 3)\n"
+           "  -F BITS   FAT type of the virtual ESP disk (default 32)\n"
+           "  -f RUN    fragment the files of the virtual disk in runs of RUN clusters\n"
+           "  -a ALIGN  IoAlign of the virtual disk BlockIo (default 0)\n"
+           "  -j CPUS   most processors of the fake MP services for -p parallel (default 4)\n"
+           "  -q        quick run: skip images above FHD and XSDTs above 1000 entries\n"
+           "  -v        print module errors\n",
+           argv0);
+}
+
+int
+main (int argc, char* argv[])
+{
+  int opt;
+  while ((opt = getopt (argc, argv, "p:t:n:F:f:a:j:qvh")) != -1)
+  {
+    switch (opt)
+    {
+      case 'p':
+        bench_opts.phase = optarg;
+        break;
+      case 't':
+        bench_opts.target_ns = strtoull (optarg, NULL, 10) * 1000000ull;
+        break;
+      case 'n':
+        bench_opts.min_iterations = strtoul (optarg, NULL, 10);
+        break;
+      case 'F':
+        bench_opts.disk.fat_bits = strtoul (optarg, NULL, 10);
+        break;
+      case 'f':
+        bench_opts.disk.fragment = strtoul (optarg, NULL, 10);
+        break;
+      case 'a':
+        bench_opts.disk.io_align = strtoul (optarg, NULL, 10);
+        break;
+      case 'j':
+        bench_opts.processors = strtoul (optarg, NULL, 10);
+        break;
+      case 'q':
+        bench_opts.quick = 1;
+        break;
+      case 'v':
+        host_set_verbose (1);
+        break;
+      default:
+        usage (argv[0]);
+        return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (!mkdtemp (esp_root))
+  {
+    perror ("mkdtemp");
+    return 1;
+  }
+  host_set_esp_root (esp_root);
+  host_set_gop (1920, 1080, 30);
+  host_seed_random (1);
+  grub_mod_init_hackbgrt ();
+  prepare_images ();
+  if (host_disk_build (&bench_opts.disk) != 0)
+  {
+    fprintf (stderr, "cannot build the virtual ESP disk\n");
+    return 1;
+  }
+  bench_header ();
+  if (bench_selected ("read_config"))
+    bench_read_config ();
+  if (bench_selected ("load_bmp"))
+    bench_load_bmp ();
+  if (bench_selected ("decode"))
+    bench_decode ();
+  if (bench_selected ("convert"))
+    bench_convert ();
+  if (bench_selected ("png"))
+    bench_png ();
+  if (bench_selected ("pack"))
+    bench_pack ();
+  if (bench_selected ("builtin"))
+    bench_builtin ();
+  if (bench_selected ("gallery"))
+    bench_gallery ();
+  if (bench_selected ("profile"))
+    bench_profile ();
+  if (bench_selected ("scale"))
+    bench_scale ();
+  if (bench_selected ("trim"))
+    bench_trim ();
+  if (bench_selected ("parallel"))
+    bench_parallel ();
+  if (bench_selected ("acpi"))
+    bench_acpi ();
+  if (bench_selected ("hack_bgrt"))
+    bench_hack_bgrt ();
+  if (bench_selected ("command"))
+    bench_command ();
+  if (bench_selected ("stats"))
+    bench_stats ();
+  if (bench_selected ("telemetry"))
+    bench_telemetry ();
+  if (bench_selected ("budget"))
+    bench_budget ();
+  if (bench_selected ("display"))
+    bench_display ();
+  if (bench_selected ("overlay"))
+    bench_overlay ();
+  grub_mod_fini_hackbgrt ();
+  host_disk_release ();
+  cleanup_images ();
+  return 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * Host-side harness for the hackbgrt module.
+ *
+ * The module sources are compiled for Linux userspace against the stand-in
+ * headers in include/; this header exposes the knobs the benchmark runner
+ * uses to shape the fake firmware and to read back what the module did.
+ */
+#pragma once
+
+#include <grub/err.h>
+#include <grub/types.h>
+#include <grub/efi/api.h>
+
+/** Counters updated by the GRUB and EFI stand-ins. */
+struct host_counters
+{
+  grub_uint64_t malloc_calls;     // grub_malloc/grub_zalloc/grub_realloc
+  grub_uint64_t malloc_bytes;
+  grub_uint64_t heap_peak;        // most bytes held from grub_malloc at once, above what was held at the reset
+  grub_uint64_t pool_calls;       // boot_services->allocate_pool
+  grub_uint64_t pool_bytes;
+  grub_uint64_t pool_frees;       // boot_services->free_pool of a pool allocation
+  grub_uint64_t pages_calls;      // boot_services->allocate_pages
+  grub_uint64_t pages_bytes;
+  grub_uint64_t stall_us;         // boot_services->stall, not actually slept
+  grub_uint64_t file_opens;
+  grub_uint64_t file_bytes_read;  // from files and from the virtual disk
+  grub_uint64_t read_calls;       // file, EFI file, BlockIo and disk reads
+  grub_uint64_t dir_walks;        // directories listed through grub_fs
+  grub_uint64_t dir_entries;      // entries passed to the dir hooks
+  grub_uint64_t gop_query_modes;
+  grub_uint64_t ap_runs;          // StartupAllAPs calls of the MP services
+  grub_uint64_t errors;           // grub_error calls
+};
+
+extern struct host_counters host_counters;
+
+/** Reset the counters. */
+void host_counters_reset (void);
+
+/** Free every EFI allocation still held by the module (pool and pages). */
+void host_efi_release_all (void);
+
+/** Directory used as the root of "(hdX,gptY)" paths. */
+void host_set_esp_root (const char* dir);
+const char* host_esp_root (void);
+
+/** Shape of the virtual FAT disk built over the ESP root. */
+struct host_disk_spec
+{
+  int fat_bits;                // 16 or 32; 16 falls back to 32 when too small
+  grub_uint32_t cluster_size;  // bytes, 4096 when 0
+  grub_uint32_t fragment;      // clusters per run of a file, 0 for contiguous files
+  grub_uint32_t io_align;      // IoAlign of the BlockIo media
+};
+
+/**
+ * Build the virtual FAT disk from the files currently in the ESP root.
+ *
+ * It backs grub_device_open/grub_disk_read and the BlockIo and
+ * SimpleFileSystem protocols of its EFI handle.
+ *
+ * @return 0 on success.
+ */
+int host_disk_build (const struct host_disk_spec* spec);
+void host_disk_release (void);
+
+/** Protocols of the virtual disk handle, for grub_efi_open_protocol. */
+void* host_disk_open_protocol (grub_efi_handle_t handle, grub_efi_guid_t* protocol);
+
+/**
+ * Configure the fake GOP.
+ *
+ * @param width Current mode width; 0 removes the GOP.
+ * @param height Current mode height.
+ * @param max_mode Number of modes the GOP reports.
+ */
+void host_set_gop (grub_uint32_t width, grub_uint32_t height, grub_uint32_t max_mode);
+
+/**
+ * Leave the mode information of the fake GOP empty, as some firmware does until a mode is set:
+ * the current mode is then only known through QueryMode.
+ */
+void host_set_gop_lazy (int lazy);
+
+/**
+ * Configure the mode of GRUB's active video adapter, for grub_video_get_info.
+ *
+ * @param width Its width; 0 for no active adapter.
+ * @param height Its height.
+ */
+void host_set_video (grub_uint32_t width, grub_uint32_t height);
+
+/**
+ * Configure the fake MP services, whose APs are threads.
+ *
+ * @param count Enabled processors, the BSP included; 0 removes the protocol.
+ */
+void host_set_processors (unsigned count);
+
+/** The MP services for locate_protocol, or NULL. */
+void* host_mp_protocol (grub_efi_guid_t* protocol);
+
+/**
+ * Set the image of image=builtin, as if hackbgrt-embed had linked the file
+ * into the module.
+ *
+ * @param path The file, up to 32 MiB; NULL for a module without an image.
+ * @return 0 on success.
+ */
+int host_set_builtin_image (const char* path);
+
+/** Append zero bytes to the image of image=builtin, as a hand-made builtin_image.c may have. */
+void host_pad_builtin_image (grub_uint32_t bytes);
+
+/** Seed the stand-in for grub_crypto_get_random. */
+void host_seed_random (grub_uint64_t seed);
+
+/** Silence (0) or print (1) grub_error messages as they are raised. */
+void host_set_verbose (int verbose);
+
+/** The function registered through grub_register_extcmd, if any. */
+struct grub_extcmd* host_registered_extcmd (const char* name);
+
+/** Run the registered preboot hooks, as grub_loader_boot() does. */
+grub_err_t host_loader_boot (void);
+
+/** Install the given configuration table array in the fake system table. */
+void host_set_configuration_table (grub_efi_configuration_table_t* table, grub_efi_uintn_t count);
+
+/** The data of the EFI variable last set, if it has this name, else NULL. */
+const void* host_efi_variable (const char* name, grub_uint32_t* attributes, grub_size_t* size);
+
+/** Forget the EFI variable last set. */
+void host_efi_clear_variable (void);
+
+/**
+ * Make each file, EFI file, BlockIo and disk read take ms on the clock of
+ * grub_get_time_ms, as on a slow medium; nothing is slept.
+ */
+void host_set_read_latency (grub_uint32_t ms);
+
+/** Advance the clock of grub_get_time_ms by the read latency, from the read mocks. */
+void host_read_elapse (void);
+
+/** Monotonic clock in nanoseconds. */
+grub_uint64_t host_now_ns (void);
@@ -0,0 +1,45 @@
+/*
+ * Stand-in for the builtin_image.c generated by tools/hackbgrt-embed: the
+ * runner loads any file of the ESP root as the image linked into the module.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <grub/types.h>
+#include "host.h"
+
+/** Large enough for a 4K BMP. */
+#define HOST_BUILTIN_MAX (32 * 1024 * 1024)
+
+// declared const by builtin.h, as the module sees them
+grub_uint8_t hackbgrt_builtin_image[HOST_BUILTIN_MAX] __attribute__ ((aligned (16)));
+grub_uint32_t hackbgrt_builtin_image_size;
+
+int
+host_set_builtin_image (const char* path)
+{
+  FILE* fp;
+  size_t size;
+
+  hackbgrt_builtin_image_size = 0;
+  if (!path)
+    return 0;
+  fp = fopen (path, "rb");
+  if (!fp)
+    return -1;
+  size = fread (hackbgrt_builtin_image, 1, HOST_BUILTIN_MAX, fp);
+  if (ferror (fp) || !feof (fp))
+  {
+    fclose (fp);
+    return -1;
+  }
+  fclose (fp);
+  hackbgrt_builtin_image_size = size;
+  return 0;
+}
+
+void
+host_pad_builtin_image (grub_uint32_t bytes)
+{
+  memset (hackbgrt_builtin_image + hackbgrt_builtin_image_size, 0, bytes);
+  hackbgrt_builtin_image_size += bytes;
+}
@@ -0,0 +1,709 @@
+/*
+ * Virtual FAT16/FAT32 disk over the harness ESP root.
+ *
+ * The boot sector, the FAT and the directories are generated in memory;
+ * data clusters of regular files are read from the host files, so large
+ * images cost no memory. The disk backs grub_device_open/grub_disk_read,
+ * the EFI_BLOCK_IO_PROTOCOL of its handle, and an
+ * EFI_SIMPLE_FILE_SYSTEM_PROTOCOL that serves the host files directly.
+ */
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <grub/device.h>
+#include <grub/disk.h>
+#include <grub/efi/api.h>
+#include <grub/efi/disk.h>
+#include <grub/fs.h>
+#include <grub/misc.h>
+#include "efi_fs.h"
+#include "host.h"
+
+#define HOST_SECTOR_SIZE 512
+#define HOST_RESERVED_SECTORS 32
+#define HOST_FAT16_ROOT_ENTRIES 512
+
+struct host_node
+{
+  char* name;
+  char* host_path;
+  int parent;
+  int is_dir;
+  grub_uint64_t size;       // files: host size; directories: bytes of entries
+  grub_uint8_t* dir;        // directory entries
+  grub_uint32_t first_cluster;
+  grub_uint32_t clusters;
+};
+
+struct host_disk
+{
+  struct host_disk_spec spec;
+  const char* root;
+  struct host_node* nodes;
+  int node_count;
+  grub_uint32_t cluster_count;
+  grub_uint32_t fat_sectors;
+  grub_uint32_t root_sectors;   // FAT16 fixed root
+  grub_uint64_t fat_offset;
+  grub_uint64_t root_offset;
+  grub_uint64_t data_offset;
+  grub_uint64_t size;
+  grub_uint8_t boot[HOST_SECTOR_SIZE];
+  grub_uint8_t* fat;
+  grub_int32_t* cluster_node;   // owner of each cluster, -1 when free
+  grub_uint32_t* cluster_index; // index of the cluster in its owner
+  int* fds;
+};
+
+static struct host_disk* host_disk;
+static int host_disk_handle;
+
+static void
+put16 (grub_uint8_t* p, grub_uint16_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+static void
+put32 (grub_uint8_t* p, grub_uint32_t v)
+{
+  put16 (p, v);
+  put16 (p + 2, v >> 16);
+}
+
+static int
+add_node (struct host_disk* d, const char* name, const char* host_path, int parent, int is_dir, grub_uint64_t size)
+{
+  d->nodes = realloc (d->nodes, (d->node_count + 1) * sizeof (*d->nodes));
+  struct host_node* n = &d->nodes[d->node_count];
+  memset (n, 0, sizeof (*n));
+  n->name = strdup (name);
+  n->host_path = strdup (host_path);
+  n->parent = parent;
+  n->is_dir = is_dir;
+  n->size = size;
+  return d->node_count++;
+}
+
+static void
+scan (struct host_disk* d, const char* host_dir, int parent)
+{
+  DIR* dir = opendir (host_dir);
+  struct dirent* de;
+  if (!dir)
+    return;
+  while ((de = readdir (dir)))
+  {
+    char path[4096];
+    struct stat st;
+    if (strcmp (de->d_name, ".") == 0 || strcmp (de->d_name, "..") == 0)
+      continue;
+    snprintf (path, sizeof (path), "%s/%s", host_dir, de->d_name);
+    if (stat (path, &st) != 0)
+      continue;
+    if (S_ISDIR (st.st_mode))
+      scan (d, path, add_node (d, de->d_name, path, parent, 1, 0));
+    else if (S_ISREG (st.st_mode))
+      add_node (d, de->d_name, path, parent, 0, st.st_size);
+  }
+  closedir (dir);
+}
+
+/**
+ * Spell a name as an 8.3 entry name; 1 if it is a valid upper-case 8.3 name
+ * as is, 0 if a long name entry is needed (the ~N tail is then applied).
+ */
+static int
+short_name (const char* name, grub_uint8_t out[11], int tail)
+{
+  const char* dot = strrchr (name, '.');
+  grub_size_t base_len = dot && dot != name ? (grub_size_t) (dot - name) : strlen (name);
+  const char* ext = dot && dot != name ? dot + 1 : "";
+  int exact = base_len >= 1 && base_len <= 8 && strlen (ext) <= 3;
+  int n = 0;
+
+  memset (out, ' ', 11);
+  for (grub_size_t i = 0; i < base_len; i++)
+  {
+    char c = name[i];
+    if (!((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-'))
+      exact = 0;
+    if (c >= 'a' && c <= 'z')
+      c -= 'a' - 'A';
+    if (((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-') && n < 8)
+      out[n++] = c;
+  }
+  for (int i = 0, m = 0; ext[i] && m < 3; i++)
+  {
+    char c = ext[i];
+    if (!((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')))
+      exact = 0;
+    if (c >= 'a' && c <= 'z')
+      c -= 'a' - 'A';
+    out[8 + m++] = c;
+  }
+  if (exact)
+    return 1;
+  char suffix[8];
+  int len = snprintf (suffix, sizeof (suffix), "~%d", tail);
+  n = grub_min (n, 8 - len);
+  memcpy (out + n, suffix, len);
+  return 0;
+}
+
+static grub_uint8_t
+short_name_checksum (const grub_uint8_t* name)
+{
+  grub_uint8_t sum = 0;
+  for (int i = 0; i < 11; i++)
+    sum = ((sum & 1) << 7) + (sum >> 1) + name[i];
+  return sum;
+}
+
+static grub_uint32_t
+entries_for (const char* name)
+{
+  grub_uint8_t sfn[11];
+  if (short_name (name, sfn, 1))
+    return 1;
+  return 1 + (strlen (name) + 12) / 13;
+}
+
+static void
+write_entry (grub_uint8_t* e, const grub_uint8_t name[11], int is_dir, grub_uint32_t cluster, grub_uint32_t size)
+{
+  memcpy (e, name, 11);
+  e[11] = is_dir ? 0x10 : 0x20;
+  put16 (e + 20, cluster >> 16);
+  put16 (e + 26, cluster & 0xffff);
+  put32 (e + 28, size);
+}
+
+static grub_uint8_t*
+write_lfn (grub_uint8_t* e, const char* name, const grub_uint8_t sfn[11])
+{
+  static const grub_uint8_t offsets[13] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+  grub_size_t len = strlen (name);
+  int count = (len + 12) / 13;
+  grub_uint8_t checksum = short_name_checksum (sfn);
+
+  for (int ordinal = count; ordinal >= 1; ordinal--, e += 32)
+  {
+    e[0] = ordinal | (ordinal == count ? 0x40 : 0);
+    e[11] = 0x0f;
+    e[13] = checksum;
+    for (int i = 0; i < 13; i++)
+    {
+      grub_size_t pos = (ordinal - 1) * 13 + i;
+      grub_uint16_t c = pos < len ? (grub_uint8_t) name[pos] : pos == len ? 0 : 0xffff;
+      put16 (e + offsets[i], c);
+    }
+  }
+  return e;
+}
+
+static void
+build_directory (struct host_disk* d, int idx)
+{
+  struct host_node* dir = &d->nodes[idx];
+  grub_uint8_t* e = dir->dir;
+  int tail = 1;
+
+  if (idx != 0)
+  {
+    grub_uint8_t dot[11], dotdot[11];
+    int parent = dir->parent;
+    memset (dot, ' ', 11);
+    memset (dotdot, ' ', 11);
+    dot[0] = dotdot[0] = dotdot[1] = '.';
+    write_entry (e, dot, 1, dir->first_cluster, 0);
+    // ".." of a first-level directory points at cluster 0, whatever the FAT type.
+    write_entry (e + 32, dotdot, 1, parent == 0 ? 0 : d->nodes[parent].first_cluster, 0);
+    e += 64;
+  }
+  for (int i = 1; i < d->node_count; i++)
+  {
+    struct host_node* n = &d->nodes[i];
+    grub_uint8_t sfn[11];
+    if (n->parent != idx)
+      continue;
+    if (!short_name (n->name, sfn, tail))
+    {
+      tail++;
+      e = write_lfn (e, n->name, sfn);
+    }
+    write_entry (e, sfn, n->is_dir, n->first_cluster, n->is_dir ? 0 : (grub_uint32_t) n->size);
+    e += 32;
+  }
+}
+
+static void
+set_fat (struct host_disk* d, grub_uint32_t cluster, grub_uint32_t value)
+{
+  if (d->spec.fat_bits == 32)
+    put32 (d->fat + cluster * 4, value);
+  else
+    put16 (d->fat + cluster * 2, value);
+}
+
+int
+host_disk_build (const struct host_disk_spec* spec)
+{
+  struct host_disk* d = calloc (1, sizeof (*d));
+  grub_uint32_t cluster_size = spec->cluster_size ? spec->cluster_size : 4096;
+  grub_uint32_t spc = cluster_size / HOST_SECTOR_SIZE;
+  grub_uint32_t needed = 0;
+
+  host_disk_release ();
+  d->spec = *spec;
+  d->spec.cluster_size = cluster_size;
+  d->root = host_esp_root ();
+  add_node (d, "", d->root, -1, 1, 0);
+  scan (d, d->root, 0);
+  // directory sizes, then cluster needs
+  for (int i = 0; i < d->node_count; i++)
+  {
+    struct host_node* n = &d->nodes[i];
+    if (!n->is_dir)
+      continue;
+    n->size = i == 0 ? 0 : 64;
+    for (int c = 1; c < d->node_count; c++)
+      if (d->nodes[c].parent == i)
+        n->size += 32 * entries_for (d->nodes[c].name);
+    n->size += 32; // end marker
+  }
+  if (d->spec.fat_bits != 16 && d->spec.fat_bits != 32)
+    d->spec.fat_bits = 32;
+  for (int i = 0; i < d->node_count; i++)
+  {
+    struct host_node* n = &d->nodes[i];
+    n->clusters = (n->size + cluster_size - 1) / cluster_size;
+    if (n->is_dir && n->clusters == 0)
+      n->clusters = 1;
+    needed += n->clusters;
+    if (d->spec.fragment)
+      needed += n->clusters / d->spec.fragment + 1;
+  }
+  // too many clusters or root entries for FAT16
+  if (d->spec.fat_bits == 16 && (needed >= 65525 || d->nodes[0].size > HOST_FAT16_ROOT_ENTRIES * 32))
+    d->spec.fat_bits = 32;
+  if (d->spec.fat_bits == 16)
+    d->nodes[0].clusters = 0;
+  d->cluster_count = d->spec.fat_bits == 16 ? grub_max (needed, 4085u) : grub_max (needed, 65525u);
+  d->fat_sectors = ((d->cluster_count + 2) * (d->spec.fat_bits / 8) + HOST_SECTOR_SIZE - 1) / HOST_SECTOR_SIZE;
+  d->root_sectors = d->spec.fat_bits == 16 ? HOST_FAT16_ROOT_ENTRIES * 32 / HOST_SECTOR_SIZE : 0;
+  d->fat_offset = (grub_uint64_t) HOST_RESERVED_SECTORS * HOST_SECTOR_SIZE;
+  d->root_offset = d->fat_offset + 2ull * d->fat_sectors * HOST_SECTOR_SIZE;
+  d->data_offset = d->root_offset + (grub_uint64_t) d->root_sectors * HOST_SECTOR_SIZE;
+  d->size = d->data_offset + (grub_uint64_t) d->cluster_count * cluster_size;
+  d->fat = calloc (d->fat_sectors, HOST_SECTOR_SIZE);
+  d->cluster_node = malloc ((d->cluster_count + 2) * sizeof (*d->cluster_node));
+  d->cluster_index = calloc (d->cluster_count + 2, sizeof (*d->cluster_index));
+  for (grub_uint32_t c = 0; c < d->cluster_count + 2; c++)
+    d->cluster_node[c] = -1;
+  set_fat (d, 0, d->spec.fat_bits == 32 ? 0x0ffffff8 : 0xfff8);
+  set_fat (d, 1, d->spec.fat_bits == 32 ? 0x0fffffff : 0xffff);
+  // allocate the chains, leaving a free cluster after each run when fragmenting
+  grub_uint32_t next = 2;
+  for (int i = 0; i < d->node_count; i++)
+  {
+    struct host_node* n = &d->nodes[i];
+    grub_uint32_t prev = 0;
+    for (grub_uint32_t k = 0; k < n->clusters; k++)
+    {
+      if (d->spec.fragment && k && k % d->spec.fragment == 0)
+        next++;
+      if (prev)
+        set_fat (d, prev, next);
+      else
+        n->first_cluster = next;
+      d->cluster_node[next] = i;
+      d->cluster_index[next] = k;
+      prev = next++;
+    }
+    if (prev)
+      set_fat (d, prev, d->spec.fat_bits == 32 ? 0x0fffffff : 0xffff);
+  }
+  for (int i = 0; i < d->node_count; i++)
+    if (d->nodes[i].is_dir)
+    {
+      grub_uint64_t bytes = i == 0 && d->spec.fat_bits == 16 ? HOST_FAT16_ROOT_ENTRIES * 32 : (grub_uint64_t) d->nodes[i].clusters * cluster_size;
+      d->nodes[i].dir = calloc (1, bytes);
+      build_directory (d, i);
+    }
+  // boot sector
+  grub_uint8_t* b = d->boot;
+  grub_uint64_t total_sectors = d->size / HOST_SECTOR_SIZE;
+  memcpy (b, "\xeb\x58\x90" "HOSTFAT ", 11);
+  put16 (b + 11, HOST_SECTOR_SIZE);
+  b[13] = spc;
+  put16 (b + 14, HOST_RESERVED_SECTORS);
+  b[16] = 2;
+  put16 (b + 17, d->spec.fat_bits == 16 ? HOST_FAT16_ROOT_ENTRIES : 0);
+  if (total_sectors < 0x10000)
+    put16 (b + 19, total_sectors);
+  else
+    put32 (b + 32, total_sectors);
+  b[21] = 0xf8;
+  if (d->spec.fat_bits == 16)
+    put16 (b + 22, d->fat_sectors);
+  else
+  {
+    put32 (b + 36, d->fat_sectors);
+    put32 (b + 44, d->nodes[0].first_cluster);
+  }
+  put16 (b + 510, 0xaa55);
+  d->fds = malloc (d->node_count * sizeof (*d->fds));
+  for (int i = 0; i < d->node_count; i++)
+    d->fds[i] = d->nodes[i].is_dir ? -1 : open (d->nodes[i].host_path, O_RDONLY);
+  host_disk = d;
+  return 0;
+}
+
+void
+host_disk_release (void)
+{
+  struct host_disk* d = host_disk;
+  if (!d)
+    return;
+  for (int i = 0; i < d->node_count; i++)
+  {
+    if (d->fds[i] >= 0)
+      close (d->fds[i]);
+    free (d->nodes[i].name);
+    free (d->nodes[i].host_path);
+    free (d->nodes[i].dir);
+  }
+  free (d->fds);
+  free (d->nodes);
+  free (d->fat);
+  free (d->cluster_node);
+  free (d->cluster_index);
+  free (d);
+  host_disk = NULL;
+}
+
+/**
+ * Read bytes of the virtual disk.
+ */
+static int
+vdisk_read (struct host_disk* d, grub_uint64_t offset, grub_size_t len, grub_uint8_t* buf)
+{
+  grub_uint32_t cs = d->spec.cluster_size;
+  grub_uint64_t fat_bytes = (grub_uint64_t) d->fat_sectors * HOST_SECTOR_SIZE;
+
+  if (offset > d->size || len > d->size - offset)
+    return -1;
+  host_counters.file_bytes_read += len;
+  while (len)
+  {
+    grub_size_t n;
+    if (offset < d->fat_offset)
+    {
+      n = grub_min (len, d->fat_offset - offset);
+      memset (buf, 0, n);
+      if (offset < HOST_SECTOR_SIZE)
+        memcpy (buf, d->boot + offset, grub_min (n, HOST_SECTOR_SIZE - offset));
+    }
+    else if (offset < d->root_offset)
+    {
+      grub_uint64_t within = (offset - d->fat_offset) % fat_bytes;
+      n = grub_min (len, fat_bytes - within);
+      memcpy (buf, d->fat + within, n);
+    }
+    else if (offset < d->data_offset)
+    {
+      n = grub_min (len, d->data_offset - offset);
+      memcpy (buf, d->nodes[0].dir + (offset - d->root_offset), n);
+    }
+    else
+    {
+      grub_uint32_t cluster = (offset - d->data_offset) / cs + 2;
+      grub_uint32_t within = (offset - d->data_offset) % cs;
+      int owner = d->cluster_node[cluster];
+      grub_uint32_t index = d->cluster_index[cluster];
+      // extend over the following clusters of the same owner
+      n = cs - within;
+      while (n < len && cluster + 1 < d->cluster_count + 2
+             && d->cluster_node[cluster + 1] == owner && d->cluster_index[cluster + 1] == index + 1)
+      {
+        cluster++;
+        index++;
+        n += cs;
+      }
+      n = grub_min (n, len);
+      grub_uint64_t node_offset = (grub_uint64_t) d->cluster_index[(offset - d->data_offset) / cs + 2] * cs + within;
+      memset (buf, 0, n);
+      if (owner >= 0 && d->nodes[owner].is_dir)
+        memcpy (buf, d->nodes[owner].dir + node_offset, n);
+      else if (owner >= 0 && node_offset < d->nodes[owner].size)
+      {
+        grub_size_t avail = grub_min ((grub_uint64_t) n, d->nodes[owner].size - node_offset);
+        if (pread (d->fds[owner], buf, avail, node_offset) != (ssize_t) avail)
+          return -1;
+      }
+    }
+    offset += n;
+    buf += n;
+    len -= n;
+  }
+  return 0;
+}
+
+/*
+ * GRUB devices and disks.
+ */
+
+char*
+grub_file_get_device_name (const char* name)
+{
+  const char* end;
+  if (name[0] != '(')
+    return NULL;
+  end = strchr (name, ')');
+  if (!end)
+  {
+    grub_error (GRUB_ERR_BAD_FILENAME, "missing `)'");
+    return NULL;
+  }
+  return grub_strndup (name + 1, end - name - 1);
+}
+
+grub_device_t
+grub_device_open (const char* name)
+{
+  grub_device_t dev;
+  if (!host_disk)
+  {
+    grub_error (GRUB_ERR_UNKNOWN_DEVICE, "disk `%s' not found", name);
+    return NULL;
+  }
+  dev = grub_zalloc (sizeof (*dev) + sizeof (struct grub_disk));
+  dev->disk = (grub_disk_t) (dev + 1);
+  dev->disk->name = "hd0";
+  dev->disk->data = host_disk;
+  return dev;
+}
+
+grub_err_t
+grub_device_close (grub_device_t device)
+{
+  grub_free (device);
+  return grub_errno;
+}
+
+grub_err_t
+grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector, grub_off_t offset, grub_size_t size, void* buf)
+{
+  host_counters.read_calls++;
+  host_read_elapse ();
+  if (vdisk_read (disk->data, sector * GRUB_DISK_SECTOR_SIZE + offset, size, buf) != 0)
+    return grub_error (GRUB_ERR_OUT_OF_RANGE, "attempt to read outside of disk `%s'", disk->name);
+  return GRUB_ERR_NONE;
+}
+
+/*
+ * The GRUB filesystem of the disk: directories are listed from the ESP root.
+ */
+
+static grub_err_t
+host_fs_dir (grub_device_t device __attribute__ ((unused)), const char* path, grub_fs_dir_hook_t hook, void* hook_data)
+{
+  char host_path[4096];
+  struct dirent* de;
+  DIR* dir;
+
+  snprintf (host_path, sizeof (host_path), "%s%s", host_esp_root (), path);
+  dir = opendir (host_path);
+  if (!dir)
+    return grub_error (GRUB_ERR_FILE_NOT_FOUND, "file `%s' not found", path);
+  host_counters.dir_walks++;
+  while ((de = readdir (dir)))
+  {
+    struct grub_dirhook_info info = { .dir = de->d_type == DT_DIR, .case_insensitive = 1 };
+    if (strcmp (de->d_name, ".") == 0 || strcmp (de->d_name, "..") == 0)
+      continue;
+    host_counters.dir_entries++;
+    if (hook (de->d_name, &info, hook_data))
+      break;
+  }
+  closedir (dir);
+  return GRUB_ERR_NONE;
+}
+
+static struct grub_fs host_fs = { .name = "fat", .fs_dir = host_fs_dir };
+
+grub_fs_t
+grub_fs_probe (grub_device_t device)
+{
+  if (!device->disk || device->disk->data != host_disk)
+  {
+    grub_error (GRUB_ERR_UNKNOWN_FS, "unknown filesystem");
+    return NULL;
+  }
+  return &host_fs;
+}
+
+grub_efi_handle_t
+grub_efidisk_get_device_handle (grub_disk_t disk)
+{
+  return disk->data == host_disk ? &host_disk_handle : NULL;
+}
+
+/*
+ * EFI_BLOCK_IO_PROTOCOL
+ */
+
+static grub_efi_block_io_media_t host_media = { .media_present = 1, .block_size = HOST_SECTOR_SIZE };
+
+static grub_efi_status_t
+host_read_blocks (struct grub_efi_block_io* this __attribute__ ((unused)),
+                  grub_efi_uint32_t media_id __attribute__ ((unused)),
+                  grub_efi_lba_t lba, grub_efi_uintn_t buffer_size, void* buffer)
+{
+  host_counters.read_calls++;
+  host_read_elapse ();
+  if (!host_disk || buffer_size % host_media.block_size)
+    return GRUB_EFI_INVALID_PARAMETER;
+  if (host_media.io_align > 1 && ((grub_addr_t) buffer & (host_media.io_align - 1)))
+    return GRUB_EFI_INVALID_PARAMETER;
+  if (vdisk_read (host_disk, lba * host_media.block_size, buffer_size, buffer) != 0)
+    return GRUB_EFI_DEVICE_ERROR;
+  return GRUB_EFI_SUCCESS;
+}
+
+static grub_efi_block_io_t host_block_io = {
+  .media = &host_media,
+  .read_blocks = host_read_blocks,
+};
+
+/*
+ * EFI_SIMPLE_FILE_SYSTEM_PROTOCOL, serving the host files.
+ */
+
+struct host_efi_file
+{
+  struct hackbgrt_efi_file file;
+  int fd;
+  grub_uint64_t position;
+  grub_uint64_t size;
+};
+
+static grub_efi_status_t host_file_open (struct hackbgrt_efi_file* this, struct hackbgrt_efi_file** new_handle,
+                                         grub_efi_char16_t* file_name, grub_efi_uint64_t open_mode,
+                                         grub_efi_uint64_t attributes);
+
+static grub_efi_status_t
+host_file_close (struct hackbgrt_efi_file* this)
+{
+  struct host_efi_file* f = (struct host_efi_file*) this;
+  if (f->fd >= 0)
+    close (f->fd);
+  free (f);
+  return GRUB_EFI_SUCCESS;
+}
+
+static grub_efi_status_t
+host_file_read (struct hackbgrt_efi_file* this, grub_efi_uintn_t* buffer_size, void* buffer)
+{
+  struct host_efi_file* f = (struct host_efi_file*) this;
+  ssize_t n;
+  host_counters.read_calls++;
+  host_read_elapse ();
+  if (f->fd < 0)
+    return GRUB_EFI_UNSUPPORTED;
+  n = pread (f->fd, buffer, *buffer_size, f->position);
+  if (n < 0)
+    return GRUB_EFI_DEVICE_ERROR;
+  f->position += n;
+  *buffer_size = n;
+  host_counters.file_bytes_read += n;
+  return GRUB_EFI_SUCCESS;
+}
+
+static grub_efi_status_t
+host_file_get_position (struct hackbgrt_efi_file* this, grub_efi_uint64_t* position)
+{
+  *position = ((struct host_efi_file*) this)->position;
+  return GRUB_EFI_SUCCESS;
+}
+
+static grub_efi_status_t
+host_file_set_position (struct hackbgrt_efi_file* this, grub_efi_uint64_t position)
+{
+  struct host_efi_file* f = (struct host_efi_file*) this;
+  f->position = position == HACKBGRT_EFI_FILE_POSITION_END ? f->size : position;
+  return GRUB_EFI_SUCCESS;
+}
+
+static struct host_efi_file*
+host_file_new (int fd, grub_uint64_t size)
+{
+  struct host_efi_file* f = calloc (1, sizeof (*f));
+  f->file.open = host_file_open;
+  f->file.close = host_file_close;
+  f->file.read = host_file_read;
+  f->file.get_position = host_file_get_position;
+  f->file.set_position = host_file_set_position;
+  f->fd = fd;
+  f->size = size;
+  return f;
+}
+
+static grub_efi_status_t
+host_file_open (struct hackbgrt_efi_file* this __attribute__ ((unused)), struct hackbgrt_efi_file** new_handle,
+                grub_efi_char16_t* file_name, grub_efi_uint64_t open_mode,
+                grub_efi_uint64_t attributes __attribute__ ((unused)))
+{
+  char path[4096];
+  grub_size_t len = snprintf (path, sizeof (path), "%s", host_esp_root ());
+  struct stat st;
+  int fd;
+
+  if (open_mode != HACKBGRT_EFI_FILE_MODE_READ)
+    return GRUB_EFI_UNSUPPORTED;
+  for (; *file_name && len + 1 < sizeof (path); file_name++)
+    path[len++] = *file_name == '\\' ? '/' : *file_name < 0x80 ? (char) *file_name : '?';
+  path[len] = '\0';
+  fd = open (path, O_RDONLY);
+  if (fd < 0)
+    return GRUB_EFI_NOT_FOUND;
+  fstat (fd, &st);
+  host_counters.file_opens++;
+  *new_handle = &host_file_new (fd, st.st_size)->file;
+  return GRUB_EFI_SUCCESS;
+}
+
+static grub_efi_status_t
+host_open_volume (struct hackbgrt_efi_simple_file_system* this __attribute__ ((unused)),
+                  struct hackbgrt_efi_file** root)
+{
+  *root = &host_file_new (-1, 0)->file;
+  return GRUB_EFI_SUCCESS;
+}
+
+static struct hackbgrt_efi_simple_file_system host_simple_file_system = {
+  .open_volume = host_open_volume,
+};
+
+void*
+host_disk_open_protocol (grub_efi_handle_t handle, grub_efi_guid_t* protocol)
+{
+  static const grub_efi_guid_t block_io_guid = GRUB_EFI_BLOCK_IO_GUID;
+  static const grub_efi_guid_t simple_file_system_guid = HACKBGRT_EFI_SIMPLE_FILE_SYSTEM_GUID;
+
+  if (handle != &host_disk_handle || !host_disk)
+    return NULL;
+  host_media.io_align = host_disk->spec.io_align;
+  host_media.last_block = host_disk->size / HOST_SECTOR_SIZE - 1;
+  if (memcmp (protocol, &block_io_guid, sizeof (*protocol)) == 0)
+    return &host_block_io;
+  if (memcmp (protocol, &simple_file_system_guid, sizeof (*protocol)) == 0)
+    return &host_simple_file_system;
+  return NULL;
+}
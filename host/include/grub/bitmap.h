@@ -0,0 +1,25 @@
+/* Host stand-in for <grub/bitmap.h>. */
+#pragma once
+
+#include <grub/err.h>
+#include <grub/types.h>
+#include <grub/video.h>
+
+struct grub_video_bitmap
+{
+  struct grub_video_mode_info mode_info;
+  void* data;
+};
+
+/**
+ * Decoded with libpng on the host; like GRUB with the png module loaded,
+ * only the .png extension is recognized.
+ */
+grub_err_t grub_video_bitmap_load (struct grub_video_bitmap** bitmap, const char* filename);
+grub_err_t grub_video_bitmap_destroy (struct grub_video_bitmap* bitmap);
+
+static inline void*
+grub_video_bitmap_get_data (struct grub_video_bitmap* bitmap)
+{
+  return bitmap ? bitmap->data : 0;
+}
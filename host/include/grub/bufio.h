@@ -0,0 +1,4 @@
+/* Host stand-in for <grub/bufio.h>. */
+#pragma once
+
+#include <grub/file.h>
@@ -0,0 +1,48 @@
+/* Host stand-in for <grub/charset.h>. */
+#pragma once
+
+#include <grub/types.h>
+
+/**
+ * Convert UTF-8 to UTF-16, as the GRUB inline of the same name; invalid
+ * sequences become '?'.
+ *
+ * @return The number of UTF-16 code units written.
+ */
+static inline grub_size_t
+grub_utf8_to_utf16 (grub_uint16_t* dest, grub_size_t destsize,
+                    const grub_uint8_t* src, grub_size_t srcsize,
+                    const grub_uint8_t** srcend)
+{
+  grub_uint16_t* p = dest;
+  const grub_uint8_t* end = srcsize == (grub_size_t) -1 ? 0 : src + srcsize;
+
+  while ((end ? src < end : *src) && p < dest + destsize)
+  {
+    grub_uint32_t code = *src++;
+    int extra = code >= 0xf0 ? 3 : code >= 0xe0 ? 2 : code >= 0xc0 ? 1 : 0;
+    if (code >= 0x80 && code < 0xc0)
+      code = '?';
+    else if (extra)
+    {
+      code &= 0x3f >> extra;
+      for (; extra && (end ? src < end : *src) && (*src & 0xc0) == 0x80; extra--)
+        code = (code << 6) | (*src++ & 0x3f);
+      if (extra)
+        code = '?';
+    }
+    if (code >= 0x10000)
+    {
+      if (p + 1 >= dest + destsize)
+        break;
+      code -= 0x10000;
+      *p++ = 0xd800 | (code >> 10);
+      *p++ = 0xdc00 | (code & 0x3ff);
+    }
+    else
+      *p++ = code;
+  }
+  if (srcend)
+    *srcend = src;
+  return p - dest;
+}
@@ -0,0 +1,14 @@
+/* Host stand-in for <grub/device.h>. */
+#pragma once
+
+#include <grub/disk.h>
+
+struct grub_device
+{
+  grub_disk_t disk;
+  void* net;
+};
+typedef struct grub_device* grub_device_t;
+
+grub_device_t grub_device_open (const char* name);
+grub_err_t grub_device_close (grub_device_t device);
@@ -0,0 +1,19 @@
+/* Host stand-in for <grub/disk.h>; the harness has a single virtual FAT disk. */
+#pragma once
+
+#include <grub/types.h>
+#include <grub/err.h>
+#include <grub/mm.h>
+
+#define GRUB_DISK_SECTOR_SIZE 0x200
+#define GRUB_DISK_SECTOR_BITS 9
+
+struct grub_disk
+{
+  const char* name;
+  void* data;
+};
+typedef struct grub_disk* grub_disk_t;
+
+grub_err_t grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
+                           grub_off_t offset, grub_size_t size, void* buf);
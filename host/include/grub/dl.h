@@ -0,0 +1,10 @@
+/*
+ * Host stand-in for <grub/dl.h>.
+ *
+ * Module init/fini become plain functions the harness calls explicitly.
+ */
+#pragma once
+
+#define GRUB_MOD_LICENSE(license)
+#define GRUB_MOD_INIT(name) void grub_mod_init_##name (void); void grub_mod_init_##name (void)
+#define GRUB_MOD_FINI(name) void grub_mod_fini_##name (void); void grub_mod_fini_##name (void)
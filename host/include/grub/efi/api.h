@@ -0,0 +1,233 @@
+/*
+ * Host stand-in for <grub/efi/api.h>.
+ *
+ * Structures keep the GRUB member names; only the services the hackbgrt
+ * sources call are present, and the harness implements them in mock_efi.c.
+ */
+#pragma once
+
+#include <grub/types.h>
+
+typedef grub_uint8_t  grub_efi_boolean_t;
+typedef grub_int8_t   grub_efi_int8_t;
+typedef grub_uint8_t  grub_efi_uint8_t;
+typedef grub_int16_t  grub_efi_int16_t;
+typedef grub_uint16_t grub_efi_uint16_t;
+typedef grub_int32_t  grub_efi_int32_t;
+typedef grub_uint32_t grub_efi_uint32_t;
+typedef grub_int64_t  grub_efi_int64_t;
+typedef grub_uint64_t grub_efi_uint64_t;
+typedef grub_uint8_t  grub_efi_char8_t;
+typedef grub_uint16_t grub_efi_char16_t;
+typedef grub_size_t   grub_efi_uintn_t;
+typedef grub_ssize_t  grub_efi_intn_t;
+typedef grub_efi_uintn_t grub_efi_status_t;
+typedef grub_efi_uint64_t grub_efi_physical_address_t;
+typedef grub_efi_uint64_t grub_efi_virtual_address_t;
+typedef grub_efi_uint64_t grub_efi_lba_t;
+typedef void* grub_efi_handle_t;
+typedef void* grub_efi_event_t;
+
+#define GRUB_EFI_ERROR_CODE(value) ((((grub_efi_status_t) 1) << (sizeof (grub_efi_status_t) * 8 - 1)) | (value))
+
+#define GRUB_EFI_SUCCESS          0
+#define GRUB_EFI_LOAD_ERROR       GRUB_EFI_ERROR_CODE (1)
+#define GRUB_EFI_INVALID_PARAMETER GRUB_EFI_ERROR_CODE (2)
+#define GRUB_EFI_UNSUPPORTED      GRUB_EFI_ERROR_CODE (3)
+#define GRUB_EFI_BUFFER_TOO_SMALL GRUB_EFI_ERROR_CODE (5)
+#define GRUB_EFI_NOT_READY        GRUB_EFI_ERROR_CODE (6)
+#define GRUB_EFI_DEVICE_ERROR     GRUB_EFI_ERROR_CODE (7)
+#define GRUB_EFI_OUT_OF_RESOURCES GRUB_EFI_ERROR_CODE (9)
+#define GRUB_EFI_NOT_FOUND        GRUB_EFI_ERROR_CODE (14)
+#define GRUB_EFI_NOT_STARTED      GRUB_EFI_ERROR_CODE (19)
+
+struct grub_efi_guid
+{
+  grub_uint32_t data1;
+  grub_uint16_t data2;
+  grub_uint16_t data3;
+  grub_uint8_t data4[8];
+} __attribute__ ((aligned (8)));
+typedef struct grub_efi_guid grub_efi_guid_t;
+
+struct grub_efi_packed_guid
+{
+  grub_uint32_t data1;
+  grub_uint16_t data2;
+  grub_uint16_t data3;
+  grub_uint8_t data4[8];
+} GRUB_PACKED;
+typedef struct grub_efi_packed_guid grub_efi_packed_guid_t;
+
+#define GRUB_EFI_ACPI_TABLE_GUID \
+  { 0xeb9d2d30, 0x2d88, 0x11d3, \
+    { 0x9a, 0x16, 0x00, 0x90, 0x27, 0x3f, 0xc1, 0x4d } \
+  }
+
+#define GRUB_EFI_ACPI_20_TABLE_GUID \
+  { 0x8868e871, 0xe4f1, 0x11d3, \
+    { 0xbc, 0x22, 0x00, 0x80, 0xc7, 0x3c, 0x88, 0x81 } \
+  }
+
+#define GRUB_EFI_SMBIOS_TABLE_GUID \
+  { 0xeb9d2d31, 0x2d88, 0x11d3, \
+    { 0x9a, 0x16, 0x00, 0x90, 0x27, 0x3f, 0xc1, 0x4d } \
+  }
+
+#define GRUB_EFI_SMBIOS3_TABLE_GUID \
+  { 0xf2fd1544, 0x9794, 0x4a2c, \
+    { 0x99, 0x2e, 0xe5, 0xbb, 0xcf, 0x20, 0xe3, 0x94 } \
+  }
+
+#define GRUB_EFI_BLOCK_IO_GUID \
+  { 0x964e5b21, 0x6459, 0x11d2, \
+    { 0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } \
+  }
+
+enum grub_efi_allocate_type
+{
+  GRUB_EFI_ALLOCATE_ANY_PAGES,
+  GRUB_EFI_ALLOCATE_MAX_ADDRESS,
+  GRUB_EFI_ALLOCATE_ADDRESS,
+  GRUB_EFI_MAX_ALLOCATION_TYPE
+};
+typedef enum grub_efi_allocate_type grub_efi_allocate_type_t;
+
+enum grub_efi_memory_type
+{
+  GRUB_EFI_RESERVED_MEMORY_TYPE,
+  GRUB_EFI_LOADER_CODE,
+  GRUB_EFI_LOADER_DATA,
+  GRUB_EFI_BOOT_SERVICES_CODE,
+  GRUB_EFI_BOOT_SERVICES_DATA,
+  GRUB_EFI_RUNTIME_SERVICES_CODE,
+  GRUB_EFI_RUNTIME_SERVICES_DATA,
+  GRUB_EFI_CONVENTIONAL_MEMORY,
+  GRUB_EFI_UNUSABLE_MEMORY,
+  GRUB_EFI_ACPI_RECLAIM_MEMORY,
+  GRUB_EFI_ACPI_MEMORY_NVS,
+  GRUB_EFI_MEMORY_MAPPED_IO,
+  GRUB_EFI_MEMORY_MAPPED_IO_PORT_SPACE,
+  GRUB_EFI_PAL_CODE,
+  GRUB_EFI_PERSISTENT_MEMORY,
+  GRUB_EFI_MAX_MEMORY_TYPE
+};
+typedef enum grub_efi_memory_type grub_efi_memory_type_t;
+
+enum grub_efi_locate_search_type
+{
+  GRUB_EFI_ALL_HANDLES,
+  GRUB_EFI_BY_REGISTER_NOTIFY,
+  GRUB_EFI_BY_PROTOCOL
+};
+typedef enum grub_efi_locate_search_type grub_efi_locate_search_type_t;
+
+#define GRUB_EFI_VARIABLE_NON_VOLATILE       0x0000000000000001
+#define GRUB_EFI_VARIABLE_BOOTSERVICE_ACCESS 0x0000000000000002
+#define GRUB_EFI_VARIABLE_RUNTIME_ACCESS     0x0000000000000004
+
+#define GRUB_EFI_OPEN_PROTOCOL_BY_HANDLE_PROTOCOL 0x00000001
+#define GRUB_EFI_OPEN_PROTOCOL_GET_PROTOCOL       0x00000002
+
+struct grub_efi_boot_services
+{
+  grub_efi_status_t
+  (*allocate_pages) (grub_efi_allocate_type_t type,
+                     grub_efi_memory_type_t memory_type,
+                     grub_efi_uintn_t pages,
+                     grub_efi_physical_address_t* memory);
+  grub_efi_status_t
+  (*free_pages) (grub_efi_physical_address_t memory,
+                 grub_efi_uintn_t pages);
+  grub_efi_status_t
+  (*allocate_pool) (grub_efi_memory_type_t pool_type,
+                    grub_efi_uintn_t size,
+                    void** buffer);
+  grub_efi_status_t
+  (*free_pool) (void* buffer);
+  grub_efi_status_t
+  (*stall) (grub_efi_uintn_t microseconds);
+  grub_efi_status_t
+  (*locate_protocol) (grub_efi_guid_t* protocol,
+                      void* registration,
+                      void** protocol_interface);
+};
+typedef struct grub_efi_boot_services grub_efi_boot_services_t;
+
+struct grub_efi_runtime_services
+{
+  grub_efi_status_t
+  (*get_variable) (grub_efi_char16_t* variable_name,
+                   const grub_efi_guid_t* vendor_guid,
+                   grub_efi_uint32_t* attributes,
+                   grub_efi_uintn_t* data_size,
+                   void* data);
+  grub_efi_status_t
+  (*set_variable) (grub_efi_char16_t* variable_name,
+                   const grub_efi_guid_t* vendor_guid,
+                   grub_efi_uint32_t attributes,
+                   grub_efi_uintn_t data_size,
+                   void* data);
+};
+typedef struct grub_efi_runtime_services grub_efi_runtime_services_t;
+
+struct grub_efi_block_io_media
+{
+  grub_uint32_t media_id;
+  grub_efi_boolean_t removable_media;
+  grub_efi_boolean_t media_present;
+  grub_efi_boolean_t logical_partition;
+  grub_efi_boolean_t read_only;
+  grub_efi_boolean_t write_caching;
+  grub_uint8_t pad[3];
+  grub_uint32_t block_size;
+  grub_uint32_t io_align;
+  grub_uint8_t pad2[4];
+  grub_efi_lba_t last_block;
+};
+typedef struct grub_efi_block_io_media grub_efi_block_io_media_t;
+
+struct grub_efi_block_io
+{
+  grub_efi_uint64_t revision;
+  grub_efi_block_io_media_t* media;
+  grub_efi_status_t (*reset) (struct grub_efi_block_io* this,
+                              grub_efi_boolean_t extended_verification);
+  grub_efi_status_t (*read_blocks) (struct grub_efi_block_io* this,
+                                    grub_efi_uint32_t media_id,
+                                    grub_efi_lba_t lba,
+                                    grub_efi_uintn_t buffer_size,
+                                    void* buffer);
+  grub_efi_status_t (*write_blocks) (struct grub_efi_block_io* this,
+                                     grub_efi_uint32_t media_id,
+                                     grub_efi_lba_t lba,
+                                     grub_efi_uintn_t buffer_size,
+                                     void* buffer);
+  grub_efi_status_t (*flush_blocks) (struct grub_efi_block_io* this);
+};
+typedef struct grub_efi_block_io grub_efi_block_io_t;
+
+struct grub_efi_configuration_table
+{
+  grub_efi_packed_guid_t vendor_guid;
+  void* vendor_table;
+} GRUB_PACKED;
+typedef struct grub_efi_configuration_table grub_efi_configuration_table_t;
+
+struct grub_efi_system_table
+{
+  grub_efi_runtime_services_t* runtime_services;
+  grub_efi_boot_services_t* boot_services;
+  grub_efi_uintn_t num_table_entries;
+  grub_efi_configuration_table_t* configuration_table;
+};
+typedef struct grub_efi_system_table grub_efi_system_table_t;
+
+#define efi_call_0(func)                   func ()
+#define efi_call_1(func, a)                func (a)
+#define efi_call_2(func, a, b)             func (a, b)
+#define efi_call_3(func, a, b, c)          func (a, b, c)
+#define efi_call_4(func, a, b, c, d)       func (a, b, c, d)
+#define efi_call_5(func, a, b, c, d, e)    func (a, b, c, d, e)
+#define efi_call_6(func, a, b, c, d, e, f) func (a, b, c, d, e, f)
+#define efi_call_7(func, a, b, c, d, e, f, g) func (a, b, c, d, e, f, g)
@@ -0,0 +1,7 @@
+/* Host stand-in for <grub/efi/disk.h>. */
+#pragma once
+
+#include <grub/disk.h>
+#include <grub/efi/api.h>
+
+grub_efi_handle_t grub_efidisk_get_device_handle (grub_disk_t disk);
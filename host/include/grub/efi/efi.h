@@ -0,0 +1,14 @@
+/* Host stand-in for <grub/efi/efi.h>. */
+#pragma once
+
+#include <grub/efi/api.h>
+
+extern grub_efi_system_table_t* grub_efi_system_table;
+
+grub_efi_handle_t* grub_efi_locate_handle (grub_efi_locate_search_type_t search_type,
+                                           grub_efi_guid_t* protocol,
+                                           void* search_key,
+                                           grub_efi_uintn_t* num_handles);
+void* grub_efi_open_protocol (grub_efi_handle_t handle,
+                              grub_efi_guid_t* protocol,
+                              grub_efi_uint32_t attributes);
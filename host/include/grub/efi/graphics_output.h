@@ -0,0 +1,64 @@
+/* Host stand-in for <grub/efi/graphics_output.h>. */
+#pragma once
+
+#include <grub/efi/api.h>
+
+#define GRUB_EFI_GOP_GUID \
+  { 0x9042a9de, 0x23dc, 0x4a38, { 0x96, 0xfb, 0x7a, 0xde, 0xd0, 0x80, 0x51, 0x6a } }
+
+typedef enum
+{
+  GRUB_EFI_GOT_RGBA8,
+  GRUB_EFI_GOT_BGRA8,
+  GRUB_EFI_GOT_BITMASK
+} grub_efi_gop_pixel_format_t;
+
+struct grub_efi_gop_pixel_bitmask
+{
+  grub_uint32_t r;
+  grub_uint32_t g;
+  grub_uint32_t b;
+  grub_uint32_t a;
+};
+
+struct grub_efi_gop_mode_info
+{
+  grub_efi_uint32_t version;
+  grub_efi_uint32_t width;
+  grub_efi_uint32_t height;
+  grub_efi_gop_pixel_format_t pixel_format;
+  struct grub_efi_gop_pixel_bitmask pixel_bitmask;
+  grub_efi_uint32_t pixels_per_scanline;
+};
+
+struct grub_efi_gop_mode
+{
+  grub_efi_uint32_t max_mode;
+  grub_efi_uint32_t mode;
+  struct grub_efi_gop_mode_info* info;
+  grub_efi_uintn_t info_size;
+  grub_efi_physical_address_t fb_base;
+  grub_efi_uintn_t fb_size;
+};
+
+struct grub_efi_gop_blt_pixel
+{
+  grub_uint8_t blue;
+  grub_uint8_t green;
+  grub_uint8_t red;
+  grub_uint8_t reserved;
+};
+
+struct grub_efi_gop
+{
+  grub_efi_status_t
+  (*query_mode) (struct grub_efi_gop* this,
+                 grub_efi_uint32_t mode_number,
+                 grub_efi_uintn_t* size_of_info,
+                 struct grub_efi_gop_mode_info** info);
+  grub_efi_status_t
+  (*set_mode) (struct grub_efi_gop* this,
+               grub_efi_uint32_t mode_number);
+  void* blt;
+  struct grub_efi_gop_mode* mode;
+};
@@ -0,0 +1,8 @@
+/* Host stand-in for <grub/env.h>: a flat table of variables. */
+#pragma once
+
+#include <grub/err.h>
+
+grub_err_t grub_env_set (const char* name, const char* val);
+const char* grub_env_get (const char* name);
+void grub_env_unset (const char* name);
@@ -0,0 +1,62 @@
+/* Host stand-in for <grub/extcmd.h>. */
+#pragma once
+
+#include <grub/types.h>
+#include <grub/err.h>
+
+typedef enum grub_arg_type
+{
+  ARG_TYPE_NONE,
+  ARG_TYPE_STRING,
+  ARG_TYPE_INT,
+  ARG_TYPE_DEVICE,
+  ARG_TYPE_FILE,
+  ARG_TYPE_DIR,
+  ARG_TYPE_PATHNAME
+} grub_arg_type_t;
+
+struct grub_arg_option
+{
+  const char* longarg;
+  int shortarg;
+  int flags;
+  const char* doc;
+  const char* arg;
+  grub_arg_type_t type;
+};
+
+struct grub_arg_list
+{
+  int set;
+  union
+  {
+    char* arg;
+    char** args;
+  };
+};
+
+#define GRUB_COMMAND_FLAG_BLOCKS 0x10
+
+struct grub_extcmd;
+struct grub_extcmd_context
+{
+  struct grub_extcmd* extcmd;
+  struct grub_arg_list* state;
+};
+typedef struct grub_extcmd_context* grub_extcmd_context_t;
+
+typedef grub_err_t (*grub_extcmd_func_t) (grub_extcmd_context_t ctxt, int argc, char** args);
+
+struct grub_extcmd
+{
+  const char* name;
+  grub_extcmd_func_t func;
+  const struct grub_arg_option* options;
+};
+typedef struct grub_extcmd* grub_extcmd_t;
+
+grub_extcmd_t grub_register_extcmd (const char* name, grub_extcmd_func_t func,
+                                    unsigned flags, const char* summary,
+                                    const char* description,
+                                    const struct grub_arg_option* parser);
+void grub_unregister_extcmd (grub_extcmd_t cmd);
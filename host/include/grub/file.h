@@ -0,0 +1,42 @@
+/* Host stand-in for <grub/file.h>; files are read from the harness ESP root. */
+#pragma once
+
+#include <grub/types.h>
+#include <grub/err.h>
+#include <grub/mm.h>
+
+enum grub_file_type
+{
+  GRUB_FILE_TYPE_NONE = 0,
+  GRUB_FILE_TYPE_PIXMAP,
+  GRUB_FILE_TYPE_FS_SEARCH,
+  GRUB_FILE_TYPE_CAT,
+  GRUB_FILE_TYPE_NO_DECOMPRESS = 0x10000
+};
+
+struct grub_file
+{
+  char* name;
+  grub_off_t offset;
+  grub_off_t size;
+  void* data;
+};
+typedef struct grub_file* grub_file_t;
+
+grub_file_t grub_file_open (const char* name, enum grub_file_type type);
+grub_ssize_t grub_file_read (grub_file_t file, void* buf, grub_size_t len);
+grub_off_t grub_file_seek (grub_file_t file, grub_off_t offset);
+grub_err_t grub_file_close (grub_file_t file);
+char* grub_file_get_device_name (const char* name);
+
+static inline grub_off_t
+grub_file_size (const grub_file_t file)
+{
+  return file->size;
+}
+
+static inline grub_off_t
+grub_file_tell (const grub_file_t file)
+{
+  return file->offset;
+}
@@ -0,0 +1,27 @@
+/* Host stand-in for <grub/fs.h>: the filesystem lists the harness ESP root. */
+#pragma once
+
+#include <grub/device.h>
+#include <grub/err.h>
+#include <grub/types.h>
+
+struct grub_dirhook_info
+{
+  unsigned dir:1;
+  unsigned mtimeset:1;
+  unsigned case_insensitive:1;
+  unsigned inodeset:1;
+  grub_int32_t mtime;
+  grub_uint64_t inode;
+};
+
+typedef int (*grub_fs_dir_hook_t) (const char* filename, const struct grub_dirhook_info* info, void* data);
+
+struct grub_fs
+{
+  const char* name;
+  grub_err_t (*fs_dir) (grub_device_t device, const char* path, grub_fs_dir_hook_t hook, void* hook_data);
+};
+typedef struct grub_fs* grub_fs_t;
+
+grub_fs_t grub_fs_probe (grub_device_t device);
@@ -0,0 +1,5 @@
+/* Host stand-in for <grub/i18n.h>. */
+#pragma once
+
+#define N_(str) str
+#define _(str) str
@@ -0,0 +1,14 @@
+/* Host stand-in for <grub/i386/tsc.h>: the TSC, without the serializing CPUID. */
+#pragma once
+
+#include <x86intrin.h>
+#include <grub/types.h>
+
+static inline grub_uint64_t
+grub_get_tsc (void)
+{
+  return __rdtsc ();
+}
+
+/* In ms per 2^32 ticks, set by GRUB when it calibrates the TSC at boot. */
+extern grub_uint32_t grub_tsc_rate;
@@ -0,0 +1,19 @@
+/* Host stand-in for <grub/loader.h>; hooks run from host_loader_boot(). */
+#pragma once
+
+#include <grub/err.h>
+
+typedef enum
+{
+  GRUB_LOADER_PREBOOT_HOOK_PRIO_NORMAL = 400,
+  GRUB_LOADER_PREBOOT_HOOK_PRIO_CONSOLE = 300,
+  GRUB_LOADER_PREBOOT_HOOK_PRIO_VIDEO = 200,
+  GRUB_LOADER_PREBOOT_HOOK_PRIO_MEMORY = 100
+} grub_loader_preboot_hook_prio_t;
+
+struct grub_preboot;
+
+struct grub_preboot* grub_loader_register_preboot_hook (grub_err_t (*preboot_func) (int noreturn),
+                                                        grub_err_t (*preboot_rest_func) (void),
+                                                        grub_loader_preboot_hook_prio_t prio);
+void grub_loader_unregister_preboot_hook (struct grub_preboot* hnd);
@@ -0,0 +1,51 @@
+/* Host stand-in for <grub/misc.h>, backed by libc. */
+#pragma once
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <grub/types.h>
+#include <grub/err.h>
+#include <grub/i18n.h>
+
+#define grub_memcmp  memcmp
+#define grub_memcpy  memcpy
+#define grub_memmove memmove
+#define grub_memset  memset
+#define grub_strlen  strlen
+#define grub_strcmp  strcmp
+#define grub_strncmp strncmp
+#define grub_strchr  strchr
+#define grub_strrchr strrchr
+#define grub_strcpy  strcpy
+#define grub_strncpy strncpy
+#define grub_snprintf snprintf
+#define grub_printf  printf
+
+#define grub_min(a, b) (((a) < (b)) ? (a) : (b))
+#define grub_max(a, b) (((a) > (b)) ? (a) : (b))
+
+#define ARRAY_SIZE(array) (sizeof (array) / sizeof (array[0]))
+#define COMPILE_TIME_ASSERT(cond) switch (0) { case 1: case !(cond): ; }
+#define ALIGN_UP(addr, align) (((addr) + (typeof (addr)) (align) - 1) & ~((typeof (addr)) (align) - 1))
+
+static inline grub_uint64_t
+grub_divmod64 (grub_uint64_t n, grub_uint64_t d, grub_uint64_t* r)
+{
+  if (r)
+    *r = n % d;
+  return n / d;
+}
+
+unsigned long grub_strtoul (const char* str, char** end, int base);
+unsigned long long grub_strtoull (const char* str, char** end, int base);
+char* grub_strdup (const char* s);
+char* grub_strndup (const char* s, grub_size_t n);
+char* grub_xasprintf (const char* fmt, ...)
+  __attribute__ ((format (printf, 1, 2)));
+
+void grub_real_dprintf (const char* file, const int line, const char* condition,
+                        const char* fmt, ...)
+  __attribute__ ((format (printf, 4, 5)));
+#define grub_dprintf(condition, ...) grub_real_dprintf (__FILE__, __LINE__, condition, __VA_ARGS__)
@@ -0,0 +1,9 @@
+/* Host stand-in for <grub/mm.h>; allocations are counted by the harness. */
+#pragma once
+
+#include <grub/types.h>
+
+void* grub_malloc (grub_size_t size);
+void* grub_zalloc (grub_size_t size);
+void* grub_realloc (void* ptr, grub_size_t size);
+void grub_free (void* ptr);
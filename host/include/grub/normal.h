@@ -0,0 +1,2 @@
+/* Host stand-in for <grub/normal.h>. */
+#pragma once
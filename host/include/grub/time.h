@@ -0,0 +1,6 @@
+/* Host stand-in for <grub/time.h>. */
+#pragma once
+
+#include <grub/types.h>
+
+grub_uint64_t grub_get_time_ms (void);
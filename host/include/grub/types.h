@@ -0,0 +1,33 @@
+/*
+ * Host stand-in for <grub/types.h>.
+ *
+ * Only what the hackbgrt sources use is declared here; sizes follow the
+ * x86_64-efi target.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define GRUB_PACKED __attribute__ ((packed))
+
+typedef int8_t    grub_int8_t;
+typedef int16_t   grub_int16_t;
+typedef int32_t   grub_int32_t;
+typedef int64_t   grub_int64_t;
+typedef uint8_t   grub_uint8_t;
+typedef uint16_t  grub_uint16_t;
+typedef uint32_t  grub_uint32_t;
+typedef uint64_t  grub_uint64_t;
+typedef uint64_t  grub_addr_t;
+typedef size_t    grub_size_t;
+typedef ptrdiff_t grub_ssize_t;
+typedef uint64_t  grub_off_t;
+typedef uint64_t  grub_disk_addr_t;
+
+#define grub_cpu_to_le16(x) ((grub_uint16_t) (x))
+#define grub_cpu_to_le32(x) ((grub_uint32_t) (x))
+#define grub_cpu_to_le64(x) ((grub_uint64_t) (x))
+#define grub_le_to_cpu16(x) ((grub_uint16_t) (x))
+#define grub_le_to_cpu32(x) ((grub_uint32_t) (x))
+#define grub_le_to_cpu64(x) ((grub_uint64_t) (x))
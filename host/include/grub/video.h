@@ -0,0 +1,49 @@
+/* Host stand-in for <grub/video.h>. */
+#pragma once
+
+#include <grub/err.h>
+#include <grub/types.h>
+
+enum grub_video_mode_type
+{
+  GRUB_VIDEO_MODE_TYPE_RGB = 0x00000001,
+  GRUB_VIDEO_MODE_TYPE_INDEX_COLOR = 0x00000002,
+  GRUB_VIDEO_MODE_TYPE_1BIT_BITMAP = 0x00000004,
+  GRUB_VIDEO_MODE_TYPE_YUV = 0x00000008,
+  GRUB_VIDEO_MODE_TYPE_ALPHA = 0x00000020,
+  GRUB_VIDEO_MODE_TYPE_DOUBLE_BUFFERED = 0x00000040,
+  GRUB_VIDEO_MODE_TYPE_UPDATING_SWAP = 0x00000080
+};
+
+enum grub_video_blit_format
+{
+  GRUB_VIDEO_BLIT_FORMAT_RGBA_8888 = 0,
+  GRUB_VIDEO_BLIT_FORMAT_BGRA_8888,
+  GRUB_VIDEO_BLIT_FORMAT_RGB_888,
+  GRUB_VIDEO_BLIT_FORMAT_BGR_888,
+  GRUB_VIDEO_BLIT_FORMAT_RGBA,
+  GRUB_VIDEO_BLIT_FORMAT_INDEXCOLOR
+};
+
+struct grub_video_mode_info
+{
+  unsigned int width;
+  unsigned int height;
+  unsigned int mode_type;
+  unsigned int bpp;
+  unsigned int bytes_per_pixel;
+  unsigned int pitch;
+  unsigned int number_of_colors;
+  unsigned int mode_number;
+  unsigned int red_mask_size;
+  unsigned int red_field_pos;
+  unsigned int green_mask_size;
+  unsigned int green_field_pos;
+  unsigned int blue_mask_size;
+  unsigned int blue_field_pos;
+  unsigned int reserved_mask_size;
+  unsigned int reserved_field_pos;
+  enum grub_video_blit_format blit_format;
+};
+
+grub_err_t grub_video_get_info (struct grub_video_mode_info* mode_info);
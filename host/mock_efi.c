@@ -0,0 +1,311 @@
+/*
+ * Fake EFI system table, boot services and GOP for the host harness.
+ *
+ * Pool and page allocations are tracked so the runner can release them
+ * between iterations; stalls are counted instead of slept.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <grub/efi/api.h>
+#include <grub/efi/efi.h>
+#include <grub/efi/graphics_output.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/smbios.h>
+#include "host.h"
+
+struct host_allocation
+{
+  struct host_allocation* next;
+  void* addr;
+  grub_size_t size;
+  int pages;
+};
+
+static struct host_allocation* host_allocations;
+
+static void
+host_track (void* addr, grub_size_t size, int pages)
+{
+  struct host_allocation* a = malloc (sizeof (*a));
+  a->addr = addr;
+  a->size = size;
+  a->pages = pages;
+  a->next = host_allocations;
+  host_allocations = a;
+}
+
+static int
+host_untrack (void* addr)
+{
+  for (struct host_allocation** p = &host_allocations; *p; p = &(*p)->next)
+    if ((*p)->addr == addr)
+    {
+      struct host_allocation* a = *p;
+      *p = a->next;
+      free (a->addr);
+      free (a);
+      return 1;
+    }
+  return 0;
+}
+
+void
+host_efi_release_all (void)
+{
+  while (host_allocations)
+  {
+    struct host_allocation* a = host_allocations;
+    host_allocations = a->next;
+    free (a->addr);
+    free (a);
+  }
+}
+
+static grub_efi_status_t
+host_allocate_pages (grub_efi_allocate_type_t type,
+                     grub_efi_memory_type_t memory_type __attribute__ ((unused)),
+                     grub_efi_uintn_t pages,
+                     grub_efi_physical_address_t* memory)
+{
+  void* addr;
+  if (type != GRUB_EFI_ALLOCATE_ANY_PAGES && type != GRUB_EFI_ALLOCATE_MAX_ADDRESS)
+    return GRUB_EFI_UNSUPPORTED;
+  if (posix_memalign (&addr, 4096, pages * 4096) != 0)
+    return GRUB_EFI_OUT_OF_RESOURCES;
+  host_track (addr, pages * 4096, 1);
+  host_counters.pages_calls++;
+  host_counters.pages_bytes += pages * 4096;
+  *memory = (grub_efi_physical_address_t) (grub_addr_t) addr;
+  return GRUB_EFI_SUCCESS;
+}
+
+static grub_efi_status_t
+host_free_pages (grub_efi_physical_address_t memory,
+                 grub_efi_uintn_t pages __attribute__ ((unused)))
+{
+  return host_untrack ((void*) (grub_addr_t) memory) ? GRUB_EFI_SUCCESS : GRUB_EFI_NOT_FOUND;
+}
+
+static grub_efi_status_t
+host_allocate_pool (grub_efi_memory_type_t pool_type __attribute__ ((unused)),
+                    grub_efi_uintn_t size,
+                    void** buffer)
+{
+  void* addr = malloc (size ? size : 1);
+  if (!addr)
+    return GRUB_EFI_OUT_OF_RESOURCES;
+  host_track (addr, size, 0);
+  host_counters.pool_calls++;
+  host_counters.pool_bytes += size;
+  *buffer = addr;
+  return GRUB_EFI_SUCCESS;
+}
+
+static grub_efi_status_t
+host_free_pool (void* buffer)
+{
+  if (!host_untrack (buffer))
+    return GRUB_EFI_INVALID_PARAMETER;
+  host_counters.pool_frees++;
+  return GRUB_EFI_SUCCESS;
+}
+
+static grub_efi_status_t
+host_stall (grub_efi_uintn_t microseconds)
+{
+  host_counters.stall_us += microseconds;
+  return GRUB_EFI_SUCCESS;
+}
+
+static grub_efi_status_t
+host_locate_protocol (grub_efi_guid_t* protocol,
+                      void* registration __attribute__ ((unused)),
+                      void** protocol_interface)
+{
+  *protocol_interface = host_mp_protocol (protocol);
+  return *protocol_interface ? GRUB_EFI_SUCCESS : GRUB_EFI_NOT_FOUND;
+}
+
+static grub_efi_boot_services_t host_boot_services = {
+  .allocate_pages = host_allocate_pages,
+  .free_pages = host_free_pages,
+  .allocate_pool = host_allocate_pool,
+  .free_pool = host_free_pool,
+  .stall = host_stall,
+  .locate_protocol = host_locate_protocol,
+};
+
+/*
+ * Variables: the last one set, for the telemetry record.
+ */
+
+static grub_efi_char16_t host_variable_name[64];
+static grub_uint32_t host_variable_attributes;
+static grub_uint8_t host_variable_data[1024];
+static grub_efi_uintn_t host_variable_size;
+
+static grub_efi_status_t
+host_set_variable (grub_efi_char16_t* variable_name,
+                   const grub_efi_guid_t* vendor_guid __attribute__ ((unused)),
+                   grub_efi_uint32_t attributes,
+                   grub_efi_uintn_t data_size,
+                   void* data)
+{
+  unsigned i;
+  if (data_size > sizeof (host_variable_data))
+    return GRUB_EFI_OUT_OF_RESOURCES;
+  for (i = 0; i + 1 < ARRAY_SIZE (host_variable_name) && variable_name[i]; i++)
+    host_variable_name[i] = variable_name[i];
+  host_variable_name[i] = 0;
+  host_variable_attributes = attributes;
+  memcpy (host_variable_data, data, data_size);
+  host_variable_size = data_size;
+  return GRUB_EFI_SUCCESS;
+}
+
+const void*
+host_efi_variable (const char* name, grub_uint32_t* attributes, grub_size_t* size)
+{
+  unsigned i;
+  for (i = 0; name[i] && host_variable_name[i] == (grub_efi_char16_t) name[i]; i++)
+    ;
+  if (name[i] || host_variable_name[i] || !host_variable_size)
+    return NULL;
+  *attributes = host_variable_attributes;
+  *size = host_variable_size;
+  return host_variable_data;
+}
+
+void
+host_efi_clear_variable (void)
+{
+  host_variable_size = 0;
+  host_variable_name[0] = 0;
+}
+
+static grub_efi_runtime_services_t host_runtime_services = {
+  .set_variable = host_set_variable,
+};
+
+static grub_efi_system_table_t host_system_table = {
+  .boot_services = &host_boot_services,
+  .runtime_services = &host_runtime_services,
+};
+
+grub_efi_system_table_t* grub_efi_system_table = &host_system_table;
+
+void
+host_set_configuration_table (grub_efi_configuration_table_t* table, grub_efi_uintn_t count)
+{
+  host_system_table.configuration_table = table;
+  host_system_table.num_table_entries = count;
+}
+
+/*
+ * GRUB's smbios module: the entry points of the configuration table, as they are.
+ */
+
+static void*
+host_vendor_table (const grub_efi_packed_guid_t* guid)
+{
+  for (grub_efi_uintn_t i = 0; i < host_system_table.num_table_entries; i++)
+    if (memcmp (&host_system_table.configuration_table[i].vendor_guid, guid, sizeof (*guid)) == 0)
+      return host_system_table.configuration_table[i].vendor_table;
+  return NULL;
+}
+
+struct grub_smbios_eps*
+grub_machine_smbios_get_eps (void)
+{
+  static const grub_efi_packed_guid_t smbios_guid = GRUB_EFI_SMBIOS_TABLE_GUID;
+  return host_vendor_table (&smbios_guid);
+}
+
+struct grub_smbios_eps3*
+grub_machine_smbios_get_eps3 (void)
+{
+  static const grub_efi_packed_guid_t smbios3_guid = GRUB_EFI_SMBIOS3_TABLE_GUID;
+  return host_vendor_table (&smbios3_guid);
+}
+
+/*
+ * GOP: a single handle whose current mode is the configured resolution.
+ */
+
+static struct grub_efi_gop_mode_info host_gop_info;
+static struct grub_efi_gop_mode host_gop_mode = { .info = &host_gop_info, .info_size = sizeof (host_gop_info) };
+static int host_gop_present;
+
+static grub_efi_status_t
+host_gop_query_mode (struct grub_efi_gop* this __attribute__ ((unused)),
+                     grub_efi_uint32_t mode_number,
+                     grub_efi_uintn_t* size_of_info,
+                     struct grub_efi_gop_mode_info** info)
+{
+  grub_efi_status_t status;
+
+  host_counters.gop_query_modes++;
+  if (mode_number >= host_gop_mode.max_mode)
+    return GRUB_EFI_INVALID_PARAMETER;
+  // a copy from pool, for the caller to free
+  status = host_allocate_pool (GRUB_EFI_BOOT_SERVICES_DATA, sizeof (host_gop_info), (void**) info);
+  if (status)
+    return status;
+  memcpy (*info, &host_gop_info, sizeof (host_gop_info));
+  *size_of_info = sizeof (host_gop_info);
+  return GRUB_EFI_SUCCESS;
+}
+
+static struct grub_efi_gop host_gop = {
+  .query_mode = host_gop_query_mode,
+  .mode = &host_gop_mode,
+};
+
+static int host_gop_handle;
+
+void
+host_set_gop (grub_uint32_t width, grub_uint32_t height, grub_uint32_t max_mode)
+{
+  host_gop_present = width != 0;
+  host_gop_info.width = width;
+  host_gop_info.height = height;
+  host_gop_info.pixel_format = GRUB_EFI_GOT_BGRA8;
+  host_gop_info.pixels_per_scanline = width;
+  host_gop_mode.max_mode = max_mode;
+  host_gop_mode.mode = max_mode ? max_mode - 1 : 0;
+}
+
+void
+host_set_gop_lazy (int lazy)
+{
+  host_gop_mode.info = lazy ? NULL : &host_gop_info;
+}
+
+grub_efi_handle_t*
+grub_efi_locate_handle (grub_efi_locate_search_type_t search_type __attribute__ ((unused)),
+                        grub_efi_guid_t* protocol,
+                        void* search_key __attribute__ ((unused)),
+                        grub_efi_uintn_t* num_handles)
+{
+  static const grub_efi_guid_t gop_guid = GRUB_EFI_GOP_GUID;
+  grub_efi_handle_t* handles;
+
+  *num_handles = 0;
+  if (memcmp (protocol, &gop_guid, sizeof (gop_guid)) != 0 || !host_gop_present)
+    return NULL;
+  handles = grub_malloc (sizeof (*handles));
+  handles[0] = &host_gop_handle;
+  *num_handles = 1;
+  return handles;
+}
+
+void*
+grub_efi_open_protocol (grub_efi_handle_t handle,
+                        grub_efi_guid_t* protocol,
+                        grub_efi_uint32_t attributes __attribute__ ((unused)))
+{
+  if (handle == &host_gop_handle)
+    return &host_gop;
+  return host_disk_open_protocol (handle, protocol);
+}
@@ -0,0 +1,504 @@
+/*
+ * libc-backed stand-ins for the GRUB kernel services used by hackbgrt.
+ */
+#include <errno.h>
+#include <malloc.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <grub/acpi.h>
+#include <grub/env.h>
+#include <grub/err.h>
+#include <grub/extcmd.h>
+#include <grub/file.h>
+#include <grub/loader.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/random.h>
+#include <grub/time.h>
+#if defined (__i386__) || defined (__x86_64__)
+#include <grub/i386/tsc.h>
+#endif
+#include "host.h"
+
+struct host_counters host_counters;
+// bytes held from grub_malloc, as malloc rounds them, and their count at the last reset
+static grub_int64_t heap_held, heap_base;
+
+grub_err_t grub_errno = GRUB_ERR_NONE;
+
+char grub_errmsg[GRUB_MAX_ERRMSG];
+static int host_verbose;
+static const char* host_esp_root_dir = ".";
+static grub_uint64_t host_random_state = 0x9e3779b97f4a7c15ull;
+
+void
+host_counters_reset (void)
+{
+  memset (&host_counters, 0, sizeof (host_counters));
+  heap_base = heap_held;
+}
+
+void
+host_set_verbose (int verbose)
+{
+  host_verbose = verbose;
+}
+
+void
+host_set_esp_root (const char* dir)
+{
+  host_esp_root_dir = dir;
+}
+
+const char*
+host_esp_root (void)
+{
+  return host_esp_root_dir;
+}
+
+void
+host_seed_random (grub_uint64_t seed)
+{
+  host_random_state = seed ? seed : 0x9e3779b97f4a7c15ull;
+}
+
+grub_uint64_t
+host_now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (grub_uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// the time the reads would have taken on a slow medium, not slept
+static grub_uint64_t host_clock_offset_ms;
+static grub_uint32_t host_read_latency_ms;
+
+void
+host_set_read_latency (grub_uint32_t ms)
+{
+  host_read_latency_ms = ms;
+}
+
+void
+host_read_elapse (void)
+{
+  host_clock_offset_ms += host_read_latency_ms;
+}
+
+grub_uint64_t
+grub_get_time_ms (void)
+{
+  return host_now_ns () / 1000000ull + host_clock_offset_ms;
+}
+
+#if defined (__i386__) || defined (__x86_64__)
+grub_uint32_t grub_tsc_rate;
+
+/**
+ * Calibrate the TSC over 10 ms against the monotonic clock, as GRUB does at boot.
+ */
+__attribute__ ((constructor)) static void
+host_calibrate_tsc (void)
+{
+  grub_uint64_t start_ns = host_now_ns (), start = grub_get_tsc (), ns;
+  while ((ns = host_now_ns ()) - start_ns < 10000000ull)
+    ;
+  grub_tsc_rate = (grub_uint32_t) (((ns - start_ns) << 32) / (grub_get_tsc () - start) / 1000000ull);
+}
+#endif
+
+#define HOST_ENV_MAX 64
+
+static struct
+{
+  char* name;
+  char* value;
+} host_env[HOST_ENV_MAX];
+
+grub_err_t
+grub_env_set (const char* name, const char* val)
+{
+  unsigned i;
+  for (i = 0; i < HOST_ENV_MAX && host_env[i].name; i++)
+    if (strcmp (host_env[i].name, name) == 0)
+      break;
+  if (i == HOST_ENV_MAX)
+    return grub_error (GRUB_ERR_OUT_OF_MEMORY, "environment full");
+  if (!host_env[i].name)
+    host_env[i].name = strdup (name);
+  free (host_env[i].value);
+  host_env[i].value = strdup (val);
+  return GRUB_ERR_NONE;
+}
+
+const char*
+grub_env_get (const char* name)
+{
+  for (unsigned i = 0; i < HOST_ENV_MAX && host_env[i].name; i++)
+    if (strcmp (host_env[i].name, name) == 0)
+      return host_env[i].value;
+  return NULL;
+}
+
+void
+grub_env_unset (const char* name)
+{
+  for (unsigned i = 0; i < HOST_ENV_MAX && host_env[i].name; i++)
+    if (strcmp (host_env[i].name, name) == 0)
+    {
+      free (host_env[i].value);
+      host_env[i].value = NULL;
+    }
+}
+
+grub_err_t
+grub_error (grub_err_t n, const char* fmt, ...)
+{
+  va_list ap;
+  va_start (ap, fmt);
+  vsnprintf (grub_errmsg, sizeof (grub_errmsg), fmt, ap);
+  va_end (ap);
+  grub_errno = n;
+  host_counters.errors++;
+  return n;
+}
+
+void
+grub_print_error (void)
+{
+  if (grub_errno != GRUB_ERR_NONE && host_verbose)
+    fprintf (stderr, "error: %s\n", grub_errmsg);
+  grub_errno = GRUB_ERR_NONE;
+}
+
+void
+grub_real_dprintf (const char* file, const int line, const char* condition,
+                   const char* fmt, ...)
+{
+  static int enabled = -1;
+  va_list ap;
+
+  if (enabled < 0)
+    enabled = getenv ("HACKBGRT_DEBUG") != NULL;
+  if (!enabled)
+    return;
+  fprintf (stderr, "%s:%d: %s: ", file, line, condition);
+  va_start (ap, fmt);
+  vfprintf (stderr, fmt, ap);
+  va_end (ap);
+}
+
+unsigned long
+grub_strtoul (const char* str, char** end, int base)
+{
+  return strtoul (str, end, base);
+}
+
+unsigned long long
+grub_strtoull (const char* str, char** end, int base)
+{
+  return strtoull (str, end, base);
+}
+
+static void*
+heap_hold (void* ptr)
+{
+  if (ptr)
+    heap_held += malloc_usable_size (ptr);
+  if (heap_held - heap_base > (grub_int64_t) host_counters.heap_peak)
+    host_counters.heap_peak = heap_held - heap_base;
+  return ptr;
+}
+
+void*
+grub_malloc (grub_size_t size)
+{
+  host_counters.malloc_calls++;
+  host_counters.malloc_bytes += size;
+  return heap_hold (malloc (size));
+}
+
+void*
+grub_zalloc (grub_size_t size)
+{
+  host_counters.malloc_calls++;
+  host_counters.malloc_bytes += size;
+  return heap_hold (calloc (1, size));
+}
+
+void*
+grub_realloc (void* ptr, grub_size_t size)
+{
+  grub_size_t held = ptr ? malloc_usable_size (ptr) : 0;
+  void* grown = realloc (ptr, size);
+
+  host_counters.malloc_calls++;
+  host_counters.malloc_bytes += size;
+  if (grown)
+    heap_held -= held;
+  return grown ? heap_hold (grown) : 0;
+}
+
+void
+grub_free (void* ptr)
+{
+  heap_held -= ptr ? malloc_usable_size (ptr) : 0;
+  free (ptr);
+}
+
+char*
+grub_strdup (const char* s)
+{
+  grub_size_t len = strlen (s) + 1;
+  char* ret = grub_malloc (len);
+  if (ret)
+    memcpy (ret, s, len);
+  return ret;
+}
+
+char*
+grub_strndup (const char* s, grub_size_t n)
+{
+  grub_size_t len = strnlen (s, n);
+  char* ret = grub_malloc (len + 1);
+  if (ret)
+  {
+    memcpy (ret, s, len);
+    ret[len] = '\0';
+  }
+  return ret;
+}
+
+char*
+grub_xasprintf (const char* fmt, ...)
+{
+  va_list ap;
+  int len;
+  char* ret;
+
+  va_start (ap, fmt);
+  len = vsnprintf (NULL, 0, fmt, ap);
+  va_end (ap);
+  ret = grub_malloc (len + 1);
+  if (!ret)
+    return NULL;
+  va_start (ap, fmt);
+  vsnprintf (ret, len + 1, fmt, ap);
+  va_end (ap);
+  return ret;
+}
+
+grub_uint8_t
+grub_byte_checksum (void* base, grub_size_t size)
+{
+  grub_uint8_t* ptr;
+  grub_uint8_t ret = 0;
+  for (ptr = (grub_uint8_t*) base; ptr < ((grub_uint8_t*) base) + size; ptr++)
+    ret += *ptr;
+  return ret;
+}
+
+grub_err_t
+grub_crypto_get_random (void* buffer, grub_size_t sz)
+{
+  grub_uint8_t* out = buffer;
+  while (sz)
+  {
+    // splitmix64
+    grub_uint64_t z = (host_random_state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    z ^= z >> 31;
+    grub_size_t n = sz < sizeof (z) ? sz : sizeof (z);
+    memcpy (out, &z, n);
+    out += n;
+    sz -= n;
+  }
+  return GRUB_ERR_NONE;
+}
+
+/*
+ * Files: "(hd0,gpt1)/EFI/x.bmp" maps to "<esp root>/EFI/x.bmp".
+ */
+
+grub_file_t
+grub_file_open (const char* name, enum grub_file_type type __attribute__ ((unused)))
+{
+  char host_path[4096];
+  const char* path = name;
+  FILE* fp;
+  grub_file_t file;
+
+  if (path[0] == '(')
+  {
+    path = strchr (path, ')');
+    if (!path)
+    {
+      grub_error (GRUB_ERR_BAD_FILENAME, "invalid file name `%s'", name);
+      return NULL;
+    }
+    path++;
+  }
+  snprintf (host_path, sizeof (host_path), "%s%s", host_esp_root_dir, path);
+  fp = fopen (host_path, "rb");
+  if (!fp)
+  {
+    grub_error (GRUB_ERR_FILE_NOT_FOUND, "file `%s' not found", name);
+    return NULL;
+  }
+  file = calloc (1, sizeof (*file));
+  file->name = strdup (name);
+  file->data = fp;
+  fseeko (fp, 0, SEEK_END);
+  file->size = ftello (fp);
+  fseeko (fp, 0, SEEK_SET);
+  host_counters.file_opens++;
+  return file;
+}
+
+grub_ssize_t
+grub_file_read (grub_file_t file, void* buf, grub_size_t len)
+{
+  grub_size_t n;
+
+  if (file->offset >= file->size)
+    return 0;
+  if (len > file->size - file->offset)
+    len = file->size - file->offset;
+  n = fread (buf, 1, len, (FILE*) file->data);
+  file->offset += n;
+  host_counters.read_calls++;
+  host_read_elapse ();
+  host_counters.file_bytes_read += n;
+  if (n != len)
+  {
+    grub_error (GRUB_ERR_FILE_READ_ERROR, "short read on `%s'", file->name);
+    return -1;
+  }
+  return n;
+}
+
+grub_off_t
+grub_file_seek (grub_file_t file, grub_off_t offset)
+{
+  grub_off_t old = file->offset;
+  if (offset > file->size)
+  {
+    grub_error (GRUB_ERR_OUT_OF_RANGE, "attempt to seek outside of the file");
+    return (grub_off_t) -1;
+  }
+  fseeko ((FILE*) file->data, offset, SEEK_SET);
+  file->offset = offset;
+  return old;
+}
+
+grub_err_t
+grub_file_close (grub_file_t file)
+{
+  fclose ((FILE*) file->data);
+  free (file->name);
+  free (file);
+  return grub_errno;
+}
+
+/*
+ * Commands.
+ */
+
+#define HOST_MAX_EXTCMDS 4
+
+static struct grub_extcmd host_extcmds[HOST_MAX_EXTCMDS];
+
+grub_extcmd_t
+grub_register_extcmd (const char* name, grub_extcmd_func_t func,
+                      unsigned flags __attribute__ ((unused)),
+                      const char* summary __attribute__ ((unused)),
+                      const char* description __attribute__ ((unused)),
+                      const struct grub_arg_option* parser)
+{
+  for (int i = 0; i < HOST_MAX_EXTCMDS; i++)
+    if (!host_extcmds[i].name)
+    {
+      host_extcmds[i].name = name;
+      host_extcmds[i].func = func;
+      host_extcmds[i].options = parser;
+      return &host_extcmds[i];
+    }
+  return NULL;
+}
+
+void
+grub_unregister_extcmd (grub_extcmd_t cmd)
+{
+  memset (cmd, 0, sizeof (*cmd));
+}
+
+struct grub_extcmd*
+host_registered_extcmd (const char* name)
+{
+  for (int i = 0; i < HOST_MAX_EXTCMDS; i++)
+    if (host_extcmds[i].name && strcmp (host_extcmds[i].name, name) == 0)
+      return &host_extcmds[i];
+  return NULL;
+}
+
+/*
+ * Loader preboot hooks, run by host_loader_boot() in priority order.
+ */
+
+struct grub_preboot
+{
+  grub_err_t (*preboot_func) (int noreturn);
+  grub_err_t (*preboot_rest_func) (void);
+  grub_loader_preboot_hook_prio_t prio;
+  struct grub_preboot* next;
+};
+
+static struct grub_preboot* host_preboots;
+
+struct grub_preboot*
+grub_loader_register_preboot_hook (grub_err_t (*preboot_func) (int noreturn),
+                                   grub_err_t (*preboot_rest_func) (void),
+                                   grub_loader_preboot_hook_prio_t prio)
+{
+  struct grub_preboot** cur;
+  struct grub_preboot* hook = grub_malloc (sizeof (*hook));
+  if (!hook)
+    return NULL;
+  hook->preboot_func = preboot_func;
+  hook->preboot_rest_func = preboot_rest_func;
+  hook->prio = prio;
+  for (cur = &host_preboots; *cur && (*cur)->prio > prio; cur = &(*cur)->next)
+    ;
+  hook->next = *cur;
+  *cur = hook;
+  return hook;
+}
+
+void
+grub_loader_unregister_preboot_hook (struct grub_preboot* hnd)
+{
+  for (struct grub_preboot** cur = &host_preboots; *cur; cur = &(*cur)->next)
+    if (*cur == hnd)
+    {
+      *cur = hnd->next;
+      grub_free (hnd);
+      return;
+    }
+}
+
+grub_err_t
+host_loader_boot (void)
+{
+  for (struct grub_preboot* cur = host_preboots; cur; cur = cur->next)
+  {
+    grub_err_t err = cur->preboot_func (0);
+    if (err)
+      return err;
+  }
+  return GRUB_ERR_NONE;
+}
@@ -0,0 +1,128 @@
+/*
+ * Fake EFI_MP_SERVICES_PROTOCOL for the host harness: the APs are pthreads,
+ * parked between StartupAllAPs calls like the firmware parks real ones.
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <grub/efi/api.h>
+#include "efi_mp.h"
+#include "host.h"
+
+static pthread_mutex_t host_mp_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t host_mp_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t host_mp_done = PTHREAD_COND_INITIALIZER;
+static pthread_t* host_mp_threads;
+static unsigned host_mp_aps;       // running AP threads
+static unsigned host_mp_processors; // 0: no protocol
+static unsigned host_mp_busy;       // APs still in the procedure
+static unsigned long host_mp_generation;
+static int host_mp_exit;
+static hackbgrt_efi_ap_procedure_t host_mp_procedure;
+static void* host_mp_argument;
+
+static void*
+host_ap_main (void* arg __attribute__ ((unused)))
+{
+  unsigned long seen = 0;
+  pthread_mutex_lock (&host_mp_lock);
+  for (;;)
+  {
+    while (!host_mp_exit && host_mp_generation == seen)
+      pthread_cond_wait (&host_mp_start, &host_mp_lock);
+    if (host_mp_exit)
+      break;
+    seen = host_mp_generation;
+    pthread_mutex_unlock (&host_mp_lock);
+    host_mp_procedure (host_mp_argument);
+    pthread_mutex_lock (&host_mp_lock);
+    if (--host_mp_busy == 0)
+      pthread_cond_signal (&host_mp_done);
+  }
+  pthread_mutex_unlock (&host_mp_lock);
+  return NULL;
+}
+
+static grub_efi_status_t
+host_mp_get_number_of_processors (struct hackbgrt_efi_mp_services* this __attribute__ ((unused)),
+                                  grub_efi_uintn_t* number_of_processors,
+                                  grub_efi_uintn_t* number_of_enabled_processors)
+{
+  *number_of_processors = host_mp_processors;
+  *number_of_enabled_processors = host_mp_processors;
+  return GRUB_EFI_SUCCESS;
+}
+
+static grub_efi_status_t
+host_mp_startup_all_aps (struct hackbgrt_efi_mp_services* this __attribute__ ((unused)),
+                         hackbgrt_efi_ap_procedure_t procedure,
+                         grub_efi_boolean_t single_thread,
+                         grub_efi_event_t wait_event,
+                         grub_efi_uintn_t timeout_in_microseconds __attribute__ ((unused)),
+                         void* procedure_argument,
+                         grub_efi_uintn_t** failed_cpu_list)
+{
+  // only the blocking, simultaneous mode is emulated
+  if (single_thread || wait_event)
+    return GRUB_EFI_UNSUPPORTED;
+  if (failed_cpu_list)
+    *failed_cpu_list = NULL;
+  if (!host_mp_aps)
+    return GRUB_EFI_NOT_STARTED;
+  pthread_mutex_lock (&host_mp_lock);
+  host_mp_procedure = procedure;
+  host_mp_argument = procedure_argument;
+  host_mp_busy = host_mp_aps;
+  host_mp_generation++;
+  pthread_cond_broadcast (&host_mp_start);
+  while (host_mp_busy)
+    pthread_cond_wait (&host_mp_done, &host_mp_lock);
+  pthread_mutex_unlock (&host_mp_lock);
+  host_counters.ap_runs++;
+  return GRUB_EFI_SUCCESS;
+}
+
+static struct hackbgrt_efi_mp_services host_mp = {
+  .get_number_of_processors = host_mp_get_number_of_processors,
+  .startup_all_aps = host_mp_startup_all_aps,
+};
+
+static void
+host_mp_stop (void)
+{
+  pthread_mutex_lock (&host_mp_lock);
+  host_mp_exit = 1;
+  pthread_cond_broadcast (&host_mp_start);
+  pthread_mutex_unlock (&host_mp_lock);
+  for (unsigned i = 0; i < host_mp_aps; i++)
+    pthread_join (host_mp_threads[i], NULL);
+  free (host_mp_threads);
+  host_mp_threads = NULL;
+  host_mp_aps = 0;
+  host_mp_exit = 0;
+}
+
+void
+host_set_processors (unsigned count)
+{
+  host_mp_stop ();
+  host_mp_processors = count;
+  if (count < 2)
+    return;
+  host_mp_threads = calloc (count - 1, sizeof (*host_mp_threads));
+  for (unsigned i = 0; i < count - 1; i++)
+  {
+    if (pthread_create (&host_mp_threads[i], NULL, host_ap_main, NULL) != 0)
+      break;
+    host_mp_aps++;
+  }
+}
+
+void*
+host_mp_protocol (grub_efi_guid_t* protocol)
+{
+  static const grub_efi_guid_t mp_services_guid = HACKBGRT_EFI_MP_SERVICES_GUID;
+  if (!host_mp_processors || memcmp (protocol, &mp_services_guid, sizeof (mp_services_guid)) != 0)
+    return NULL;
+  return &host_mp;
+}
@@ -0,0 +1,104 @@
+/*
+ * Stand-in for the GRUB bitmap loader and its png reader, decoding with
+ * libpng. As in GRUB, the file goes through grub_file_open/grub_file_read
+ * and the result is RGBA_8888 with an alpha channel, RGB_888 otherwise,
+ * top-down with a packed pitch.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <png.h>
+#include <grub/bitmap.h>
+#include <grub/err.h>
+#include <grub/file.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include "host.h"
+
+grub_err_t
+grub_video_bitmap_load (struct grub_video_bitmap** bitmap, const char* filename)
+{
+  png_image image;
+  grub_file_t file;
+  grub_uint8_t* data;
+  grub_size_t len = strlen (filename);
+  struct grub_video_bitmap* b;
+  int alpha;
+
+  *bitmap = 0;
+  if (len < 4 || strcasecmp (filename + len - 4, ".png") != 0)
+    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "unsupported bitmap format");
+  file = grub_file_open (filename, GRUB_FILE_TYPE_PIXMAP);
+  if (!file)
+    return grub_errno;
+  data = malloc (file->size);
+  if (grub_file_read (file, data, file->size) != (grub_ssize_t) file->size)
+  {
+    grub_file_close (file);
+    free (data);
+    return grub_error (GRUB_ERR_FILE_READ_ERROR, "premature end of file %s", filename);
+  }
+  memset (&image, 0, sizeof (image));
+  image.version = PNG_IMAGE_VERSION;
+  if (!png_image_begin_read_from_memory (&image, data, file->size))
+  {
+    grub_file_close (file);
+    free (data);
+    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "png: %s", image.message);
+  }
+  alpha = (image.format & PNG_FORMAT_FLAG_ALPHA) != 0;
+  image.format = alpha ? PNG_FORMAT_RGBA : PNG_FORMAT_RGB;
+  b = calloc (1, sizeof (*b));
+  b->mode_info.width = image.width;
+  b->mode_info.height = image.height;
+  b->mode_info.mode_type = GRUB_VIDEO_MODE_TYPE_RGB | (alpha ? GRUB_VIDEO_MODE_TYPE_ALPHA : 0);
+  b->mode_info.bytes_per_pixel = alpha ? 4 : 3;
+  b->mode_info.bpp = b->mode_info.bytes_per_pixel * 8;
+  b->mode_info.pitch = image.width * b->mode_info.bytes_per_pixel;
+  b->mode_info.blit_format = alpha ? GRUB_VIDEO_BLIT_FORMAT_RGBA_8888 : GRUB_VIDEO_BLIT_FORMAT_RGB_888;
+  b->data = malloc (PNG_IMAGE_SIZE (image));
+  host_counters.malloc_calls += 2;
+  host_counters.malloc_bytes += sizeof (*b) + PNG_IMAGE_SIZE (image);
+  if (!png_image_finish_read (&image, NULL, b->data, b->mode_info.pitch, NULL))
+  {
+    grub_file_close (file);
+    free (data);
+    grub_video_bitmap_destroy (b);
+    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "png: %s", image.message);
+  }
+  grub_file_close (file);
+  free (data);
+  *bitmap = b;
+  return GRUB_ERR_NONE;
+}
+
+grub_err_t
+grub_video_bitmap_destroy (struct grub_video_bitmap* bitmap)
+{
+  if (bitmap)
+  {
+    free (bitmap->data);
+    free (bitmap);
+  }
+  return GRUB_ERR_NONE;
+}
+
+static struct grub_video_mode_info host_video_info;
+
+void
+host_set_video (grub_uint32_t width, grub_uint32_t height)
+{
+  memset (&host_video_info, 0, sizeof (host_video_info));
+  host_video_info.width = width;
+  host_video_info.height = height;
+  host_video_info.mode_type = GRUB_VIDEO_MODE_TYPE_RGB;
+  host_video_info.blit_format = GRUB_VIDEO_BLIT_FORMAT_BGRA_8888;
+}
+
+grub_err_t
+grub_video_get_info (struct grub_video_mode_info* mode_info)
+{
+  if (!host_video_info.width)
+    return grub_error (GRUB_ERR_BAD_DEVICE, "no video mode activated");
+  *mode_info = host_video_info;
+  return GRUB_ERR_NONE;
+}
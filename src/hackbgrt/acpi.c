@@ -0,0 +1,260 @@
+#include <grub/acpi.h>
+#include <grub/efi/api.h>
+#include <grub/efi/efi.h>
+#include <grub/err.h>
+#include <grub/misc.h>
+#include <grub/types.h>
+#include "acpi.h"
+#include "tier.h"
+#include "types.h"
+
+#define OEMID_TO_CHAR_LIST(oemid) oemid[0], oemid[1], oemid[2], oemid[3], oemid[4], oemid[5]
+
+/**
+ * Sum of the bytes of a 64-bit word, modulo 256.
+ */
+static inline grub_uint8_t
+byte_sum64 (grub_uint64_t v)
+{
+  v = (v & 0x00ff00ff00ff00ffULL) + ((v >> 8) & 0x00ff00ff00ff00ffULL);
+  return (grub_uint8_t) (v + (v >> 16) + (v >> 32) + (v >> 48));
+}
+
+static inline int
+is_bgrt_entry (grub_uint64_t entry)
+{
+  struct grub_acpi_table_header* table = (struct grub_acpi_table_header*) (grub_efi_uintn_t) entry;
+  return table && grub_memcmp (table->signature, BGRT_MAGIC, BGRT_MAGIC_SIZE) == 0;
+}
+
+/**
+ * Create a new XSDT with the given number of entries.
+ *
+ * @param xsdt0 The old XSDT.
+ * @param entries The number of SDT entries.
+ * @return Pointer to a new XSDT.
+ */
+static struct grub_acpi_table_header*
+create_xsdt (struct grub_acpi_table_header* xsdt0, grub_efi_uintn_t entries)
+{
+  struct grub_acpi_table_header* xsdt = 0;
+
+  grub_efi_uint32_t xsdt_len = sizeof (struct grub_acpi_table_header) + entries * sizeof (grub_efi_uint64_t);
+  grub_efi_status_t status = efi_call_3 (grub_efi_system_table->boot_services->allocate_pool, GRUB_EFI_ACPI_RECLAIM_MEMORY, xsdt_len, (void**) &xsdt);
+  if (status)
+  {
+    grub_error (GRUB_ERR_OUT_OF_MEMORY, "HackBGRT: Failed to allocate memory for XSDT.\n");
+    return 0;
+  }
+  grub_memset (xsdt, 0, xsdt_len);
+  grub_memcpy (xsdt, xsdt0, grub_min (xsdt0->length, xsdt_len));
+  xsdt->length = xsdt_len;
+  xsdt->checksum = 0;
+  return xsdt;
+}
+
+/**
+ * Walk an XSDT once: count its BGRT entries and verify its checksum.
+ */
+static void
+index_xsdt (struct hackbgrt_acpi_xsdt* entry, struct grub_acpi_table_header* xsdt)
+{
+  grub_uint64_t* entry_arr = (grub_uint64_t*) &xsdt[1];
+  grub_uint32_t entry_arr_length = (xsdt->length - sizeof (*xsdt)) / sizeof (grub_uint64_t);
+  grub_uint8_t sum = grub_byte_checksum (xsdt, sizeof (*xsdt));
+
+  entry->xsdt = xsdt;
+  entry->entry_count = entry_arr_length;
+  for (grub_uint32_t j = 0; j < entry_arr_length; j++)
+  {
+    grub_uint64_t e = entry_arr[j];
+    sum += byte_sum64 (e);
+    if (!is_bgrt_entry (e))
+      continue;
+    if (!entry->bgrt_count)
+      entry->first_bgrt = j;
+    entry->bgrt_count++;
+  }
+  // trailing bytes of a length that is not a whole number of entries
+  grub_size_t tail = sizeof (*xsdt) + entry_arr_length * sizeof (grub_uint64_t);
+  sum += grub_byte_checksum ((grub_uint8_t*) xsdt + tail, xsdt->length - tail);
+  entry->checksum_ok = sum == 0;
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "* XSDT: OEM ID = %c%c%c%c%c%c, entry count = %d, BGRT count = %d, checksum %s\n",
+                  OEMID_TO_CHAR_LIST (xsdt->oemid), entry_arr_length, entry->bgrt_count, entry->checksum_ok ? "ok" : "bad");
+}
+
+void
+hackbgrt_acpi_scan (hackbgrt_acpi_t acpi)
+{
+  static grub_efi_packed_guid_t acpi20_guid = GRUB_EFI_ACPI_20_TABLE_GUID;
+  struct grub_acpi_rsdp_v20* rsdp;
+  struct grub_acpi_table_header* xsdt;
+
+  grub_memset (acpi, 0, sizeof (*acpi));
+  for (unsigned i = 0; i < grub_efi_system_table->num_table_entries; i++)
+  {
+    grub_efi_packed_guid_t *guid = &grub_efi_system_table->configuration_table[i].vendor_guid;
+    if (grub_memcmp (guid, &acpi20_guid, sizeof (grub_efi_packed_guid_t)) != 0)
+      continue;
+    // read RSDP version 2.0 https://wiki.osdev.org/RSDP
+    rsdp = (struct grub_acpi_rsdp_v20*) grub_efi_system_table->configuration_table[i].vendor_table;
+    if (grub_memcmp (rsdp->rsdpv1.signature, GRUB_RSDP_SIGNATURE, GRUB_RSDP_SIGNATURE_SIZE) != 0 || rsdp->rsdpv1.revision < 2 || !verify_acpi_rsdp2_checksums (rsdp))
+      continue;
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "RSDP: revision = %d, OEM ID = %c%c%c%c%c%c\n", rsdp->rsdpv1.revision, OEMID_TO_CHAR_LIST (rsdp->rsdpv1.oemid));
+    // Read XSDT https://wiki.osdev.org/XSDT
+    xsdt = (struct grub_acpi_table_header*) (grub_efi_uintn_t) rsdp->xsdt_addr;
+    if (!xsdt)
+    {
+      hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "* XSDT: missing\n");
+      continue;
+    }
+    if (grub_memcmp (xsdt->signature, "XSDT", 4) != 0)
+    {
+      hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "* XSDT: bad signature\n");
+      continue;
+    }
+    struct hackbgrt_acpi_xsdt* entry = 0;
+    for (unsigned k = 0; k < acpi->xsdt_count; k++)
+      if (acpi->xsdts[k].xsdt == xsdt)
+        entry = &acpi->xsdts[k];
+    if (entry)
+    {
+      hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "* XSDT: already indexed\n");
+      unsigned k;
+      for (k = 0; k < entry->rsdp_count && entry->rsdps[k] != rsdp; k++)
+        ;
+      if (k == entry->rsdp_count && entry->rsdp_count < HACKBGRT_ACPI_MAX_RSDPS)
+        entry->rsdps[entry->rsdp_count++] = rsdp;
+      continue;
+    }
+    if (acpi->xsdt_count == HACKBGRT_ACPI_MAX_RSDPS)
+    {
+      hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "* XSDT: too many, ignored\n");
+      continue;
+    }
+    entry = &acpi->xsdts[acpi->xsdt_count++];
+    index_xsdt (entry, xsdt);
+    acpi->entries_walked += entry->entry_count;
+    entry->rsdps[entry->rsdp_count++] = rsdp;
+    if (!acpi->bgrt && entry->checksum_ok && entry->bgrt_count)
+    {
+      hackbgrt_trace (HACKBGRT_TRACE_STEPS, " -> Returning first BGRT (entry %d).\n", entry->first_bgrt);
+      acpi->bgrt = (grub_acpi_bgrt_t) (grub_efi_uintn_t) ((grub_uint64_t*) &xsdt[1])[entry->first_bgrt];
+    }
+  }
+}
+
+grub_err_t
+hackbgrt_acpi_queue (hackbgrt_acpi_t acpi, enum hackbgrt_acpi_op op, grub_acpi_bgrt_t bgrt)
+{
+  if (acpi->edit_count == HACKBGRT_ACPI_MAX_EDITS)
+    return grub_error (GRUB_ERR_OUT_OF_RANGE, "HackBGRT: Too many queued ACPI edits.\n");
+  acpi->edits[acpi->edit_count].op = op;
+  acpi->edits[acpi->edit_count].bgrt = bgrt;
+  acpi->edit_count++;
+  return GRUB_ERR_NONE;
+}
+
+grub_err_t
+hackbgrt_acpi_commit (hackbgrt_acpi_t acpi)
+{
+  int remove = 0;
+  grub_acpi_bgrt_t replacement = 0;
+  grub_acpi_bgrt_t append = 0;
+  grub_err_t err = GRUB_ERR_NONE;
+
+  // Fold the queue into the net effect on one XSDT.
+  for (unsigned i = 0; i < acpi->edit_count; i++)
+  {
+    switch (acpi->edits[i].op)
+    {
+      case HACKBGRT_ACPI_REMOVE:
+        remove = 1;
+        replacement = 0;
+        append = 0;
+        break;
+      case HACKBGRT_ACPI_REPLACE:
+        replacement = acpi->edits[i].bgrt;
+        if (append)
+          append = replacement;
+        break;
+      case HACKBGRT_ACPI_APPEND:
+        append = acpi->edits[i].bgrt;
+    }
+  }
+  acpi->edit_count = 0;
+  for (unsigned i = 0; i < acpi->xsdt_count; i++)
+  {
+    struct hackbgrt_acpi_xsdt* entry = &acpi->xsdts[i];
+    int replaces = entry->bgrt_count && (remove || replacement);
+    int appends = append && (remove || !entry->bgrt_count);
+    if (!replaces && !appends)
+      continue;
+    struct grub_acpi_table_header* xsdt = entry->xsdt;
+    grub_uint32_t new_count = entry->entry_count - (remove ? entry->bgrt_count : 0) + (appends ? 1 : 0);
+    if (new_count > entry->entry_count)
+    {
+      hackbgrt_trace (HACKBGRT_TRACE_RESULTS, " - Growing XSDT to %d entries.\n", new_count);
+      xsdt = create_xsdt (entry->xsdt, new_count);
+      if (!xsdt)
+      {
+        err = grub_errno;
+        continue;
+      }
+    }
+    grub_uint64_t* src = (grub_uint64_t*) &entry->xsdt[1];
+    grub_uint64_t* dst = (grub_uint64_t*) &xsdt[1];
+    grub_uint32_t w = entry->entry_count;
+    if (entry->bgrt_count)
+    {
+      // one compaction pass from the first BGRT on
+      w = entry->first_bgrt;
+      acpi->entries_walked += entry->entry_count - entry->first_bgrt;
+      for (grub_uint32_t r = entry->first_bgrt; r < entry->entry_count; r++)
+      {
+        grub_uint64_t e = src[r];
+        if (is_bgrt_entry (e))
+        {
+          if (remove)
+            continue;
+          e = (grub_efi_uintn_t) replacement;
+        }
+        dst[w++] = e;
+      }
+    }
+    if (appends)
+    {
+      hackbgrt_trace (HACKBGRT_TRACE_RESULTS, " - Adding missing BGRT.\n");
+      dst[w++] = (grub_efi_uintn_t) append;
+    }
+    for (grub_uint32_t k = w; k < entry->entry_count; k++)
+      dst[k] = 0;
+    xsdt->length = sizeof (*xsdt) + w * sizeof (grub_uint64_t);
+    set_acpi_sdt_checksum (xsdt);
+    if (xsdt != entry->xsdt)
+    {
+      for (unsigned k = 0; k < entry->rsdp_count; k++)
+      {
+        entry->rsdps[k]->xsdt_addr = (grub_efi_uintn_t) xsdt;
+        set_acpi_rsdp2_checksums (entry->rsdps[k]);
+      }
+      entry->xsdt = xsdt;
+    }
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, " - XSDT %d: %d -> %d entries.\n", i, entry->entry_count, w);
+    if (remove)
+    {
+      entry->bgrt_count = appends ? 1 : 0;
+      entry->first_bgrt = w - 1;
+    }
+    else if (appends)
+    {
+      entry->bgrt_count = 1;
+      entry->first_bgrt = w - 1;
+    }
+    entry->entry_count = w;
+    entry->checksum_ok = 1;
+  }
+  if (remove || replacement || append)
+    acpi->bgrt = append ? append : replacement;
+  return err;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <grub/acpi.h>
+#include <grub/err.h>
+#include <grub/types.h>
+#include "types.h"
+
+#define HACKBGRT_ACPI_MAX_RSDPS 8
+#define HACKBGRT_ACPI_MAX_EDITS 4
+
+/**
+ * Possible edits on the BGRT entries of the XSDTs.
+ */
+enum hackbgrt_acpi_op
+{
+  HACKBGRT_ACPI_REMOVE = 0, // drop every BGRT entry
+  HACKBGRT_ACPI_REPLACE,    // point every BGRT entry at the given table
+  HACKBGRT_ACPI_APPEND      // add the given table where no BGRT entry is left
+};
+
+struct hackbgrt_acpi_edit
+{
+  enum hackbgrt_acpi_op op;
+  grub_acpi_bgrt_t bgrt;
+};
+
+/**
+ * One distinct XSDT, with the ACPI 2.0 RSDPs pointing to it.
+ */
+struct hackbgrt_acpi_xsdt
+{
+  struct grub_acpi_table_header* xsdt;
+  struct grub_acpi_rsdp_v20* rsdps[HACKBGRT_ACPI_MAX_RSDPS];
+  unsigned rsdp_count;
+  grub_uint32_t entry_count;
+  grub_uint32_t bgrt_count;
+  grub_uint32_t first_bgrt; // entry index of the first BGRT, if any
+  int checksum_ok;
+};
+
+/**
+ * Index of the ACPI tables, built once per invocation.
+ *
+ * Edits are queued and only written to the tables by hackbgrt_acpi_commit().
+ */
+struct hackbgrt_acpi
+{
+  struct hackbgrt_acpi_xsdt xsdts[HACKBGRT_ACPI_MAX_RSDPS];
+  unsigned xsdt_count;
+  grub_acpi_bgrt_t bgrt; // first BGRT of an XSDT with a valid checksum
+  struct hackbgrt_acpi_edit edits[HACKBGRT_ACPI_MAX_EDITS];
+  unsigned edit_count;
+  grub_uint64_t entries_walked; // XSDT entries read by the scan and the commits
+};
+
+typedef struct hackbgrt_acpi* hackbgrt_acpi_t;
+
+/**
+ * Index the RSDP, XSDT and BGRT locations.
+ *
+ * Each XSDT is walked once, even if several configuration table entries or
+ * RSDPs point to it; its checksum is verified in the same pass.
+ *
+ * @param acpi The index to fill.
+ */
+extern void
+hackbgrt_acpi_scan (hackbgrt_acpi_t acpi);
+
+/**
+ * Queue an edit.
+ *
+ * @param acpi The index.
+ * @param op The edit.
+ * @param bgrt The table for REPLACE and APPEND, ignored for REMOVE.
+ * @return GRUB_ERR_NONE or an error if the queue is full.
+ */
+extern grub_err_t
+hackbgrt_acpi_queue (hackbgrt_acpi_t acpi, enum hackbgrt_acpi_op op, grub_acpi_bgrt_t bgrt);
+
+/**
+ * Apply the queued edits.
+ *
+ * Each XSDT gets one compaction pass and one checksum; an XSDT is only
+ * reallocated when it has to grow, and an RSDP is only checksummed when
+ * its XSDT address changes.
+ *
+ * @param acpi The index; the queue is emptied.
+ * @return GRUB_ERR_NONE or the first error met, the other XSDTs are still updated.
+ */
+extern grub_err_t
+hackbgrt_acpi_commit (hackbgrt_acpi_t acpi);
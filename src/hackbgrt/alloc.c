@@ -0,0 +1,122 @@
+#include <grub/efi/api.h>
+#include <grub/efi/efi.h>
+#include <grub/err.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/types.h>
+#include "alloc.h"
+#include "tier.h"
+
+#define EFI_PAGE_SIZE 4096
+
+/**
+ * Pages allocated for a bitmap; the firmware's buffer is never in the list.
+ */
+struct allocation
+{
+  struct allocation* next;
+  bitmap_t bmp;
+  grub_efi_uintn_t pages;
+};
+
+static struct allocation* allocations;
+static bitmap_t offered;
+static grub_uint32_t offered_capacity;
+static struct hackbgrt_alloc_stats alloc_stats;
+
+void
+hackbgrt_alloc_init (void)
+{
+  allocations = 0;
+  offered = 0;
+  offered_capacity = 0;
+  grub_memset (&alloc_stats, 0, sizeof (alloc_stats));
+}
+
+void
+hackbgrt_alloc_fini (void)
+{
+  while (allocations)
+  {
+    struct allocation* a = allocations;
+    allocations = a->next;
+    grub_free (a);
+  }
+  offered = 0;
+}
+
+void
+hackbgrt_alloc_offer (bitmap_t buffer, grub_uint32_t capacity)
+{
+  offered = buffer;
+  offered_capacity = buffer ? capacity : 0;
+}
+
+bitmap_t
+hackbgrt_alloc_offered (grub_uint32_t* capacity)
+{
+  *capacity = offered_capacity;
+  return offered;
+}
+
+bitmap_t
+hackbgrt_alloc_bitmap (grub_size_t size)
+{
+  struct allocation* a;
+  grub_efi_physical_address_t address;
+  grub_efi_uintn_t pages = (size + EFI_PAGE_SIZE - 1) / EFI_PAGE_SIZE;
+  grub_efi_status_t status;
+
+  if (offered && size <= offered_capacity)
+  {
+    bitmap_t bmp = offered;
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "bitmap of %d bytes in the firmware's logo buffer (%d bytes)\n",
+                    (int) size, offered_capacity);
+    alloc_stats.reused++;
+    alloc_stats.reused_bytes += offered_capacity;
+    offered = 0;
+    offered_capacity = 0;
+    return bmp;
+  }
+  a = grub_malloc (sizeof (*a));
+  if (!a)
+    return 0;
+  status = efi_call_4 (grub_efi_system_table->boot_services->allocate_pages, GRUB_EFI_ALLOCATE_ANY_PAGES,
+                       GRUB_EFI_ACPI_RECLAIM_MEMORY, pages, &address);
+  if (status)
+  {
+    grub_free (a);
+    grub_error (GRUB_ERR_OUT_OF_MEMORY, "HackBGRT: Failed to allocate memory for BMP!\n");
+    return 0;
+  }
+  a->bmp = (bitmap_t) (grub_addr_t) address;
+  a->pages = pages;
+  a->next = allocations;
+  allocations = a;
+  alloc_stats.allocated++;
+  alloc_stats.allocated_bytes += pages * EFI_PAGE_SIZE;
+  return a->bmp;
+}
+
+void
+hackbgrt_alloc_free (bitmap_t bmp)
+{
+  for (struct allocation** p = &allocations; *p; p = &(*p)->next)
+    if ((*p)->bmp == bmp)
+    {
+      struct allocation* a = *p;
+      *p = a->next;
+      efi_call_2 (grub_efi_system_table->boot_services->free_pages, (grub_addr_t) a->bmp, a->pages);
+      alloc_stats.released++;
+      alloc_stats.released_bytes += a->pages * EFI_PAGE_SIZE;
+      grub_free (a);
+      return;
+    }
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "%p is the firmware's logo buffer, kept\n", bmp);
+}
+
+void
+hackbgrt_alloc_get_stats (struct hackbgrt_alloc_stats* stats)
+{
+  grub_memcpy (stats, &alloc_stats, sizeof (*stats));
+}
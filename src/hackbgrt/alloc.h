@@ -0,0 +1,71 @@
+#pragma once
+
+#include <grub/types.h>
+#include "types.h"
+
+/**
+ * Counters of the bitmap memory, for the module lifetime.
+ */
+struct hackbgrt_alloc_stats
+{
+  grub_uint32_t reused;          // bitmaps written into the firmware's logo buffer
+  grub_uint64_t reused_bytes;
+  grub_uint32_t allocated;       // ACPI reclaim page allocations
+  grub_uint64_t allocated_bytes; // whole pages
+  grub_uint32_t released;
+  grub_uint64_t released_bytes;
+};
+
+/**
+ * Set up the tracking of the allocations, from GRUB_MOD_INIT.
+ */
+extern void
+hackbgrt_alloc_init (void);
+
+/**
+ * Forget the allocations, from GRUB_MOD_FINI: the bitmap published in the
+ * BGRT must stay, the others are already released through the cache.
+ */
+extern void
+hackbgrt_alloc_fini (void);
+
+/**
+ * Offer the firmware's logo buffer for the next bitmap.
+ *
+ * It must not be referenced by anything but the BGRT about to be replaced.
+ *
+ * @param buffer The buffer, or 0 to withdraw the offer.
+ * @param capacity Its size, the size of the old bitmap.
+ */
+extern void
+hackbgrt_alloc_offer (bitmap_t buffer, grub_uint32_t capacity);
+
+/**
+ * The buffer currently offered, if any.
+ *
+ * @param capacity Set to its size.
+ */
+extern bitmap_t
+hackbgrt_alloc_offered (grub_uint32_t* capacity);
+
+/**
+ * Get the memory of a bitmap.
+ *
+ * The offered buffer is used, once, if the bitmap fits; otherwise the
+ * bitmap gets pages of ACPI reclaim memory of its own, which the OS keeps
+ * until its BGRT driver has copied the image.
+ *
+ * @param size The bitmap size, header included.
+ * @return The memory, or 0 with grub_errno set.
+ */
+extern bitmap_t
+hackbgrt_alloc_bitmap (grub_size_t size);
+
+/**
+ * Release the memory of a bitmap; the firmware's logo buffer stays as is.
+ */
+extern void
+hackbgrt_alloc_free (bitmap_t bmp);
+
+extern void
+hackbgrt_alloc_get_stats (struct hackbgrt_alloc_stats* stats);
@@ -0,0 +1,876 @@
+#include <grub/err.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/types.h>
+#include "bmp.h"
+#include "parallel.h"
+#include "tier.h"
+#include "types.h"
+
+/*
+ * The kernels pack pixels into words in little endian order, which is what
+ * the EFI platforms of the module (i386, x86_64) are.
+ */
+
+#define BMP_FILE_HEADER_SIZE 14
+#define BMP_V2_HEADER_SIZE   52
+#define BMP_V3_HEADER_SIZE   56
+#define BMP_V4_HEADER_SIZE   108
+#define BMP_V5_HEADER_SIZE   124
+
+static inline grub_uint32_t
+load32 (const grub_uint8_t* p)
+{
+  grub_uint32_t v;
+  grub_memcpy (&v, p, sizeof (v));
+  return v;
+}
+
+static inline void
+store32 (grub_uint8_t* p, grub_uint32_t v)
+{
+  grub_memcpy (p, &v, sizeof (v));
+}
+
+static inline void
+store_bgr (grub_uint8_t* p, grub_uint32_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+}
+
+/**
+ * Four 0x00RRGGBB pixels as three BGR words.
+ */
+static inline void
+store_bgr4 (grub_uint8_t* dst, grub_uint32_t p0, grub_uint32_t p1, grub_uint32_t p2, grub_uint32_t p3)
+{
+  store32 (dst, (p0 & 0xffffff) | p1 << 24);
+  store32 (dst + 4, (p1 >> 8 & 0xffff) | p2 << 16);
+  store32 (dst + 8, (p2 >> 16 & 0xff) | p3 << 8);
+}
+
+/*
+ * Row kernels
+ */
+
+#if HACKBGRT_WITH_CONVERT
+static void
+row_lut8 (grub_uint8_t* dst, const grub_uint8_t* index, grub_uint32_t width, const grub_uint32_t* lut)
+{
+  grub_uint32_t x = 0;
+  for (; x + 4 <= width; x += 4, dst += 12)
+    store_bgr4 (dst, lut[index[x]], lut[index[x + 1]], lut[index[x + 2]], lut[index[x + 3]]);
+  for (; x < width; x++, dst += 3)
+    store_bgr (dst, lut[index[x]]);
+}
+
+static void
+row_bgrx (grub_uint8_t* dst, const grub_uint8_t* src, grub_uint32_t width)
+{
+  grub_uint32_t x = 0;
+  for (; x + 4 <= width; x += 4, src += 16, dst += 12)
+    store_bgr4 (dst, load32 (src), load32 (src + 4), load32 (src + 8), load32 (src + 12));
+  for (; x < width; x++, src += 4, dst += 3)
+    store_bgr (dst, load32 (src));
+}
+
+/** 1 bpp to one index byte per pixel, eight pixels per source byte. */
+static void
+expand1 (grub_uint8_t* index, const grub_uint8_t* src, grub_uint32_t width)
+{
+  static grub_uint64_t table[256];
+  static int table_ready;
+
+  if (!table_ready)
+  {
+    for (unsigned b = 0; b < 256; b++)
+    {
+      grub_uint64_t v = 0;
+      for (unsigned bit = 0; bit < 8; bit++)
+        v |= (grub_uint64_t) ((b >> (7 - bit)) & 1) << (8 * bit);
+      table[b] = v;
+    }
+    table_ready = 1;
+  }
+  // the index row has room for a whole last byte
+  for (grub_uint32_t x = 0; x < width; x += 8)
+    grub_memcpy (index + x, &table[*src++], 8);
+}
+
+/** 4 bpp to one index byte per pixel. */
+static void
+expand4 (grub_uint8_t* index, const grub_uint8_t* src, grub_uint32_t width)
+{
+  for (grub_uint32_t x = 0; x < width; x += 2, src++)
+  {
+    index[x] = *src >> 4;
+    index[x + 1] = *src & 15;
+  }
+}
+
+#endif
+
+/** 0x00BBGGRR, as RGB bytes read in little endian, to 0x00RRGGBB. */
+static inline grub_uint32_t
+swap_rb (grub_uint32_t v)
+{
+  return (v & 0xff) << 16 | (v & 0xff00) | (v >> 16 & 0xff);
+}
+
+#if HACKBGRT_WITH_PNG
+static void
+row_rgb (grub_uint8_t* dst, const grub_uint8_t* src, grub_uint32_t width)
+{
+  grub_uint32_t x = 0;
+  for (; x + 4 <= width; x += 4, src += 12, dst += 12)
+  {
+    grub_uint32_t w0 = load32 (src), w1 = load32 (src + 4), w2 = load32 (src + 8);
+    store_bgr4 (dst, swap_rb (w0), swap_rb (w0 >> 24 | w1 << 8), swap_rb (w1 >> 16 | w2 << 16), swap_rb (w2 >> 8));
+  }
+  for (; x < width; x++, src += 3, dst += 3)
+  {
+    dst[0] = src[2];
+    dst[1] = src[1];
+    dst[2] = src[0];
+  }
+}
+
+static inline grub_uint32_t
+blend_rgba (grub_uint32_t v)
+{
+  grub_uint32_t a = v >> 24;
+  if (a == 255)
+    return swap_rb (v);
+  if (a == 0)
+    return 0;
+  return ((v & 0xff) * a + 127) / 255 << 16
+         | ((v >> 8 & 0xff) * a + 127) / 255 << 8
+         | ((v >> 16 & 0xff) * a + 127) / 255;
+}
+
+static void
+row_rgba (grub_uint8_t* dst, const grub_uint8_t* src, grub_uint32_t width)
+{
+  grub_uint32_t x = 0;
+  for (; x + 4 <= width; x += 4, src += 16, dst += 12)
+  {
+    grub_uint32_t p0 = load32 (src), p1 = load32 (src + 4), p2 = load32 (src + 8), p3 = load32 (src + 12);
+    if ((p0 & p1 & p2 & p3) >> 24 == 255)
+      store_bgr4 (dst, swap_rb (p0), swap_rb (p1), swap_rb (p2), swap_rb (p3));
+    else
+      store_bgr4 (dst, blend_rgba (p0), blend_rgba (p1), blend_rgba (p2), blend_rgba (p3));
+  }
+  for (; x < width; x++, src += 4, dst += 3)
+    store_bgr (dst, blend_rgba (load32 (src)));
+}
+
+#endif
+
+#if HACKBGRT_WITH_CONVERT || HACKBGRT_WITH_OVERLAY
+struct channel
+{
+  grub_uint32_t mask;
+  unsigned shift;
+  grub_uint32_t max;
+};
+
+static void
+init_channel (struct channel* c, grub_uint32_t mask)
+{
+  c->mask = mask;
+  c->shift = 0;
+  c->max = 0;
+  if (!mask)
+    return;
+  while (!(mask & 1))
+  {
+    mask >>= 1;
+    c->shift++;
+  }
+  c->max = mask;
+}
+
+static inline grub_uint32_t
+channel_value (const struct channel* c, grub_uint32_t pixel)
+{
+  grub_uint32_t v = (pixel & c->mask) >> c->shift;
+  if (c->max == 255)
+    return v;
+  if (!c->max)
+    return 0;
+  return (v * 255 + c->max / 2) / c->max;
+}
+
+#endif
+
+#if HACKBGRT_WITH_CONVERT
+/** Any 16 or 32 bpp masks, one pixel at a time; only odd encoders need it. */
+static void
+row_masks (grub_uint8_t* dst, const grub_uint8_t* src, grub_uint32_t width, grub_uint16_t bpp,
+           const struct channel* channels)
+{
+  for (grub_uint32_t x = 0; x < width; x++, dst += 3)
+  {
+    grub_uint32_t pixel = bpp == 32 ? load32 (src + 4 * x) : (grub_uint32_t) (src[2 * x] | src[2 * x + 1] << 8);
+    grub_uint32_t r = channel_value (&channels[0], pixel);
+    grub_uint32_t g = channel_value (&channels[1], pixel);
+    grub_uint32_t b = channel_value (&channels[2], pixel);
+    grub_uint32_t a = channels[3].mask ? channel_value (&channels[3], pixel) : 255;
+    if (a != 255)
+    {
+      r = (r * a + 127) / 255;
+      g = (g * a + 127) / 255;
+      b = (b * a + 127) / 255;
+    }
+    dst[0] = b;
+    dst[1] = g;
+    dst[2] = r;
+  }
+}
+
+#endif
+
+/*
+ * Parsing
+ */
+
+grub_err_t
+hackbgrt_bmp_parse (const grub_uint8_t* file, grub_size_t size, struct hackbgrt_bmp_info* info)
+{
+  return hackbgrt_bmp_parse_head (file, size, size, info);
+}
+
+grub_err_t
+hackbgrt_bmp_parse_head (const grub_uint8_t* head, grub_size_t head_size, grub_uint64_t size,
+                         struct hackbgrt_bmp_info* info)
+{
+  struct bitmap_header header;
+  grub_int32_t height;
+  grub_uint32_t palette_offset, palette_count = 0;
+  grub_uint64_t stride;
+
+  grub_memset (info, 0, sizeof (*info));
+  if (head_size < sizeof (header) || head_size > size || size > HACKBGRT_BMP_MAX_FILE_SIZE)
+    return GRUB_ERR_BAD_FILE_TYPE;
+  grub_memcpy (&header, head, sizeof (header));
+  height = (grub_int32_t) header.height;
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "bmp: dib_header_size=%d, %dx%d, bpp=%d, compression=%d, palette_colors=%d\n",
+                  header.dib_header_size, header.width, height, header.bpp, header.compression, header.palette_colors);
+  if (grub_memcmp (&header.signature, BMP_MAGIC, BMP_MAGIC_SIZE) != 0
+      || (header.dib_header_size != BMP_DIB_HEADER_SIZE
+          && header.dib_header_size != BMP_V2_HEADER_SIZE
+          && header.dib_header_size != BMP_V3_HEADER_SIZE
+          && header.dib_header_size != BMP_V4_HEADER_SIZE
+          && header.dib_header_size != BMP_V5_HEADER_SIZE)
+      || BMP_FILE_HEADER_SIZE + header.dib_header_size > head_size
+      || header.planes != 1
+      || header.width == 0 || header.width > HACKBGRT_BMP_MAX_DIMENSION
+      || height == 0 || height < -HACKBGRT_BMP_MAX_DIMENSION || height > HACKBGRT_BMP_MAX_DIMENSION
+      || header.pixel_data_offset >= size)
+    return GRUB_ERR_BAD_FILE_TYPE;
+
+  info->width = header.width;
+  info->top_down = height < 0;
+  info->height = height < 0 ? -height : height;
+  info->bpp = header.bpp;
+  info->compression = header.compression;
+  info->pixel_offset = header.pixel_data_offset;
+  info->data_size = size - header.pixel_data_offset;
+  if ((grub_uint64_t) get_bitmap_total_size (info->width, 1) * info->height > HACKBGRT_BMP_MAX_FILE_SIZE)
+    return GRUB_ERR_BAD_FILE_TYPE;
+
+  switch (header.compression)
+  {
+    case BMP_NO_COMPRESSION:
+      if (header.bpp == 16)
+      {
+        info->masks[0] = 0x7c00;
+        info->masks[1] = 0x03e0;
+        info->masks[2] = 0x001f;
+      }
+      else if (header.bpp == 32)
+      {
+        // the fourth byte is unused, not alpha
+        info->masks[0] = 0xff0000;
+        info->masks[1] = 0x00ff00;
+        info->masks[2] = 0x0000ff;
+      }
+      else if (header.bpp != 1 && header.bpp != 4 && header.bpp != 8 && header.bpp != 24)
+        return GRUB_ERR_BAD_FILE_TYPE;
+      break;
+    case BMP_RLE8:
+    case BMP_RLE4:
+      if (header.bpp != (header.compression == BMP_RLE8 ? 8 : 4) || info->top_down)
+        return GRUB_ERR_BAD_FILE_TYPE;
+      break;
+    case BMP_BITFIELDS:
+    case BMP_ALPHABITFIELDS:
+    {
+      // right after the 40-byte header, inside the V2+ ones
+      unsigned count = header.compression == BMP_ALPHABITFIELDS || header.dib_header_size >= BMP_V3_HEADER_SIZE ? 4 : 3;
+      if ((header.bpp != 16 && header.bpp != 32)
+          || BMP_PIXEL_DATA_OFFSET + 4 * count > head_size)
+        return GRUB_ERR_BAD_FILE_TYPE;
+      for (unsigned i = 0; i < count; i++)
+        info->masks[i] = load32 (head + BMP_PIXEL_DATA_OFFSET + 4 * i);
+      if (!info->masks[0] && !info->masks[1] && !info->masks[2])
+        return GRUB_ERR_BAD_FILE_TYPE;
+      break;
+    }
+    default:
+      return GRUB_ERR_BAD_FILE_TYPE;
+  }
+
+  if (header.bpp <= 8)
+  {
+    palette_offset = BMP_FILE_HEADER_SIZE + header.dib_header_size;
+    palette_count = header.palette_colors ? header.palette_colors : 1u << header.bpp;
+    if (palette_count > (1u << header.bpp) || palette_offset + 4 * palette_count > head_size)
+      return GRUB_ERR_BAD_FILE_TYPE;
+    for (grub_uint32_t i = 0; i < palette_count; i++)
+      info->palette[i] = load32 (head + palette_offset + 4 * i) & 0xffffff;
+  }
+
+  if (header.compression != BMP_RLE8 && header.compression != BMP_RLE4)
+  {
+    stride = ((grub_uint64_t) info->width * info->bpp + 31) / 32 * 4;
+    if (stride * info->height > info->data_size)
+      return GRUB_ERR_BAD_FILE_TYPE;
+  }
+  return GRUB_ERR_NONE;
+}
+
+/*
+ * Conversion
+ */
+
+void
+hackbgrt_bmp_init_header (struct bitmap_header* header, grub_uint32_t width, grub_uint32_t height)
+{
+  grub_memcpy (&header->signature, BMP_MAGIC, BMP_MAGIC_SIZE);
+  header->size = get_bitmap_total_size (width, height);
+  header->unused = 0;
+  header->pixel_data_offset = BMP_PIXEL_DATA_OFFSET;
+  header->dib_header_size = BMP_DIB_HEADER_SIZE;
+  header->width = width;
+  header->height = height;
+  header->planes = 1;
+  header->bpp = BMP_888_BPP;
+  header->compression = BMP_NO_COMPRESSION;
+  header->data_size = get_bitmap_pixels_size (width, height);
+  header->ppm_horiz = BMP_72_DPI;
+  header->ppm_vert = BMP_72_DPI;
+  header->palette_colors = BMP_NO_PALETTE;
+  header->important_colors = BMP_NO_PALETTE;
+}
+
+#if HACKBGRT_WITH_CONVERT
+struct hackbgrt_bmp_stream
+{
+  const struct hackbgrt_bmp_info* info;
+  grub_uint8_t* pixels;
+  grub_uint32_t out_stride;
+  grub_size_t in_stride;      // 0 for RLE
+  grub_uint32_t row;          // the next row of the file
+  grub_uint32_t x;            // RLE: the next pixel of the row
+  int ended;                  // RLE: end of bitmap code
+  grub_uint8_t* index;        // a row of indices, per worker for bpp < 8, a single one for RLE
+  grub_size_t index_size;
+  int bgrx;
+  struct channel channels[4];
+};
+
+/**
+ * A chunk of rows, shared by the bands.
+ */
+struct convert_job
+{
+  const struct hackbgrt_bmp_stream* stream;
+  const grub_uint8_t* data;
+  grub_uint32_t first;        // the row of the file data starts with
+};
+
+static inline grub_uint8_t*
+output_row (const struct hackbgrt_bmp_stream* stream, grub_uint32_t row)
+{
+  const struct hackbgrt_bmp_info* info = stream->info;
+  // output rows are bottom-up
+  return stream->pixels + (grub_size_t) (info->top_down ? info->height - 1 - row : row) * stream->out_stride;
+}
+
+static void
+convert_band (void* context, unsigned worker, grub_uint32_t first, grub_uint32_t count)
+{
+  const struct convert_job* job = context;
+  const struct hackbgrt_bmp_stream* stream = job->stream;
+  const struct hackbgrt_bmp_info* info = stream->info;
+  grub_uint8_t* index = stream->index + worker * stream->index_size;
+
+  for (grub_uint32_t i = first; i < first + count; i++)
+  {
+    const grub_uint8_t* src = job->data + (grub_size_t) i * stream->in_stride;
+    grub_uint8_t* dst = output_row (stream, job->first + i);
+    if (info->bpp == 8)
+      row_lut8 (dst, src, info->width, info->palette);
+    else if (info->bpp == 1 || info->bpp == 4)
+    {
+      (info->bpp == 1 ? expand1 : expand4) (index, src, info->width);
+      row_lut8 (dst, index, info->width, info->palette);
+    }
+    else if (info->bpp == 24)
+      grub_memcpy (dst, src, 3 * info->width);
+    else if (stream->bgrx)
+      row_bgrx (dst, src, info->width);
+    else
+      row_masks (dst, src, info->width, info->bpp, stream->channels);
+    // row padding
+    grub_memset (dst + 3 * info->width, 0, stream->out_stride - 3 * info->width);
+  }
+}
+
+/**
+ * Write the row of indices of an RLE bitmap and start the next one blank.
+ */
+static void
+rle_next_row (struct hackbgrt_bmp_stream* stream)
+{
+  const struct hackbgrt_bmp_info* info = stream->info;
+  grub_uint8_t* dst = output_row (stream, stream->row);
+
+  row_lut8 (dst, stream->index, info->width, info->palette);
+  grub_memset (dst + 3 * info->width, 0, stream->out_stride - 3 * info->width);
+  grub_memset (stream->index, 0, info->width);
+  stream->row++;
+}
+
+/**
+ * Decode RLE4 or RLE8 codes, bottom-up.
+ *
+ * Runs past the end of a row or of the image are clipped, as Windows does.
+ *
+ * @return The bytes of the whole codes decoded.
+ */
+static grub_size_t
+rle_feed (struct hackbgrt_bmp_stream* stream, const grub_uint8_t* src, grub_size_t size)
+{
+  const struct hackbgrt_bmp_info* info = stream->info;
+  int rle4 = info->compression == BMP_RLE4;
+  grub_size_t pos = 0;
+
+  while (size - pos >= 2 && stream->row < info->height && !stream->ended)
+  {
+    grub_uint8_t count = src[pos];
+    grub_uint8_t value = src[pos + 1];
+    grub_uint32_t x = stream->x;
+    if (count)
+    {
+      grub_uint32_t n = x < info->width ? grub_min ((grub_uint32_t) count, info->width - x) : 0;
+      grub_uint8_t* dst = stream->index + x;
+      if (!rle4 || value >> 4 == (value & 15))
+        grub_memset (dst, rle4 ? value & 15 : value, n);
+      else
+        for (unsigned i = 0; i < n; i++)
+          dst[i] = i & 1 ? value & 15 : value >> 4;
+      stream->x += count;
+      pos += 2;
+    }
+    else if (value == 0) // end of line
+    {
+      rle_next_row (stream);
+      stream->x = 0;
+      pos += 2;
+    }
+    else if (value == 1) // end of bitmap
+    {
+      stream->ended = 1;
+      pos += 2;
+    }
+    else if (value == 2) // delta
+    {
+      if (size - pos < 4)
+        break;
+      stream->x += src[pos + 2];
+      for (unsigned dy = src[pos + 3]; dy && stream->row < info->height; dy--)
+        rle_next_row (stream);
+      pos += 4;
+    }
+    else // absolute run, padded to a word
+    {
+      grub_size_t bytes = rle4 ? (value + 1) / 2 : value;
+      const grub_uint8_t* run = src + pos + 2;
+      if (size - pos - 2 < ((bytes + 1) & ~(grub_size_t) 1))
+        break;
+      for (unsigned i = 0; i < value && x < info->width; i++, x++)
+        stream->index[x] = !rle4 ? run[i] : i & 1 ? run[i / 2] & 15 : run[i / 2] >> 4;
+      stream->x += value;
+      pos += 2 + ((bytes + 1) & ~(grub_size_t) 1);
+    }
+  }
+  return pos;
+}
+
+hackbgrt_bmp_stream_t
+hackbgrt_bmp_stream_open (const struct hackbgrt_bmp_info* info, bitmap_t out)
+{
+  hackbgrt_bmp_stream_t stream = grub_zalloc (sizeof (*stream));
+  int rle = info->compression == BMP_RLE8 || info->compression == BMP_RLE4;
+
+  if (!stream)
+    return 0;
+  stream->info = info;
+  stream->pixels = (grub_uint8_t*) out + BMP_PIXEL_DATA_OFFSET;
+  stream->out_stride = get_bitmap_pixels_size (info->width, 1);
+  stream->in_stride = rle ? 0 : ((grub_size_t) info->width * info->bpp + 31) / 32 * 4;
+  stream->bgrx = info->bpp == 32 && info->masks[0] == 0xff0000 && info->masks[1] == 0x00ff00
+                 && info->masks[2] == 0x0000ff && !info->masks[3];
+  if (rle || info->bpp < 8)
+  {
+    // with room for the last source byte; RLE is decoded on the BSP alone
+    stream->index_size = ALIGN_UP (info->width, 8);
+    stream->index = grub_zalloc (stream->index_size * (rle ? 1 : hackbgrt_parallel_workers ()));
+    if (!stream->index)
+    {
+      grub_free (stream);
+      return 0;
+    }
+  }
+  for (unsigned i = 0; i < 4; i++)
+    init_channel (&stream->channels[i], info->masks[i]);
+  hackbgrt_bmp_init_header (&out->header, info->width, info->height);
+  return stream;
+}
+
+int
+hackbgrt_bmp_stream_feed (hackbgrt_bmp_stream_t stream, const grub_uint8_t* data, grub_size_t size, grub_size_t* used)
+{
+  const struct hackbgrt_bmp_info* info = stream->info;
+  struct convert_job job = {
+    .stream = stream,
+    .data = data,
+    .first = stream->row,
+  };
+  grub_uint32_t rows;
+
+  if (!stream->in_stride)
+  {
+    *used = rle_feed (stream, data, size);
+    return stream->ended || stream->row == info->height;
+  }
+  rows = grub_min (size / stream->in_stride, (grub_size_t) (info->height - stream->row));
+  // the work goes with the larger side, the 32-bit rows read or the 24-bit ones written
+  if (rows)
+    hackbgrt_parallel_rows (rows, grub_max (stream->in_stride, (grub_size_t) stream->out_stride), convert_band, &job);
+  stream->row += rows;
+  *used = rows * stream->in_stride;
+  return stream->row == info->height;
+}
+
+void
+hackbgrt_bmp_stream_close (hackbgrt_bmp_stream_t stream)
+{
+  const struct hackbgrt_bmp_info* info = stream->info;
+
+  if (!stream->in_stride)
+    while (stream->row < info->height)
+      rle_next_row (stream);
+  for (; stream->row < info->height; stream->row++)
+    grub_memset (output_row (stream, stream->row), 0, stream->out_stride);
+  grub_free (stream->index);
+  grub_free (stream);
+}
+
+grub_err_t
+hackbgrt_bmp_convert (const struct hackbgrt_bmp_info* info, const grub_uint8_t* file, bitmap_t out)
+{
+  hackbgrt_bmp_stream_t stream = hackbgrt_bmp_stream_open (info, out);
+  grub_size_t used;
+
+  if (!stream)
+    return grub_errno;
+  hackbgrt_bmp_stream_feed (stream, file + info->pixel_offset, info->data_size, &used);
+  hackbgrt_bmp_stream_close (stream);
+  return GRUB_ERR_NONE;
+}
+
+#endif
+
+#if HACKBGRT_WITH_PNG
+/**
+ * An RGB(A) run, shared by the bands of output rows.
+ */
+struct rgb_job
+{
+  const grub_uint8_t* data;
+  grub_uint32_t width;
+  grub_uint32_t height;
+  grub_uint32_t pitch;
+  grub_uint32_t out_stride;
+  grub_uint8_t* pixels;
+  int alpha;
+};
+
+static void
+rgb_band (void* context, unsigned worker __attribute__ ((unused)), grub_uint32_t first, grub_uint32_t count)
+{
+  const struct rgb_job* job = context;
+  for (grub_uint32_t y = first; y < first + count; y++)
+  {
+    // output rows are bottom-up
+    const grub_uint8_t* src = job->data + (grub_size_t) (job->height - 1 - y) * job->pitch;
+    grub_uint8_t* dst = job->pixels + (grub_size_t) y * job->out_stride;
+    (job->alpha ? row_rgba : row_rgb) (dst, src, job->width);
+    grub_memset (dst + 3 * job->width, 0, job->out_stride - 3 * job->width);
+  }
+}
+
+void
+hackbgrt_bmp_from_rgb (bitmap_t out, const grub_uint8_t* data, grub_uint32_t width, grub_uint32_t height,
+                       grub_uint32_t pitch, int alpha)
+{
+  struct rgb_job job = {
+    .data = data,
+    .width = width,
+    .height = height,
+    .pitch = pitch,
+    .out_stride = get_bitmap_pixels_size (width, 1),
+    .pixels = (grub_uint8_t*) out + BMP_PIXEL_DATA_OFFSET,
+    .alpha = alpha,
+  };
+
+  hackbgrt_bmp_init_header (&out->header, width, height);
+  hackbgrt_parallel_rows (height, job.out_stride, rgb_band, &job);
+}
+
+#endif
+
+#if HACKBGRT_WITH_SCALE
+/** 1 if the pixels of a row all have the color of its first one. */
+static int
+row_uniform (const grub_uint8_t* row, grub_uint32_t width)
+{
+  return width < 2 || grub_memcmp (row, row + 3, 3 * (width - 1)) == 0;
+}
+
+void
+hackbgrt_bmp_bounds (const bitmap_t bmp, struct hackbgrt_bmp_rect* rect)
+{
+  grub_uint32_t width = bmp->header.width, height = bmp->header.height;
+  grub_uint32_t stride = get_bitmap_pixels_size (width, 1);
+  const grub_uint8_t* pixels = (const grub_uint8_t*) bmp + BMP_PIXEL_DATA_OFFSET;
+  // rows are bottom-up: the top left pixel starts the last row
+  const grub_uint8_t* background = pixels + (grub_size_t) (height - 1) * stride;
+  grub_uint32_t bottom = 0, top = height, left = width, right = 0;
+
+#define ROW(r) (pixels + (grub_size_t) (r) * stride)
+#define BACKGROUND(p) (grub_memcmp ((p), background, 3) == 0)
+  while (bottom < height && BACKGROUND (ROW (bottom)) && row_uniform (ROW (bottom), width))
+    bottom++;
+  if (bottom == height)
+  {
+    rect->x = rect->y = 0;
+    rect->width = rect->height = 1;
+    return;
+  }
+  while (BACKGROUND (ROW (top - 1)) && row_uniform (ROW (top - 1), width))
+    top--;
+  for (grub_uint32_t r = bottom; r < top; r++)
+  {
+    const grub_uint8_t* row = ROW (r);
+    grub_uint32_t x = 0;
+    while (x < left && BACKGROUND (row + 3 * x))
+      x++;
+    left = x;
+    x = width;
+    while (x > right && BACKGROUND (row + 3 * (x - 1)))
+      x--;
+    right = x;
+  }
+#undef ROW
+#undef BACKGROUND
+  rect->x = left;
+  rect->y = height - top;
+  rect->width = right - left;
+  rect->height = top - bottom;
+}
+
+void
+hackbgrt_bmp_crop (const bitmap_t src, bitmap_t dst, const struct hackbgrt_bmp_rect* rect)
+{
+  grub_uint32_t src_stride = get_bitmap_pixels_size (src->header.width, 1);
+  grub_uint32_t dst_stride = get_bitmap_pixels_size (rect->width, 1);
+  // the bottom row of the rectangle, as rows are bottom-up
+  const grub_uint8_t* in = (const grub_uint8_t*) src + BMP_PIXEL_DATA_OFFSET
+                           + (grub_size_t) (src->header.height - rect->y - rect->height) * src_stride + 3 * rect->x;
+  grub_uint8_t* out = (grub_uint8_t*) dst + BMP_PIXEL_DATA_OFFSET;
+
+  hackbgrt_bmp_init_header (&dst->header, rect->width, rect->height);
+  for (grub_uint32_t y = 0; y < rect->height; y++, in += src_stride, out += dst_stride)
+  {
+    grub_memcpy (out, in, 3 * rect->width);
+    grub_memset (out + 3 * rect->width, 0, dst_stride - 3 * rect->width);
+  }
+}
+
+#endif
+
+/*
+ * Compositing
+ */
+
+#if HACKBGRT_WITH_OVERLAY
+
+grub_err_t
+hackbgrt_bgra_from_bmp (const struct hackbgrt_bmp_info* info, const grub_uint8_t* file, struct hackbgrt_bgra* out)
+{
+  const grub_uint8_t* data = file + info->pixel_offset;
+  grub_size_t stride = (grub_size_t) info->width * 4;
+  int standard = info->masks[0] == 0xff0000 && info->masks[1] == 0x00ff00 && info->masks[2] == 0x0000ff
+                 && (!info->masks[3] || info->masks[3] == 0xff000000);
+  struct channel channels[4];
+  grub_uint32_t alpha_seen = 0;
+
+  if (info->bpp != 32)
+    return GRUB_ERR_BAD_FILE_TYPE;
+  out->width = info->width;
+  out->height = info->height;
+  out->pixels = grub_malloc (stride * info->height);
+  if (!out->pixels)
+    return grub_errno;
+  for (unsigned i = 0; i < 4; i++)
+    init_channel (&channels[i], info->masks[i]);
+  for (grub_uint32_t y = 0; y < info->height; y++)
+  {
+    const grub_uint8_t* src = data + (grub_size_t) (info->top_down ? info->height - 1 - y : y) * stride;
+    grub_uint32_t* dst = out->pixels + (grub_size_t) y * info->width;
+    if (standard)
+    {
+      grub_memcpy (dst, src, stride);
+      for (grub_uint32_t x = 0; x < info->width; x++)
+        alpha_seen |= dst[x];
+      continue;
+    }
+    for (grub_uint32_t x = 0; x < info->width; x++)
+    {
+      grub_uint32_t pixel = load32 (src + 4 * x);
+      grub_uint32_t a = channels[3].mask ? channel_value (&channels[3], pixel) : 255;
+      dst[x] = a << 24 | channel_value (&channels[0], pixel) << 16 | channel_value (&channels[1], pixel) << 8
+               | channel_value (&channels[2], pixel);
+    }
+  }
+  // a fourth byte left at 0 is padding, not a transparent image
+  if (standard && !info->masks[3] && !(alpha_seen >> 24))
+    for (grub_size_t i = 0; i < (grub_size_t) info->width * info->height; i++)
+      out->pixels[i] |= 0xff000000;
+  return GRUB_ERR_NONE;
+}
+
+grub_err_t
+hackbgrt_bgra_from_rgb (struct hackbgrt_bgra* out, const grub_uint8_t* data, grub_uint32_t width,
+                        grub_uint32_t height, grub_uint32_t pitch, int alpha)
+{
+  out->width = width;
+  out->height = height;
+  out->pixels = grub_malloc ((grub_size_t) width * height * 4);
+  if (!out->pixels)
+    return grub_errno;
+  for (grub_uint32_t y = 0; y < height; y++)
+  {
+    // rows are bottom-up
+    const grub_uint8_t* src = data + (grub_size_t) (height - 1 - y) * pitch;
+    grub_uint32_t* dst = out->pixels + (grub_size_t) y * width;
+    if (alpha)
+      for (grub_uint32_t x = 0; x < width; x++)
+      {
+        grub_uint32_t v = load32 (src + 4 * x);
+        dst[x] = (v & 0xff000000) | swap_rb (v);
+      }
+    else
+      for (grub_uint32_t x = 0; x < width; x++, src += 3)
+        dst[x] = 0xff000000 | (grub_uint32_t) src[0] << 16 | src[1] << 8 | src[2];
+  }
+  return GRUB_ERR_NONE;
+}
+
+void
+hackbgrt_bmp_extend (const bitmap_t src, bitmap_t dst, grub_uint32_t width, grub_uint32_t height)
+{
+  grub_uint32_t src_width = src->header.width, src_height = src->header.height;
+  grub_uint32_t src_stride = get_bitmap_pixels_size (src_width, 1);
+  grub_uint32_t dst_stride = get_bitmap_pixels_size (width, 1);
+  const grub_uint8_t* in = (const grub_uint8_t*) src + BMP_PIXEL_DATA_OFFSET;
+  grub_uint8_t* out = (grub_uint8_t*) dst + BMP_PIXEL_DATA_OFFSET;
+
+  hackbgrt_bmp_init_header (&dst->header, width, height);
+  // rows are bottom-up: the rows added are the first ones
+  grub_memset (out, 0, (grub_size_t) (height - src_height) * dst_stride);
+  out += (grub_size_t) (height - src_height) * dst_stride;
+  for (grub_uint32_t y = 0; y < src_height; y++, in += src_stride, out += dst_stride)
+  {
+    grub_memcpy (out, in, 3 * src_width);
+    grub_memset (out + 3 * src_width, 0, dst_stride - 3 * src_width);
+  }
+}
+
+static inline grub_uint32_t
+load_bgr (const grub_uint8_t* p)
+{
+  return p[0] | p[1] << 8 | (grub_uint32_t) p[2] << 16;
+}
+
+/**
+ * s, 0xAARRGGBB, over d, 0x00RRGGBB: (s * a + d * (255 - a)) / 255 per
+ * channel, rounded. Red and blue share a word, 16 bits each; the division
+ * is (t + (t >> 8)) >> 8 with t = v + 128, exact for v up to 255 * 255.
+ */
+static inline grub_uint32_t
+blend_over (grub_uint32_t s, grub_uint32_t d)
+{
+  grub_uint32_t a = s >> 24, na = 255 - a;
+  grub_uint32_t rb = (s & 0xff00ff) * a + (d & 0xff00ff) * na + 0x800080;
+  grub_uint32_t g = (s & 0x00ff00) * a + (d & 0x00ff00) * na + 0x008000;
+  rb = (rb + (rb >> 8 & 0xff00ff)) >> 8 & 0xff00ff;
+  g = (g + (g >> 8 & 0x00ff00)) >> 8 & 0x00ff00;
+  return rb | g;
+}
+
+static void
+row_over (grub_uint8_t* dst, const grub_uint32_t* src, grub_uint32_t width)
+{
+  grub_uint32_t x = 0;
+  for (; x + 4 <= width; x += 4, src += 4, dst += 12)
+  {
+    grub_uint32_t p0 = src[0], p1 = src[1], p2 = src[2], p3 = src[3];
+    if ((p0 & p1 & p2 & p3) >> 24 == 255)
+      store_bgr4 (dst, p0, p1, p2, p3);
+    else if ((p0 | p1 | p2 | p3) >> 24)
+    {
+      grub_uint32_t w0 = load32 (dst), w1 = load32 (dst + 4), w2 = load32 (dst + 8);
+      store_bgr4 (dst, blend_over (p0, w0), blend_over (p1, w0 >> 24 | w1 << 8),
+                  blend_over (p2, w1 >> 16 | w2 << 16), blend_over (p3, w2 >> 8));
+    }
+  }
+  for (; x < width; x++, src++, dst += 3)
+    if (*src >> 24)
+      store_bgr (dst, blend_over (*src, load_bgr (dst)));
+}
+
+void
+hackbgrt_bmp_overlay (bitmap_t dst, const struct hackbgrt_bgra* src, grub_uint32_t x, grub_uint32_t y)
+{
+  grub_uint32_t width = dst->header.width, height = dst->header.height;
+  grub_uint32_t stride = get_bitmap_pixels_size (width, 1);
+  grub_uint8_t* pixels = (grub_uint8_t*) dst + BMP_PIXEL_DATA_OFFSET;
+  grub_uint32_t overlap_width, overlap_height;
+
+  if (x >= width || y >= height)
+    return;
+  overlap_width = grub_min (src->width, width - x);
+  overlap_height = grub_min (src->height, height - y);
+  // r counts the rows from the top; both bitmaps store them bottom-up
+  for (grub_uint32_t r = 0; r < overlap_height; r++)
+    row_over (pixels + (grub_size_t) (height - 1 - y - r) * stride + 3 * x,
+              src->pixels + (grub_size_t) (src->height - 1 - r) * src->width, overlap_width);
+}
+#endif
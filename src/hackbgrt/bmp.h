@@ -0,0 +1,232 @@
+#pragma once
+
+#include <grub/err.h>
+#include <grub/types.h>
+#include "types.h"
+
+#define HACKBGRT_BMP_MAX_DIMENSION 32768
+#define HACKBGRT_BMP_MAX_FILE_SIZE (256 * 1024 * 1024)
+// what a converted file is read in: its headers and palette, or at least one row (32768 pixels of 32 bits)
+#define HACKBGRT_BMP_STREAM_CHUNK (1024 * 1024)
+
+/**
+ * A bitmap file in one of the formats the BGRT does not take as is.
+ *
+ * Accepted: 1, 4 and 8 bpp indexed, RLE4 and RLE8, 16 and 32 bpp BI_RGB or
+ * (ALPHA)BITFIELDS, 24 bpp with any DIB header from BITMAPINFOHEADER to
+ * BITMAPV5HEADER, bottom-up or top-down.
+ */
+struct hackbgrt_bmp_info
+{
+  grub_uint32_t width;
+  grub_uint32_t height;
+  int top_down;
+  grub_uint16_t bpp;
+  grub_uint32_t compression;
+  grub_uint32_t pixel_offset;
+  grub_uint32_t data_size; // from pixel_offset to the end of the file
+  grub_uint32_t masks[4]; // red, green, blue, alpha; 16 and 32 bpp only
+  grub_uint32_t palette[256]; // 0x00RRGGBB, what a BGR pixel reads as in little endian
+};
+
+/**
+ * Check a bitmap file and describe how to convert it.
+ *
+ * @param file The whole file.
+ * @param size The size of the file.
+ * @param info Filled on success.
+ * @return GRUB_ERR_NONE, or GRUB_ERR_BAD_FILE_TYPE if the format is not supported.
+ */
+extern grub_err_t
+hackbgrt_bmp_parse (const grub_uint8_t* file, grub_size_t size, struct hackbgrt_bmp_info* info);
+
+/**
+ * Check the head of a bitmap file and describe how to convert it, before
+ * the rest of the file is read.
+ *
+ * @param head The first bytes of the file.
+ * @param head_size The bytes in head: all the headers and the palette, or the whole file.
+ * @param size The size of the file, which must hold every row the headers declare.
+ * @param info Filled on success.
+ * @return GRUB_ERR_NONE, or GRUB_ERR_BAD_FILE_TYPE if the format is not supported.
+ */
+extern grub_err_t
+hackbgrt_bmp_parse_head (const grub_uint8_t* head, grub_size_t head_size, grub_uint64_t size,
+                         struct hackbgrt_bmp_info* info);
+
+/**
+ * Convert a parsed bitmap file to the layout the BGRT requires: 24 bpp,
+ * BI_RGB, bottom-up, 40-byte DIB header and no palette.
+ *
+ * Rows are converted by kernels that emit four pixels (three words) per
+ * iteration from palette or channel lookups. Pixels an RLE bitmap skips take
+ * palette entry 0; an alpha channel is blended over black.
+ *
+ * @param info The result of hackbgrt_bmp_parse.
+ * @param file The whole file.
+ * @param out The output, get_bitmap_total_size (info->width, info->height) bytes.
+ * @return GRUB_ERR_NONE, or the error also set in grub_errno.
+ */
+extern grub_err_t
+hackbgrt_bmp_convert (const struct hackbgrt_bmp_info* info, const grub_uint8_t* file, bitmap_t out);
+
+typedef struct hackbgrt_bmp_stream* hackbgrt_bmp_stream_t;
+
+/**
+ * Start a conversion fed with the pixel data of the file as it is read, as
+ * hackbgrt_bmp_convert does with the whole file.
+ *
+ * Rows go straight to their place in the output, flipped and padded;
+ * RLE codes through a single row of indices.
+ *
+ * @param info The result of hackbgrt_bmp_parse_head, kept until hackbgrt_bmp_stream_close.
+ * @param out The output, get_bitmap_total_size (info->width, info->height) bytes; its header is filled.
+ * @return The stream, or 0 with grub_errno set.
+ */
+extern hackbgrt_bmp_stream_t
+hackbgrt_bmp_stream_open (const struct hackbgrt_bmp_info* info, bitmap_t out);
+
+/**
+ * Convert the next pixel data.
+ *
+ * @param data What follows the data already used, from info->pixel_offset on.
+ * @param size The bytes in data.
+ * @param used Set to the bytes converted: whole rows or RLE codes. The rest
+ *        must be passed again, followed by the next bytes of the file.
+ * @return 1 once the image is complete, 0 while it needs more.
+ */
+extern int
+hackbgrt_bmp_stream_feed (hackbgrt_bmp_stream_t stream, const grub_uint8_t* data, grub_size_t size, grub_size_t* used);
+
+/**
+ * Finish the output and free the stream. Rows the data did not reach are
+ * black, or palette entry 0 for RLE.
+ */
+extern void
+hackbgrt_bmp_stream_close (hackbgrt_bmp_stream_t stream);
+
+/**
+ * Fill the header of a BGRT-compliant bitmap.
+ *
+ * @param header The header to fill.
+ * @param width The width in pixels.
+ * @param height The height in pixels.
+ */
+extern void
+hackbgrt_bmp_init_header (struct bitmap_header* header, grub_uint32_t width, grub_uint32_t height);
+
+/**
+ * Convert top-down RGB or RGBA pixels, like a bitmap decoded by GRUB, to a
+ * BGRT-compliant bitmap. Opaque pixels are swapped four at a time; others
+ * are blended over black.
+ *
+ * @param out The output, get_bitmap_total_size (width, height) bytes.
+ * @param data The first row.
+ * @param width The width in pixels.
+ * @param height The height in pixels.
+ * @param pitch The bytes between two rows.
+ * @param alpha 1 for RGBA (4 bytes per pixel), 0 for RGB.
+ */
+extern void
+hackbgrt_bmp_from_rgb (bitmap_t out, const grub_uint8_t* data, grub_uint32_t width, grub_uint32_t height,
+                       grub_uint32_t pitch, int alpha);
+
+/**
+ * A rectangle of a bitmap, from its top left corner.
+ */
+struct hackbgrt_bmp_rect
+{
+  grub_uint32_t x;
+  grub_uint32_t y;
+  grub_uint32_t width;
+  grub_uint32_t height;
+};
+
+/**
+ * Find the smallest rectangle holding every pixel that differs from the
+ * background, the color of the top left pixel.
+ *
+ * Rows are compared with themselves shifted by a pixel, then each row of
+ * the rectangle is only scanned from its ends up to the columns already in
+ * it: a logo on a flat canvas is read about once.
+ *
+ * @param bmp A BGRT-compliant bitmap.
+ * @param rect Set to the rectangle; the top left pixel when the bitmap is uniform.
+ */
+extern void
+hackbgrt_bmp_bounds (const bitmap_t bmp, struct hackbgrt_bmp_rect* rect);
+
+/**
+ * Copy a rectangle of a bitmap into another one.
+ *
+ * @param src A BGRT-compliant bitmap.
+ * @param dst The output, get_bitmap_total_size (rect->width, rect->height) bytes; its header is filled.
+ * @param rect The rectangle, inside src.
+ */
+extern void
+hackbgrt_bmp_crop (const bitmap_t src, bitmap_t dst, const struct hackbgrt_bmp_rect* rect);
+
+/**
+ * An image with its alpha channel, to composite: 0xAARRGGBB pixels,
+ * straight (not premultiplied) alpha, rows bottom-up like the BGRT's and
+ * packed.
+ */
+struct hackbgrt_bgra
+{
+  grub_uint32_t width;
+  grub_uint32_t height;
+  grub_uint32_t* pixels; // from grub_malloc
+};
+
+/**
+ * Decode a parsed 32 bpp bitmap file with its alpha channel.
+ *
+ * Without an alpha mask, the fourth byte is the alpha, as in the files of
+ * most tools, unless it is 0 everywhere: the image is then opaque.
+ *
+ * @param info The result of hackbgrt_bmp_parse.
+ * @param file The whole file.
+ * @param out Filled on success; free its pixels with grub_free.
+ * @return GRUB_ERR_NONE, GRUB_ERR_BAD_FILE_TYPE if the bitmap is not 32 bpp, or the error also set in grub_errno.
+ */
+extern grub_err_t
+hackbgrt_bgra_from_bmp (const struct hackbgrt_bmp_info* info, const grub_uint8_t* file, struct hackbgrt_bgra* out);
+
+/**
+ * Take top-down RGB or RGBA pixels, like a bitmap decoded by GRUB, with their alpha channel.
+ *
+ * @param out Filled on success; free its pixels with grub_free.
+ * @param data The first row.
+ * @param pitch The bytes between two rows.
+ * @param alpha 1 for RGBA (4 bytes per pixel), 0 for RGB, which is opaque.
+ * @return GRUB_ERR_NONE, or the error also set in grub_errno.
+ */
+extern grub_err_t
+hackbgrt_bgra_from_rgb (struct hackbgrt_bgra* out, const grub_uint8_t* data, grub_uint32_t width,
+                        grub_uint32_t height, grub_uint32_t pitch, int alpha);
+
+/**
+ * Copy a bitmap into the top left corner of a larger one, black around.
+ *
+ * @param src A BGRT-compliant bitmap.
+ * @param dst The output, get_bitmap_total_size (width, height) bytes; its header is filled.
+ * @param width At least the width of src.
+ * @param height At least the height of src.
+ */
+extern void
+hackbgrt_bmp_extend (const bitmap_t src, bitmap_t dst, grub_uint32_t width, grub_uint32_t height);
+
+/**
+ * Blend an image over a bitmap, in place ("over" operator).
+ *
+ * Only the rectangle where they overlap is read and written. Four pixels
+ * go per iteration: opaque ones are stored as is, transparent ones
+ * skipped, the others blended with integer math, red and blue together.
+ *
+ * @param dst A BGRT-compliant bitmap.
+ * @param src The image to blend.
+ * @param x The position of the top left corner of src in dst.
+ * @param y
+ */
+extern void
+hackbgrt_bmp_overlay (bitmap_t dst, const struct hackbgrt_bgra* src, grub_uint32_t x, grub_uint32_t y);
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <grub/types.h>
+
+/** The path load_bmp is given for image=builtin, instead of an ESP file. */
+#define HACKBGRT_BUILTIN_PATH "builtin"
+
+/**
+ * The splash linked into the module with BUILTIN_IMAGE=, in its read-only
+ * data: a BGRT-compliant BMP or a .bmz container of one, checked by
+ * tools/hackbgrt-embed when builtin_image.c is generated.
+ * hackbgrt_builtin_image_size is 0 when the module has no image.
+ */
+extern const grub_uint8_t hackbgrt_builtin_image[];
+extern const grub_uint32_t hackbgrt_builtin_image_size;
@@ -0,0 +1,10 @@
+/*
+ * The image of image=builtin: none in this build. The top-level Makefile
+ * replaces this file with the output of tools/hackbgrt-embed when the module
+ * is built with BUILTIN_IMAGE=path/to/splash.bmp.
+ */
+#include <grub/types.h>
+#include "builtin.h"
+
+const grub_uint8_t hackbgrt_builtin_image[] __attribute__ ((aligned (16))) = { 0 };
+const grub_uint32_t hackbgrt_builtin_image_size = 0;
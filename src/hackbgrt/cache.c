@@ -0,0 +1,167 @@
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/types.h>
+#include "alloc.h"
+#include "cache.h"
+#include "tier.h"
+#include "types.h"
+
+struct hackbgrt_cache_entry
+{
+  struct hackbgrt_cache_entry* next;
+  char* path;
+  grub_uint64_t file_size;
+  bitmap_t bmp;
+  struct hackbgrt_cache_origin origin;
+  int published;
+};
+
+static struct hackbgrt_cache_entry* cache_entries;
+static struct hackbgrt_cache_stats cache_stats;
+
+void
+hackbgrt_cache_init (void)
+{
+  cache_entries = 0;
+  grub_memset (&cache_stats, 0, sizeof (cache_stats));
+}
+
+static void
+free_entry (struct hackbgrt_cache_entry* entry, int free_bitmap)
+{
+  cache_stats.entries--;
+  cache_stats.bytes -= entry->bmp->header.size;
+  if (free_bitmap)
+  {
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "cache: release %s (%p)\n", entry->path, entry->bmp);
+    hackbgrt_alloc_free (entry->bmp);
+    cache_stats.released++;
+  }
+  grub_free (entry->path);
+  grub_free (entry);
+}
+
+void
+hackbgrt_cache_fini (void)
+{
+  while (cache_entries)
+  {
+    struct hackbgrt_cache_entry* entry = cache_entries;
+    cache_entries = entry->next;
+    free_entry (entry, !entry->published);
+  }
+}
+
+bitmap_t
+hackbgrt_cache_lookup (const char* path, grub_uint64_t file_size)
+{
+  for (struct hackbgrt_cache_entry* entry = cache_entries; entry; entry = entry->next)
+    if (entry->file_size == file_size && grub_strcmp (entry->path, path) == 0)
+    {
+      hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "cache: hit %s (%p)\n", path, entry->bmp);
+      cache_stats.hits++;
+      return entry->bmp;
+    }
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "cache: miss %s\n", path);
+  cache_stats.misses++;
+  return 0;
+}
+
+bitmap_t
+hackbgrt_cache_lookup_screen (const char* path, grub_uint32_t screen_width, grub_uint32_t screen_height,
+                              grub_uint64_t file_size)
+{
+  char screen[24];
+  grub_size_t len = grub_strlen (path);
+  grub_snprintf (screen, sizeof (screen), "@%ux%u", screen_width, screen_height);
+  for (struct hackbgrt_cache_entry* entry = cache_entries; entry; entry = entry->next)
+    if (entry->file_size == file_size && grub_strncmp (entry->path, path, len) == 0
+        && (!entry->path[len] || grub_strcmp (entry->path + len, screen) == 0))
+    {
+      hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "cache: hit %s (%p)\n", entry->path, entry->bmp);
+      cache_stats.hits++;
+      return entry->bmp;
+    }
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "cache: miss %s%s\n", path, screen);
+  cache_stats.misses++;
+  return 0;
+}
+
+int
+hackbgrt_cache_contains (bitmap_t bmp)
+{
+  for (struct hackbgrt_cache_entry* entry = cache_entries; entry; entry = entry->next)
+    if (entry->bmp == bmp)
+      return 1;
+  return 0;
+}
+
+void
+hackbgrt_cache_insert (const char* path, grub_uint64_t file_size, bitmap_t bmp)
+{
+  struct hackbgrt_cache_origin origin = {
+    .image_width = bmp->header.width,
+    .image_height = bmp->header.height,
+  };
+  hackbgrt_cache_insert_cut (path, file_size, bmp, &origin);
+}
+
+void
+hackbgrt_cache_insert_cut (const char* path, grub_uint64_t file_size, bitmap_t bmp,
+                           const struct hackbgrt_cache_origin* origin)
+{
+  struct hackbgrt_cache_entry* entry = grub_zalloc (sizeof (*entry));
+  if (!entry)
+    return;
+  entry->path = grub_strdup (path);
+  if (!entry->path)
+  {
+    grub_free (entry);
+    return;
+  }
+  entry->file_size = file_size;
+  entry->bmp = bmp;
+  entry->origin = *origin;
+  entry->next = cache_entries;
+  cache_entries = entry;
+  cache_stats.entries++;
+  cache_stats.bytes += bmp->header.size;
+}
+
+void
+hackbgrt_cache_get_origin (bitmap_t bmp, struct hackbgrt_cache_origin* origin)
+{
+  for (struct hackbgrt_cache_entry* entry = cache_entries; entry; entry = entry->next)
+    if (entry->bmp == bmp)
+    {
+      *origin = entry->origin;
+      return;
+    }
+  origin->x = 0;
+  origin->y = 0;
+  origin->image_width = bmp->header.width;
+  origin->image_height = bmp->header.height;
+}
+
+void
+hackbgrt_cache_publish (bitmap_t bmp)
+{
+  for (struct hackbgrt_cache_entry** p = &cache_entries; *p;)
+  {
+    struct hackbgrt_cache_entry* entry = *p;
+    if (entry->bmp == bmp)
+    {
+      entry->published = 1;
+      p = &entry->next;
+      continue;
+    }
+    *p = entry->next;
+    free_entry (entry, 1);
+  }
+}
+
+void
+hackbgrt_cache_get_stats (struct hackbgrt_cache_stats* stats)
+{
+  grub_memcpy (stats, &cache_stats, sizeof (*stats));
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <grub/types.h>
+#include "types.h"
+
+/**
+ * Counters of the bitmap cache.
+ */
+struct hackbgrt_cache_stats
+{
+  grub_uint32_t entries;
+  grub_uint32_t hits;
+  grub_uint32_t misses;
+  grub_uint32_t released;
+  grub_uint64_t bytes; // held by the entries
+};
+
+/**
+ * Where a cached bitmap sits in the image it was cut from, for trim=auto.
+ */
+struct hackbgrt_cache_origin
+{
+  grub_uint32_t x;            // from the top left corner of the image
+  grub_uint32_t y;
+  grub_uint32_t image_width;  // the size of the whole image
+  grub_uint32_t image_height;
+};
+
+/**
+ * Set up the cache, from GRUB_MOD_INIT.
+ */
+extern void
+hackbgrt_cache_init (void);
+
+/**
+ * Drop the cache, from GRUB_MOD_FINI.
+ *
+ * The bitmap published in the BGRT, if any, is kept alive.
+ */
+extern void
+hackbgrt_cache_fini (void);
+
+/**
+ * Find a loaded bitmap.
+ *
+ * @param path The resolved path, like (hd0,gpt1)/EFI/logo.bmp.
+ * @param file_size The current size of the file.
+ * @return The bitmap, or 0 on a miss.
+ */
+extern bitmap_t
+hackbgrt_cache_lookup (const char* path, grub_uint64_t file_size);
+
+/**
+ * Find a bitmap loaded from a file, or the variant of a pack picked for this
+ * screen, registered as path@WIDTHxHEIGHT; in one pass and without allocating.
+ *
+ * @param path The resolved path.
+ * @param screen_width The screen the variant was picked for.
+ * @param screen_height
+ * @param file_size The current size of the file.
+ * @return The bitmap, or 0 on a miss.
+ */
+extern bitmap_t
+hackbgrt_cache_lookup_screen (const char* path, grub_uint32_t screen_width, grub_uint32_t screen_height,
+                              grub_uint64_t file_size);
+
+/**
+ * Tell whether a bitmap is in the cache, under any path.
+ */
+extern int
+hackbgrt_cache_contains (bitmap_t bmp);
+
+/**
+ * Register a loaded bitmap.
+ *
+ * @param path The resolved path.
+ * @param file_size The size of the file.
+ * @param bmp The bitmap, from hackbgrt_alloc_bitmap.
+ */
+extern void
+hackbgrt_cache_insert (const char* path, grub_uint64_t file_size, bitmap_t bmp);
+
+/**
+ * Register a bitmap cut from a larger image.
+ *
+ * @param path The cache key.
+ * @param file_size The size of the file of the image.
+ * @param bmp The bitmap, from hackbgrt_alloc_bitmap.
+ * @param origin Where it sits in the image.
+ */
+extern void
+hackbgrt_cache_insert_cut (const char* path, grub_uint64_t file_size, bitmap_t bmp,
+                           const struct hackbgrt_cache_origin* origin);
+
+/**
+ * Tell where a bitmap sits in the image it was cut from.
+ *
+ * @param bmp A bitmap.
+ * @param origin Set to its origin; the bitmap itself at 0,0 when it is not a cut.
+ */
+extern void
+hackbgrt_cache_get_origin (bitmap_t bmp, struct hackbgrt_cache_origin* origin);
+
+/**
+ * Tell which bitmap the BGRT now references and free the others.
+ *
+ * @param bmp The published bitmap, or 0 if no cached bitmap is referenced.
+ */
+extern void
+hackbgrt_cache_publish (bitmap_t bmp);
+
+extern void
+hackbgrt_cache_get_stats (struct hackbgrt_cache_stats* stats);
@@ -5,159 +5,434 @@
 #include <grub/normal.h>
 #include <grub/random.h>
 #include <grub/types.h>
+#include "builtin.h"
 #include "config.h"
+#include "profile.h"
+#include "tier.h"
+
+/**
+ * The value of a variable, pointing into the argument: nothing is copied.
+ */
+struct param_value
+{
+  const char* str;
+  grub_size_t length;
+};
+
+/**
+ * The variables of an image parameter.
+ */
+enum param_variable
+{
+  PARAM_IMAGE = 0,
+  PARAM_X,
+  PARAM_Y,
+  PARAM_WEIGHT,
+  PARAM_SCALE,
+  PARAM_TRIM,
+  PARAM_SCREEN,
+  PARAM_MODE,
+  PARAM_VARIABLES
+};
+
+static const char* const param_names[PARAM_VARIABLES] = {
+  "image", "x", "y", "weight", "scale", "trim", "screen", "mode",
+};
+
+/**
+ * An image parameter, one of the candidates of the weighted draw.
+ */
+struct hackbgrt_candidate
+{
+  enum hackbgrt_action action;
+  struct param_value path; // relative to the ESP
+  int gallery;             // path is a directory to draw the image from
+  int builtin;             // the image linked into the module, no path
+  int x;
+  int y;
+  enum hackbgrt_scale scale;
+  int trim;
+  int overlay;             // mode=overlay
+  grub_uint32_t screen_width; // 0 unless screen= is given
+  grub_uint32_t screen_height;
+  grub_uint64_t weight_end; // sum of the weights up to this candidate, included
+};
 
 
-grub_err_t hackbgrt_parse_param (const char* param, const char* esp_path, hackbgrt_config_t config, int* image_weight_sum_p);
-char** hackbgrt_strsplit (char* s, const char separator);
-char* hackbgrt_strsep (char** stringp, const char separator);
+static grub_err_t parse_param (const char* param, struct hackbgrt_candidate* candidate, grub_uint32_t* weight);
+static grub_err_t parse_budget (const char* param, hackbgrt_config_t config);
+static grub_uint64_t seeded_draw (grub_uint64_t seed);
+static const struct hackbgrt_candidate* select_candidate (const struct hackbgrt_candidate* candidates, grub_size_t count, grub_uint64_t draw);
+static grub_size_t read_profile (const char* esp_path, const char* profile_path, struct hackbgrt_profile* profile,
+                                 struct hackbgrt_candidate** candidates, grub_size_t first, grub_size_t capacity);
 int hackbgrt_parse_coordinate(const char* str, enum hackbgrt_action action);
-void hackbgrt_set_config_with_random(const char* esp_path, hackbgrt_config_t config, enum hackbgrt_action action, const char* path, int x, int y, int weight, int* weight_sum_p);
 
 
 hackbgrt_config_t
 hackbgrt_read_config (const char* esp_path, const char* params[], const grub_size_t params_count)
 {
-  const char* param;
+  struct hackbgrt_candidate* candidates;
+  const struct hackbgrt_candidate* selected;
+  grub_size_t count = 0;
+  grub_uint64_t weight_sum = 0;
+  grub_uint64_t draw;
+  grub_uint64_t seed = 0;
+  int seeded = 0;
+  const char* profile_path = 0;
+  struct hackbgrt_profile profile = { 0 };
   hackbgrt_config_t config = grub_zalloc (sizeof (struct hackbgrt_config));
   if (! config)
     return 0;
-  int image_weight_sum = 0;
-  for (grub_size_t i = 0; i < params_count; i++)
+  // the prefix sums of the weights; the paths stay in the arguments
+  candidates = grub_malloc (grub_max (params_count, 1) * sizeof (*candidates));
+  if (! candidates)
   {
-    param = params[i];
-    hackbgrt_parse_param (param, esp_path, config, &image_weight_sum);
-    grub_print_error ();
+    grub_free (config);
+    return 0;
   }
-  grub_dprintf ("hackbgrt", "config is read\n");
-  return config;
-}
-
-grub_err_t
-hackbgrt_parse_param (const char* param, const char* esp_path, hackbgrt_config_t config, int* image_weight_sum_p)
-{
-  int action = HACKBGRT_REPLACE;
-  char* image_path = NULL;
-  char* image_x_str = NULL;
-  int image_x = HACKBGRT_COORD_AUTO;
-  char* image_y_str = NULL;
-  int image_y = HACKBGRT_COORD_AUTO;
-  char* image_weight_str = NULL;
-  int image_weight = 1;
-
-  grub_dprintf("hackbgrt", "HackBGRT: param '%s' will be parsed\n", param);
-  grub_errno = GRUB_ERR_NONE;
-  char* param_dup = grub_strdup (param);
-  char** var_values = hackbgrt_strsplit (param_dup, ',');
-  for (char** var_value_p = var_values; *var_value_p != NULL; var_value_p += sizeof (char*))
+  for (grub_size_t i = 0; i < params_count; i++)
   {
-    char* var_value = *var_value_p;
-    if (grub_strlen (var_value) == 0)
+    const char* param = params[i];
+    grub_uint32_t weight;
+    grub_errno = GRUB_ERR_NONE;
+    if (grub_strncmp (param, "seed=", 5) == 0)
+    {
+      seed = grub_strtoull (param + 5, 0, 10);
+      seeded = 1;
       continue;
-    char* value = var_value;
-    char* var = hackbgrt_strsep (&value, '=');
-    if (value == NULL)
+    }
+    if (grub_strncmp (param, "profile=", 8) == 0)
     {
-      grub_error (GRUB_ERR_READ_ERROR, "No variable=value defined in parameter: %s", var_value);
-      break;
+      if (HACKBGRT_WITH_PROFILE)
+        profile_path = param + 8;
+      else
+      {
+        hackbgrt_not_in_build ("profile=");
+        grub_print_error ();
+      }
+      continue;
     }
-    if (grub_strcmp(var, "image") == 0 && !image_path)
-      image_path = value;
-    else if (grub_strcmp(var, "x") == 0 && !image_x_str)
-      image_x_str = value;
-    else if (grub_strcmp(var, "y") == 0 && !image_y_str)
-      image_y_str = value;
-    else if (grub_strcmp(var, "weight") == 0 && !image_weight_str)
-      image_weight_str = value;
-    else
+    if (grub_strncmp (param, "budget=", 7) == 0)
     {
-      grub_error (GRUB_ERR_READ_ERROR, "Unknown variable in parameter: %s", var_value);
-      break;
+      parse_budget (param, config);
+      grub_print_error ();
+      continue;
+    }
+    if (parse_param (param, &candidates[count], &weight) == GRUB_ERR_NONE)
+    {
+      weight_sum += weight;
+      candidates[count++].weight_end = weight_sum;
     }
+    grub_print_error ();
   }
-  if (grub_errno != GRUB_ERR_NONE)
-    goto fail;
-  if (image_path == NULL)
+  // the entries of the machine replace the image parameters, which stay the fallback
+  if (profile_path)
   {
-    grub_error (GRUB_ERR_READ_ERROR, "image variable should be defined in parameter: %s", param);
-    goto fail;
+    grub_size_t profile_count = read_profile (esp_path, profile_path, &profile, &candidates, count,
+                                              grub_max (params_count, 1));
+    if (profile_count)
+    {
+      grub_memmove (candidates, candidates + count, profile_count * sizeof (*candidates));
+      count = profile_count;
+    }
   }
-  else
+  if (count)
   {
-    if (grub_strcmp(image_path, "keep") == 0)
+    // one draw for all the images
+    if (seeded)
+      draw = seeded_draw (seed);
+    else
+      grub_crypto_get_random (&draw, sizeof (draw));
+    selected = select_candidate (candidates, count, draw);
+    config->image_index = selected - candidates;
+    config->action = selected->action;
+    config->image_x = selected->x;
+    config->image_y = selected->y;
+    config->image_scale = selected->scale;
+    config->image_trim = selected->trim;
+    config->image_overlay = selected->overlay;
+    config->image_gallery = selected->gallery;
+    config->screen_width = selected->screen_width;
+    config->screen_height = selected->screen_height;
+    // the image of a gallery is drawn when loading, from the same entropy
+    config->gallery_draw = seeded_draw (draw);
+    // only the selected path is copied, and only when there is an image to load
+    if (selected->action == HACKBGRT_REPLACE && selected->builtin)
+      config->image_path = grub_strdup (HACKBGRT_BUILTIN_PATH);
+    else if (selected->action == HACKBGRT_REPLACE)
     {
-      action = HACKBGRT_KEEP;
-      image_x = HACKBGRT_COORD_KEEP;
-      image_y = HACKBGRT_COORD_KEEP;
+      grub_size_t esp_len = grub_strlen (esp_path);
+      config->image_path = grub_malloc (esp_len + selected->path.length + 1);
+      if (config->image_path)
+      {
+        grub_memcpy (config->image_path, esp_path, esp_len);
+        grub_memcpy (config->image_path + esp_len, selected->path.str, selected->path.length);
+        config->image_path[esp_len + selected->path.length] = '\0';
+      }
     }
-    else if (grub_strcmp(image_path, "remove") == 0)
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "HackBGRT: action %d (path %s) selected\n", config->action,
+                    config->image_path ? config->image_path : "none");
+  }
+  hackbgrt_profile_free (&profile);
+  grub_free (candidates);
+  hackbgrt_trace (HACKBGRT_TRACE_STEPS, "config is read\n");
+  return config;
+}
+
+/**
+ * Parse the entries of the machine in a profile table into the candidates.
+ *
+ * @param profile Set to the table; the paths of the candidates point into it.
+ * @param candidates Grown if they cannot hold the entries of the machine.
+ * @param first Where to parse the entries, after the image parameters kept as the fallback.
+ * @param capacity The size of candidates.
+ * @return The number of parsed entries, 0 to keep the image parameters.
+ */
+static grub_size_t
+read_profile (const char* esp_path, const char* profile_path, struct hackbgrt_profile* profile,
+              struct hackbgrt_candidate** candidates, grub_size_t first, grub_size_t capacity)
+{
+  grub_uint64_t weight_sum = 0;
+  grub_size_t count = 0;
+  char* path = grub_xasprintf ("%s%s", esp_path, profile_path);
+
+  grub_errno = GRUB_ERR_NONE;
+  if (!path || hackbgrt_profile_match (path, profile) != GRUB_ERR_NONE)
+  {
+    grub_free (path);
+    grub_print_error ();
+    return 0;
+  }
+  grub_free (path);
+  if (first + profile->count > capacity)
+  {
+    struct hackbgrt_candidate* grown = grub_realloc (*candidates, (first + profile->count) * sizeof (*grown));
+    if (!grown)
     {
-      action = HACKBGRT_REMOVE;
-      image_x = 0;
-      image_y = 0;
+      grub_print_error ();
+      return 0;
     }
-    else if (grub_strncmp(image_path, "/", 1) != 0)
+    *candidates = grown;
+  }
+  for (grub_uint32_t i = 0; i < profile->count; i++)
+  {
+    grub_uint32_t weight;
+    grub_errno = GRUB_ERR_NONE;
+    if (parse_param (hackbgrt_profile_param (profile, i), &(*candidates)[first + count], &weight) == GRUB_ERR_NONE)
     {
-      grub_error (GRUB_ERR_READ_ERROR, "image variable should define a BMP image path or 'keep' or 'remove': %s", param);
-      goto fail;
+      weight_sum += weight;
+      (*candidates)[first + count++].weight_end = weight_sum;
     }
+    grub_print_error ();
   }
-  if (image_x_str != NULL)
-    image_x = hackbgrt_parse_coordinate (image_x_str, action);
-  if (image_y_str != NULL)
-    image_y = hackbgrt_parse_coordinate (image_y_str, action);
-  if (image_weight_str != NULL)
-    image_weight = (int) grub_strtoul (image_weight_str, 0, 10);
-  hackbgrt_set_config_with_random(esp_path, config, action, image_path, image_x, image_y, image_weight, image_weight_sum_p);
-  goto succeed;
-fail:
-  grub_print_error ();
-succeed:
-  grub_dprintf("hackbgrt", "HackBGRT: param '%s' parsed, free some memory\n", param);
-  grub_free (var_values);
-  grub_free (param_dup);
-  return grub_errno;
+  return count;
+}
+
+static int
+value_is (const struct param_value* value, const char* word)
+{
+  return grub_strlen (word) == value->length && grub_memcmp (value->str, word, value->length) == 0;
 }
 
-char**
-hackbgrt_strsplit (char* s, const char separator)
+/**
+ * Parse an image parameter, in one pass over the argument.
+ *
+ * @param param The parameter, like image=/EFI/logo.bmp,x=center,weight=2.
+ * @param candidate Set to the parsed parameter; its path points into param.
+ * @param weight Set to its weight.
+ * @return GRUB_ERR_NONE, or the error raised.
+ */
+static grub_err_t
+parse_param (const char* param, struct hackbgrt_candidate* candidate, grub_uint32_t* weight)
 {
-  grub_size_t count = 2; // n + 1 intervals, last one is null
-  char** ret;
-
-  for (char* c = (char*) s; *c; c++)
-    if (*c == separator)
-      count++;
-  ret = (char**) grub_malloc (sizeof (char*) * count);
-  char** elem_p = ret;
-  for (char* part = s; part;)
-  {
-    char* elem = hackbgrt_strsep (&part, separator);
-    if (elem)
+  struct param_value values[PARAM_VARIABLES];
+
+  hackbgrt_trace (HACKBGRT_TRACE_STEPS, "HackBGRT: param '%s' will be parsed\n", param);
+  grub_memset (values, 0, sizeof (values));
+  *weight = 1;
+  for (const char* var = param; *var;)
+  {
+    const char* end = var;
+    const char* equal = 0;
+    for (; *end && *end != ','; end++)
+      if (*end == '=' && !equal)
+        equal = end;
+    if (end > var)
     {
-      *elem_p = elem;
-      elem_p += sizeof (char*);
+      unsigned v;
+      if (!equal)
+        return grub_error (GRUB_ERR_READ_ERROR, "No variable=value defined in parameter: %s", param);
+      for (v = 0; v < PARAM_VARIABLES; v++)
+        if (!values[v].str && grub_strlen (param_names[v]) == (grub_size_t) (equal - var)
+            && grub_memcmp (var, param_names[v], equal - var) == 0)
+          break;
+      if (v == PARAM_VARIABLES)
+        return grub_error (GRUB_ERR_READ_ERROR, "Unknown variable in parameter: %s", param);
+      values[v].str = equal + 1;
+      values[v].length = end - equal - 1;
     }
+    var = *end ? end + 1 : end;
+  }
+
+  candidate->action = HACKBGRT_REPLACE;
+  candidate->path = values[PARAM_IMAGE];
+  candidate->x = HACKBGRT_COORD_AUTO;
+  candidate->y = HACKBGRT_COORD_AUTO;
+  candidate->scale = HACKBGRT_SCALE_NONE;
+  candidate->trim = 0;
+  candidate->overlay = 0;
+  candidate->gallery = 0;
+  candidate->builtin = 0;
+  candidate->screen_width = 0;
+  candidate->screen_height = 0;
+  if (!values[PARAM_IMAGE].str)
+    return grub_error (GRUB_ERR_READ_ERROR, "image variable should be defined in parameter: %s", param);
+  if (value_is (&values[PARAM_IMAGE], "keep"))
+  {
+    candidate->action = HACKBGRT_KEEP;
+    candidate->x = HACKBGRT_COORD_KEEP;
+    candidate->y = HACKBGRT_COORD_KEEP;
+  }
+  else if (value_is (&values[PARAM_IMAGE], "remove"))
+  {
+    candidate->action = HACKBGRT_REMOVE;
+    candidate->x = 0;
+    candidate->y = 0;
+  }
+  else if (value_is (&values[PARAM_IMAGE], HACKBGRT_BUILTIN_PATH))
+    candidate->builtin = 1;
+  else if (values[PARAM_IMAGE].length > 4 && grub_memcmp (values[PARAM_IMAGE].str, "dir:/", 5) == 0)
+  {
+    candidate->gallery = 1;
+    candidate->path.str += 4;
+    candidate->path.length -= 4;
   }
-  *elem_p = NULL;
-  return ret;
+  else if (values[PARAM_IMAGE].str[0] != '/')
+    return grub_error (GRUB_ERR_READ_ERROR, "image variable should define a BMP image path, a dir:/ gallery or 'builtin', 'keep' or 'remove': %s", param);
+  if (!HACKBGRT_WITH_BUILTIN && candidate->builtin)
+    return hackbgrt_not_in_build ("image=builtin");
+  if (!HACKBGRT_WITH_GALLERY && candidate->gallery)
+    return hackbgrt_not_in_build ("dir:/");
+  // the numbers stop at the next comma
+  if (values[PARAM_X].str)
+    candidate->x = hackbgrt_parse_coordinate (values[PARAM_X].str, candidate->action);
+  if (values[PARAM_Y].str)
+    candidate->y = hackbgrt_parse_coordinate (values[PARAM_Y].str, candidate->action);
+  if (values[PARAM_WEIGHT].str)
+    *weight = (grub_uint32_t) grub_strtoul (values[PARAM_WEIGHT].str, 0, 10);
+  if (values[PARAM_SCALE].str)
+  {
+    int scale = hackbgrt_parse_scale (values[PARAM_SCALE].str, values[PARAM_SCALE].length);
+    if (scale < 0)
+      return grub_error (GRUB_ERR_READ_ERROR, "scale variable should be none, fit, fill, 2x or 3x: %s", param);
+    if (!HACKBGRT_WITH_SCALE && scale != HACKBGRT_SCALE_NONE)
+      return hackbgrt_not_in_build ("scale=");
+    candidate->scale = scale;
+  }
+  if (values[PARAM_TRIM].str)
+  {
+    if (value_is (&values[PARAM_TRIM], "auto"))
+      candidate->trim = 1;
+    else if (!value_is (&values[PARAM_TRIM], "none"))
+      return grub_error (GRUB_ERR_READ_ERROR, "trim variable should be auto or none: %s", param);
+    if (!HACKBGRT_WITH_SCALE && candidate->trim)
+      return hackbgrt_not_in_build ("trim=");
+  }
+  if (values[PARAM_MODE].str)
+  {
+    if (value_is (&values[PARAM_MODE], "overlay"))
+      candidate->overlay = 1;
+    else if (!value_is (&values[PARAM_MODE], "replace"))
+      return grub_error (GRUB_ERR_READ_ERROR, "mode variable should be replace or overlay: %s", param);
+    if (!HACKBGRT_WITH_OVERLAY && candidate->overlay)
+      return hackbgrt_not_in_build ("mode=overlay");
+    if (candidate->overlay && candidate->builtin)
+      return grub_error (GRUB_ERR_READ_ERROR, "mode=overlay takes a BMP or PNG file: %s", param);
+  }
+  if (values[PARAM_SCREEN].str)
+  {
+    char* end;
+    candidate->screen_width = (grub_uint32_t) grub_strtoul (values[PARAM_SCREEN].str, &end, 10);
+    if (*end == 'x')
+      candidate->screen_height = (grub_uint32_t) grub_strtoul (end + 1, &end, 10);
+    if (!candidate->screen_width || !candidate->screen_height || (*end && *end != ','))
+      return grub_error (GRUB_ERR_READ_ERROR, "screen variable should be WIDTHxHEIGHT: %s", param);
+  }
+  hackbgrt_trace (HACKBGRT_TRACE_STEPS, "HackBGRT: action %d, x %d, y %d, weight %u\n",
+                  candidate->action, candidate->x, candidate->y, *weight);
+  return GRUB_ERR_NONE;
+}
+
+/**
+ * Parse budget=MS[:keep|:remove], the time the run may take before it gives up.
+ *
+ * @param param The whole parameter.
+ * @param config Where to set budget_ms and budget_fallback.
+ * @return GRUB_ERR_NONE, or the error also set in grub_errno.
+ */
+static grub_err_t
+parse_budget (const char* param, hackbgrt_config_t config)
+{
+  char* end;
+  grub_uint32_t ms = (grub_uint32_t) grub_strtoul (param + 7, &end, 10);
+  enum hackbgrt_action fallback = HACKBGRT_KEEP;
+
+  if (grub_strcmp (end, ":remove") == 0)
+    fallback = HACKBGRT_REMOVE;
+  else if (*end && grub_strcmp (end, ":keep") != 0)
+    end = 0;
+  if (!end || !ms || end == param + 7)
+    return grub_error (GRUB_ERR_BAD_NUMBER, "budget variable should be MS[:keep|:remove]: %s", param);
+  config->budget_ms = ms;
+  config->budget_fallback = fallback;
+  return GRUB_ERR_NONE;
 }
 
-char*
-hackbgrt_strsep (char** stringp, const char separator)
+/**
+ * Mix a value into a uniform one (splitmix64): the draw of a seed= parameter,
+ * so the same seed always selects the same image, and the draw of a gallery,
+ * from the draw of the parameters.
+ */
+static grub_uint64_t
+seeded_draw (grub_uint64_t seed)
 {
-  char* begin = *stringp;
-  if (begin == NULL)
-    return NULL;
-  char* end = grub_strchr (begin, separator);
-  if (*end)
-  {
-    *end++ = '\0';
-    *stringp = end;
-  }
-  else
-    *stringp = NULL;
-  return begin;
+  grub_uint64_t z = seed + 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+/**
+ * Pick a candidate with a probability proportional to its weight.
+ *
+ * @param candidates The candidates, with the prefix sums of their weights.
+ * @param count Their number, at least 1.
+ * @param draw A uniform random value.
+ * @return The selected candidate.
+ */
+static const struct hackbgrt_candidate*
+select_candidate (const struct hackbgrt_candidate* candidates, grub_size_t count, grub_uint64_t draw)
+{
+  grub_uint64_t weight_sum = candidates[count - 1].weight_end;
+  grub_uint64_t target;
+  grub_size_t low = 0, high = count - 1;
+
+  // no weight at all: the last one, as it always was
+  if (!weight_sum)
+    return &candidates[count - 1];
+  grub_divmod64 (draw, weight_sum, &target);
+  // the first candidate whose prefix sum goes past the target: a zero weight is never picked
+  while (low < high)
+  {
+    grub_size_t middle = low + (high - low) / 2;
+    if (candidates[middle].weight_end > target)
+      high = middle;
+    else
+      low = middle + 1;
+  }
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "HackBGRT: draw %llu of %llu, candidate %d selected\n",
+                  (unsigned long long) target, (unsigned long long) weight_sum, (int) low);
+  return &candidates[low];
 }
 
 int
@@ -170,33 +445,6 @@ hackbgrt_parse_coordinate(const char* str, enum hackbgrt_action action)
   return HACKBGRT_COORD_AUTO;
 }
 
-void
-hackbgrt_set_config_with_random(const char* esp_path, hackbgrt_config_t config, enum hackbgrt_action action, const char* path, int x, int y, int weight, int* weight_sum_p)
-{
-  grub_uint32_t random;
-  grub_uint32_t limit;
-  grub_size_t esp_len;
-  grub_size_t path_len;
-  int weight_sum = *weight_sum_p;
-
-  grub_crypto_get_random (&random, sizeof (grub_uint32_t));
-  weight_sum += weight;
-  limit = 0xfffffffful / weight_sum * weight;
-  grub_dprintf("hackbgrt", "HackBGRT: action %d, path %s, x %d, y %d, weight %d, random = %08x, limit = %08x\n", action, path, x, y, weight, random, limit);
-  if (!weight_sum || random <= limit)
-  {
-    config->action = action;
-    esp_len = grub_strlen (esp_path);
-    path_len = grub_strlen (path);
-    config->image_path = grub_zalloc (esp_len + path_len + 1);
-    grub_strncpy (config->image_path, esp_path, esp_len);
-    grub_strncpy (config->image_path + esp_len, path, path_len);
-    config->image_x = x;
-    config->image_y = y;
-    grub_dprintf("hackbgrt", "HackBGRT: action %d (path %s) selected\n", config->action, config->image_path);
-  }
-}
-
 void
 hackbgrt_free_config (hackbgrt_config_t config)
 {
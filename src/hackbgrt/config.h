@@ -1,5 +1,8 @@
 #pragma once
 
+#include "io.h"
+#include "scale.h"
+
 /**
  * Possible actions to perform on the BGRT.
  */
@@ -26,9 +29,24 @@ enum hackbgrt_coordinate
 struct hackbgrt_config
 {
   enum hackbgrt_action action;
+  grub_uint32_t image_index; // the drawn image parameter, profile entries first
   char* image_path;
   int image_x;
   int image_y;
+  enum hackbgrt_scale image_scale;
+  int image_trim; // crop the uniform borders of the image
+  int image_overlay; // composite the image onto the firmware's logo, x and y relative to it
+  int image_gallery; // image_path is a directory to draw the image from
+  grub_uint64_t gallery_draw; // the draw of the image of the gallery
+  grub_uint32_t screen_width; // the screen given by screen=, 0 to probe the GOP
+  grub_uint32_t screen_height;
+  enum hackbgrt_io_backend io_backend;
+  int parallel; // spread the pixel work over the APs
+  int stats; // print the stats of the run
+  int telemetry; // write the telemetry record of the run
+  int deferred; // applied from the preboot hook
+  grub_uint32_t budget_ms; // budget=: the time the run may take from the ACPI scan on, 0 for no limit
+  enum hackbgrt_action budget_fallback; // what the BGRT becomes when the budget runs out: KEEP or REMOVE
 };
 
 typedef struct hackbgrt_config* hackbgrt_config_t;
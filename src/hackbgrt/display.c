@@ -0,0 +1,119 @@
+#include <grub/efi/api.h>
+#include <grub/efi/efi.h>
+#include <grub/efi/graphics_output.h>
+#include <grub/err.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/types.h>
+#include <grub/video.h>
+#include "display.h"
+#include "tier.h"
+
+static int located;
+static grub_efi_handle_t gop_handle;
+static struct grub_efi_gop* gop;
+static struct hackbgrt_display_stats stats;
+
+/**
+ * The resolution of the current mode of a GOP.
+ *
+ * @return 1 if the GOP has a usable current mode, 0 otherwise.
+ */
+static int
+current_mode (struct grub_efi_gop* candidate, grub_uint32_t* width, grub_uint32_t* height)
+{
+  struct grub_efi_gop_mode_info* info;
+  struct grub_efi_gop_mode_info* queried = 0;
+  grub_efi_uintn_t size;
+  int usable;
+
+  if (!candidate || !candidate->mode || candidate->mode->mode >= candidate->mode->max_mode)
+    return 0;
+  info = candidate->mode->info;
+  // some firmware only fills in mode->info once a mode is set: ask for the current one
+  if (!info || !info->width || !info->height)
+  {
+    stats.queries++;
+    if (efi_call_4 (candidate->query_mode, candidate, candidate->mode->mode, &size, &queried) || !queried)
+      return 0;
+    info = queried;
+  }
+  usable = info->width && info->height;
+  if (usable)
+  {
+    *width = info->width;
+    *height = info->height;
+  }
+  // QueryMode allocates the information from pool, the caller frees it
+  if (queried)
+    efi_call_1 (grub_efi_system_table->boot_services->free_pool, queried);
+  return usable;
+}
+
+/**
+ * Find the first GOP with a usable current mode.
+ */
+static void
+locate_gop (void)
+{
+  static grub_efi_guid_t graphics_output_guid = GRUB_EFI_GOP_GUID;
+  grub_efi_handle_t* handles;
+  grub_efi_uintn_t num_handles = 0;
+  grub_uint32_t width, height;
+
+  located = 1;
+  stats.locates++;
+  handles = grub_efi_locate_handle (GRUB_EFI_BY_PROTOCOL, &graphics_output_guid, NULL, &num_handles);
+  for (grub_efi_uintn_t i = 0; handles && i < num_handles; i++)
+  {
+    struct grub_efi_gop* candidate = grub_efi_open_protocol (handles[i], &graphics_output_guid,
+                                                             GRUB_EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+    if (current_mode (candidate, &width, &height))
+    {
+      gop_handle = handles[i];
+      gop = candidate;
+      hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "GOP %p on handle %p, %ux%u\n", gop, gop_handle, width, height);
+      break;
+    }
+  }
+  grub_free (handles);
+}
+
+enum hackbgrt_display_source
+hackbgrt_display_get (grub_uint32_t* width, grub_uint32_t* height)
+{
+  struct grub_video_mode_info info;
+
+  stats.lookups++;
+  *width = 0;
+  *height = 0;
+  if (!located)
+    locate_gop ();
+  if (gop && current_mode (gop, width, height))
+    return HACKBGRT_DISPLAY_GOP;
+  // no GOP, or none with a mode: the adapter GRUB draws with, which may be set up later
+  if (grub_video_get_info (&info) != GRUB_ERR_NONE)
+  {
+    grub_errno = GRUB_ERR_NONE;
+    return HACKBGRT_DISPLAY_NONE;
+  }
+  if (!info.width || !info.height)
+    return HACKBGRT_DISPLAY_NONE;
+  *width = info.width;
+  *height = info.height;
+  return HACKBGRT_DISPLAY_VIDEO;
+}
+
+void
+hackbgrt_display_get_stats (struct hackbgrt_display_stats* copy)
+{
+  *copy = stats;
+}
+
+void
+hackbgrt_display_fini (void)
+{
+  located = 0;
+  gop_handle = 0;
+  gop = 0;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <grub/types.h>
+
+/**
+ * Where the screen resolution comes from.
+ */
+enum hackbgrt_display_source
+{
+  HACKBGRT_DISPLAY_NONE = 0,
+  HACKBGRT_DISPLAY_GOP,   // the current mode of the first GOP that has one
+  HACKBGRT_DISPLAY_VIDEO  // the mode of GRUB's active video adapter, without a usable GOP
+};
+
+/**
+ * Counters of the display lookups, for the module lifetime.
+ */
+struct hackbgrt_display_stats
+{
+  grub_uint32_t lookups;  // hackbgrt_display_get calls
+  grub_uint32_t locates;  // GOP handle searches, at most one until hackbgrt_display_fini
+  grub_uint32_t queries;  // query_mode calls, for a GOP whose mode info is not filled in
+};
+
+/**
+ * The screen resolution.
+ *
+ * The GOP handles are searched once per module lifetime, and only the
+ * current mode of each is looked at: its mode->info, else query_mode on
+ * that mode alone. The GOP found is kept, and its mode->info read again on
+ * each call, so a mode set since by GRUB's video driver is seen without a
+ * firmware call. Without a usable GOP, the mode of GRUB's active video
+ * adapter is used, if any.
+ *
+ * @param width Set to the width, 0 if unknown.
+ * @param height Set to the height, 0 if unknown.
+ * @return Where the resolution comes from.
+ */
+extern enum hackbgrt_display_source
+hackbgrt_display_get (grub_uint32_t* width, grub_uint32_t* height);
+
+extern void
+hackbgrt_display_get_stats (struct hackbgrt_display_stats* stats);
+
+/**
+ * Forget the GOP found, at module unload.
+ */
+extern void
+hackbgrt_display_fini (void);
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <grub/efi/api.h>
+
+/*
+ * EFI_SIMPLE_FILE_SYSTEM_PROTOCOL and EFI_FILE_PROTOCOL (UEFI 2.x, 13.4 and 13.5),
+ * which GRUB 2.04 does not declare.
+ */
+
+#define HACKBGRT_EFI_SIMPLE_FILE_SYSTEM_GUID \
+  { 0x964e5b22, 0x6459, 0x11d2, \
+    { 0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } \
+  }
+
+#define HACKBGRT_EFI_FILE_MODE_READ 0x0000000000000001ULL
+#define HACKBGRT_EFI_FILE_POSITION_END 0xffffffffffffffffULL
+
+struct hackbgrt_efi_file
+{
+  grub_efi_uint64_t revision;
+  grub_efi_status_t (*open) (struct hackbgrt_efi_file* this,
+                             struct hackbgrt_efi_file** new_handle,
+                             grub_efi_char16_t* file_name,
+                             grub_efi_uint64_t open_mode,
+                             grub_efi_uint64_t attributes);
+  grub_efi_status_t (*close) (struct hackbgrt_efi_file* this);
+  grub_efi_status_t (*delete) (struct hackbgrt_efi_file* this);
+  grub_efi_status_t (*read) (struct hackbgrt_efi_file* this,
+                             grub_efi_uintn_t* buffer_size,
+                             void* buffer);
+  grub_efi_status_t (*write) (struct hackbgrt_efi_file* this,
+                              grub_efi_uintn_t* buffer_size,
+                              void* buffer);
+  grub_efi_status_t (*get_position) (struct hackbgrt_efi_file* this,
+                                     grub_efi_uint64_t* position);
+  grub_efi_status_t (*set_position) (struct hackbgrt_efi_file* this,
+                                     grub_efi_uint64_t position);
+  grub_efi_status_t (*get_info) (struct hackbgrt_efi_file* this,
+                                 grub_efi_guid_t* information_type,
+                                 grub_efi_uintn_t* buffer_size,
+                                 void* buffer);
+  grub_efi_status_t (*set_info) (struct hackbgrt_efi_file* this,
+                                 grub_efi_guid_t* information_type,
+                                 grub_efi_uintn_t buffer_size,
+                                 void* buffer);
+  grub_efi_status_t (*flush) (struct hackbgrt_efi_file* this);
+};
+
+struct hackbgrt_efi_simple_file_system
+{
+  grub_efi_uint64_t revision;
+  grub_efi_status_t (*open_volume) (struct hackbgrt_efi_simple_file_system* this,
+                                    struct hackbgrt_efi_file** root);
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <grub/efi/api.h>
+
+/*
+ * EFI_MP_SERVICES_PROTOCOL (PI 1.2+, volume 2, 13.4), which GRUB 2.04 does
+ * not declare.
+ */
+
+#define HACKBGRT_EFI_MP_SERVICES_GUID \
+  { 0x3fdda605, 0xa76e, 0x4f46, \
+    { 0xad, 0x29, 0x12, 0xf4, 0x53, 0x1b, 0x3d, 0x08 } \
+  }
+
+/*
+ * The firmware calls the AP procedure itself, so it must use the EFI calling
+ * convention; GRUB 2.04 only wraps the calls it makes (efi_call_N).
+ */
+#if defined (__x86_64__)
+#define HACKBGRT_EFIAPI __attribute__ ((ms_abi))
+#else
+#define HACKBGRT_EFIAPI
+#endif
+
+typedef void (HACKBGRT_EFIAPI *hackbgrt_efi_ap_procedure_t) (void* argument);
+
+struct hackbgrt_efi_mp_services
+{
+  grub_efi_status_t (*get_number_of_processors) (struct hackbgrt_efi_mp_services* this,
+                                                 grub_efi_uintn_t* number_of_processors,
+                                                 grub_efi_uintn_t* number_of_enabled_processors);
+  grub_efi_status_t (*get_processor_info) (struct hackbgrt_efi_mp_services* this,
+                                           grub_efi_uintn_t processor_number,
+                                           void* processor_info_buffer);
+  grub_efi_status_t (*startup_all_aps) (struct hackbgrt_efi_mp_services* this,
+                                        hackbgrt_efi_ap_procedure_t procedure,
+                                        grub_efi_boolean_t single_thread,
+                                        grub_efi_event_t wait_event,
+                                        grub_efi_uintn_t timeout_in_microseconds,
+                                        void* procedure_argument,
+                                        grub_efi_uintn_t** failed_cpu_list);
+  grub_efi_status_t (*startup_this_ap) (struct hackbgrt_efi_mp_services* this,
+                                        hackbgrt_efi_ap_procedure_t procedure,
+                                        grub_efi_uintn_t processor_number,
+                                        grub_efi_event_t wait_event,
+                                        grub_efi_uintn_t timeout_in_microseconds,
+                                        void* procedure_argument,
+                                        grub_efi_boolean_t* finished);
+  grub_efi_status_t (*switch_bsp) (struct hackbgrt_efi_mp_services* this,
+                                   grub_efi_uintn_t processor_number,
+                                   grub_efi_boolean_t enable_old_bsp);
+  grub_efi_status_t (*enable_disable_ap) (struct hackbgrt_efi_mp_services* this,
+                                          grub_efi_uintn_t processor_number,
+                                          grub_efi_boolean_t enable_ap,
+                                          grub_efi_uint32_t* health_flag);
+  grub_efi_status_t (*who_am_i) (struct hackbgrt_efi_mp_services* this,
+                                 grub_efi_uintn_t* processor_number);
+};
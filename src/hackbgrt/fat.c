@@ -0,0 +1,472 @@
+#include <grub/charset.h>
+#include <grub/disk.h>
+#include <grub/err.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/types.h>
+#include "fat.h"
+#include "tier.h"
+
+#if HACKBGRT_WITH_IO
+#define FAT_BOOT_SIGNATURE 0xaa55
+#define FAT_DIRENT_SIZE 32
+#define FAT_ATTR_VOLUME_ID 0x08
+#define FAT_ATTR_DIRECTORY 0x10
+#define FAT_ATTR_LONG_NAME 0x0f
+#define FAT_DIRENT_FREE 0xe5
+#define FAT_DIRENT_KANJI_E5 0x05
+#define FAT_LFN_LAST 0x40
+#define FAT_LFN_CHARS 13
+#define FAT_LFN_ENTRIES 20
+#define FAT_NAME_MAX 255
+/** Directories larger than this are not worth walking for a splash. */
+#define FAT_DIRECTORY_MAX (1024 * 1024)
+/** FAT bytes kept around while following a chain. */
+#define FAT_WINDOW_SIZE 4096
+
+/**
+ * The BIOS parameter block, with the FAT32 extension.
+ */
+struct fat_bpb
+{
+  grub_uint8_t jump[3];
+  grub_uint8_t oem_name[8];
+  grub_uint16_t bytes_per_sector;
+  grub_uint8_t sectors_per_cluster;
+  grub_uint16_t reserved_sectors;
+  grub_uint8_t num_fats;
+  grub_uint16_t root_entries;
+  grub_uint16_t total_sectors_16;
+  grub_uint8_t media;
+  grub_uint16_t sectors_per_fat_16;
+  grub_uint16_t sectors_per_track;
+  grub_uint16_t num_heads;
+  grub_uint32_t hidden_sectors;
+  grub_uint32_t total_sectors_32;
+  grub_uint32_t sectors_per_fat_32;
+  grub_uint16_t extended_flags;
+  grub_uint16_t version;
+  grub_uint32_t root_cluster;
+} GRUB_PACKED;
+
+struct fat_dirent
+{
+  grub_uint8_t name[11];
+  grub_uint8_t attr;
+  grub_uint8_t reserved[8];
+  grub_uint16_t cluster_high;
+  grub_uint8_t reserved2[4];
+  grub_uint16_t cluster_low;
+  grub_uint32_t size;
+} GRUB_PACKED;
+
+struct fat_volume
+{
+  grub_disk_t disk;
+  int bits;
+  grub_uint32_t cluster_size;
+  grub_uint32_t cluster_count;
+  grub_uint32_t end_of_chain;
+  grub_uint64_t fat_offset;
+  grub_uint64_t fat_end;
+  grub_uint64_t root_offset;   // FAT12/16 only
+  grub_uint32_t root_size;     // FAT12/16 only
+  grub_uint32_t root_cluster;  // FAT32 only
+  grub_uint64_t data_offset;
+  grub_uint64_t window_offset;
+  grub_uint32_t window_size;
+  grub_uint8_t window[FAT_WINDOW_SIZE];
+};
+
+static grub_err_t
+read_bytes (grub_disk_t disk, grub_uint64_t offset, grub_size_t size, void* buf)
+{
+  return grub_disk_read (disk, offset >> GRUB_DISK_SECTOR_BITS, offset & (GRUB_DISK_SECTOR_SIZE - 1), size, buf);
+}
+
+static int
+is_power_of_two (grub_uint32_t v)
+{
+  return v && !(v & (v - 1));
+}
+
+static grub_err_t
+mount (struct fat_volume* vol, grub_disk_t disk)
+{
+  grub_uint8_t sector[GRUB_DISK_SECTOR_SIZE];
+  struct fat_bpb* bpb = (struct fat_bpb*) sector;
+
+  if (read_bytes (disk, 0, sizeof (sector), sector))
+    return grub_errno;
+  grub_uint32_t bytes_per_sector = grub_le_to_cpu16 (bpb->bytes_per_sector);
+  grub_uint32_t fat_sectors = bpb->sectors_per_fat_16 ? grub_le_to_cpu16 (bpb->sectors_per_fat_16) : grub_le_to_cpu32 (bpb->sectors_per_fat_32);
+  grub_uint32_t total_sectors = bpb->total_sectors_16 ? grub_le_to_cpu16 (bpb->total_sectors_16) : grub_le_to_cpu32 (bpb->total_sectors_32);
+  grub_uint32_t root_entries = grub_le_to_cpu16 (bpb->root_entries);
+  grub_uint32_t root_sectors = (root_entries * FAT_DIRENT_SIZE + bytes_per_sector - 1) / bytes_per_sector;
+  grub_uint32_t reserved_sectors = grub_le_to_cpu16 (bpb->reserved_sectors);
+  grub_uint64_t meta_sectors = reserved_sectors + (grub_uint64_t) bpb->num_fats * fat_sectors + root_sectors;
+
+  if (grub_le_to_cpu16 (*(grub_uint16_t*) (sector + 510)) != FAT_BOOT_SIGNATURE
+      || bytes_per_sector < 512 || bytes_per_sector > 4096 || !is_power_of_two (bytes_per_sector)
+      || !is_power_of_two (bpb->sectors_per_cluster)
+      || reserved_sectors == 0 || bpb->num_fats == 0 || fat_sectors == 0
+      || total_sectors <= meta_sectors)
+    return grub_error (GRUB_ERR_BAD_FS, "HackBGRT: not a FAT filesystem\n");
+  vol->disk = disk;
+  vol->cluster_size = bytes_per_sector * bpb->sectors_per_cluster;
+  // below total_sectors, so 32-bit: no 64-bit division on i386
+  vol->cluster_count = (total_sectors - (grub_uint32_t) meta_sectors) / bpb->sectors_per_cluster;
+  // The FAT type only depends on the number of clusters.
+  if (vol->cluster_count < 4085)
+    vol->bits = 12;
+  else if (vol->cluster_count < 65525)
+    vol->bits = 16;
+  else
+    vol->bits = 32;
+  vol->end_of_chain = vol->bits == 12 ? 0xff8 : vol->bits == 16 ? 0xfff8 : 0x0ffffff8;
+  grub_uint32_t active_fat = 0;
+  if (vol->bits == 32)
+  {
+    if (root_entries != 0)
+      return grub_error (GRUB_ERR_BAD_FS, "HackBGRT: not a FAT filesystem\n");
+    grub_uint16_t flags = grub_le_to_cpu16 (bpb->extended_flags);
+    // FAT mirroring disabled: only the active FAT is up to date.
+    if (flags & 0x80)
+      active_fat = grub_min ((grub_uint32_t) (flags & 0xf), bpb->num_fats - 1u);
+    vol->root_cluster = grub_le_to_cpu32 (bpb->root_cluster);
+  }
+  vol->fat_offset = ((grub_uint64_t) reserved_sectors + (grub_uint64_t) active_fat * fat_sectors) * bytes_per_sector;
+  vol->fat_end = vol->fat_offset + (grub_uint64_t) fat_sectors * bytes_per_sector;
+  vol->root_offset = ((grub_uint64_t) reserved_sectors + (grub_uint64_t) bpb->num_fats * fat_sectors) * bytes_per_sector;
+  vol->root_size = root_entries * FAT_DIRENT_SIZE;
+  vol->data_offset = meta_sectors * bytes_per_sector;
+  vol->window_size = 0;
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "fat: FAT%d, %u clusters of %u bytes\n", vol->bits, vol->cluster_count, vol->cluster_size);
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+next_cluster (struct fat_volume* vol, grub_uint32_t cluster, grub_uint32_t* next)
+{
+  grub_uint64_t offset = vol->fat_offset + (grub_uint64_t) cluster * vol->bits / 8;
+  grub_uint32_t width = vol->bits == 32 ? 4 : 2;
+  grub_uint32_t value;
+  grub_uint8_t* p;
+
+  if (offset < vol->window_offset || offset + width > vol->window_offset + vol->window_size)
+  {
+    vol->window_offset = offset & ~(grub_uint64_t) (GRUB_DISK_SECTOR_SIZE - 1);
+    vol->window_size = grub_min ((grub_uint64_t) FAT_WINDOW_SIZE, vol->fat_end - vol->window_offset);
+    if (offset + width > vol->window_offset + vol->window_size)
+    {
+      vol->window_size = 0;
+      return grub_error (GRUB_ERR_BAD_FS, "HackBGRT: cluster %u beyond the FAT\n", cluster);
+    }
+    if (read_bytes (vol->disk, vol->window_offset, vol->window_size, vol->window))
+    {
+      vol->window_size = 0;
+      return grub_errno;
+    }
+  }
+  p = vol->window + (offset - vol->window_offset);
+  value = p[0] | (p[1] << 8);
+  if (vol->bits == 32)
+    value = (value | ((grub_uint32_t) p[2] << 16) | ((grub_uint32_t) p[3] << 24)) & 0x0fffffff;
+  else if (vol->bits == 12)
+    value = (cluster & 1) ? value >> 4 : value & 0xfff;
+  *next = value;
+  return GRUB_ERR_NONE;
+}
+
+/**
+ * Follow a cluster chain, merging adjacent clusters into extents.
+ *
+ * @param size The bytes to map, or (grub_uint64_t) -1 to follow the chain to its end.
+ */
+static grub_err_t
+map_chain (struct fat_volume* vol, grub_uint32_t cluster, grub_uint64_t size, struct hackbgrt_fat_file* file)
+{
+  grub_size_t capacity = 0;
+  grub_uint64_t mapped = 0;
+  grub_uint32_t steps = 0;
+
+  file->extent_count = 0;
+  file->extents = 0;
+  while (mapped < size)
+  {
+    if (cluster < 2 || cluster >= vol->cluster_count + 2 || steps++ >= vol->cluster_count)
+      return grub_error (GRUB_ERR_BAD_FS, "HackBGRT: bad cluster chain\n");
+    grub_uint64_t disk_offset = vol->data_offset + (grub_uint64_t) (cluster - 2) * vol->cluster_size;
+    grub_uint64_t length = grub_min ((grub_uint64_t) vol->cluster_size, size - mapped);
+    struct hackbgrt_extent* last = file->extent_count ? &file->extents[file->extent_count - 1] : 0;
+    if (last && last->disk_offset + last->length == disk_offset)
+      last->length += length;
+    else
+    {
+      if (file->extent_count == capacity)
+      {
+        capacity = capacity ? capacity * 2 : 8;
+        struct hackbgrt_extent* extents = grub_realloc (file->extents, capacity * sizeof (*extents));
+        if (!extents)
+          return grub_errno;
+        file->extents = extents;
+      }
+      last = &file->extents[file->extent_count++];
+      last->file_offset = mapped;
+      last->disk_offset = disk_offset;
+      last->length = length;
+    }
+    mapped += length;
+    if (mapped == size)
+      break;
+    if (next_cluster (vol, cluster, &cluster))
+      return grub_errno;
+    if (cluster >= vol->end_of_chain)
+    {
+      if (size != (grub_uint64_t) -1)
+        return grub_error (GRUB_ERR_BAD_FS, "HackBGRT: cluster chain shorter than the file\n");
+      break;
+    }
+    if (size == (grub_uint64_t) -1 && mapped >= FAT_DIRECTORY_MAX)
+      return grub_error (GRUB_ERR_OUT_OF_RANGE, "HackBGRT: directory too large\n");
+  }
+  file->size = mapped;
+  return GRUB_ERR_NONE;
+}
+
+/**
+ * Read a whole directory; cluster 0 is the root.
+ */
+static grub_uint8_t*
+read_directory (struct fat_volume* vol, grub_uint32_t cluster, grub_size_t* size)
+{
+  struct hackbgrt_fat_file dir;
+  grub_uint8_t* buf;
+
+  if (cluster == 0 && vol->bits != 32)
+  {
+    dir.size = vol->root_size;
+    dir.extent_count = 0;
+    dir.extents = 0;
+    buf = grub_malloc (dir.size);
+    if (buf && read_bytes (vol->disk, vol->root_offset, dir.size, buf))
+    {
+      grub_free (buf);
+      buf = 0;
+    }
+  }
+  else
+  {
+    if (map_chain (vol, cluster ? cluster : vol->root_cluster, (grub_uint64_t) -1, &dir))
+    {
+      hackbgrt_fat_free (&dir);
+      return 0;
+    }
+    buf = grub_malloc (dir.size);
+    for (grub_size_t i = 0; buf && i < dir.extent_count; i++)
+      if (read_bytes (vol->disk, dir.extents[i].disk_offset, dir.extents[i].length, buf + dir.extents[i].file_offset))
+      {
+        grub_free (buf);
+        buf = 0;
+      }
+    hackbgrt_fat_free (&dir);
+  }
+  *size = dir.size;
+  return buf;
+}
+
+static grub_uint16_t
+fold_ascii (grub_uint16_t c)
+{
+  return (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+}
+
+static int
+names_equal (const grub_uint16_t* a, grub_size_t a_len, const grub_uint16_t* b, grub_size_t b_len)
+{
+  if (a_len != b_len)
+    return 0;
+  for (grub_size_t i = 0; i < a_len; i++)
+    if (fold_ascii (a[i]) != fold_ascii (b[i]))
+      return 0;
+  return 1;
+}
+
+static grub_uint8_t
+short_name_checksum (const grub_uint8_t* name)
+{
+  grub_uint8_t sum = 0;
+  for (int i = 0; i < 11; i++)
+    sum = ((sum & 1) << 7) + (sum >> 1) + name[i];
+  return sum;
+}
+
+/**
+ * Spell an 8.3 entry name as NAME.EXT.
+ */
+static grub_size_t
+short_name (const struct fat_dirent* entry, grub_uint16_t* name)
+{
+  grub_size_t len = 0;
+  int base_len = 8, ext_len = 3;
+
+  while (base_len > 0 && entry->name[base_len - 1] == ' ')
+    base_len--;
+  while (ext_len > 0 && entry->name[8 + ext_len - 1] == ' ')
+    ext_len--;
+  for (int i = 0; i < base_len; i++)
+    name[len++] = (i == 0 && entry->name[0] == FAT_DIRENT_KANJI_E5) ? 0xe5 : entry->name[i];
+  if (ext_len)
+    name[len++] = '.';
+  for (int i = 0; i < ext_len; i++)
+    name[len++] = entry->name[8 + i];
+  return len;
+}
+
+/**
+ * Find a name in a directory.
+ *
+ * @param name The wanted name, in UTF-16.
+ * @param cluster In: the directory (0 for the root). Out: the first cluster of the entry.
+ */
+static grub_err_t
+lookup (struct fat_volume* vol, const grub_uint16_t* name, grub_size_t name_len,
+        grub_uint32_t* cluster, grub_uint64_t* size, int* is_dir)
+{
+  grub_uint16_t lfn[FAT_LFN_ENTRIES * FAT_LFN_CHARS];
+  grub_uint16_t sfn[12];
+  grub_uint8_t lfn_checksum = 0;
+  int lfn_next = -1; // ordinal of the next expected LFN entry; 0 once complete
+  grub_size_t dir_size;
+  grub_uint8_t* dir = read_directory (vol, *cluster, &dir_size);
+  grub_err_t err = GRUB_ERR_FILE_NOT_FOUND;
+
+  if (!dir)
+    return grub_errno;
+  for (grub_size_t off = 0; off + FAT_DIRENT_SIZE <= dir_size; off += FAT_DIRENT_SIZE)
+  {
+    struct fat_dirent* entry = (struct fat_dirent*) (dir + off);
+    grub_uint8_t* raw = dir + off;
+    if (raw[0] == 0)
+      break;
+    if (raw[0] == FAT_DIRENT_FREE)
+    {
+      lfn_next = -1;
+      continue;
+    }
+    if ((entry->attr & 0x3f) == FAT_ATTR_LONG_NAME)
+    {
+      int ordinal = raw[0] & 0x1f;
+      if (raw[0] & FAT_LFN_LAST)
+      {
+        lfn_next = ordinal;
+        lfn_checksum = raw[13];
+        grub_memset (lfn, 0, sizeof (lfn));
+      }
+      if (ordinal == 0 || ordinal > FAT_LFN_ENTRIES || ordinal != lfn_next || raw[13] != lfn_checksum)
+      {
+        lfn_next = -1;
+        continue;
+      }
+      grub_uint16_t* part = lfn + (ordinal - 1) * FAT_LFN_CHARS;
+      static const grub_uint8_t offsets[FAT_LFN_CHARS] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+      for (int i = 0; i < FAT_LFN_CHARS; i++)
+        part[i] = raw[offsets[i]] | (raw[offsets[i] + 1] << 8);
+      lfn_next--;
+      continue;
+    }
+    int has_lfn = lfn_next == 0 && short_name_checksum (entry->name) == lfn_checksum;
+    lfn_next = -1;
+    if (entry->attr & FAT_ATTR_VOLUME_ID)
+      continue;
+    int match = names_equal (sfn, short_name (entry, sfn), name, name_len);
+    if (!match && has_lfn)
+    {
+      grub_size_t lfn_len = 0;
+      while (lfn_len < ARRAY_SIZE (lfn) && lfn[lfn_len] != 0)
+        lfn_len++;
+      match = names_equal (lfn, lfn_len, name, name_len);
+    }
+    if (match)
+    {
+      *cluster = grub_le_to_cpu16 (entry->cluster_low);
+      if (vol->bits == 32)
+        *cluster |= (grub_uint32_t) grub_le_to_cpu16 (entry->cluster_high) << 16;
+      if (*cluster == vol->root_cluster && vol->bits == 32)
+        *cluster = 0;
+      *size = grub_le_to_cpu32 (entry->size);
+      *is_dir = !!(entry->attr & FAT_ATTR_DIRECTORY);
+      err = GRUB_ERR_NONE;
+      break;
+    }
+  }
+  grub_free (dir);
+  return err;
+}
+
+grub_err_t
+hackbgrt_fat_resolve (grub_disk_t disk, const char* path, struct hackbgrt_fat_file* file)
+{
+  grub_uint16_t name[FAT_NAME_MAX + 1];
+  grub_uint32_t cluster = 0;
+  grub_uint64_t size = 0;
+  int is_dir = 1;
+  struct fat_volume* vol = grub_malloc (sizeof (*vol));
+
+  file->size = 0;
+  file->extent_count = 0;
+  file->extents = 0;
+  if (!vol)
+    return grub_errno;
+  if (mount (vol, disk))
+    goto fail;
+  while (*path)
+  {
+    const char* end;
+    grub_size_t name_len;
+    while (*path == '/')
+      path++;
+    if (!*path)
+      break;
+    end = grub_strchr (path, '/');
+    if (!end)
+      end = path + grub_strlen (path);
+    if (!is_dir)
+    {
+      grub_error (GRUB_ERR_BAD_FILE_TYPE, "HackBGRT: not a directory\n");
+      goto fail;
+    }
+    name_len = grub_utf8_to_utf16 (name, ARRAY_SIZE (name), (const grub_uint8_t*) path, end - path, 0);
+    if (name_len > FAT_NAME_MAX
+        || lookup (vol, name, name_len, &cluster, &size, &is_dir) == GRUB_ERR_FILE_NOT_FOUND)
+    {
+      grub_error (GRUB_ERR_FILE_NOT_FOUND, "HackBGRT: %s not found on the FAT\n", path);
+      goto fail;
+    }
+    if (grub_errno)
+      goto fail;
+    path = end;
+  }
+  if (is_dir)
+  {
+    grub_error (GRUB_ERR_BAD_FILE_TYPE, "HackBGRT: is a directory\n");
+    goto fail;
+  }
+  if (map_chain (vol, cluster, size, file))
+    goto fail;
+  grub_free (vol);
+  return GRUB_ERR_NONE;
+fail:
+  hackbgrt_fat_free (file);
+  grub_free (vol);
+  return grub_errno;
+}
+
+void
+hackbgrt_fat_free (struct hackbgrt_fat_file* file)
+{
+  grub_free (file->extents);
+  file->extents = 0;
+  file->extent_count = 0;
+}
+#endif
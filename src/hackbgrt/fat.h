@@ -0,0 +1,43 @@
+#pragma once
+
+#include <grub/disk.h>
+#include <grub/err.h>
+#include <grub/types.h>
+
+/**
+ * A contiguous run of a file on its partition, in bytes.
+ */
+struct hackbgrt_extent
+{
+  grub_uint64_t file_offset;
+  grub_uint64_t disk_offset; // from the start of the partition
+  grub_uint64_t length;
+};
+
+/**
+ * Where a file lies on a FAT12/16/32 partition.
+ */
+struct hackbgrt_fat_file
+{
+  grub_uint64_t size;
+  grub_size_t extent_count;
+  struct hackbgrt_extent* extents; // sorted by file_offset, adjacent clusters merged
+};
+
+/**
+ * Resolve the extents of a file by walking the directories and the FAT.
+ *
+ * Only the boot sector, the directories on the path and the FAT entries of
+ * the file are read, through the GRUB disk cache; the file data is not.
+ *
+ * @param disk The partition holding the FAT filesystem.
+ * @param path The path inside the filesystem, like /EFI/logo.bmp; the
+ *        components match the long or the short names, ignoring ASCII case.
+ * @param file Filled on success; release with hackbgrt_fat_free.
+ * @return GRUB_ERR_NONE, or the error also set in grub_errno.
+ */
+extern grub_err_t
+hackbgrt_fat_resolve (grub_disk_t disk, const char* path, struct hackbgrt_fat_file* file);
+
+extern void
+hackbgrt_fat_free (struct hackbgrt_fat_file* file);
@@ -0,0 +1,331 @@
+#include <grub/device.h>
+#include <grub/err.h>
+#include <grub/file.h>
+#include <grub/fs.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/types.h>
+#include "gallery.h"
+#include "tier.h"
+
+#if HACKBGRT_WITH_GALLERY
+/**
+ * A line of a manifest, pointing into it.
+ */
+struct manifest_entry
+{
+  const char* name;
+  grub_size_t name_length;
+  grub_uint32_t weight;
+  grub_uint32_t width; // 0 if not given
+  grub_uint32_t height;
+};
+
+/**
+ * A listing of the gallery directory: the first one counts the images, the
+ * second one stops at the drawn image.
+ */
+struct gallery_walk
+{
+  grub_uint64_t count;
+  grub_uint64_t target; // the image to pick, on the second listing
+  int picking;
+  char* name;           // the picked image
+};
+
+/**
+ * Join a directory and a name.
+ *
+ * @return The path, to free, or 0 with grub_errno set.
+ */
+static char*
+join_path (const char* dir, const char* name, grub_size_t name_length)
+{
+  grub_size_t dir_length = grub_strlen (dir);
+  int slash = dir_length && dir[dir_length - 1] != '/';
+  char* path = grub_malloc (dir_length + slash + name_length + 1);
+  if (!path)
+    return 0;
+  grub_memcpy (path, dir, dir_length);
+  if (slash)
+    path[dir_length] = '/';
+  grub_memcpy (path + dir_length + slash, name, name_length);
+  path[dir_length + slash + name_length] = '\0';
+  return path;
+}
+
+static int
+is_blank (char c)
+{
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+static int
+is_digit (char c)
+{
+  return '0' <= c && c <= '9';
+}
+
+/**
+ * Read the next entry of a manifest, skipping the blank and # lines.
+ *
+ * @param cursor The position in the manifest, moved past the entry.
+ * @param entry Set to the entry.
+ * @return 1, or 0 at the end of the manifest.
+ */
+static int
+next_entry (const char** cursor, struct manifest_entry* entry)
+{
+  const char* p = *cursor;
+  while (*p)
+  {
+    const char* line = p;
+    const char* end = grub_strchr (line, '\n');
+    char* next;
+    if (!end)
+      end = line + grub_strlen (line);
+    p = *end ? end + 1 : end;
+    while (line < end && is_blank (*line))
+      line++;
+    if (line == end || *line == '#')
+      continue;
+    entry->name = line;
+    while (line < end && !is_blank (*line))
+      line++;
+    entry->name_length = line - entry->name;
+    entry->weight = 1;
+    entry->width = 0;
+    entry->height = 0;
+    while (line < end && is_blank (*line))
+      line++;
+    if (line < end && is_digit (*line))
+    {
+      entry->weight = (grub_uint32_t) grub_strtoul (line, &next, 10);
+      line = next;
+    }
+    while (line < end && is_blank (*line))
+      line++;
+    if (line < end && is_digit (*line))
+    {
+      entry->width = (grub_uint32_t) grub_strtoul (line, &next, 10);
+      if (*next == 'x' && is_digit (next[1]))
+        entry->height = (grub_uint32_t) grub_strtoul (next + 1, 0, 10);
+      else
+        entry->width = 0;
+    }
+    *cursor = p;
+    return 1;
+  }
+  *cursor = p;
+  return 0;
+}
+
+static int
+fits_screen (const struct manifest_entry* entry, grub_uint32_t screen_width, grub_uint32_t screen_height)
+{
+  return !screen_width || !entry->width || (entry->width <= screen_width && entry->height <= screen_height);
+}
+
+/**
+ * Draw an image of a manifest by weight.
+ *
+ * @param dir The gallery directory.
+ * @param manifest The manifest, NUL-terminated.
+ * @return The path of the image, to free, or 0 with grub_errno set.
+ */
+static char*
+pick_from_manifest (const char* dir, const char* manifest, grub_uint64_t draw,
+                    grub_uint32_t screen_width, grub_uint32_t screen_height)
+{
+  struct manifest_entry entry;
+  const char* cursor = manifest;
+  grub_uint64_t all = 0, fitting = 0, target;
+  int only_fitting;
+
+  while (next_entry (&cursor, &entry))
+  {
+    all += entry.weight;
+    if (fits_screen (&entry, screen_width, screen_height))
+      fitting += entry.weight;
+  }
+  // nothing fits: better a cropped logo than the firmware's
+  only_fitting = fitting != 0;
+  if (!only_fitting && !all)
+  {
+    grub_error (GRUB_ERR_FILE_NOT_FOUND, "HackBGRT: No image in the manifest of %s!\n", dir);
+    return 0;
+  }
+  grub_divmod64 (draw, only_fitting ? fitting : all, &target);
+  cursor = manifest;
+  while (next_entry (&cursor, &entry))
+  {
+    if (only_fitting && !fits_screen (&entry, screen_width, screen_height))
+      continue;
+    if (target < entry.weight)
+      return join_path (dir, entry.name, entry.name_length);
+    target -= entry.weight;
+  }
+  // not reached: the target is below the sum of the weights
+  grub_error (GRUB_ERR_BUG, "HackBGRT: Gallery draw out of range!\n");
+  return 0;
+}
+
+/**
+ * Read the manifest of a gallery, if any.
+ *
+ * @return The manifest, NUL-terminated, to free; 0 if there is none, grub_errno cleared.
+ */
+static char*
+read_manifest (const char* dir)
+{
+  char* path = join_path (dir, HACKBGRT_GALLERY_MANIFEST, sizeof (HACKBGRT_GALLERY_MANIFEST) - 1);
+  grub_file_t file;
+  char* manifest = 0;
+  grub_size_t size;
+
+  if (!path)
+    return 0;
+  file = grub_file_open (path, GRUB_FILE_TYPE_CAT);
+  grub_free (path);
+  if (!file)
+  {
+    grub_errno = GRUB_ERR_NONE;
+    return 0;
+  }
+  size = grub_min (grub_file_size (file), HACKBGRT_GALLERY_MANIFEST_MAX);
+  manifest = grub_malloc (size + 1);
+  if (manifest && grub_file_read (file, manifest, size) != (grub_ssize_t) size)
+  {
+    grub_free (manifest);
+    manifest = 0;
+  }
+  grub_file_close (file);
+  if (!manifest)
+  {
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "gallery %s: unreadable manifest, listing the directory\n", dir);
+    grub_errno = GRUB_ERR_NONE;
+    return 0;
+  }
+  manifest[size] = '\0';
+  return manifest;
+}
+
+/**
+ * Tell whether a file name has the extension of a supported image.
+ */
+static int
+is_image_name (const char* name)
+{
+  static const char* const extensions[] = { ".bmp", ".bmz", ".bpk", ".png" };
+  grub_size_t length = grub_strlen (name);
+  if (length < 5)
+    return 0;
+  for (unsigned e = 0; e < ARRAY_SIZE (extensions); e++)
+  {
+    unsigned i;
+    // FAT short names are upper case
+    for (i = 0; i < 4; i++)
+      if ((name[length - 4 + i] | 0x20) != extensions[e][i])
+        break;
+    if (i == 4)
+      return 1;
+  }
+  return 0;
+}
+
+static int
+gallery_dir_hook (const char* filename, const struct grub_dirhook_info* info, void* data)
+{
+  struct gallery_walk* walk = data;
+  if (info->dir || !is_image_name (filename))
+    return 0;
+  if (walk->picking && walk->count == walk->target)
+  {
+    walk->name = grub_strdup (filename);
+    return 1;
+  }
+  walk->count++;
+  return 0;
+}
+
+/**
+ * Draw an image among those of a directory, listed twice by the filesystem
+ * driver: the files are never opened and only the drawn name is copied.
+ *
+ * @return The path of the image, to free, or 0 with grub_errno set.
+ */
+static char*
+pick_from_directory (const char* dir, grub_uint64_t draw)
+{
+  struct gallery_walk walk = { 0 };
+  char* device_name = grub_file_get_device_name (dir);
+  const char* path = grub_strchr (dir, ')');
+  grub_device_t device = 0;
+  grub_fs_t fs;
+  char* image = 0;
+
+  if (!device_name || !path)
+  {
+    grub_error (GRUB_ERR_BAD_FILENAME, "HackBGRT: Bad gallery directory (%s)!\n", dir);
+    goto done;
+  }
+  path++;
+  device = grub_device_open (device_name);
+  if (!device)
+    goto done;
+  fs = grub_fs_probe (device);
+  if (!fs || fs->fs_dir (device, path, gallery_dir_hook, &walk) != GRUB_ERR_NONE)
+    goto done;
+  if (!walk.count)
+  {
+    grub_error (GRUB_ERR_FILE_NOT_FOUND, "HackBGRT: No image in %s!\n", dir);
+    goto done;
+  }
+  grub_divmod64 (draw, walk.count, &walk.target);
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "gallery %s: image %llu of %llu\n", dir,
+                  (unsigned long long) walk.target, (unsigned long long) walk.count);
+  walk.count = 0;
+  walk.picking = 1;
+  if (fs->fs_dir (device, path, gallery_dir_hook, &walk) != GRUB_ERR_NONE)
+    goto done;
+  if (walk.name)
+    image = join_path (dir, walk.name, grub_strlen (walk.name));
+  else if (grub_errno == GRUB_ERR_NONE)
+    // the directory changed between the listings
+    grub_error (GRUB_ERR_FILE_NOT_FOUND, "HackBGRT: No image in %s!\n", dir);
+done:
+  grub_free (walk.name);
+  if (device)
+    grub_device_close (device);
+  grub_free (device_name);
+  return image;
+}
+
+char*
+hackbgrt_gallery_pick (const char* dir, grub_uint64_t draw, grub_uint32_t screen_width, grub_uint32_t screen_height)
+{
+  char* manifest = read_manifest (dir);
+  char* image;
+
+  if (manifest)
+  {
+    hackbgrt_trace (HACKBGRT_TRACE_STEPS, "gallery %s: reading its manifest\n", dir);
+    image = pick_from_manifest (dir, manifest, draw, screen_width, screen_height);
+    grub_free (manifest);
+  }
+  else
+    image = pick_from_directory (dir, draw);
+  if (image)
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "gallery %s: %s drawn\n", dir, image);
+  return image;
+}
+#else
+char*
+hackbgrt_gallery_pick (const char* dir __attribute__ ((unused)), grub_uint64_t draw __attribute__ ((unused)),
+                       grub_uint32_t screen_width __attribute__ ((unused)),
+                       grub_uint32_t screen_height __attribute__ ((unused)))
+{
+  hackbgrt_not_in_build ("dir:/");
+  return 0;
+}
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <grub/err.h>
+#include <grub/types.h>
+
+/** The manifest of a gallery directory, read instead of listing it. */
+#define HACKBGRT_GALLERY_MANIFEST "gallery.lst"
+
+/** The largest manifest read, in bytes. */
+#define HACKBGRT_GALLERY_MANIFEST_MAX (64 * 1024)
+
+/**
+ * Pick an image of a gallery directory (image=dir:).
+ *
+ * With a manifest in the directory, the image is drawn from its lines in
+ * one small read: NAME [WEIGHT [WIDTHxHEIGHT]], by weight, among the images
+ * that fit the screen if any does. Otherwise the directory is listed by the
+ * GRUB filesystem driver, without opening the files, and every .bmp, .bmz,
+ * .bpk and .png has the same chance.
+ *
+ * @param dir The directory, with the ESP, like (hd0,gpt1)/EFI/splash/.
+ * @param draw A uniform random value.
+ * @param screen_width The GOP resolution, to leave out the images larger than the screen; 0 if unknown.
+ * @param screen_height
+ * @return The path of the image, to free, or 0 with grub_errno set.
+ */
+extern char*
+hackbgrt_gallery_pick (const char* dir, grub_uint64_t draw, grub_uint32_t screen_width, grub_uint32_t screen_height);
@@ -1,281 +1,774 @@
 #include <grub/acpi.h>
+#include <grub/bitmap.h>
 #include <grub/charset.h>
 #include <grub/dl.h>
 #include <grub/efi/api.h>
 #include <grub/efi/disk.h>
 #include <grub/efi/efi.h>
-#include <grub/efi/graphics_output.h>
+#include <grub/env.h>
 #include <grub/err.h>
 #include <grub/extcmd.h>
 #include <grub/file.h>
 #include <grub/i18n.h>
+#include <grub/loader.h>
 #include <grub/misc.h>
 #include <grub/mm.h>
+#include <grub/time.h>
 #include <grub/types.h>
 #include <grub/video.h>
+#include "acpi.h"
+#include "alloc.h"
+#include "bmp.h"
+#include "builtin.h"
+#include "cache.h"
 #include "config.h"
+#include "display.h"
+#include "gallery.h"
+#include "io.h"
+#include "lz4.h"
+#include "parallel.h"
+#include "profile.h"
+#include "scale.h"
+#include "stats.h"
+#include "telemetry.h"
+#include "tier.h"
 #include "types.h"
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
+// budget=: when the run must be done, in grub_get_time_ms; 0 for no limit
+static grub_uint64_t deadline;
+static int budget_spent;
 
+// set by read_pack: the bitmap read depends on the screen, and is cached under it
+static int read_from_pack;
+
+// with a budget, the reads go in chunks of this size and the deadline is checked in between
+#define HACKBGRT_BUDGET_CHUNK (1024 * 1024)
+
+/**
+ * Check the budget of the run before a stage.
+ *
+ * Once spent it stays spent: the stages after give up too, and the
+ * error is only raised once.
+ *
+ * @param stage The stage about to start, for the message.
+ * @return 1 if the budget is spent, 0 otherwise.
+ */
+static int
+over_budget (const char* stage)
+{
+  if (!deadline || grub_get_time_ms () < deadline)
+    return 0;
+  if (!budget_spent)
+  {
+    budget_spent = 1;
+    grub_error (GRUB_ERR_TIMEOUT, "HackBGRT: Budget exceeded before %s!\n", stage);
+  }
+  return 1;
+}
+
+/**
+ * Read exactly size bytes at offset, in chunks checked against the budget if there is one.
+ *
+ * @return GRUB_ERR_NONE, GRUB_ERR_TIMEOUT if the budget ran out, or the error of the read.
+ */
 static grub_err_t
-grub_video_gop_fill_mode_info (unsigned mode,
-			       struct grub_efi_gop_mode_info* in,
-			       struct grub_video_mode_info* out)
-{
-  out->mode_number = mode;
-  out->number_of_colors = 256;
-  out->width = in->width;
-  out->height = in->height;
-  out->mode_type = GRUB_VIDEO_MODE_TYPE_RGB;
-  out->bytes_per_pixel = sizeof (struct grub_efi_gop_blt_pixel);
-  out->bpp = out->bytes_per_pixel << 3;
-  out->pitch = in->width * out->bytes_per_pixel;
-  out->red_mask_size = 8;
-  out->red_field_pos = 16;
-  out->green_mask_size = 8;
-  out->green_field_pos = 8;
-  out->blue_mask_size = 8;
-  out->blue_field_pos = 0;
-  out->reserved_mask_size = 8;
-  out->reserved_field_pos = 24;
-  out->blit_format = GRUB_VIDEO_BLIT_FORMAT_BGRA_8888;
-  out->mode_type |= (GRUB_VIDEO_MODE_TYPE_DOUBLE_BUFFERED | GRUB_VIDEO_MODE_TYPE_UPDATING_SWAP);
+read_in_budget (hackbgrt_io_t file, grub_uint64_t offset, void* buf, grub_size_t size)
+{
+  grub_size_t chunk = deadline ? HACKBGRT_BUDGET_CHUNK : size;
+
+  for (grub_size_t done = 0; done < size; done += chunk)
+  {
+    if (over_budget ("reading the image"))
+      return GRUB_ERR_TIMEOUT;
+    if (hackbgrt_io_read (file, offset + done, (grub_uint8_t*) buf + done, grub_min (chunk, size - done)))
+      return GRUB_ERR_READ_ERROR;
+  }
   return GRUB_ERR_NONE;
 }
 
+/**
+ * Check that a bitmap header describes an image the BGRT can display, and
+ * that its sizes hold the rows its width and height make.
+ *
+ * @param header The bitmap header.
+ * @return 1 if supported, 0 otherwise.
+ */
 static int
-grub_video_gop_iterate (struct grub_efi_gop* gop,
-                        int (*hook) (const struct grub_video_mode_info* info, void* hook_arg),
-                        void* hook_arg)
-{
-  for (unsigned mode = 0; mode < gop->mode->max_mode; mode++)
-  {
-    grub_efi_uintn_t size;
-    grub_efi_status_t status;
-    struct grub_efi_gop_mode_info* info = NULL;
-    grub_err_t err;
-    struct grub_video_mode_info mode_info;
-    status = efi_call_4 (gop->query_mode, gop, mode, &size, &info);
-    if (status)
-    {
-      info = 0;
-      continue;
-    }
-    err = grub_video_gop_fill_mode_info (mode, info, &mode_info);
-    if (err)
-    {
-      grub_errno = GRUB_ERR_NONE;
-      continue;
-    }
-    if (hook (&mode_info, hook_arg))
-      return 1;
+check_bmp_header (const struct bitmap_header* header)
+{
+  hackbgrt_trace (HACKBGRT_TRACE_STEPS, "signature %s, pixel_data_offset=%d, dib_header_size=%d, planes=%d, bpp=%d, compression=%d, palette_colors=%d, important_colors=%d\n",
+            grub_memcmp(&header->signature, BMP_MAGIC, BMP_MAGIC_SIZE) == 0 ? "ok" : "ko",
+            header->pixel_data_offset,
+            header->dib_header_size,
+            header->planes,
+            header->bpp,
+            header->compression,
+            header->palette_colors,
+            header->important_colors
+            );
+  return grub_memcmp(&header->signature, BMP_MAGIC, BMP_MAGIC_SIZE) == 0
+      && header->pixel_data_offset == BMP_PIXEL_DATA_OFFSET
+      && header->dib_header_size == BMP_DIB_HEADER_SIZE
+      && header->planes == 1
+      && header->bpp == BMP_888_BPP
+      && header->compression == BMP_NO_COMPRESSION
+      && header->palette_colors == BMP_NO_PALETTE
+      && header->important_colors == BMP_NO_PALETTE
+      // a top-down height is negative, above the maximum
+      && header->width > 0 && header->width <= HACKBGRT_BMP_MAX_DIMENSION
+      && header->height > 0 && header->height <= HACKBGRT_BMP_MAX_DIMENSION
+      && header->size >= BMP_PIXEL_DATA_OFFSET
+      && header->data_size <= header->size - BMP_PIXEL_DATA_OFFSET
+      && header->data_size >= get_bitmap_pixels_size (header->width, header->height);
+}
+
+#if HACKBGRT_WITH_CONVERT
+/**
+ * Convert a bitmap file in another format to a BGRT-compliant bitmap in EFI memory.
+ *
+ * @param data The whole file.
+ * @param size The size of the file.
+ * @param path The path, for messages.
+ * @return The bitmap, or 0 with grub_errno set.
+ */
+static bitmap_t
+convert_bmp (const grub_uint8_t* data, grub_size_t size, const char* path)
+{
+  struct hackbgrt_bmp_info info;
+  bitmap_t bmp;
+
+  if (over_budget ("converting the image"))
+    return 0;
+  if (hackbgrt_bmp_parse (data, size, &info))
+  {
+    grub_error(GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load BMP, not supported format (%s)!\n", path);
+    return 0;
+  }
+  bmp = hackbgrt_alloc_bitmap (get_bitmap_total_size (info.width, info.height));
+  if (!bmp)
+    return 0;
+  if (hackbgrt_bmp_convert (&info, data, bmp))
+  {
+    hackbgrt_alloc_free (bmp);
+    return 0;
+  }
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "EFI bitmap converted from %d bpp (compression %d)\n", info.bpp, info.compression);
+  return bmp;
+}
+
+/**
+ * Read a bitmap file that is not BGRT-compliant, converting its pixels as they are read.
+ *
+ * The headers are checked against the size of the file once the first
+ * chunk is read, before anything is allocated. The pixels then go through
+ * that chunk straight into the bitmap the BGRT will point to: the file is
+ * never held whole.
+ *
+ * @param file The opened file.
+ * @param path The path, for messages.
+ * @return The bitmap, or 0 with grub_errno set.
+ */
+static bitmap_t
+read_converted (hackbgrt_io_t file, const char* path)
+{
+  grub_uint64_t size = hackbgrt_io_size (file);
+  grub_size_t chunk_size = grub_min (size, (grub_uint64_t) HACKBGRT_BMP_STREAM_CHUNK);
+  grub_uint64_t offset = chunk_size;
+  struct hackbgrt_bmp_info info;
+  hackbgrt_bmp_stream_t stream;
+  grub_size_t kept, used, n;
+  grub_uint8_t* chunk;
+  bitmap_t bmp = 0;
+  grub_err_t err;
+
+  if (size > HACKBGRT_BMP_MAX_FILE_SIZE)
+  {
+    grub_error(GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load BMP, not supported format (%s)!\n", path);
+    return 0;
+  }
+  chunk = grub_malloc (chunk_size);
+  if (!chunk)
+    return 0;
+  if ((err = read_in_budget (file, 0, chunk, chunk_size)))
+    goto read_error;
+  if (hackbgrt_bmp_parse_head (chunk, chunk_size, size, &info))
+  {
+    grub_error(GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load BMP, not supported format (%s)!\n", path);
+    goto fail;
   }
+  if (over_budget ("converting the image"))
+    goto fail;
+  bmp = hackbgrt_alloc_bitmap (get_bitmap_total_size (info.width, info.height));
+  if (!bmp)
+    goto fail;
+  stream = hackbgrt_bmp_stream_open (&info, bmp);
+  if (!stream)
+    goto fail;
+  // the pixels in the first chunk move to its start
+  kept = info.pixel_offset < offset ? offset - info.pixel_offset : 0;
+  grub_memmove (chunk, chunk + offset - kept, kept);
+  offset = grub_max (offset, (grub_uint64_t) info.pixel_offset);
+  while (!hackbgrt_bmp_stream_feed (stream, chunk, kept, &used))
+  {
+    kept -= used;
+    grub_memmove (chunk, chunk + used, kept);
+    n = grub_min (chunk_size - kept, size - offset);
+    if (!n)
+      break;
+    if ((err = read_in_budget (file, offset, chunk + kept, n)))
+      break;
+    offset += n;
+    kept += n;
+  }
+  hackbgrt_bmp_stream_close (stream);
+  if (err)
+    goto read_error;
+  grub_free (chunk);
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "EFI bitmap converted from %d bpp (compression %d), %llu bytes read\n",
+                  info.bpp, info.compression, (unsigned long long) offset);
+  return bmp;
+
+read_error:
+  if (err != GRUB_ERR_TIMEOUT)
+    grub_error(GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load BMP (%s)!\n", path);
+fail:
+  if (bmp)
+    hackbgrt_alloc_free (bmp);
+  grub_free (chunk);
+  return 0;
+}
+#else
+#if HACKBGRT_WITH_BMZ || HACKBGRT_WITH_OVERLAY
+static bitmap_t
+convert_bmp (const grub_uint8_t* data __attribute__ ((unused)), grub_size_t size __attribute__ ((unused)),
+             const char* path __attribute__ ((unused)))
+{
+  hackbgrt_not_in_build ("BMP conversion");
   return 0;
 }
+#endif
 
-static int
-check_protocol_hook (const struct grub_video_mode_info* info __attribute__ ((unused)),
-                     void* hook_arg)
+static bitmap_t
+read_converted (hackbgrt_io_t file __attribute__ ((unused)), const char* path __attribute__ ((unused)))
 {
-  int* have_usable_mode = hook_arg;
-  *have_usable_mode = 1;
-  return 1;
+  hackbgrt_not_in_build ("BMP conversion");
+  return 0;
 }
+#endif
 
+#if HACKBGRT_WITH_PNG
 /**
- * Get the GOP (Graphics Output Protocol) pointer.
+ * Decode a PNG with the GRUB bitmap loader and convert it to a BGRT-compliant bitmap in EFI memory.
+ *
+ * The png module must be loaded; GRUB reads the file again by itself.
+ *
+ * @param path The path, ending with .png.
+ * @return The bitmap, or 0 with grub_errno set.
  */
-static struct grub_efi_gop*
-get_gop(void)
-{
-  static grub_efi_guid_t graphics_output_guid = GRUB_EFI_GOP_GUID;
-  static grub_efi_handle_t gop_handle;
-  static struct grub_efi_gop* gop;
-
-  grub_efi_handle_t* handles;
-  grub_efi_uintn_t num_handles, i;
-  int have_usable_mode = 0;
-  handles = grub_efi_locate_handle (GRUB_EFI_BY_PROTOCOL, &graphics_output_guid, NULL, &num_handles);
-  if (!handles || num_handles == 0)
-    return gop;
-  for (i = 0; i < num_handles; i++)
-  {
-    gop_handle = handles[i];
-    gop = grub_efi_open_protocol (gop_handle, &graphics_output_guid, GRUB_EFI_OPEN_PROTOCOL_GET_PROTOCOL);
-    grub_video_gop_iterate (gop, check_protocol_hook, &have_usable_mode);
-    if (have_usable_mode)
-    {
-      grub_free (handles);
-      return gop;
-    }
+static bitmap_t
+read_png (const char* path)
+{
+  struct grub_video_bitmap* image;
+  bitmap_t bmp;
+  int alpha;
+
+  if (over_budget ("decoding the image"))
+    return 0;
+  if (grub_video_bitmap_load (&image, path))
+  {
+    grub_error(GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load PNG (%s), is the png module loaded?\n", path);
+    return 0;
   }
-  gop = 0;
-  gop_handle = 0;
-  return gop;
+  alpha = image->mode_info.blit_format == GRUB_VIDEO_BLIT_FORMAT_RGBA_8888;
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "PNG %s decoded: %dx%d, %s\n", path, image->mode_info.width, image->mode_info.height,
+                  alpha ? "RGBA" : "RGB");
+  if ((!alpha && image->mode_info.blit_format != GRUB_VIDEO_BLIT_FORMAT_RGB_888)
+      || image->mode_info.width > HACKBGRT_BMP_MAX_DIMENSION
+      || image->mode_info.height > HACKBGRT_BMP_MAX_DIMENSION)
+  {
+    grub_video_bitmap_destroy (image);
+    grub_error(GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load PNG, not supported format (%s)!\n", path);
+    return 0;
+  }
+  if (over_budget ("converting the image"))
+  {
+    grub_video_bitmap_destroy (image);
+    return 0;
+  }
+  bmp = hackbgrt_alloc_bitmap (get_bitmap_total_size (image->mode_info.width, image->mode_info.height));
+  if (!bmp)
+  {
+    grub_video_bitmap_destroy (image);
+    return 0;
+  }
+  hackbgrt_bmp_from_rgb (bmp, grub_video_bitmap_get_data (image), image->mode_info.width, image->mode_info.height,
+                         image->mode_info.pitch, alpha);
+  grub_video_bitmap_destroy (image);
+  return bmp;
+}
+#else
+static bitmap_t
+read_png (const char* path __attribute__ ((unused)))
+{
+  hackbgrt_not_in_build ("PNG");
+  return 0;
 }
+#endif
 
 /**
- * Create a new XSDT with the given number of entries.
+ * Read an uncompressed bitmap into EFI memory.
  *
- * @param xsdt0 The old XSDT.
- * @param entries The number of SDT entries.
- * @return Pointer to a new XSDT.
+ * @param file The opened file.
+ * @param path The path, for messages.
+ * @param header The bitmap header, already read from the file.
+ * @return The bitmap, or 0 with grub_errno set.
  */
-static struct grub_acpi_table_header*
-create_xsdt(struct grub_acpi_table_header* xsdt0, grub_efi_uintn_t entries)
+static bitmap_t
+read_bmp (hackbgrt_io_t file, const char* path, const struct bitmap_header* header)
 {
-  struct grub_acpi_table_header* xsdt = 0;
+  bitmap_t bmp;
 
-  grub_efi_uint32_t xsdt_len = sizeof (struct grub_acpi_table_header) + entries * sizeof (grub_efi_uint64_t);
-  grub_efi_status_t status = efi_call_3 (grub_efi_system_table->boot_services->allocate_pool, GRUB_EFI_ACPI_RECLAIM_MEMORY, xsdt_len, (void**) &xsdt);
-  if (status)
+  hackbgrt_trace (HACKBGRT_TRACE_STEPS, "header of %s read\n", path);
+  if (!check_bmp_header (header))
+    return read_converted (file, path);
+  // only the rows: what the sizes declare past them is not read, nor published
+  grub_uint32_t pixels_size = get_bitmap_pixels_size (header->width, header->height);
+  if (BMP_PIXEL_DATA_OFFSET + (grub_uint64_t) pixels_size > hackbgrt_io_size (file))
   {
-    grub_printf("HackBGRT: Failed to allocate memory for XSDT.\n");
+    grub_error(GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load BMP, truncated (%s)!\n", path);
     return 0;
   }
-  grub_memset(xsdt, 0, xsdt_len);
-  grub_memcpy(xsdt, xsdt0, grub_min(xsdt0->length, xsdt_len));
-  xsdt->length = xsdt_len;
-  xsdt->checksum = 0;
-  return xsdt;
+  hackbgrt_trace (HACKBGRT_TRACE_STEPS, "header of %s OK (bitmap size = %d)\n", path, header->size);
+  bmp = hackbgrt_alloc_bitmap (BMP_PIXEL_DATA_OFFSET + pixels_size);
+  if (!bmp)
+    return 0;
+  hackbgrt_trace (HACKBGRT_TRACE_STEPS, "EFI memory allocated for bitmap\n");
+  grub_memcpy(&bmp->header, header, sizeof (*header));
+  bmp->header.size = BMP_PIXEL_DATA_OFFSET + pixels_size;
+  bmp->header.data_size = pixels_size;
+  hackbgrt_trace (HACKBGRT_TRACE_STEPS, "EFI bitmap header copied\n");
+  grub_err_t err = read_in_budget (file, sizeof (*header), &bmp->pixels, pixels_size);
+  if (err)
+  {
+    hackbgrt_alloc_free (bmp);
+    if (err != GRUB_ERR_TIMEOUT)
+      grub_error(GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load BMP (%s)!\n", path);
+    return 0;
+  }
+  hackbgrt_trace (HACKBGRT_TRACE_STEPS, "EFI bitmap pixels (%d) copied\n", pixels_size);
+  return bmp;
 }
 
-#define OEMID_TO_CHAR_LIST(oemid) oemid[0], oemid[1], oemid[2], oemid[3], oemid[4], oemid[5]
-#define ACPI_TABLE_TO_CHAR_LIST(sign) sign[0], sign[1], sign[2], sign[3]
-
+#if HACKBGRT_WITH_BMZ
 /**
- * Update the ACPI tables as needed for the desired BGRT change.
+ * Read a compressed splash container and decompress it straight into the
+ * EFI memory the BGRT will point to.
  *
- * If action is REMOVE, all BGRT entries will be removed.
- * If action is KEEP, the first BGRT entry will be returned.
- * If action is REPLACE, the given BGRT entry will be stored in each XSDT.
+ * Only the compressed payload goes through the I/O backend; for a mostly
+ * flat logo it is a small fraction of the bitmap.
  *
- * @param action The intended action.
- * @param bgrt The BGRT, if action is REPLACE.
- * @return Pointer to the BGRT, or 0 if not found (or destroyed).
+ * @param file The opened file.
+ * @param path The path, for messages.
+ * @param splash The container header, already read from the file.
+ * @return The bitmap, or 0 with grub_errno set.
  */
-static grub_acpi_bgrt_t
-handle_acpi_tables(enum hackbgrt_action action, grub_acpi_bgrt_t bgrt)
+static bitmap_t
+read_bmz (hackbgrt_io_t file, const char* path, const struct splash_header* splash)
 {
-  static grub_efi_packed_guid_t acpi20_guid = GRUB_EFI_ACPI_20_TABLE_GUID;
-  struct grub_acpi_rsdp_v20* rsdp;
-  struct grub_acpi_table_header* xsdt;
+  bitmap_t bmp;
+  grub_uint8_t* payload;
+  grub_ssize_t decoded;
+  grub_err_t err;
 
-  for (unsigned i = 0; i < grub_efi_system_table->num_table_entries; i++)
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "container %s: codec=%d, bmp_size=%d, payload_size=%d\n",
+                  path, splash->codec, splash->bmp_size, splash->payload_size);
+  if (splash->codec != SPLASH_CODEC_LZ4
+      || splash->bmp_size < BMP_PIXEL_DATA_OFFSET
+      || splash->bmp_size > SPLASH_MAX_BMP_SIZE
+      || splash->payload_size != hackbgrt_io_size (file) - sizeof (*splash))
   {
-    grub_efi_packed_guid_t *guid = &grub_efi_system_table->configuration_table[i].vendor_guid;
-    if (grub_memcmp (guid, &acpi20_guid, sizeof (grub_efi_packed_guid_t)) != 0)
-      continue;
-    // read RSDP version 2.0 https://wiki.osdev.org/RSDP
-    rsdp = (struct grub_acpi_rsdp_v20*) grub_efi_system_table->configuration_table[i].vendor_table;
-    if (grub_memcmp (rsdp->rsdpv1.signature, GRUB_RSDP_SIGNATURE, GRUB_RSDP_SIGNATURE_SIZE) != 0 || rsdp->rsdpv1.revision < 2 || !verify_acpi_rsdp2_checksums (rsdp))
-      continue;
-    grub_dprintf ("hackbgrt", "RSDP: revision = %d, OEM ID = %c%c%c%c%c%c\n", rsdp->rsdpv1.revision, OEMID_TO_CHAR_LIST (rsdp->rsdpv1.oemid));
-    // Read XSDT https://wiki.osdev.org/XSDT
-    xsdt = (struct grub_acpi_table_header*) (grub_efi_uintn_t) rsdp->xsdt_addr;
-    if (!xsdt)
-    {
-      grub_dprintf ("hackbgrt", "* XSDT: missing\n");
-      continue;
-    }
-    if (grub_memcmp(xsdt->signature, "XSDT", 4) != 0)
-    {
-      grub_dprintf ("hackbgrt", "* XSDT: bad signature\n");
-      continue;
-    }
-    if (action == HACKBGRT_KEEP && !verify_acpi_sdt_checksum (xsdt))
+    grub_error(GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load BMP, not supported format (%s)!\n", path);
+    return 0;
+  }
+  payload = grub_malloc (splash->payload_size);
+  if (!payload)
+    return 0;
+  if ((err = read_in_budget (file, sizeof (*splash), payload, splash->payload_size))
+      || over_budget ("decompressing the image"))
+  {
+    grub_free (payload);
+    if (err && err != GRUB_ERR_TIMEOUT)
+      grub_error(GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load BMP (%s)!\n", path);
+    return 0;
+  }
+  bmp = hackbgrt_alloc_bitmap (splash->bmp_size);
+  if (!bmp)
+  {
+    grub_free (payload);
+    return 0;
+  }
+  decoded = hackbgrt_lz4_decode (payload, splash->payload_size, (grub_uint8_t*) bmp, splash->bmp_size);
+  grub_free (payload);
+  if (decoded != (grub_ssize_t) splash->bmp_size)
+  {
+    hackbgrt_alloc_free (bmp);
+    grub_error(GRUB_ERR_BAD_COMPRESSED_DATA, "HackBGRT: Failed to decompress BMP (%s)!\n", path);
+    return 0;
+  }
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "EFI bitmap decompressed (%d -> %d)\n", splash->payload_size, splash->bmp_size);
+  if (!check_bmp_header (&bmp->header) || bmp->header.size > splash->bmp_size)
+  {
+    bitmap_t converted = convert_bmp ((const grub_uint8_t*) bmp, splash->bmp_size, path);
+    hackbgrt_alloc_free (bmp);
+    bmp = converted;
+  }
+  return bmp;
+}
+#else
+static bitmap_t
+read_bmz (hackbgrt_io_t file __attribute__ ((unused)), const char* path __attribute__ ((unused)),
+          const struct splash_header* splash __attribute__ ((unused)))
+{
+  hackbgrt_not_in_build (".bmz");
+  return 0;
+}
+#endif
+
+#if HACKBGRT_WITH_BUILTIN
+/**
+ * Copy the image linked into the module (image=builtin) to EFI memory, or
+ * decompress it there: the module's own memory is GRUB heap that the OS
+ * reuses, so the BGRT cannot point into it.
+ *
+ * @return The bitmap, or 0 with grub_errno set.
+ */
+static bitmap_t
+read_builtin (void)
+{
+  const grub_uint8_t* data = hackbgrt_builtin_image;
+  grub_uint32_t size = hackbgrt_builtin_image_size;
+  const struct splash_header* splash = (const struct splash_header*) data;
+  const struct bitmap_header* header = (const struct bitmap_header*) data;
+  grub_uint32_t bmp_size;
+  int compressed;
+  bitmap_t bmp;
+
+  if (!size)
+  {
+    grub_error (GRUB_ERR_FILE_NOT_FOUND, "HackBGRT: No builtin image in this module (BUILTIN_IMAGE)!\n");
+    return 0;
+  }
+  // hackbgrt-embed has checked the bitmap; these only guard against a hand-made builtin_image.c
+  compressed = size >= sizeof (*splash) && grub_memcmp (splash->signature, SPLASH_MAGIC, SPLASH_MAGIC_SIZE) == 0;
+  if (compressed)
+    bmp_size = splash->payload_size == size - sizeof (*splash) ? splash->bmp_size : 0;
+  else
+    bmp_size = size >= sizeof (*header) && check_bmp_header (header) && header->size <= size ? header->size : 0;
+  if (bmp_size < sizeof (*header) || bmp_size > SPLASH_MAX_BMP_SIZE)
+  {
+    grub_error (GRUB_ERR_BAD_FILE_TYPE, "HackBGRT: Bad builtin image!\n");
+    return 0;
+  }
+  bmp = hackbgrt_alloc_bitmap (bmp_size);
+  if (!bmp)
+    return 0;
+  // a plain BMP may have bytes past its pixels, left out
+  if (!compressed)
+    grub_memcpy (bmp, data, bmp_size);
+  else if (hackbgrt_lz4_decode (data + sizeof (*splash), splash->payload_size, (grub_uint8_t*) bmp, bmp_size)
+           != (grub_ssize_t) bmp_size || !check_bmp_header (&bmp->header) || bmp->header.size > bmp_size)
+  {
+    hackbgrt_alloc_free (bmp);
+    grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "HackBGRT: Bad builtin image!\n");
+    return 0;
+  }
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "builtin image: %ux%u, %u bytes %s\n", bmp->header.width, bmp->header.height,
+                  size, compressed ? "decompressed" : "copied");
+  return bmp;
+}
+#else
+static bitmap_t
+read_builtin (void)
+{
+  hackbgrt_not_in_build ("image=builtin");
+  return 0;
+}
+#endif
+
+#if HACKBGRT_WITH_PACK
+/**
+ * Pick the variant of a splash pack for a screen.
+ *
+ * In order: the variant drawn for this exact resolution, the largest one
+ * drawn for a smaller screen, the one for any screen, the smallest one.
+ *
+ * @param pack The pack index, with a valid count.
+ * @param screen_width The GOP resolution; 0 if unknown.
+ * @param screen_height
+ * @return The index of the entry.
+ */
+static grub_uint32_t
+select_pack_entry (const struct splash_pack_header* pack, grub_uint32_t screen_width, grub_uint32_t screen_height)
+{
+  int fits = -1, any = -1, smallest = 0;
+  for (grub_uint32_t i = 0; i < pack->count; i++)
+  {
+    const struct splash_pack_entry* e = &pack->entries[i];
+    grub_uint64_t area = (grub_uint64_t) e->screen_width * e->screen_height;
+    if (area == 0)
     {
-      grub_dprintf ("hackbgrt", "* XSDT: bad checksum\n");
+      if (any < 0)
+        any = i;
       continue;
     }
-    grub_efi_uint64_t* entry_arr = (grub_efi_uint64_t*) &xsdt[1];
-    grub_efi_uint32_t entry_arr_length = (xsdt->length - sizeof (*xsdt)) / sizeof (grub_efi_uint64_t);
-    grub_dprintf ("hackbgrt", "* XSDT: OEM ID = %c%c%c%c%c%c, entry count = %d\n", OEMID_TO_CHAR_LIST (xsdt->oemid), entry_arr_length);
-    unsigned bgrt_count = 0;
-    for (unsigned j = 0; j < entry_arr_length; j++)
-    {
-      struct grub_acpi_table_header* entry = (struct grub_acpi_table_header*) ((grub_efi_uintn_t) entry_arr[j]);
-      if (grub_memcmp(entry->signature, "BGRT", 4) != 0)
-        continue;
-      grub_dprintf ("hackbgrt", " - ACPI table: %c%c%c%c, revision = %d, OEM ID = %c%c%c%c%c%c\n", ACPI_TABLE_TO_CHAR_LIST (entry->signature), entry->revision, OEMID_TO_CHAR_LIST (entry->oemid));
-      switch (action)
-      {
-        case HACKBGRT_KEEP:
-          if (!bgrt)
-          {
-            grub_dprintf ("hackbgrt", " -> Returning first BGRT.\n");
-            bgrt = (grub_acpi_bgrt_t) entry;
-          }
-          break;
-        case HACKBGRT_REMOVE:
-          grub_dprintf ("hackbgrt", " -> Deleting BGRT (entry %d).\n", j);
-          for (unsigned k = j + 1; k < entry_arr_length; k++)
-            entry_arr[k - 1] = entry_arr[k];
-          entry_arr_length--;
-          entry_arr[entry_arr_length] = 0;
-          xsdt->length -= sizeof (entry_arr[0]);
-          j--;
-          break;
-        case HACKBGRT_REPLACE:
-          grub_dprintf ("hackbgrt", " -> Replacing BGRT (entry %d).\n", j);
-          entry_arr[j] = (grub_efi_uintn_t) bgrt;
-      }
-      bgrt_count += 1;
-    }
-    if (!bgrt_count && action == HACKBGRT_REPLACE && bgrt)
-    {
-      grub_dprintf ("hackbgrt", " - Adding missing BGRT.\n");
-      xsdt = create_xsdt(xsdt, entry_arr_length + 1);
-      entry_arr = (grub_efi_uint64_t*) &xsdt[1];
-      entry_arr[entry_arr_length++] = (grub_efi_uintn_t) bgrt;
-      rsdp->xsdt_addr = (grub_efi_uintn_t) xsdt;
-      set_acpi_rsdp2_checksums(rsdp);
-    }
-    set_acpi_sdt_checksum(xsdt);
+    if (e->screen_width == screen_width && e->screen_height == screen_height)
+      return i;
+    if (e->screen_width <= screen_width && e->screen_height <= screen_height
+        && (fits < 0 || area > (grub_uint64_t) pack->entries[fits].screen_width * pack->entries[fits].screen_height))
+      fits = i;
+    if (area < (grub_uint64_t) pack->entries[smallest].screen_width * pack->entries[smallest].screen_height
+        || pack->entries[smallest].screen_width == 0)
+      smallest = i;
+  }
+  return fits >= 0 ? fits : any >= 0 ? any : smallest;
+}
+
+static bitmap_t
+read_image (hackbgrt_io_t file, const char* path, grub_uint32_t screen_width, grub_uint32_t screen_height, int in_pack);
+
+/**
+ * Read the variant of a splash pack that suits the screen, and only that one.
+ *
+ * @param file The opened file.
+ * @param path The path, for messages.
+ * @param pack The pack index, already read from the file.
+ * @param screen_width The GOP resolution; 0 if unknown.
+ * @param screen_height
+ * @return The bitmap, or 0 with grub_errno set.
+ */
+static bitmap_t
+read_pack (hackbgrt_io_t file, const char* path, const struct splash_pack_header* pack,
+           grub_uint32_t screen_width, grub_uint32_t screen_height)
+{
+  const struct splash_pack_entry* entry;
+
+  if (pack->count == 0 || pack->count > SPLASH_PACK_MAX_ENTRIES)
+  {
+    grub_error(GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load BMP, not supported format (%s)!\n", path);
+    return 0;
+  }
+  entry = &pack->entries[select_pack_entry (pack, screen_width, screen_height)];
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "pack %s: variant for %dx%d at %d (%d bytes) for a %dx%d screen\n", path,
+                  entry->screen_width, entry->screen_height, entry->offset, entry->length, screen_width, screen_height);
+  if ((entry->format != SPLASH_FORMAT_BMP && entry->format != SPLASH_FORMAT_BMZ)
+      || hackbgrt_io_window (file, entry->offset, entry->length))
+  {
+    grub_error(GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load BMP, not supported format (%s)!\n", path);
+    return 0;
+  }
+  read_from_pack = 1;
+  return read_image (file, path, 0, 0, 1);
+}
+#else
+static bitmap_t
+read_pack (hackbgrt_io_t file __attribute__ ((unused)), const char* path __attribute__ ((unused)),
+           const struct splash_pack_header* pack __attribute__ ((unused)),
+           grub_uint32_t screen_width __attribute__ ((unused)), grub_uint32_t screen_height __attribute__ ((unused)))
+{
+  hackbgrt_not_in_build ("packs");
+  return 0;
+}
+#endif
+
+/**
+ * Read an image in any supported format, told apart by its first bytes.
+ *
+ * @param file The opened file.
+ * @param path The path, for messages.
+ * @param screen_width The GOP resolution, to pick the variant of a pack; 0 if unknown.
+ * @param screen_height
+ * @param in_pack 1 for a variant of a pack, which can only be a BMP or a .bmz.
+ * @return The bitmap, or 0 with grub_errno set.
+ */
+static bitmap_t
+read_image (hackbgrt_io_t file, const char* path, grub_uint32_t screen_width, grub_uint32_t screen_height, int in_pack)
+{
+  union
+  {
+    struct bitmap_header bmp;
+    struct splash_header splash;
+    struct splash_pack_header pack;
+  } head;
+  grub_size_t head_size = grub_min (hackbgrt_io_size (file), sizeof (head));
+
+  if (hackbgrt_io_read (file, 0, &head, head_size))
+    grub_error(GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load BMP (%s)!\n", path);
+  else if (head_size >= sizeof (head.splash)
+           && grub_memcmp(head.splash.signature, SPLASH_MAGIC, SPLASH_MAGIC_SIZE) == 0)
+    return read_bmz (file, path, &head.splash);
+  else if (!in_pack && head_size >= sizeof (head.pack)
+           && grub_memcmp(head.pack.signature, SPLASH_PACK_MAGIC, SPLASH_PACK_MAGIC_SIZE) == 0)
+    return read_pack (file, path, &head.pack, screen_width, screen_height);
+  else if (!in_pack && head_size >= PNG_MAGIC_SIZE && grub_memcmp(&head, PNG_MAGIC, PNG_MAGIC_SIZE) == 0)
+    return read_png (path);
+  else if (head_size < sizeof (head.bmp))
+    grub_error(GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load BMP, not supported format (%s)!\n", path);
+  else
+    return read_bmp (file, path, &head.bmp);
+  return 0;
+}
+
+#if HACKBGRT_WITH_SCALE
+/**
+ * Resample a loaded bitmap for the screen.
+ *
+ * @param bmp The loaded bitmap.
+ * @param scale How to size it.
+ * @param screen_width The GOP resolution; 0 if unknown.
+ * @param screen_height
+ * @return The scaled bitmap, bmp itself if the size does not change, or 0 with grub_errno set.
+ */
+static bitmap_t
+scale_bmp (bitmap_t bmp, enum hackbgrt_scale scale, grub_uint32_t screen_width, grub_uint32_t screen_height)
+{
+  grub_uint32_t width = bmp->header.width, height = bmp->header.height;
+  bitmap_t scaled;
+
+  hackbgrt_scale_size (scale, &width, &height, screen_width, screen_height);
+  if (width == bmp->header.width && height == bmp->header.height)
+    return bmp;
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "scale %s: %dx%d -> %dx%d\n", hackbgrt_scale_name (scale),
+                  bmp->header.width, bmp->header.height, width, height);
+  scaled = hackbgrt_alloc_bitmap (get_bitmap_total_size (width, height));
+  if (!scaled)
+    return 0;
+  if (hackbgrt_scale_bitmap (bmp, scaled, width, height, scale == HACKBGRT_SCALE_FILL))
+  {
+    hackbgrt_alloc_free (scaled);
+    return 0;
+  }
+  return scaled;
+}
+
+/**
+ * Cut the uniform borders off a bitmap.
+ *
+ * @param bmp The bitmap.
+ * @param origin Set to where the cut sits in bmp.
+ * @return The cut, or bmp itself if there is no border or on failure, with grub_errno set.
+ */
+static bitmap_t
+trim_bmp (bitmap_t bmp, struct hackbgrt_cache_origin* origin)
+{
+  struct hackbgrt_bmp_rect rect;
+  bitmap_t cut;
+
+  origin->x = 0;
+  origin->y = 0;
+  origin->image_width = bmp->header.width;
+  origin->image_height = bmp->header.height;
+  hackbgrt_bmp_bounds (bmp, &rect);
+  if (rect.width == bmp->header.width && rect.height == bmp->header.height)
+    return bmp;
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "trim: %dx%d -> %ux%u at %u,%u\n", bmp->header.width, bmp->header.height,
+                  rect.width, rect.height, rect.x, rect.y);
+  cut = hackbgrt_alloc_bitmap (get_bitmap_total_size (rect.width, rect.height));
+  if (!cut)
+    return bmp;
+  hackbgrt_bmp_crop (bmp, cut, &rect);
+  origin->x = rect.x;
+  origin->y = rect.y;
+  return cut;
+}
+
+/**
+ * Scale and trim a loaded bitmap as configured, caching the result.
+ *
+ * A step that fails is skipped: the image is then shown unscaled or untrimmed.
+ *
+ * @param bmp The loaded bitmap.
+ * @param key The cache key of the result.
+ * @param file_size The size of the file bmp was loaded from.
+ * @param scale How to size it.
+ * @param trim 1 to cut its uniform borders.
+ * @param screen_width The GOP resolution; 0 if unknown.
+ * @param screen_height
+ * @return The bitmap to show, bmp itself if nothing changes.
+ */
+static bitmap_t
+fit_bmp (bitmap_t bmp, const char* key, grub_uint64_t file_size, enum hackbgrt_scale scale, int trim,
+         grub_uint32_t screen_width, grub_uint32_t screen_height)
+{
+  struct hackbgrt_cache_origin origin;
+  grub_uint32_t capacity;
+  bitmap_t offered = hackbgrt_alloc_offered (&capacity);
+  bitmap_t scaled, shown;
+
+  // the firmware's logo buffer is for the image shown, not for the source of the trim
+  if (trim)
+    hackbgrt_alloc_offer (0, 0);
+  scaled = scale_bmp (bmp, scale, screen_width, screen_height);
+  if (trim)
+    hackbgrt_alloc_offer (offered, capacity);
+  if (!scaled)
+    scaled = bmp;
+  shown = trim ? trim_bmp (scaled, &origin) : scaled;
+  if (shown == bmp)
+    return bmp;
+  if (shown == scaled)
+    hackbgrt_cache_insert (key, file_size, shown);
+  else
+  {
+    if (scaled != bmp)
+      hackbgrt_alloc_free (scaled);
+    hackbgrt_cache_insert_cut (key, file_size, shown, &origin);
   }
-  return bgrt;
+  return shown;
+}
+#else
+// scale= and trim= are refused with the config: there is never anything to do
+static bitmap_t
+fit_bmp (bitmap_t bmp, const char* key __attribute__ ((unused)), grub_uint64_t file_size __attribute__ ((unused)),
+         enum hackbgrt_scale scale __attribute__ ((unused)), int trim __attribute__ ((unused)),
+         grub_uint32_t screen_width __attribute__ ((unused)), grub_uint32_t screen_height __attribute__ ((unused)))
+{
+  return bmp;
 }
+#endif
 
 /**
  * Load a bitmap or generate a black one.
  *
- * @param path The bitmap path; NULL for a black bitmap.
+ * @param path The bitmap path (BMP, .bmz, pack or PNG), HACKBGRT_BUILTIN_PATH for the image of the module;
+ *        NULL for a black bitmap.
+ * @param io_backend How to read the file.
+ * @param screen_width The GOP resolution, to pick the variant of a pack and to scale; 0 if unknown.
+ * @param screen_height
+ * @param scale How to size the image for the screen.
+ * @param trim 1 to cut the uniform borders of the image; see hackbgrt_cache_get_origin.
  * @return The loaded bitmap, or 0 if not available.
  */
-static bitmap_t load_bmp(const char* path)
+static bitmap_t load_bmp(const char* path, enum hackbgrt_io_backend io_backend,
+                         grub_uint32_t screen_width, grub_uint32_t screen_height,
+                         enum hackbgrt_scale scale, int trim)
 {
   bitmap_t bmp = 0;
-  grub_efi_status_t status;
-  grub_file_t file;
+  hackbgrt_io_t file;
+  char* key = 0;
+  char* pack_key = 0;
+  enum hackbgrt_stats_phase phase = HACKBGRT_PHASE_LOAD;
+  grub_uint64_t start = hackbgrt_stats_now ();
 
   if (!path)
   {
-    grub_uint32_t bitmap_size = get_bitmap_total_size (1, 1);
-    status = efi_call_3 (grub_efi_system_table->boot_services->allocate_pool, GRUB_EFI_BOOT_SERVICES_DATA, bitmap_size, (void**) &bmp);
-    if (status)
-    {
+    bmp = hackbgrt_alloc_bitmap (get_bitmap_total_size (1, 1));
+    if (!bmp)
       grub_error(GRUB_ERR_READ_ERROR, "HackBGRT: Failed to allocate a blank BMP!\n");
-      grub_efi_system_table->boot_services->stall(1000000); // 1 sec pause
-    }
     else
     {
-      grub_memcpy(&bmp->header.signature, BMP_MAGIC, BMP_MAGIC_SIZE);
-      bmp->header.size = bitmap_size;
-      bmp->header.unused = 0;
-      bmp->header.pixel_data_offset = BMP_PIXEL_DATA_OFFSET;
-      bmp->header.dib_header_size = BMP_DIB_HEADER_SIZE;
-      bmp->header.width = 1;
-      bmp->header.height = 1;
-      bmp->header.planes = 1;
-      bmp->header.bpp = BMP_888_BPP;
-      bmp->header.compression = BMP_NO_COMPRESSION;
-      bmp->header.data_size = get_bitmap_pixels_size (1, 1);
-      bmp->header.ppm_horiz = BMP_72_DPI;
-      bmp->header.ppm_vert = BMP_72_DPI;
-      bmp->header.palette_colors = BMP_NO_PALETTE;
-      bmp->header.important_colors = BMP_NO_PALETTE;
+      hackbgrt_bmp_init_header (&bmp->header, 1, 1);
       grub_memcpy(bmp->pixels,
           "\x00\x00\x00" // 1 black pixel (RGB 888)
           "\x00", // DWORD row padding
@@ -285,83 +778,63 @@ static bitmap_t load_bmp(const char* path)
   }
   else
   {
-    grub_dprintf ("hackbgrt", "HackBGRT: Loading %s.\n", path);
-    file = grub_file_open(path, GRUB_FILE_TYPE_PIXMAP);
-    if (!file)
-    {
+    int builtin = grub_strcmp (path, HACKBGRT_BUILTIN_PATH) == 0;
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "HackBGRT: Loading %s.\n", path);
+    // the builtin image needs no ESP, and goes through the same cache
+    file = builtin ? 0 : hackbgrt_io_open (path, io_backend);
+    if (!file && !builtin)
       grub_error(GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load BMP (%s)!\n", path);
-      grub_efi_system_table->boot_services->stall(1000000); // 1 sec pause
-    }
     else
     {
-      struct bitmap_header header;
-      grub_dprintf ("hackbgrt", "file %s opened\n", path);
-      if (grub_file_read (file, &header, sizeof (header)) != sizeof (header))
+      grub_uint64_t file_size = builtin ? hackbgrt_builtin_image_size : hackbgrt_io_size (file);
+      bitmap_t fitted = 0;
+      grub_uint32_t capacity;
+      bitmap_t offered = hackbgrt_alloc_offered (&capacity);
+      // the scaled or trimmed copy is keyed by the screen too, the scaled size depends on it
+      if (scale != HACKBGRT_SCALE_NONE || trim)
       {
-        grub_file_close(file);
-        grub_error(GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load BMP (%s)!\n", path);
-        grub_efi_system_table->boot_services->stall(1000000); // 1 sec pause
+        key = grub_xasprintf ("%s#%s@%ux%u%s", path, hackbgrt_scale_name (scale), screen_width, screen_height,
+                              trim ? "#trim" : "");
+        if (key)
+          fitted = hackbgrt_cache_lookup (key, file_size);
       }
+      if (fitted)
+        hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "file %s already loaded and fitted\n", path);
+      // the variant of a pack is keyed by the screen it was picked for
+      else if ((bmp = hackbgrt_cache_lookup_screen (path, screen_width, screen_height, file_size)))
+        hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "file %s already loaded\n", path);
       else
       {
-        grub_dprintf ("hackbgrt", "header of %s read\n", path);
-        grub_dprintf ("hackbgrt", "signature %s, pixel_data_offset=%d, dib_header_size=%d, planes=%d, bpp=%d, compression=%d, palette_colors=%d, important_colors=%d\n",
-                grub_memcmp(&header.signature, BMP_MAGIC, BMP_MAGIC_SIZE) == 0 ? "ok" : "ko",
-                header.pixel_data_offset,
-                header.dib_header_size,
-                header.planes,
-                header.bpp,
-                header.compression,
-                header.palette_colors,
-                header.important_colors
-                );
-        if (grub_memcmp(&header.signature, BMP_MAGIC, BMP_MAGIC_SIZE) != 0
-            || header.pixel_data_offset != BMP_PIXEL_DATA_OFFSET
-            || header.dib_header_size != BMP_DIB_HEADER_SIZE
-            || header.planes != 1
-            || header.bpp != BMP_888_BPP
-            || header.compression != BMP_NO_COMPRESSION
-            || header.palette_colors != BMP_NO_PALETTE
-            || header.important_colors != BMP_NO_PALETTE)
-        {
-          grub_file_close(file);
-          grub_error(GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load BMP, not supported format (%s)!\n", path);
-          grub_efi_system_table->boot_services->stall(1000000); // 1 sec pause
-        }
-        else
-        {
-          grub_dprintf ("hackbgrt", "header of %s OK (bitmap size = %d)\n", path, header.size);
-          status = efi_call_3 (grub_efi_system_table->boot_services->allocate_pool, GRUB_EFI_BOOT_SERVICES_DATA, header.size, (void**) &bmp);
-          if (status)
-          {
-            grub_file_close(file);
-            grub_error(GRUB_ERR_READ_ERROR, "HackBGRT: Failed to allocate memory for BMP!\n");
-            grub_efi_system_table->boot_services->stall(1000000); // 1 sec pause
-          }
-          else
-          {
-            grub_dprintf ("hackbgrt", "EFI memory allocated for bitmap\n");
-            grub_memcpy(&bmp->header, &header, sizeof (header));
-            grub_dprintf ("hackbgrt", "EFI bitmap header copied\n");
-            grub_uint32_t pixels_size = header.data_size;
-            if (grub_file_read (file, &bmp->pixels, pixels_size) != pixels_size)
-            {
-              grub_file_close(file);
-              grub_error(GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load BMP (%s)!\n", path);
-              grub_efi_system_table->boot_services->stall(1000000); // 1 sec pause
-            }
-            else
-            {
-              grub_dprintf ("hackbgrt", "EFI bitmap pixels (%d) copied\n", pixels_size);
-              grub_file_close(file);
-            }
-          }
-        }
+        hackbgrt_trace (HACKBGRT_TRACE_STEPS, "file %s opened\n", path);
+        read_from_pack = 0;
+        // the firmware's logo buffer is for the image shown, not for the source of a scaling or a trim
+        if (key)
+          hackbgrt_alloc_offer (0, 0);
+        bmp = builtin ? read_builtin () : read_image (file, path, screen_width, screen_height, 0);
+        if (key)
+          hackbgrt_alloc_offer (offered, capacity);
+        if (bmp && !read_from_pack)
+          hackbgrt_cache_insert (path, file_size, bmp);
+        else if (bmp && (pack_key = grub_xasprintf ("%s@%ux%u", path, screen_width, screen_height)))
+          hackbgrt_cache_insert (pack_key, file_size, bmp);
       }
+      if (file)
+        hackbgrt_io_close (file);
+      hackbgrt_stats_add (phase, start);
+      phase = HACKBGRT_PHASE_FIT;
+      start = hackbgrt_stats_now ();
+      if (!fitted && bmp && key && !over_budget ("scaling the image"))
+        fitted = fit_bmp (bmp, key, file_size, scale, trim, screen_width, screen_height);
+      if (fitted)
+        bmp = fitted;
+      grub_free (pack_key);
+      grub_free (key);
     }
   }
+  hackbgrt_stats_add (phase, start);
+  hackbgrt_telemetry_error (grub_errno);
   grub_print_error ();
-  grub_dprintf ("hackbgrt", "EFI bitmap = %p\n", bmp);
+  hackbgrt_trace (HACKBGRT_TRACE_STEPS, "EFI bitmap = %p\n", bmp);
   return bmp;
 }
 
@@ -381,39 +854,341 @@ static int select_coordinate(int value, int automatic, int native) {
   return value;
 }
 
+#if HACKBGRT_WITH_OVERLAY
+/**
+ * Read the image of mode=overlay with its alpha channel.
+ *
+ * @param file The opened file, a 32 bpp BMP or a PNG.
+ * @param path The path, for messages and for the PNG loader.
+ * @param badge Filled on success.
+ * @return GRUB_ERR_NONE, or the error also set in grub_errno.
+ */
+static grub_err_t
+read_badge (hackbgrt_io_t file, const char* path, struct hackbgrt_bgra* badge)
+{
+  grub_uint64_t size = hackbgrt_io_size (file);
+  grub_uint8_t* data;
+  struct hackbgrt_bmp_info info;
+  grub_err_t err;
+
+  if (size > HACKBGRT_BMP_MAX_FILE_SIZE)
+    return grub_error (GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load the overlay, not supported format (%s)!\n", path);
+  data = grub_malloc (size);
+  if (!data)
+    return grub_errno;
+  // a PNG is read again by GRUB: only its signature goes through the backend
+  err = read_in_budget (file, 0, data, grub_min (size, (grub_uint64_t) PNG_MAGIC_SIZE));
+  if (!err && size >= PNG_MAGIC_SIZE && grub_memcmp (data, PNG_MAGIC, PNG_MAGIC_SIZE) == 0)
+  {
+    struct grub_video_bitmap* image;
+    grub_free (data);
+    if (over_budget ("decoding the overlay"))
+      return GRUB_ERR_TIMEOUT;
+    if (grub_video_bitmap_load (&image, path))
+      return grub_error (GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load PNG (%s), is the png module loaded?\n", path);
+    if (image->mode_info.blit_format != GRUB_VIDEO_BLIT_FORMAT_RGBA_8888
+        && image->mode_info.blit_format != GRUB_VIDEO_BLIT_FORMAT_RGB_888)
+      err = grub_error (GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load PNG, not supported format (%s)!\n", path);
+    else
+      err = hackbgrt_bgra_from_rgb (badge, grub_video_bitmap_get_data (image), image->mode_info.width,
+                                    image->mode_info.height, image->mode_info.pitch,
+                                    image->mode_info.blit_format == GRUB_VIDEO_BLIT_FORMAT_RGBA_8888);
+    grub_video_bitmap_destroy (image);
+    return err;
+  }
+  if (!err && size > PNG_MAGIC_SIZE)
+    err = read_in_budget (file, PNG_MAGIC_SIZE, data + PNG_MAGIC_SIZE, size - PNG_MAGIC_SIZE);
+  if (err)
+  {
+    grub_free (data);
+    if (err != GRUB_ERR_TIMEOUT)
+      grub_error (GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load the overlay (%s)!\n", path);
+    return err;
+  }
+  if (hackbgrt_bmp_parse (data, size, &info) || (err = hackbgrt_bgra_from_bmp (&info, data, badge)) == GRUB_ERR_BAD_FILE_TYPE)
+    err = grub_error (GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load the overlay, not a 32 bpp BMP or a PNG (%s)!\n", path);
+  grub_free (data);
+  return err;
+}
+
+/**
+ * Composite an image onto a copy of the firmware's logo (mode=overlay).
+ *
+ * The canvas grows to the right and down when the image goes past the
+ * logo; the added pixels are black.
+ *
+ * @param path The image, a 32 bpp BMP or a PNG.
+ * @param io_backend How to read the file.
+ * @param logo The firmware's logo, or 0: the image is then shown alone, over black.
+ * @param x The position of the image from the top left of the logo; see enum hackbgrt_coordinate.
+ * @param y
+ * @return The composite, or 0 if not available.
+ */
+static bitmap_t
+load_overlay (const char* path, enum hackbgrt_io_backend io_backend, bitmap_t logo, int x, int y)
+{
+  struct hackbgrt_bgra badge = { 0, 0, 0 };
+  bitmap_t base = logo, canvas = 0;
+  hackbgrt_io_t file;
+  enum hackbgrt_stats_phase phase = HACKBGRT_PHASE_LOAD;
+  grub_uint64_t start = hackbgrt_stats_now ();
+
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "HackBGRT: Loading %s to overlay on %p.\n", path, logo);
+  file = hackbgrt_io_open (path, io_backend);
+  if (!file)
+    grub_error (GRUB_ERR_READ_ERROR, "HackBGRT: Failed to load the overlay (%s)!\n", path);
+  else
+  {
+    grub_uint64_t file_size = hackbgrt_io_size (file);
+    // the composite depends on the logo and the position too
+    char* key = grub_xasprintf ("%s#overlay@%d,%d#%p", path, x, y, logo);
+    if (key && (canvas = hackbgrt_cache_lookup (key, file_size)))
+      hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "overlay %s already composited\n", path);
+    else if (read_badge (file, path, &badge) == GRUB_ERR_NONE)
+    {
+      grub_uint32_t width, height, badge_x = 0, badge_y = 0;
+      hackbgrt_stats_add (phase, start);
+      phase = HACKBGRT_PHASE_FIT;
+      start = hackbgrt_stats_now ();
+      // a logo the BGRT could not take as is is converted first
+      if (logo && !check_bmp_header (&logo->header))
+      {
+        base = convert_bmp ((const grub_uint8_t*) logo, logo->header.size, "the firmware's logo");
+        if (!base)
+        {
+          hackbgrt_telemetry_error (grub_errno);
+          grub_print_error ();
+        }
+      }
+      if (base)
+      {
+        badge_x = select_coordinate (x, grub_max (0, ((int) base->header.width - (int) badge.width) / 2), 0);
+        badge_y = select_coordinate (y, grub_max (0, ((int) base->header.height - (int) badge.height) / 2), 0);
+      }
+      width = grub_max (base ? base->header.width : 0, badge_x + badge.width);
+      height = grub_max (base ? base->header.height : 0, badge_y + badge.height);
+      if (width > HACKBGRT_BMP_MAX_DIMENSION || height > HACKBGRT_BMP_MAX_DIMENSION)
+        grub_error (GRUB_ERR_OUT_OF_RANGE, "HackBGRT: Overlay out of the maximum canvas (%s)!\n", path);
+      else if (over_budget ("compositing the overlay"))
+        ;
+      // a converted logo of the right size is already a copy
+      else if (base && base != logo && width == base->header.width && height == base->header.height)
+        canvas = base;
+      else if ((canvas = hackbgrt_alloc_bitmap (get_bitmap_total_size (width, height))))
+      {
+        if (base)
+          hackbgrt_bmp_extend (base, canvas, width, height);
+        else
+        {
+          hackbgrt_bmp_init_header (&canvas->header, width, height);
+          grub_memset (&canvas->pixels, 0, canvas->header.data_size);
+        }
+      }
+      if (canvas)
+      {
+        hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "overlay %ux%u at %u,%u on %ux%u\n", badge.width, badge.height,
+                        badge_x, badge_y, width, height);
+        hackbgrt_bmp_overlay (canvas, &badge, badge_x, badge_y);
+        if (key)
+          hackbgrt_cache_insert (key, file_size, canvas);
+      }
+      if (base && base != logo && base != canvas)
+        hackbgrt_alloc_free (base);
+      grub_free (badge.pixels);
+    }
+    grub_free (key);
+    hackbgrt_io_close (file);
+  }
+  hackbgrt_stats_add (phase, start);
+  hackbgrt_telemetry_error (grub_errno);
+  grub_print_error ();
+  return canvas;
+}
+#else
+static bitmap_t
+load_overlay (const char* path __attribute__ ((unused)), enum hackbgrt_io_backend io_backend __attribute__ ((unused)),
+              bitmap_t logo __attribute__ ((unused)), int x __attribute__ ((unused)), int y __attribute__ ((unused)))
+{
+  hackbgrt_not_in_build ("mode=overlay");
+  hackbgrt_telemetry_error (grub_errno);
+  grub_print_error ();
+  return 0;
+}
+#endif
+
+/**
+ * Write the queued edits and let the cache release the bitmaps the BGRT no
+ * longer shows.
+ *
+ * @param bmp The bitmap now published, or 0.
+ */
+static void
+commit_bgrt (hackbgrt_acpi_t acpi, bitmap_t bmp)
+{
+  grub_uint64_t start = hackbgrt_stats_now ();
+  hackbgrt_acpi_commit (acpi);
+  hackbgrt_cache_publish (bmp);
+  hackbgrt_stats_add (HACKBGRT_PHASE_ACPI_COMMIT, start);
+}
+
+// the firmware's logo and its place, kept for overlays on later runs, which see our own BGRT
+static bitmap_t firmware_logo;
+static int firmware_x, firmware_y;
+// a copy of the logo, taken before a run that is not the last one writes over it
+static bitmap_t firmware_copy;
+
+/**
+ * Copy the firmware's logo, so that later runs still see it once its buffer is reused.
+ *
+ * @return 1 if the copy was made, 0 otherwise.
+ */
+static int
+copy_firmware_logo (void)
+{
+  grub_free (firmware_copy);
+  firmware_copy = grub_malloc (firmware_logo->header.size);
+  if (!firmware_copy)
+  {
+    grub_errno = GRUB_ERR_NONE;
+    return 0;
+  }
+  grub_memcpy (firmware_copy, firmware_logo, firmware_logo->header.size);
+  return 1;
+}
+
 /**
  * The main logic for BGRT modification.
  *
  * @param config The hack BGRT config.
+ * @param acpi The ACPI tables, scanned.
  */
 static void
-hack_bgrt(hackbgrt_config_t config)
+patch_bgrt (hackbgrt_config_t config, hackbgrt_acpi_t acpi)
 {
   // REMOVE: simply delete all BGRT entries.
   if (config->action == HACKBGRT_REMOVE)
   {
-    grub_dprintf ("hackbgrt", "Remove old BGRT.\n");
-    handle_acpi_tables(HACKBGRT_REMOVE, 0);
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "Remove old BGRT.\n");
+    hackbgrt_acpi_queue (acpi, HACKBGRT_ACPI_REMOVE, 0);
+    commit_bgrt (acpi, 0);
     return;
   }
-  grub_dprintf ("hackbgrt", "Get old BGRT.\n");
-  grub_acpi_bgrt_t bgrt = handle_acpi_tables(HACKBGRT_KEEP, 0);
+  hackbgrt_trace (HACKBGRT_TRACE_STEPS, "Get old BGRT.\n");
+  grub_acpi_bgrt_t bgrt = acpi->bgrt;
   bitmap_t old_bmp = 0;
   int old_x = 0, old_y = 0;
-  if (bgrt && verify_acpi_sdt_checksum(bgrt) == 0)
+  if (bgrt && verify_acpi_sdt_checksum(bgrt))
   {
-    grub_dprintf ("hackbgrt", "Get old Bitmap and position.\n");
+    hackbgrt_trace (HACKBGRT_TRACE_STEPS, "Get old Bitmap and position.\n");
     old_bmp = (bitmap_t) bgrt->image_address;
     old_x = bgrt->image_offset_x;
     old_y = bgrt->image_offset_y;
   }
+  // the new bitmap may overwrite the old one: keep what the position needs
+  int old_width = old_bmp ? (int) old_bmp->header.width : 0;
+  int old_height = old_bmp ? (int) old_bmp->header.height : 0;
+  // Keep missing = do nothing.
+  if (!bgrt && config->action == HACKBGRT_KEEP)
+    return;
+  hackbgrt_trace (HACKBGRT_TRACE_STEPS, "Get the bitmap.\n");
+  bitmap_t new_bmp = old_bmp;
+  // screen= comes from hackbgrt-prepare: no need to probe the GOP modes
+  grub_uint32_t screen_width = config->screen_width, screen_height = config->screen_height;
+  if (!screen_width)
+  {
+    grub_uint64_t start = hackbgrt_stats_now ();
+    hackbgrt_display_get (&screen_width, &screen_height);
+    hackbgrt_stats_add (HACKBGRT_PHASE_GOP, start);
+  }
+  else
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "Screen %ux%u given, GOP not probed.\n", screen_width, screen_height);
+  hackbgrt_telemetry_screen (screen_width, screen_height);
+  int logo_offered = 0, logo_taken = 0;
+  // a BGRT that is not ours is the firmware's, logo or not
+  if (!old_bmp || !hackbgrt_cache_contains (old_bmp))
+  {
+    int is_bmp = old_bmp && grub_memcmp(&old_bmp->header.signature, BMP_MAGIC, BMP_MAGIC_SIZE) == 0
+                 && old_bmp->header.size >= BMP_PIXEL_DATA_OFFSET;
+    grub_free (firmware_copy);
+    firmware_copy = 0;
+    firmware_logo = is_bmp ? old_bmp : 0;
+    firmware_x = old_x;
+    firmware_y = old_y;
+  }
+  if (config->action == HACKBGRT_REPLACE)
+  {
+    hackbgrt_trace (HACKBGRT_TRACE_STEPS, "Load BMP %s.\n", config->image_path);
+    hackbgrt_parallel_init (config->parallel);
+    // the firmware's logo is only referenced by the BGRT being replaced, unless it is one of ours,
+    // or an overlay is drawn on it; a run before the one at boot keeps a copy for the next overlay.
+    // With budget=MS:keep, the logo must survive a run given up halfway through the read.
+    if (firmware_logo && firmware_logo == old_bmp && !config->image_overlay
+        && !(deadline && config->budget_fallback == HACKBGRT_KEEP)
+        && (config->deferred || copy_firmware_logo ()))
+    {
+      hackbgrt_alloc_offer (old_bmp, old_bmp->header.size);
+      logo_offered = 1;
+    }
+    char* gallery_image = 0;
+    if (config->image_gallery)
+    {
+      grub_uint64_t start = hackbgrt_stats_now ();
+      gallery_image = hackbgrt_gallery_pick (config->image_path, config->gallery_draw,
+                                             screen_width, screen_height);
+      hackbgrt_stats_add (HACKBGRT_PHASE_GALLERY, start);
+    }
+    // an empty or unreadable gallery keeps the firmware's logo
+    if (over_budget ("loading the image"))
+      new_bmp = 0;
+    else if (config->image_overlay && (!config->image_gallery || gallery_image))
+      new_bmp = load_overlay (gallery_image ? gallery_image : config->image_path, config->io_backend,
+                              firmware_logo, config->image_x, config->image_y);
+    else if (!config->image_gallery || gallery_image)
+      new_bmp = load_bmp(gallery_image ? gallery_image : config->image_path, config->io_backend,
+                         screen_width, screen_height,
+                         config->image_scale, config->image_trim);
+    else
+    {
+      hackbgrt_telemetry_error (grub_errno);
+      grub_print_error ();
+    }
+    grub_free (gallery_image);
+    grub_uint32_t capacity;
+    // taken by a bitmap, possibly one given up on: the logo is not the firmware's any more
+    logo_taken = logo_offered && !hackbgrt_alloc_offered (&capacity);
+    hackbgrt_alloc_offer (0, 0);
+    if (logo_taken)
+      firmware_logo = firmware_copy;
+    else if (firmware_logo != firmware_copy)
+    {
+      grub_free (firmware_copy);
+      firmware_copy = 0;
+    }
+  }
+  // nothing is written before this point, so giving up leaves the tables as they were
+  if (budget_spent)
+  {
+    hackbgrt_telemetry_error (grub_errno);
+    grub_print_error ();
+    if (config->budget_fallback == HACKBGRT_KEEP)
+    {
+      hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "Out of budget, BGRT kept.\n");
+      return;
+    }
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "Out of budget, BGRT removed.\n");
+    new_bmp = 0;
+  }
+  if (!new_bmp)
+  {
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "No bitmap, no need for BGRT.\n");
+    hackbgrt_acpi_queue (acpi, HACKBGRT_ACPI_REMOVE, 0);
+    commit_bgrt (acpi, 0);
+    return;
+  }
   // Missing BGRT?
   if (!bgrt)
   {
-    // Keep missing = do nothing.
-    if (config->action == HACKBGRT_KEEP)
-      return;
-    grub_dprintf ("hackbgrt", "Allocate new BGRT because there was no old one.\n");
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "Allocate new BGRT because there was no old one.\n");
     grub_efi_status_t status = efi_call_3 (grub_efi_system_table->boot_services->allocate_pool, GRUB_EFI_ACPI_RECLAIM_MEMORY, sizeof (*bgrt), (void**) &bgrt);
     if (status)
     {
@@ -421,7 +1196,7 @@ hack_bgrt(hackbgrt_config_t config)
       return;
     }
   }
-  grub_dprintf ("hackbgrt", "Clear BGRT, fill new values.\n");
+  hackbgrt_trace (HACKBGRT_TRACE_STEPS, "Clear BGRT, fill new values.\n");
   grub_memcpy(bgrt->header.signature, BGRT_MAGIC, BGRT_MAGIC_SIZE);
   bgrt->header.length = BGRT_HEADER_SIZE;
   bgrt->header.revision = 0;
@@ -433,53 +1208,233 @@ hack_bgrt(hackbgrt_config_t config)
   bgrt->version = BGRT_VERSION;
   bgrt->status = BGRT_STATUS_VALID;
   bgrt->image_type = BGRT_IMAGE_TYPE_BMP;
-  set_acpi_sdt_checksum(bgrt);
-  grub_dprintf ("hackbgrt", "Get the bitmap.\n");
-  bitmap_t new_bmp = old_bmp;
-  if (config->action == HACKBGRT_REPLACE)
-  {
-    grub_dprintf ("hackbgrt", "Load BMP %s.\n", config->image_path);
-    new_bmp = load_bmp(config->image_path);
-  }
-  if (!new_bmp)
-  {
-    grub_dprintf ("hackbgrt", "No bitmap, no need for BGRT.\n");
-    handle_acpi_tables(HACKBGRT_REMOVE, 0);
-    return;
-  }
-  grub_dprintf ("hackbgrt", "Address new bitmap into BGRT structure.\n");
+  hackbgrt_trace (HACKBGRT_TRACE_STEPS, "Address new bitmap into BGRT structure.\n");
   bgrt->image_address = (grub_uint64_t) new_bmp;
+  // A trimmed bitmap is placed as the whole image would be, then shifted to where it was cut.
+  struct hackbgrt_cache_origin origin;
+  hackbgrt_cache_get_origin (new_bmp, &origin);
+  int image_width = (int) origin.image_width, image_height = (int) origin.image_height;
   // Calculate the automatically centered position for the image.
   int auto_x = 0, auto_y = 0;
-  struct grub_efi_gop* gop = get_gop();
-  if (gop)
+  if (screen_width)
   {
-    grub_dprintf ("hackbgrt", "Compute new bitmap position using GOP info.\n");
-    auto_x = grub_max(0, ((int) gop->mode->info->width - (int) new_bmp->header.width) / 2);
-    auto_y = grub_max(0, ((int) gop->mode->info->height * 2/3 - (int) new_bmp->header.height) / 2);
+    hackbgrt_trace (HACKBGRT_TRACE_STEPS, "Compute new bitmap position using GOP info.\n");
+    auto_x = grub_max(0, ((int) screen_width - image_width) / 2);
+    auto_y = grub_max(0, ((int) screen_height * 2/3 - image_height) / 2);
   }
   else if (old_bmp)
   {
-    grub_dprintf ("hackbgrt", "Compute new bitmap position using old bitmap info.\n");
-    auto_x = grub_max(0, old_x + ((int) old_bmp->header.width - (int) new_bmp->header.width) / 2);
-    auto_y = grub_max(0, old_y + ((int) old_bmp->header.height - (int) new_bmp->header.height) / 2);
+    hackbgrt_trace (HACKBGRT_TRACE_STEPS, "Compute new bitmap position using old bitmap info.\n");
+    auto_x = grub_max(0, old_x + (old_width - image_width) / 2);
+    auto_y = grub_max(0, old_y + (old_height - image_height) / 2);
+  }
+  if (config->image_overlay && firmware_logo)
+  {
+    // the composite grows right and down from the firmware's logo, which stays in place
+    hackbgrt_trace (HACKBGRT_TRACE_STEPS, "Set the overlay position (firmware's logo) into BGRT structure.\n");
+    bgrt->image_offset_x = firmware_x;
+    bgrt->image_offset_y = firmware_y;
+  }
+  else
+  {
+    hackbgrt_trace (HACKBGRT_TRACE_STEPS, "Set the bitmap position (manual, automatic, original) into BGRT structure.\n");
+    bgrt->image_offset_x = select_coordinate(config->image_x, auto_x, old_x) + origin.x;
+    bgrt->image_offset_y = select_coordinate(config->image_y, auto_y, old_y) + origin.y;
   }
-  grub_dprintf ("hackbgrt", "Set the bitmap position (manual, automatic, original) into BGRT structure.\n");
-  bgrt->image_offset_x = select_coordinate(config->image_x, auto_x, old_x);
-  bgrt->image_offset_y = select_coordinate(config->image_y, auto_y, old_y);
   set_acpi_sdt_checksum(bgrt);
-  grub_dprintf ("hackbgrt", "Store this BGRT (%d x %d).\n", (int) bgrt->image_offset_x, (int) bgrt->image_offset_y);
-  handle_acpi_tables(HACKBGRT_REPLACE, bgrt);
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "Store this BGRT (%d x %d).\n", (int) bgrt->image_offset_x, (int) bgrt->image_offset_y);
+  hackbgrt_acpi_queue (acpi, HACKBGRT_ACPI_REPLACE, bgrt);
+  hackbgrt_acpi_queue (acpi, HACKBGRT_ACPI_APPEND, bgrt);
+  commit_bgrt (acpi, new_bmp);
+}
+
+static void
+print_stats (void)
+{
+  struct hackbgrt_stats stats;
+  const char* message;
+  hackbgrt_stats_get (&stats);
+  grub_printf ("HackBGRT stats: %llu us in total:", (unsigned long long) stats.us[HACKBGRT_PHASE_TOTAL]);
+  for (int phase = 0; phase < HACKBGRT_PHASE_TOTAL; phase++)
+    grub_printf (" %s %llu%s", hackbgrt_stats_phase_name (phase), (unsigned long long) stats.us[phase],
+                 phase + 1 < HACKBGRT_PHASE_TOTAL ? "," : " us\n");
+  grub_printf ("HackBGRT stats: %llu bytes read, %u allocations (%llu bytes), %llu XSDT entries walked\n",
+               (unsigned long long) stats.bytes_read, stats.allocations,
+               (unsigned long long) stats.allocated_bytes, (unsigned long long) stats.xsdt_entries);
+  message = hackbgrt_telemetry_message ();
+  if (message)
+    grub_printf ("HackBGRT stats: first error: %s\n", message);
+}
+
+/**
+ * Apply a configuration to the ACPI tables, and publish what it cost.
+ *
+ * @param config The hack BGRT config.
+ */
+static void
+hack_bgrt(hackbgrt_config_t config)
+{
+  struct hackbgrt_acpi acpi;
+  grub_uint64_t start = hackbgrt_stats_now ();
+  const char* message;
+
+  deadline = config->budget_ms ? grub_get_time_ms () + config->budget_ms : 0;
+  budget_spent = 0;
+  hackbgrt_acpi_scan (&acpi);
+  hackbgrt_stats_add (HACKBGRT_PHASE_ACPI_SCAN, start);
+  patch_bgrt (config, &acpi);
+  hackbgrt_stats_count_xsdt (acpi.entries_walked);
+  hackbgrt_stats_add (HACKBGRT_PHASE_TOTAL, start);
+  hackbgrt_stats_end ();
+  hackbgrt_telemetry_error (grub_errno);
+  // the errors are printed without a pause: the first one stays for the menu and the next command
+  message = hackbgrt_telemetry_message ();
+  if (message)
+    grub_env_set ("hackbgrt_error", message);
+  else
+    grub_env_unset ("hackbgrt_error");
+  deadline = 0;
+  if (config->stats)
+    print_stats ();
+  if (config->telemetry)
+  {
+    // the error of the run stays the one reported
+    grub_err_t err = grub_errno;
+    grub_errno = GRUB_ERR_NONE;
+    if (hackbgrt_telemetry_write (config, acpi.bgrt) != GRUB_ERR_NONE)
+      grub_print_error ();
+    grub_errno = err;
+  }
+}
+
+static const struct grub_arg_option options[] =
+{
+  {"defer", 'd', 0, N_("Only check the arguments now; load the image and patch the ACPI tables just before booting."), 0, 0},
+  {"cache-stats", 's', 0, N_("Show the bitmap cache hits and misses, and the I/O backend counters."), 0, 0},
+  {"io", 'i', 0, N_("How to read the image: grub (default), efi, blocklist, or auto to keep the fastest."), N_("BACKEND"), ARG_TYPE_STRING},
+  {"parallel", 'p', 0, N_("Spread the conversion and the scaling of large images over the processors (EFI MP services)."), 0, 0},
+  {"stats", 't', 0, N_("Show the time spent in each phase, the bytes read and the allocations; alone, those of the last run."), 0, 0},
+  {"telemetry", 'T', 0, N_("Leave the stats and the outcome of the run to the OS, in a volatile EFI variable."), 0, 0},
+  {0, 0, 0, 0, 0, 0}
+};
+
+enum options
+{
+  HACKBGRT_OPTION_DEFER,
+  HACKBGRT_OPTION_CACHE_STATS,
+  HACKBGRT_OPTION_IO,
+  HACKBGRT_OPTION_PARALLEL,
+  HACKBGRT_OPTION_STATS,
+  HACKBGRT_OPTION_TELEMETRY
+};
+
+static void
+print_cache_stats (void)
+{
+  struct hackbgrt_cache_stats stats;
+  struct hackbgrt_alloc_stats alloc;
+  struct hackbgrt_parallel_stats parallel;
+  struct hackbgrt_display_stats display;
+  hackbgrt_cache_get_stats (&stats);
+  grub_printf ("HackBGRT cache: %u entries (%llu bytes), %u hits, %u misses, %u released\n",
+               stats.entries, (unsigned long long) stats.bytes, stats.hits, stats.misses, stats.released);
+  for (int backend = 0; backend < HACKBGRT_IO_BACKENDS; backend++)
+  {
+    struct hackbgrt_io_stats io;
+    hackbgrt_io_get_stats (backend, &io);
+    if (io.opens)
+      grub_printf ("HackBGRT I/O %s: %u opens (%u failed), %u reads, %llu bytes in %llu us\n",
+                   hackbgrt_io_backend_name (backend), io.opens, io.failures, io.reads,
+                   (unsigned long long) io.bytes, (unsigned long long) io.us);
+  }
+  if (hackbgrt_io_auto_choice () != HACKBGRT_IO_AUTO)
+    grub_printf ("HackBGRT I/O auto: %s\n", hackbgrt_io_backend_name (hackbgrt_io_auto_choice ()));
+  hackbgrt_alloc_get_stats (&alloc);
+  if (alloc.reused || alloc.allocated)
+    grub_printf ("HackBGRT memory: %u bitmaps in the firmware's logo buffer (%llu bytes reused), "
+                 "%u in ACPI reclaim pages (%llu bytes), %u released (%llu bytes)\n",
+                 alloc.reused, (unsigned long long) alloc.reused_bytes,
+                 alloc.allocated, (unsigned long long) alloc.allocated_bytes,
+                 alloc.released, (unsigned long long) alloc.released_bytes);
+  hackbgrt_parallel_get_stats (&parallel);
+  if (parallel.parallel)
+    grub_printf ("HackBGRT parallel: %u processors, %u runs on the APs, %u on the BSP\n",
+                 parallel.processors, parallel.parallel, parallel.serial);
+  hackbgrt_display_get_stats (&display);
+  if (display.lookups)
+    grub_printf ("HackBGRT display: %u lookups, %u GOP searches, %u mode queries\n",
+                 display.lookups, display.locates, display.queries);
+}
+
+/** Configuration to apply from the preboot hook, if any. */
+static hackbgrt_config_t deferred_config;
+static struct grub_preboot* preboot_handle;
+
+static void
+drop_deferred_config (void)
+{
+  if (deferred_config)
+  {
+    hackbgrt_trace (HACKBGRT_TRACE_STEPS, "drop deferred config\n");
+    hackbgrt_free_config (deferred_config);
+    deferred_config = 0;
+  }
+}
+
+/**
+ * Apply the last deferred configuration just before the loader starts.
+ *
+ * Errors are reported but never prevent the boot.
+ */
+static grub_err_t
+hackbgrt_preboot (int noreturn __attribute__ ((unused)))
+{
+  if (!deferred_config)
+    return GRUB_ERR_NONE;
+  hackbgrt_trace (HACKBGRT_TRACE_STEPS, "starting deferred hack\n");
+  hack_bgrt(deferred_config);
+  grub_print_error ();
+  drop_deferred_config ();
+  hackbgrt_trace (HACKBGRT_TRACE_STEPS, "ending deferred hack\n");
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+hackbgrt_preboot_rest (void)
+{
+  return GRUB_ERR_NONE;
 }
 
 static grub_err_t
-grub_cmd_hackbgrt (grub_extcmd_context_t ctxt __attribute__ ((unused)),
+grub_cmd_hackbgrt (grub_extcmd_context_t ctxt,
                    int argc,
                    char* argv[])
 {
   grub_size_t esp_arg_len;
   hackbgrt_config_t config;
+  int io_backend = HACKBGRT_IO_GRUB;
+  grub_uint64_t start;
 
+  if (!HACKBGRT_WITH_DIAGNOSTICS && ctxt->state[HACKBGRT_OPTION_CACHE_STATS].set)
+    return hackbgrt_not_in_build ("--cache-stats");
+  if (!HACKBGRT_WITH_DIAGNOSTICS && ctxt->state[HACKBGRT_OPTION_TELEMETRY].set)
+    return hackbgrt_not_in_build ("--telemetry");
+  if (!HACKBGRT_WITH_PARALLEL && ctxt->state[HACKBGRT_OPTION_PARALLEL].set)
+    return hackbgrt_not_in_build ("--parallel");
+  if (ctxt->state[HACKBGRT_OPTION_CACHE_STATS].set)
+    print_cache_stats ();
+  if (ctxt->state[HACKBGRT_OPTION_STATS].set && argc == 0)
+    print_stats ();
+  if ((ctxt->state[HACKBGRT_OPTION_CACHE_STATS].set || ctxt->state[HACKBGRT_OPTION_STATS].set) && argc == 0)
+    return GRUB_ERR_NONE;
+  if (ctxt->state[HACKBGRT_OPTION_IO].set)
+  {
+    io_backend = hackbgrt_io_parse_backend (ctxt->state[HACKBGRT_OPTION_IO].arg);
+    if (io_backend < 0)
+      return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("unknown I/O backend `%s'"), ctxt->state[HACKBGRT_OPTION_IO].arg);
+    if (!HACKBGRT_WITH_IO && io_backend != HACKBGRT_IO_GRUB)
+      return hackbgrt_not_in_build ("--io");
+  }
   if (argc < 2)
     return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("EFI system partition (ESP) and image= argument expected"));
   esp_arg_len = grub_strlen (argv[0]);
@@ -487,21 +1442,43 @@ grub_cmd_hackbgrt (grub_extcmd_context_t ctxt __attribute__ ((unused)),
   {
     return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("format (hd0,gpt1) expected"));
   }
+  hackbgrt_stats_begin ();
+  hackbgrt_telemetry_begin ();
+  start = hackbgrt_stats_now ();
   config = hackbgrt_read_config (argv[0], (const char**) argv + 1, argc - 1);
+  hackbgrt_stats_add (HACKBGRT_PHASE_CONFIG, start);
+  hackbgrt_stats_add (HACKBGRT_PHASE_TOTAL, start);
   if (! config)
   {
     grub_print_error ();
     goto fail;
   }
-  grub_dprintf ("hackbgrt", "starting hack\n");
+  config->io_backend = io_backend;
+  config->parallel = ctxt->state[HACKBGRT_OPTION_PARALLEL].set;
+  config->stats = ctxt->state[HACKBGRT_OPTION_STATS].set;
+  config->telemetry = ctxt->state[HACKBGRT_OPTION_TELEMETRY].set;
+  // The last invocation wins: a pending deferred config is replaced or dropped.
+  drop_deferred_config ();
+  if (ctxt->state[HACKBGRT_OPTION_DEFER].set)
+  {
+    if (!preboot_handle)
+      preboot_handle = grub_loader_register_preboot_hook (hackbgrt_preboot, hackbgrt_preboot_rest, GRUB_LOADER_PREBOOT_HOOK_PRIO_NORMAL);
+    if (!preboot_handle)
+      goto fail;
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "hack deferred until boot\n");
+    config->deferred = 1;
+    deferred_config = config;
+    return GRUB_ERR_NONE;
+  }
+  hackbgrt_trace (HACKBGRT_TRACE_STEPS, "starting hack\n");
   hack_bgrt(config);
   grub_print_error ();
-  grub_dprintf ("hackbgrt", "ending hack\n");
+  hackbgrt_trace (HACKBGRT_TRACE_STEPS, "ending hack\n");
 fail:
-  grub_dprintf ("hackbgrt", "free some memory\n");
+  hackbgrt_trace (HACKBGRT_TRACE_STEPS, "free some memory\n");
   if (config)
     hackbgrt_free_config (config);
-  grub_dprintf ("hackbgrt", "end of my code\n");
+  hackbgrt_trace (HACKBGRT_TRACE_STEPS, "end of my code\n");
   return grub_errno;
 }
 
@@ -509,17 +1486,32 @@ static grub_extcmd_t cmd;
 
 GRUB_MOD_INIT(hackbgrt)
 {
+  hackbgrt_alloc_init ();
+  hackbgrt_cache_init ();
+  hackbgrt_profile_init ();
+  hackbgrt_stats_init ();
   cmd = grub_register_extcmd (
       "hackbgrt",
       grub_cmd_hackbgrt,
       GRUB_COMMAND_FLAG_BLOCKS,
-      N_("EFI_PARTITION image=/relative/path/to/bmp|keep|remove[,x=123|center|keep,y=456|center|keep][,weight=1] [image=...]*"),
+      N_("[--defer] [--io=grub|efi|blocklist|auto] [--parallel] [--cache-stats] [--stats] [--telemetry] EFI_PARTITION image=/relative/path/to/bmp|dir:/relative/dir/|builtin|keep|remove[,x=123|center|keep,y=456|center|keep][,scale=none|fit|fill|2x|3x][,trim=auto|none][,mode=replace|overlay][,screen=WxH][,weight=1] [image=...]* [profile=/relative/path/to/table] [seed=N] [budget=MS[:keep|:remove]]"),
       N_("Change the BGRT image."),
-      0
+      options
   );
 }
 
 GRUB_MOD_FINI(hackbgrt)
 {
   grub_unregister_extcmd (cmd);
+  if (preboot_handle)
+    grub_loader_unregister_preboot_hook (preboot_handle);
+  preboot_handle = 0;
+  drop_deferred_config ();
+  grub_free (firmware_copy);
+  firmware_copy = 0;
+  firmware_logo = 0;
+  hackbgrt_cache_fini ();
+  hackbgrt_alloc_fini ();
+  hackbgrt_io_fini ();
+  hackbgrt_display_fini ();
 }
@@ -0,0 +1,289 @@
+#include <grub/err.h>
+#include <grub/file.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/types.h>
+#include "io.h"
+#include "stats.h"
+#include "tier.h"
+
+/** Smallest share of a read given to each backend of an auto race. */
+#define HACKBGRT_IO_RACE_MIN_CHUNK (256 * 1024)
+/** Largest share; the winner reads the rest. */
+#define HACKBGRT_IO_RACE_MAX_CHUNK (4 * 1024 * 1024)
+/** A backend must be faster by 1/2^this of the time of the one it replaces, 1/8, not to win on noise. */
+#define HACKBGRT_IO_RACE_MARGIN 3
+
+struct hackbgrt_io
+{
+  grub_uint64_t base; // of the window, see hackbgrt_io_window
+  grub_uint64_t size;
+  // Opened backends, in preference order; a single one once settled.
+  unsigned count;
+  enum hackbgrt_io_backend backends[HACKBGRT_IO_BACKENDS];
+  void* handles[HACKBGRT_IO_BACKENDS];
+};
+
+static void*
+grub_io_open (const char* path, grub_uint64_t* size)
+{
+  grub_file_t file = grub_file_open (path, GRUB_FILE_TYPE_PIXMAP);
+  if (!file)
+    return 0;
+  *size = grub_file_size (file);
+  return file;
+}
+
+static grub_err_t
+grub_io_read (void* handle, grub_uint64_t offset, void* buf, grub_size_t len)
+{
+  grub_file_t file = handle;
+  if (grub_file_tell (file) != offset && grub_file_seek (file, offset) == (grub_off_t) -1)
+    return grub_errno;
+  if (grub_file_read (file, buf, len) != (grub_ssize_t) len)
+    return grub_errno ? grub_errno : grub_error (GRUB_ERR_FILE_READ_ERROR, "HackBGRT: short read\n");
+  return GRUB_ERR_NONE;
+}
+
+static void
+grub_io_close (void* handle)
+{
+  grub_file_close (handle);
+}
+
+static const struct hackbgrt_io_ops grub_io_ops =
+{
+  .open = grub_io_open,
+  .read = grub_io_read,
+  .close = grub_io_close
+};
+
+static const struct hackbgrt_io_ops* const io_ops[HACKBGRT_IO_BACKENDS] =
+{
+  [HACKBGRT_IO_GRUB] = &grub_io_ops,
+#if HACKBGRT_WITH_IO
+  [HACKBGRT_IO_EFI] = &hackbgrt_io_efi_ops,
+  [HACKBGRT_IO_BLOCKLIST] = &hackbgrt_io_blocklist_ops
+#endif
+};
+
+static const char* const io_names[] =
+{
+  [HACKBGRT_IO_GRUB] = "grub",
+  [HACKBGRT_IO_EFI] = "efi",
+  [HACKBGRT_IO_BLOCKLIST] = "blocklist",
+  [HACKBGRT_IO_AUTO] = "auto"
+};
+
+/** Race order of HACKBGRT_IO_AUTO, the first one winning ties. */
+static const enum hackbgrt_io_backend io_preference[HACKBGRT_IO_BACKENDS] =
+{
+  HACKBGRT_IO_BLOCKLIST,
+  HACKBGRT_IO_EFI,
+  HACKBGRT_IO_GRUB
+};
+
+static struct hackbgrt_io_stats io_stats[HACKBGRT_IO_BACKENDS];
+static enum hackbgrt_io_backend io_auto_choice = HACKBGRT_IO_AUTO;
+
+static int
+open_backend (hackbgrt_io_t io, const char* path, enum hackbgrt_io_backend backend)
+{
+  grub_uint64_t size = 0;
+  void* handle;
+
+  io_stats[backend].opens++;
+  handle = io_ops[backend]->open (path, &size);
+  if (!handle)
+  {
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "io: %s cannot open %s: %s\n", io_names[backend], path, grub_errmsg);
+    io_stats[backend].failures++;
+    return 0;
+  }
+  if (io->count && size != io->size)
+  {
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "io: %s sees %llu bytes instead of %llu, ignored\n",
+                    io_names[backend], (unsigned long long) size, (unsigned long long) io->size);
+    io_ops[backend]->close (handle);
+    io_stats[backend].failures++;
+    return 0;
+  }
+  io->size = size;
+  io->backends[io->count] = backend;
+  io->handles[io->count] = handle;
+  io->count++;
+  return 1;
+}
+
+hackbgrt_io_t
+hackbgrt_io_open (const char* path, enum hackbgrt_io_backend backend)
+{
+  int automatic = backend == HACKBGRT_IO_AUTO;
+  hackbgrt_io_t io = grub_zalloc (sizeof (*io));
+  if (!io)
+    return 0;
+  if (automatic)
+    backend = io_auto_choice;
+  if (backend != HACKBGRT_IO_AUTO)
+    open_backend (io, path, backend);
+  // race again if the settled backend cannot open this one
+  if (automatic && io->count == 0)
+    for (unsigned i = 0; i < ARRAY_SIZE (io_preference); i++)
+      if (io_preference[i] != backend)
+        open_backend (io, path, io_preference[i]);
+  if (io->count == 0)
+  {
+    grub_free (io);
+    if (grub_errno == GRUB_ERR_NONE)
+      grub_error (GRUB_ERR_FILE_NOT_FOUND, "HackBGRT: cannot open %s\n", path);
+    return 0;
+  }
+  // a failing firmware backend is not an error as long as another one opened the file
+  grub_errno = GRUB_ERR_NONE;
+  return io;
+}
+
+grub_uint64_t
+hackbgrt_io_size (hackbgrt_io_t io)
+{
+  return io->size;
+}
+
+static grub_err_t
+read_backend (hackbgrt_io_t io, unsigned i, grub_uint64_t offset, void* buf, grub_size_t len, grub_uint64_t* us)
+{
+  enum hackbgrt_io_backend backend = io->backends[i];
+  grub_uint64_t start = hackbgrt_stats_now ();
+  grub_err_t err = io_ops[backend]->read (io->handles[i], offset, buf, len);
+  *us = hackbgrt_stats_us (hackbgrt_stats_now () - start);
+  io_stats[backend].reads++;
+  io_stats[backend].us += *us;
+  if (!err)
+    io_stats[backend].bytes += len;
+  return err;
+}
+
+/**
+ * Give each opened backend its own slice of a large read, keep the fastest.
+ *
+ * Slices are disjoint so that no backend benefits from a cache warmed by
+ * another one. They are timed against the TSC, as a slice of a fast ESP
+ * takes a millisecond or two; a backend only beats the one preferred over
+ * it by HACKBGRT_IO_RACE_MARGIN. On return only the winner is left open.
+ *
+ * @return The number of bytes read.
+ */
+static grub_size_t
+race (hackbgrt_io_t io, grub_uint64_t offset, grub_uint8_t* buf, grub_size_t len)
+{
+  grub_size_t chunk = grub_min (len / (io->count + 1), HACKBGRT_IO_RACE_MAX_CHUNK);
+  grub_size_t done = 0;
+  grub_uint64_t best_us = 0;
+  unsigned winner = io->count;
+
+  chunk &= ~(grub_size_t) 0xffff;
+  for (unsigned i = 0; i < io->count; i++)
+  {
+    grub_uint64_t us;
+    if (read_backend (io, i, offset + done, buf + done, chunk, &us))
+    {
+      hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "io: %s failed in race: %s\n", io_names[io->backends[i]], grub_errmsg);
+      grub_errno = GRUB_ERR_NONE;
+      continue;
+    }
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "io: %s read %llu bytes in %llu us\n",
+                    io_names[io->backends[i]], (unsigned long long) chunk, (unsigned long long) us);
+    done += chunk;
+    if (winner == io->count || us + (best_us >> HACKBGRT_IO_RACE_MARGIN) < best_us)
+    {
+      winner = i;
+      best_us = us;
+    }
+  }
+  // everyone failed: keep the last one to report the error on the next read
+  if (winner == io->count)
+    winner = io->count - 1;
+  else
+  {
+    io_auto_choice = io->backends[winner];
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "io: auto settles on %s\n", io_names[io_auto_choice]);
+  }
+  for (unsigned i = 0; i < io->count; i++)
+    if (i != winner)
+      io_ops[io->backends[i]]->close (io->handles[i]);
+  io->backends[0] = io->backends[winner];
+  io->handles[0] = io->handles[winner];
+  io->count = 1;
+  return done;
+}
+
+grub_err_t
+hackbgrt_io_read (hackbgrt_io_t io, grub_uint64_t offset, void* buf, grub_size_t len)
+{
+  grub_uint64_t us;
+  grub_size_t done = 0;
+
+  if (offset > io->size || len > io->size - offset)
+    return grub_error (GRUB_ERR_OUT_OF_RANGE, "HackBGRT: read past the end of the file\n");
+  offset += io->base;
+  if (io->count > 1 && len >= (io->count + 1) * HACKBGRT_IO_RACE_MIN_CHUNK)
+    done = race (io, offset, buf, len);
+  if (done == len)
+    return GRUB_ERR_NONE;
+  return read_backend (io, 0, offset + done, (grub_uint8_t*) buf + done, len - done, &us);
+}
+
+grub_err_t
+hackbgrt_io_window (hackbgrt_io_t io, grub_uint64_t offset, grub_uint64_t length)
+{
+  if (offset > io->size || length > io->size - offset)
+    return grub_error (GRUB_ERR_OUT_OF_RANGE, "HackBGRT: window past the end of the file\n");
+  io->base += offset;
+  io->size = length;
+  return GRUB_ERR_NONE;
+}
+
+void
+hackbgrt_io_close (hackbgrt_io_t io)
+{
+  for (unsigned i = 0; i < io->count; i++)
+    io_ops[io->backends[i]]->close (io->handles[i]);
+  grub_free (io);
+}
+
+int
+hackbgrt_io_parse_backend (const char* name)
+{
+  for (unsigned i = 0; i < ARRAY_SIZE (io_names); i++)
+    if (grub_strcmp (name, io_names[i]) == 0)
+      return i;
+  return -1;
+}
+
+const char*
+hackbgrt_io_backend_name (enum hackbgrt_io_backend backend)
+{
+  return io_names[backend];
+}
+
+enum hackbgrt_io_backend
+hackbgrt_io_auto_choice (void)
+{
+  return io_auto_choice;
+}
+
+void
+hackbgrt_io_get_stats (enum hackbgrt_io_backend backend, struct hackbgrt_io_stats* stats)
+{
+  grub_memcpy (stats, &io_stats[backend], sizeof (*stats));
+}
+
+void
+hackbgrt_io_fini (void)
+{
+#if HACKBGRT_WITH_IO
+  hackbgrt_io_blocklist_fini ();
+#endif
+  grub_memset (io_stats, 0, sizeof (io_stats));
+  io_auto_choice = HACKBGRT_IO_AUTO;
+}
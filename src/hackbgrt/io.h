@@ -0,0 +1,117 @@
+#pragma once
+
+#include <grub/err.h>
+#include <grub/types.h>
+
+/**
+ * The ways to read an image from the ESP.
+ *
+ * The order of the firmware backends is also the preference order of
+ * HACKBGRT_IO_AUTO when the measured times are equal.
+ */
+enum hackbgrt_io_backend
+{
+  HACKBGRT_IO_GRUB = 0,  // grub_file_open/grub_file_read
+  HACKBGRT_IO_EFI,       // EFI_SIMPLE_FILE_SYSTEM_PROTOCOL of the ESP
+  HACKBGRT_IO_BLOCKLIST, // FAT extents read with EFI_BLOCK_IO_PROTOCOL
+  HACKBGRT_IO_AUTO,      // the fastest one measured on this machine
+  HACKBGRT_IO_BACKENDS = HACKBGRT_IO_AUTO
+};
+
+/**
+ * Counters of one backend, for the module lifetime.
+ */
+struct hackbgrt_io_stats
+{
+  grub_uint32_t opens;
+  grub_uint32_t failures; // opens that failed
+  grub_uint32_t reads;
+  grub_uint64_t bytes;
+  grub_uint64_t us;       // spent in reads
+};
+
+typedef struct hackbgrt_io* hackbgrt_io_t;
+
+/**
+ * Operations of a backend.
+ *
+ * open() returns a backend handle, or 0 with grub_errno set; read() reads
+ * exactly len bytes at offset.
+ */
+struct hackbgrt_io_ops
+{
+  void* (*open) (const char* path, grub_uint64_t* size);
+  grub_err_t (*read) (void* handle, grub_uint64_t offset, void* buf, grub_size_t len);
+  void (*close) (void* handle);
+};
+
+extern const struct hackbgrt_io_ops hackbgrt_io_efi_ops;
+extern const struct hackbgrt_io_ops hackbgrt_io_blocklist_ops;
+
+/**
+ * Open a file.
+ *
+ * @param path The resolved path, like (hd0,gpt1)/EFI/logo.bmp.
+ * @param backend The backend to use; HACKBGRT_IO_AUTO races the available
+ *        backends on the first large read until one has won.
+ * @return The opened file, or 0 with grub_errno set.
+ */
+extern hackbgrt_io_t
+hackbgrt_io_open (const char* path, enum hackbgrt_io_backend backend);
+
+extern grub_uint64_t
+hackbgrt_io_size (hackbgrt_io_t io);
+
+/**
+ * Read exactly len bytes at offset.
+ *
+ * @return GRUB_ERR_NONE, or the error also set in grub_errno.
+ */
+extern grub_err_t
+hackbgrt_io_read (hackbgrt_io_t io, grub_uint64_t offset, void* buf, grub_size_t len);
+
+/**
+ * Restrict the file to a part of it, like one variant of a splash pack:
+ * offsets and the size are relative to that part from then on.
+ *
+ * @param offset The start of the part, relative to the current one.
+ * @param length The length of the part.
+ * @return GRUB_ERR_NONE, or GRUB_ERR_OUT_OF_RANGE if the part is not in the file.
+ */
+extern grub_err_t
+hackbgrt_io_window (hackbgrt_io_t io, grub_uint64_t offset, grub_uint64_t length);
+
+extern void
+hackbgrt_io_close (hackbgrt_io_t io);
+
+/**
+ * Parse a backend name: grub, efi, blocklist or auto.
+ *
+ * @return The backend, or -1 if unknown.
+ */
+extern int
+hackbgrt_io_parse_backend (const char* name);
+
+extern const char*
+hackbgrt_io_backend_name (enum hackbgrt_io_backend backend);
+
+/**
+ * The backend HACKBGRT_IO_AUTO settled on, or HACKBGRT_IO_AUTO while none has been measured.
+ */
+extern enum hackbgrt_io_backend
+hackbgrt_io_auto_choice (void);
+
+extern void
+hackbgrt_io_get_stats (enum hackbgrt_io_backend backend, struct hackbgrt_io_stats* stats);
+
+/**
+ * Drop the memoized extents and measurements, from GRUB_MOD_FINI.
+ */
+extern void
+hackbgrt_io_fini (void);
+
+/**
+ * Drop the extents memoized by the blocklist backend.
+ */
+extern void
+hackbgrt_io_blocklist_fini (void);
@@ -0,0 +1,382 @@
+#include <grub/charset.h>
+#include <grub/device.h>
+#include <grub/disk.h>
+#include <grub/efi/api.h>
+#include <grub/efi/disk.h>
+#include <grub/efi/efi.h>
+#include <grub/env.h>
+#include <grub/err.h>
+#include <grub/file.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/types.h>
+#include "efi_fs.h"
+#include "fat.h"
+#include "io.h"
+#include "tier.h"
+
+#if HACKBGRT_WITH_IO
+/** Largest single ReadBlocks request, for firmware that mishandles huge transfers. */
+#define HACKBGRT_IO_MAX_TRANSFER (8 * 1024 * 1024)
+/** Bounce buffer for partial blocks, and for buffers that miss the IoAlign requirement. */
+#define HACKBGRT_IO_BOUNCE_SIZE (64 * 1024)
+
+/**
+ * Find the EFI handle of the device of a GRUB path.
+ *
+ * @param path A path like (hd0,gpt1)/EFI/logo.bmp, or /EFI/logo.bmp on $root as grub_file_open takes it.
+ * @param file_path Receives the path on the device, like /EFI/logo.bmp.
+ * @param device If not 0, receives the opened device, to close with grub_device_close.
+ * @return The handle of the partition (or of the disk if not partitioned), or 0.
+ */
+static grub_efi_handle_t
+device_handle (const char* path, const char** file_path, grub_device_t* device)
+{
+  char* name = grub_file_get_device_name (path);
+  grub_efi_handle_t handle = 0;
+  grub_device_t dev;
+
+  if (!name && grub_errno == GRUB_ERR_NONE)
+  {
+    // no (device): the file is on $root, as for grub_file_open
+    const char* root = grub_env_get ("root");
+    if (!root)
+    {
+      grub_error (GRUB_ERR_BAD_FILENAME, "HackBGRT: no device in %s and no $root\n", path);
+      return 0;
+    }
+    name = grub_strdup (root);
+  }
+  if (!name)
+    return 0;
+  dev = grub_device_open (name);
+  grub_free (name);
+  if (!dev)
+    return 0;
+  if (dev->disk)
+    handle = grub_efidisk_get_device_handle (dev->disk);
+  if (!handle)
+  {
+    grub_device_close (dev);
+    grub_error (GRUB_ERR_BAD_DEVICE, "HackBGRT: %s is not on an EFI disk\n", path);
+    return 0;
+  }
+  *file_path = path[0] == '(' ? grub_strchr (path, ')') + 1 : path;
+  if (device)
+    *device = dev;
+  else
+    grub_device_close (dev);
+  return handle;
+}
+
+/*
+ * EFI_SIMPLE_FILE_SYSTEM_PROTOCOL: the firmware FAT driver.
+ */
+
+struct efi_io
+{
+  struct hackbgrt_efi_file* root;
+  struct hackbgrt_efi_file* file;
+  grub_uint64_t position;
+};
+
+static void
+efi_io_close (void* handle)
+{
+  struct efi_io* io = handle;
+  if (io->file)
+    efi_call_1 (io->file->close, io->file);
+  if (io->root)
+    efi_call_1 (io->root->close, io->root);
+  grub_free (io);
+}
+
+static void*
+efi_io_open (const char* path, grub_uint64_t* size)
+{
+  static grub_efi_guid_t simple_file_system_guid = HACKBGRT_EFI_SIMPLE_FILE_SYSTEM_GUID;
+  struct hackbgrt_efi_simple_file_system* fs;
+  grub_efi_char16_t* name = 0;
+  struct efi_io* io = 0;
+  grub_efi_status_t status;
+  const char* file_path;
+  grub_size_t len;
+
+  grub_efi_handle_t handle = device_handle (path, &file_path, 0);
+  if (!handle)
+    return 0;
+  fs = grub_efi_open_protocol (handle, &simple_file_system_guid, GRUB_EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+  if (!fs)
+  {
+    grub_error (GRUB_ERR_BAD_DEVICE, "HackBGRT: no EFI file system for %s\n", path);
+    return 0;
+  }
+  // UTF-16 never needs more code units than UTF-8 has bytes.
+  len = grub_strlen (file_path);
+  name = grub_malloc ((len + 1) * sizeof (*name));
+  io = grub_zalloc (sizeof (*io));
+  if (!name || !io)
+    goto fail;
+  len = grub_utf8_to_utf16 (name, len, (const grub_uint8_t*) file_path, len, 0);
+  name[len] = 0;
+  for (grub_size_t i = 0; i < len; i++)
+    if (name[i] == '/')
+      name[i] = '\\';
+  status = efi_call_2 (fs->open_volume, fs, &io->root);
+  if (status)
+  {
+    io->root = 0;
+    grub_error (GRUB_ERR_BAD_DEVICE, "HackBGRT: cannot open the EFI volume of %s\n", path);
+    goto fail;
+  }
+  status = efi_call_5 (io->root->open, io->root, &io->file, name, HACKBGRT_EFI_FILE_MODE_READ, 0);
+  if (status)
+  {
+    io->file = 0;
+    grub_error (GRUB_ERR_FILE_NOT_FOUND, "HackBGRT: EFI cannot open %s\n", path);
+    goto fail;
+  }
+  // Seeking to the end is the way to get the size without EFI_FILE_INFO.
+  status = efi_call_2 (io->file->set_position, io->file, HACKBGRT_EFI_FILE_POSITION_END);
+  if (!status)
+    status = efi_call_2 (io->file->get_position, io->file, size);
+  if (!status)
+    status = efi_call_2 (io->file->set_position, io->file, 0);
+  if (status)
+  {
+    grub_error (GRUB_ERR_FILE_READ_ERROR, "HackBGRT: EFI cannot size %s\n", path);
+    goto fail;
+  }
+  grub_free (name);
+  return io;
+fail:
+  grub_free (name);
+  if (io)
+    efi_io_close (io);
+  return 0;
+}
+
+static grub_err_t
+efi_io_read (void* handle, grub_uint64_t offset, void* buf, grub_size_t len)
+{
+  struct efi_io* io = handle;
+  grub_uint8_t* p = buf;
+
+  if (io->position != offset)
+  {
+    if (efi_call_2 (io->file->set_position, io->file, offset))
+      return grub_error (GRUB_ERR_FILE_READ_ERROR, "HackBGRT: EFI seek error\n");
+    io->position = offset;
+  }
+  while (len)
+  {
+    grub_efi_uintn_t n = len;
+    grub_efi_status_t status = efi_call_3 (io->file->read, io->file, &n, p);
+    if (status || n == 0)
+      return grub_error (GRUB_ERR_FILE_READ_ERROR, "HackBGRT: EFI read error\n");
+    io->position += n;
+    p += n;
+    len -= n;
+  }
+  return GRUB_ERR_NONE;
+}
+
+const struct hackbgrt_io_ops hackbgrt_io_efi_ops =
+{
+  .open = efi_io_open,
+  .read = efi_io_read,
+  .close = efi_io_close
+};
+
+/*
+ * Blocklist: FAT extents resolved once, then EFI_BLOCK_IO_PROTOCOL reads.
+ */
+
+struct blocklist_memo
+{
+  struct blocklist_memo* next;
+  char* path;
+  grub_efi_block_io_t* block_io;
+  struct hackbgrt_fat_file fat;
+};
+
+static struct blocklist_memo* blocklist_memos;
+
+struct blocklist_io
+{
+  struct blocklist_memo* memo;
+  grub_uint8_t* bounce_alloc;
+  grub_uint8_t* bounce;
+  grub_size_t bounce_size;
+};
+
+static struct blocklist_memo*
+blocklist_resolve (const char* path)
+{
+  static grub_efi_guid_t block_io_guid = GRUB_EFI_BLOCK_IO_GUID;
+  struct blocklist_memo* memo;
+  grub_device_t dev;
+  const char* file_path;
+  grub_efi_handle_t handle;
+
+  for (memo = blocklist_memos; memo; memo = memo->next)
+    if (grub_strcmp (memo->path, path) == 0)
+      return memo;
+  handle = device_handle (path, &file_path, &dev);
+  if (!handle)
+    return 0;
+  memo = grub_zalloc (sizeof (*memo));
+  if (!memo)
+    goto fail;
+  memo->block_io = grub_efi_open_protocol (handle, &block_io_guid, GRUB_EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+  if (!memo->block_io || !memo->block_io->media || !memo->block_io->media->media_present
+      || memo->block_io->media->block_size == 0)
+  {
+    grub_error (GRUB_ERR_BAD_DEVICE, "HackBGRT: no EFI block device for %s\n", path);
+    goto fail;
+  }
+  if (hackbgrt_fat_resolve (dev->disk, file_path, &memo->fat))
+    goto fail;
+  memo->path = grub_strdup (path);
+  if (!memo->path)
+    goto fail;
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "io: %s is %llu bytes in %llu extents\n",
+                  path, (unsigned long long) memo->fat.size, (unsigned long long) memo->fat.extent_count);
+  grub_device_close (dev);
+  memo->next = blocklist_memos;
+  blocklist_memos = memo;
+  return memo;
+fail:
+  if (memo)
+  {
+    hackbgrt_fat_free (&memo->fat);
+    grub_free (memo);
+  }
+  grub_device_close (dev);
+  return 0;
+}
+
+static void*
+blocklist_io_open (const char* path, grub_uint64_t* size)
+{
+  struct blocklist_memo* memo = blocklist_resolve (path);
+  struct blocklist_io* io;
+  grub_uint32_t block_size, align;
+
+  if (!memo)
+    return 0;
+  io = grub_zalloc (sizeof (*io));
+  if (!io)
+    return 0;
+  block_size = memo->block_io->media->block_size;
+  align = grub_max (memo->block_io->media->io_align, 1u);
+  io->memo = memo;
+  io->bounce_size = (HACKBGRT_IO_BOUNCE_SIZE + block_size - 1) / block_size * block_size;
+  io->bounce_alloc = grub_malloc (io->bounce_size + align - 1);
+  if (!io->bounce_alloc)
+  {
+    grub_free (io);
+    return 0;
+  }
+  io->bounce = (grub_uint8_t*) ALIGN_UP ((grub_addr_t) io->bounce_alloc, align);
+  *size = memo->fat.size;
+  return io;
+}
+
+/**
+ * Read a byte range of the partition.
+ *
+ * Whole blocks go straight into the destination when it meets the IoAlign
+ * requirement; partial blocks go through the bounce buffer.
+ */
+static grub_err_t
+blocklist_read_disk (struct blocklist_io* io, grub_uint64_t disk_offset, grub_uint8_t* buf, grub_size_t len)
+{
+  grub_efi_block_io_t* bio = io->memo->block_io;
+  grub_uint32_t block_size = bio->media->block_size;
+  grub_uint32_t align = grub_max (bio->media->io_align, 1u);
+
+  while (len)
+  {
+    grub_uint64_t rem;
+    grub_efi_lba_t lba = grub_divmod64 (disk_offset, block_size, &rem);
+    grub_uint32_t skip = (grub_uint32_t) rem;
+    grub_efi_status_t status;
+    grub_size_t n;
+    if (skip == 0 && len >= block_size && ((grub_addr_t) buf & (align - 1)) == 0)
+    {
+      n = grub_min (len - len % block_size, (grub_size_t) HACKBGRT_IO_MAX_TRANSFER);
+      status = efi_call_5 (bio->read_blocks, bio, bio->media->media_id, lba, n, buf);
+    }
+    else
+    {
+      // whole blocks up to the bounce buffer, in native-width arithmetic
+      grub_size_t blocks = ((grub_size_t) skip + len + block_size - 1) / block_size;
+      grub_size_t span = grub_min (blocks * block_size, io->bounce_size);
+      n = grub_min (len, span - skip);
+      status = efi_call_5 (bio->read_blocks, bio, bio->media->media_id, lba, span, io->bounce);
+      if (!status)
+        grub_memcpy (buf, io->bounce + skip, n);
+    }
+    if (status)
+      return grub_error (GRUB_ERR_READ_ERROR, "HackBGRT: BlockIo error at LBA %llu\n", (unsigned long long) lba);
+    disk_offset += n;
+    buf += n;
+    len -= n;
+  }
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+blocklist_io_read (void* handle, grub_uint64_t offset, void* buf, grub_size_t len)
+{
+  struct blocklist_io* io = handle;
+  struct hackbgrt_fat_file* fat = &io->memo->fat;
+  grub_uint8_t* p = buf;
+
+  for (grub_size_t i = 0; len && i < fat->extent_count; i++)
+  {
+    struct hackbgrt_extent* extent = &fat->extents[i];
+    if (offset >= extent->file_offset + extent->length)
+      continue;
+    grub_uint64_t within = offset - extent->file_offset;
+    grub_size_t n = grub_min ((grub_uint64_t) len, extent->length - within);
+    if (blocklist_read_disk (io, extent->disk_offset + within, p, n))
+      return grub_errno;
+    offset += n;
+    p += n;
+    len -= n;
+  }
+  if (len)
+    return grub_error (GRUB_ERR_OUT_OF_RANGE, "HackBGRT: read past the last extent\n");
+  return GRUB_ERR_NONE;
+}
+
+static void
+blocklist_io_close (void* handle)
+{
+  struct blocklist_io* io = handle;
+  grub_free (io->bounce_alloc);
+  grub_free (io);
+}
+
+const struct hackbgrt_io_ops hackbgrt_io_blocklist_ops =
+{
+  .open = blocklist_io_open,
+  .read = blocklist_io_read,
+  .close = blocklist_io_close
+};
+
+void
+hackbgrt_io_blocklist_fini (void)
+{
+  while (blocklist_memos)
+  {
+    struct blocklist_memo* memo = blocklist_memos;
+    blocklist_memos = memo->next;
+    hackbgrt_fat_free (&memo->fat);
+    grub_free (memo->path);
+    grub_free (memo);
+  }
+}
+#endif
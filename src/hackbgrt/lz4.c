@@ -0,0 +1,97 @@
+#include <grub/misc.h>
+#include <grub/types.h>
+#include "lz4.h"
+#include "tier.h"
+
+#if HACKBGRT_WITH_BMZ || HACKBGRT_WITH_BUILTIN
+/** Below this length, an overlapping match is copied byte by byte. */
+#define LZ4_SHORT_MATCH 16
+
+/**
+ * Read the extra bytes of a literal or match length.
+ *
+ * @return 0 on success, -1 if the input ends or the length overflows.
+ */
+static int
+read_length (const grub_uint8_t** ip, const grub_uint8_t* iend, grub_size_t* len)
+{
+  grub_uint8_t b;
+  do
+  {
+    if (*ip >= iend)
+      return -1;
+    b = *(*ip)++;
+    if (*len + b < *len)
+      return -1;
+    *len += b;
+  }
+  while (b == 255);
+  return 0;
+}
+
+static inline void
+copy_match (grub_uint8_t* op, grub_size_t offset, grub_size_t len)
+{
+  if (offset >= len)
+  {
+    grub_memcpy (op, op - offset, len);
+    return;
+  }
+  if (len < LZ4_SHORT_MATCH)
+  {
+    for (const grub_uint8_t* match = op - offset; len; len--)
+      *op++ = *match++;
+    return;
+  }
+  // The output behind op repeats with period offset: each copy doubles the
+  // distance while staying a multiple of the period.
+  while (len)
+  {
+    grub_size_t n = grub_min (len, offset);
+    grub_memcpy (op, op - offset, n);
+    op += n;
+    len -= n;
+    offset += n;
+  }
+}
+
+grub_ssize_t
+hackbgrt_lz4_decode (const grub_uint8_t* src, grub_size_t src_size, grub_uint8_t* dst, grub_size_t dst_size)
+{
+  const grub_uint8_t* ip = src;
+  const grub_uint8_t* iend = src + src_size;
+  grub_uint8_t* op = dst;
+  grub_uint8_t* oend = dst + dst_size;
+
+  while (ip < iend)
+  {
+    grub_uint8_t token = *ip++;
+    grub_size_t len = token >> 4;
+    if (len == 15 && read_length (&ip, iend, &len))
+      return -1;
+    if (len > (grub_size_t) (iend - ip) || len > (grub_size_t) (oend - op))
+      return -1;
+    grub_memcpy (op, ip, len);
+    ip += len;
+    op += len;
+    // the last sequence only has literals
+    if (ip == iend)
+      break;
+    if (iend - ip < 2)
+      return -1;
+    grub_size_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > (grub_size_t) (op - dst))
+      return -1;
+    len = token & 15;
+    if (len == 15 && read_length (&ip, iend, &len))
+      return -1;
+    len += HACKBGRT_LZ4_MIN_MATCH;
+    if (len > (grub_size_t) (oend - op))
+      return -1;
+    copy_match (op, offset, len);
+    op += len;
+  }
+  return op - dst;
+}
+#endif
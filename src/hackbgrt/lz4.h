@@ -0,0 +1,21 @@
+#pragma once
+
+#include <grub/types.h>
+
+#define HACKBGRT_LZ4_MIN_MATCH 4
+
+/**
+ * Decode one raw LZ4 block (no frame, no checksum).
+ *
+ * Overlapping matches, like the 3-byte period of a flat 24-bit area, are
+ * expanded with copies that double in size, so long runs cost a handful of
+ * memcpy calls instead of one byte at a time.
+ *
+ * @param src The compressed block.
+ * @param src_size The size of the compressed block.
+ * @param dst The output buffer.
+ * @param dst_size The size of the output buffer.
+ * @return The number of bytes written, or -1 if the block is corrupt or does not fit.
+ */
+extern grub_ssize_t
+hackbgrt_lz4_decode (const grub_uint8_t* src, grub_size_t src_size, grub_uint8_t* dst, grub_size_t dst_size);
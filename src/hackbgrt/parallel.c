@@ -0,0 +1,154 @@
+#include <grub/efi/api.h>
+#include <grub/efi/efi.h>
+#include <grub/misc.h>
+#include <grub/types.h>
+#include "efi_mp.h"
+#include "parallel.h"
+#include "tier.h"
+
+#if HACKBGRT_WITH_PARALLEL
+static struct hackbgrt_efi_mp_services* mp;
+static unsigned workers = 1;
+static struct hackbgrt_parallel_stats stats;
+
+/**
+ * One run: the APs take worker slots, then bands, from shared counters.
+ */
+struct parallel_run
+{
+  hackbgrt_parallel_band_t band;
+  void* context;
+  grub_uint32_t rows;
+  grub_uint32_t band_rows;
+  grub_uint32_t bands;
+  grub_uint32_t next_band;
+  grub_uint32_t next_worker;
+};
+
+static void
+run_bands (struct parallel_run* run, unsigned worker)
+{
+  for (;;)
+  {
+    grub_uint32_t band = __atomic_fetch_add (&run->next_band, 1, __ATOMIC_RELAXED);
+    grub_uint32_t first = band * run->band_rows;
+    if (band >= run->bands)
+      return;
+    run->band (run->context, worker, first, grub_min (run->band_rows, run->rows - first));
+  }
+}
+
+static void HACKBGRT_EFIAPI
+ap_procedure (void* argument)
+{
+  struct parallel_run* run = argument;
+  unsigned worker = __atomic_fetch_add (&run->next_worker, 1, __ATOMIC_RELAXED);
+  // more APs than scratch slots: the others have enough to do
+  if (worker < workers)
+    run_bands (run, worker);
+}
+
+void
+hackbgrt_parallel_init (int enable)
+{
+  static grub_efi_guid_t mp_services_guid = HACKBGRT_EFI_MP_SERVICES_GUID;
+  grub_efi_uintn_t processors, enabled;
+
+  mp = 0;
+  workers = 1;
+  stats.processors = 0;
+  if (!enable)
+    return;
+  if (efi_call_3 (grub_efi_system_table->boot_services->locate_protocol, &mp_services_guid, 0, (void**) &mp)
+      || !mp)
+  {
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "no MP services, pixel work stays serial\n");
+    mp = 0;
+    return;
+  }
+  if (efi_call_3 (mp->get_number_of_processors, mp, &processors, &enabled) || enabled < 2)
+  {
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "no enabled AP, pixel work stays serial\n");
+    mp = 0;
+    return;
+  }
+  stats.processors = enabled;
+  workers = grub_min (enabled - 1, HACKBGRT_PARALLEL_MAX_WORKERS);
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "%u processors, %u workers\n", (unsigned) enabled, workers);
+}
+
+unsigned
+hackbgrt_parallel_workers (void)
+{
+  return workers;
+}
+
+void
+hackbgrt_parallel_rows (grub_uint32_t rows, grub_size_t row_bytes, hackbgrt_parallel_band_t band, void* context)
+{
+  struct parallel_run run = {
+    .band = band,
+    .context = context,
+    .rows = rows,
+  };
+  grub_efi_status_t status;
+
+  if (!mp || rows < 2 || (grub_uint64_t) rows * row_bytes < HACKBGRT_PARALLEL_MIN_BYTES)
+  {
+    stats.serial++;
+    band (context, 0, 0, rows);
+    return;
+  }
+  // a few bands per worker, so a slow AP does not hold up the run
+  run.bands = grub_min (rows, 4 * workers);
+  run.band_rows = (rows + run.bands - 1) / run.bands;
+  run.bands = (rows + run.band_rows - 1) / run.band_rows;
+  // blocking: with a wait event, the firmware may only notice the APs are done on its next timer tick
+  status = efi_call_7 (mp->startup_all_aps, mp, ap_procedure, 0, 0, 0, &run, 0);
+  if (status)
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "StartupAllAPs failed (%d), finishing on the BSP\n", (int) status);
+  else
+    stats.parallel++;
+  // the APs are done: what they left, all if they never started, is the BSP's
+  if (run.next_band < run.bands)
+  {
+    if (status)
+      stats.serial++;
+    run_bands (&run, 0);
+  }
+}
+
+void
+hackbgrt_parallel_get_stats (struct hackbgrt_parallel_stats* s)
+{
+  *s = stats;
+}
+#else
+// without --parallel, the pixel work is always done on the BSP
+static struct hackbgrt_parallel_stats stats;
+
+void
+hackbgrt_parallel_init (int enable __attribute__ ((unused)))
+{
+}
+
+unsigned
+hackbgrt_parallel_workers (void)
+{
+  return 1;
+}
+
+void
+hackbgrt_parallel_rows (grub_uint32_t rows, grub_size_t row_bytes __attribute__ ((unused)),
+                        hackbgrt_parallel_band_t band, void* context)
+{
+  stats.serial++;
+  band (context, 0, 0, rows);
+}
+
+void
+hackbgrt_parallel_get_stats (struct hackbgrt_parallel_stats* s)
+{
+  *s = stats;
+}
+#endif
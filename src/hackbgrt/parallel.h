@@ -0,0 +1,65 @@
+#pragma once
+
+#include <grub/types.h>
+
+/** The most workers a parallel run uses, sizing the per-worker scratch. */
+#define HACKBGRT_PARALLEL_MAX_WORKERS 32
+
+/** Below this many output bytes, waking the APs costs more than it saves. */
+#define HACKBGRT_PARALLEL_MIN_BYTES (1024 * 1024)
+
+/**
+ * Counters of the parallel runs, for the module lifetime.
+ */
+struct hackbgrt_parallel_stats
+{
+  grub_uint32_t processors; // enabled ones, the BSP included; 0 without MP services
+  grub_uint32_t parallel;   // runs spread over the APs
+  grub_uint32_t serial;     // runs kept on the BSP
+};
+
+/**
+ * A kernel over a band of rows.
+ *
+ * It runs on an AP: it must not call GRUB or EFI services, nor allocate.
+ *
+ * @param context The context given to hackbgrt_parallel_rows.
+ * @param worker Which worker runs it, below hackbgrt_parallel_workers (), to pick its scratch.
+ * @param first The first row of the band.
+ * @param count The number of rows.
+ */
+typedef void (*hackbgrt_parallel_band_t) (void* context, unsigned worker, grub_uint32_t first, grub_uint32_t count);
+
+/**
+ * Enable or disable the parallel runs, looking up EFI_MP_SERVICES_PROTOCOL.
+ *
+ * Without the protocol or without enabled APs, the runs stay serial.
+ *
+ * @param enable 1 to use the APs.
+ */
+extern void
+hackbgrt_parallel_init (int enable);
+
+/**
+ * How many workers a run may use, 1 when serial.
+ */
+extern unsigned
+hackbgrt_parallel_workers (void);
+
+/**
+ * Run a kernel over rows 0 to rows - 1, split in bands.
+ *
+ * The bands go to the APs when enabled and the work is large enough, and
+ * return once all of them are done. Whatever the APs did not take runs on
+ * the BSP, as worker 0.
+ *
+ * @param rows The number of rows.
+ * @param row_bytes The bytes written per row, to judge the size of the work.
+ * @param band The kernel.
+ * @param context Its context.
+ */
+extern void
+hackbgrt_parallel_rows (grub_uint32_t rows, grub_size_t row_bytes, hackbgrt_parallel_band_t band, void* context);
+
+extern void
+hackbgrt_parallel_get_stats (struct hackbgrt_parallel_stats* stats);
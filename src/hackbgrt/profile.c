@@ -0,0 +1,324 @@
+#include <grub/acpi.h>
+#include <grub/err.h>
+#include <grub/file.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/smbios.h>
+#include <grub/types.h>
+#include "profile.h"
+#include "tier.h"
+#include "types.h"
+
+#if HACKBGRT_WITH_PROFILE
+// the machine, read from SMBIOS once: system\tMANUFACTURER\tPRODUCT, board\t..., "" if unknown
+static char system_key[PROFILE_PARAM_MAX];
+static char board_key[PROFILE_PARAM_MAX];
+static int machine_read;
+
+void
+hackbgrt_profile_init (void)
+{
+  machine_read = 0;
+  system_key[0] = '\0';
+  board_key[0] = '\0';
+}
+
+/**
+ * Find a string of an SMBIOS structure.
+ *
+ * @param strings The strings following the formatted area.
+ * @param end The end of the strings.
+ * @param number The string number, from 1; 0 means none.
+ * @param length Set to its length, without the trailing spaces.
+ * @return The string, or 0.
+ */
+static const char*
+smbios_string (const grub_uint8_t* strings, const grub_uint8_t* end, grub_uint8_t number, grub_size_t* length)
+{
+  const grub_uint8_t* s = strings;
+  if (!number)
+    return 0;
+  for (grub_uint8_t n = 1; s < end && *s; n++)
+  {
+    const grub_uint8_t* e = s;
+    while (e < end && *e)
+      e++;
+    if (n == number)
+    {
+      while (e > s && e[-1] == ' ')
+        e--;
+      *length = e - s;
+      return (const char*) s;
+    }
+    s = e + 1;
+  }
+  return 0;
+}
+
+/**
+ * Build the key of a system or baseboard structure.
+ */
+static void
+make_key (char* key, const char* kind, const grub_uint8_t* formatted, const grub_uint8_t* strings,
+          const grub_uint8_t* end)
+{
+  grub_size_t manufacturer_length, product_length;
+  const char* manufacturer = smbios_string (strings, end, formatted[SMBIOS_MANUFACTURER], &manufacturer_length);
+  const char* product = smbios_string (strings, end, formatted[SMBIOS_PRODUCT], &product_length);
+  grub_size_t kind_length = grub_strlen (kind);
+
+  key[0] = '\0';
+  if (!manufacturer || !product || kind_length + manufacturer_length + product_length + 3 > PROFILE_PARAM_MAX)
+    return;
+  grub_memcpy (key, kind, kind_length);
+  key += kind_length;
+  *key++ = '\t';
+  grub_memcpy (key, manufacturer, manufacturer_length);
+  key += manufacturer_length;
+  *key++ = '\t';
+  grub_memcpy (key, product, product_length);
+  key[product_length] = '\0';
+}
+
+/**
+ * Find the SMBIOS structure table through the entry points GRUB's smbios
+ * module found, preferring the 64-bit one.
+ *
+ * @param length Set to the table length.
+ * @return The table, or 0.
+ */
+static const grub_uint8_t*
+find_smbios_table (grub_size_t* length)
+{
+  struct grub_smbios_eps3* eps3 = grub_machine_smbios_get_eps3 ();
+  struct grub_smbios_eps* eps = grub_machine_smbios_get_eps ();
+
+  // they come as the configuration table has them: check them first
+  if (eps3 && grub_memcmp (eps3->anchor, SMBIOS3_ANCHOR, sizeof (eps3->anchor)) == 0
+      && grub_byte_checksum (eps3, eps3->length) == 0)
+  {
+    *length = eps3->maximum_table_length;
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "SMBIOS %d.%d (64-bit entry point)\n",
+                    eps3->version_major, eps3->version_minor);
+    return (const grub_uint8_t*) (grub_addr_t) eps3->table_address;
+  }
+  if (eps && grub_memcmp (eps->anchor, SMBIOS_ANCHOR, sizeof (eps->anchor)) == 0
+      && grub_byte_checksum (eps, eps->length) == 0)
+  {
+    *length = eps->intermediate.table_length;
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "SMBIOS %d.%d\n", eps->version_major, eps->version_minor);
+    return (const grub_uint8_t*) (grub_addr_t) eps->intermediate.table_address;
+  }
+  return 0;
+}
+
+/**
+ * Read the system and baseboard identities from SMBIOS, once.
+ */
+static void
+read_machine (void)
+{
+  grub_size_t length = 0;
+  const grub_uint8_t* p;
+  const grub_uint8_t* end;
+
+  if (machine_read)
+    return;
+  machine_read = 1;
+  p = find_smbios_table (&length);
+  if (!p)
+  {
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "no SMBIOS table\n");
+    return;
+  }
+  end = p + length;
+  while (p + sizeof (struct smbios_header) <= end)
+  {
+    const struct smbios_header* header = (const struct smbios_header*) p;
+    const grub_uint8_t* strings = p + header->length;
+    const grub_uint8_t* next = strings;
+    if (header->length < sizeof (*header) || strings > end)
+      break;
+    // the strings end with two NULs
+    while (next + 1 < end && (next[0] || next[1]))
+      next++;
+    if (header->length > SMBIOS_PRODUCT && header->type == SMBIOS_TYPE_SYSTEM && !system_key[0])
+      make_key (system_key, PROFILE_KEY_SYSTEM, p, strings, next + 1);
+    else if (header->length > SMBIOS_PRODUCT && header->type == SMBIOS_TYPE_BASEBOARD && !board_key[0])
+      make_key (board_key, PROFILE_KEY_BOARD, p, strings, next + 1);
+    else if (header->type == SMBIOS_TYPE_END)
+      break;
+    p = next + 2;
+  }
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "SMBIOS: '%s', '%s'\n", system_key, board_key);
+}
+
+static int
+read_at (grub_file_t file, grub_off_t offset, void* buf, grub_size_t size)
+{
+  return grub_file_seek (file, offset) != (grub_off_t) -1 && grub_file_read (file, buf, size) == (grub_ssize_t) size;
+}
+
+static int
+read_entry (grub_file_t file, grub_uint32_t i, struct profile_entry* entry)
+{
+  return read_at (file, sizeof (struct profile_header) + (grub_off_t) i * sizeof (*entry), entry, sizeof (*entry));
+}
+
+/**
+ * Read a string of the table, at most PROFILE_PARAM_MAX bytes with its NUL.
+ *
+ * @return 1, or 0 if it cannot be read or is too long.
+ */
+static int
+read_string (grub_file_t file, const struct profile_header* header, grub_uint32_t offset, char* buf)
+{
+  grub_size_t size;
+  if (offset >= header->strings_size)
+    return 0;
+  size = grub_min (header->strings_size - offset, PROFILE_PARAM_MAX);
+  if (!read_at (file, header->strings_offset + (grub_off_t) offset, buf, size))
+    return 0;
+  for (grub_size_t i = 0; i < size; i++)
+    if (!buf[i])
+      return 1;
+  return 0;
+}
+
+/**
+ * Find the entries of a key and read their parameters. The table is never
+ * read whole: a binary search on the hashes reads one entry per step.
+ *
+ * @return 1 if found, with the profile filled; 0 if not found or on error, with grub_errno set.
+ */
+static int
+find_key (grub_file_t file, const char* path, const struct profile_header* header, const char* key,
+          struct hackbgrt_profile* profile)
+{
+  grub_uint64_t hash = profile_key_hash (key);
+  grub_uint32_t low = 0, high = header->count, count = 1;
+  struct profile_entry entry;
+  char name[PROFILE_PARAM_MAX];
+
+  if (!key[0])
+    return 0;
+  while (low < high)
+  {
+    grub_uint32_t middle = low + (high - low) / 2;
+    if (!read_entry (file, middle, &entry))
+      goto bad_table;
+    if (entry.hash < hash)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  // the keys of a hash are sorted: the first one with the same name
+  for (; low < header->count; low++)
+  {
+    if (!read_entry (file, low, &entry))
+      goto bad_table;
+    if (entry.hash != hash)
+      return 0;
+    if (!read_string (file, header, entry.key, name))
+      goto bad_table;
+    if (grub_strcmp (name, key) == 0)
+      break;
+  }
+  if (low == header->count)
+    return 0;
+  // the entries of a key follow each other and share its string
+  for (grub_uint32_t key_offset = entry.key; low + count < header->count; count++)
+  {
+    if (!read_entry (file, low + count, &entry))
+      goto bad_table;
+    if (entry.key != key_offset)
+      break;
+  }
+  profile->params = grub_malloc ((grub_size_t) count * PROFILE_PARAM_MAX);
+  if (!profile->params)
+    return 0;
+  for (grub_uint32_t i = 0; i < count; i++)
+    if (!read_entry (file, low + i, &entry)
+        || !read_string (file, header, entry.param, profile->params + (grub_size_t) i * PROFILE_PARAM_MAX))
+    {
+      hackbgrt_profile_free (profile);
+      goto bad_table;
+    }
+  profile->count = count;
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "profile: %u entries for '%s'\n", count, key);
+  return 1;
+bad_table:
+  grub_error (GRUB_ERR_BAD_FILE_TYPE, "HackBGRT: Bad profile table (%s)!\n", path);
+  return 0;
+}
+
+grub_err_t
+hackbgrt_profile_match (const char* path, struct hackbgrt_profile* profile)
+{
+  struct profile_header header;
+  grub_file_t file;
+  grub_off_t size;
+
+  grub_memset (profile, 0, sizeof (*profile));
+  file = grub_file_open (path, GRUB_FILE_TYPE_CAT);
+  if (!file)
+    return grub_error (GRUB_ERR_FILE_NOT_FOUND, "HackBGRT: Failed to load profile table (%s)!\n", path);
+  size = grub_file_size (file);
+  if (!read_at (file, 0, &header, sizeof (header))
+      || grub_memcmp (header.signature, PROFILE_MAGIC, PROFILE_MAGIC_SIZE) != 0
+      || header.strings_offset < sizeof (header) + (grub_off_t) header.count * sizeof (struct profile_entry)
+      || header.strings_offset + (grub_off_t) header.strings_size > size)
+  {
+    grub_file_close (file);
+    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "HackBGRT: Bad profile table (%s)!\n", path);
+  }
+  read_machine ();
+  grub_errno = GRUB_ERR_NONE;
+  if (!find_key (file, path, &header, system_key, profile) && grub_errno == GRUB_ERR_NONE
+      && !find_key (file, path, &header, board_key, profile) && grub_errno == GRUB_ERR_NONE
+      && !find_key (file, path, &header, PROFILE_KEY_DEFAULT, profile) && grub_errno == GRUB_ERR_NONE)
+    hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "profile: no entry for this machine in %s\n", path);
+  grub_file_close (file);
+  return grub_errno;
+}
+
+const char*
+hackbgrt_profile_param (const struct hackbgrt_profile* profile, grub_uint32_t i)
+{
+  return profile->params + (grub_size_t) i * PROFILE_PARAM_MAX;
+}
+
+void
+hackbgrt_profile_free (struct hackbgrt_profile* profile)
+{
+  grub_free (profile->params);
+  profile->params = 0;
+  profile->count = 0;
+}
+#else
+void
+hackbgrt_profile_init (void)
+{
+}
+
+grub_err_t
+hackbgrt_profile_match (const char* path __attribute__ ((unused)), struct hackbgrt_profile* profile)
+{
+  grub_memset (profile, 0, sizeof (*profile));
+  return hackbgrt_not_in_build ("profile=");
+}
+
+const char*
+hackbgrt_profile_param (const struct hackbgrt_profile* profile __attribute__ ((unused)),
+                        grub_uint32_t i __attribute__ ((unused)))
+{
+  return 0;
+}
+
+void
+hackbgrt_profile_free (struct hackbgrt_profile* profile)
+{
+  profile->params = 0;
+  profile->count = 0;
+}
+#endif
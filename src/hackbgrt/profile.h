@@ -0,0 +1,48 @@
+#pragma once
+
+#include <grub/err.h>
+#include <grub/types.h>
+#include "types.h"
+
+/**
+ * The image parameters of the machine, read from a profile table.
+ */
+struct hackbgrt_profile
+{
+  char* params;        // count parameters, PROFILE_PARAM_MAX bytes apart
+  grub_uint32_t count; // 0: no match and no default entry
+};
+
+/**
+ * Forget the SMBIOS identity of the machine, from GRUB_MOD_INIT.
+ */
+extern void
+hackbgrt_profile_init (void);
+
+/**
+ * Read a profile table and find the entries of the machine.
+ *
+ * The SMBIOS entry point is read on the first call only. The system
+ * (type 1) manufacturer and product are looked up first, then the baseboard
+ * (type 2) ones, then the default entry, each by a binary search on the
+ * hashes of the keys: only the probed entries and the parameters of the
+ * machine are read, not the whole table.
+ *
+ * @param path The table, with the ESP.
+ * @param profile Filled on success; release with hackbgrt_profile_free.
+ * @return GRUB_ERR_NONE, or the error also set in grub_errno.
+ */
+extern grub_err_t
+hackbgrt_profile_match (const char* path, struct hackbgrt_profile* profile);
+
+/**
+ * The image parameter of a matching entry, like image=/EFI/x.bmp,x=center.
+ *
+ * @param i From 0 to profile->count - 1.
+ * @return The parameter, valid until hackbgrt_profile_free.
+ */
+extern const char*
+hackbgrt_profile_param (const struct hackbgrt_profile* profile, grub_uint32_t i);
+
+extern void
+hackbgrt_profile_free (struct hackbgrt_profile* profile);
@@ -0,0 +1,311 @@
+#include <grub/err.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/types.h>
+#include "bmp.h"
+#include "parallel.h"
+#include "scale.h"
+#include "tier.h"
+#include "types.h"
+
+static const char* const scale_names[] = { "none", "fit", "fill", "2x", "3x" };
+
+int
+hackbgrt_parse_scale (const char* name, grub_size_t length)
+{
+  for (unsigned i = 0; i < ARRAY_SIZE (scale_names); i++)
+    if (grub_strlen (scale_names[i]) == length && grub_memcmp (name, scale_names[i], length) == 0)
+      return i;
+  return -1;
+}
+
+const char*
+hackbgrt_scale_name (enum hackbgrt_scale scale)
+{
+  return scale_names[scale];
+}
+
+#if HACKBGRT_WITH_SCALE
+void
+hackbgrt_scale_size (enum hackbgrt_scale scale, grub_uint32_t* width, grub_uint32_t* height,
+                     grub_uint32_t screen_width, grub_uint32_t screen_height)
+{
+  grub_uint64_t w = *width, h = *height;
+  switch (scale)
+  {
+    case HACKBGRT_SCALE_NONE:
+      return;
+    case HACKBGRT_SCALE_2X:
+    case HACKBGRT_SCALE_3X:
+      w *= scale == HACKBGRT_SCALE_2X ? 2 : 3;
+      h *= scale == HACKBGRT_SCALE_2X ? 2 : 3;
+      break;
+    case HACKBGRT_SCALE_FIT:
+      if (!screen_width || !screen_height)
+        return;
+      // bound by the height if the image is narrower than the screen
+      if (w * screen_height <= h * screen_width)
+      {
+        w = grub_divmod64 (w * screen_height + h / 2, h, 0);
+        h = screen_height;
+      }
+      else
+      {
+        h = grub_divmod64 (h * screen_width + w / 2, w, 0);
+        w = screen_width;
+      }
+      break;
+    case HACKBGRT_SCALE_FILL:
+      if (!screen_width || !screen_height)
+        return;
+      w = screen_width;
+      h = screen_height;
+      break;
+  }
+  *width = grub_max (w, 1);
+  *height = grub_max (h, 1);
+}
+
+/**
+ * Where each output column samples the source: the byte offset of its left
+ * neighbour and the 8-bit weight of the right one.
+ */
+struct column
+{
+  grub_uint32_t offset;
+  grub_uint32_t next; // offset of the right neighbour, the same one at the edge
+  grub_uint16_t weight;
+};
+
+/**
+ * Map output positions to source positions in 16.16 fixed point, pixel
+ * centers aligned.
+ *
+ * @return The 16.16 source position of the output position i.
+ */
+static inline grub_uint64_t
+source_position (grub_uint32_t i, grub_uint32_t out_size, grub_uint32_t first, grub_uint32_t size)
+{
+  grub_uint64_t twice = grub_divmod64 ((grub_uint64_t) (2 * i + 1) * size * 65536, out_size, 0);
+  return ((grub_uint64_t) first << 16) + (twice > 65536 ? (twice - 65536) / 2 : 0);
+}
+
+/** Horizontal pass: one source row to 8.8 fixed point channels. */
+static void
+interpolate_row (grub_uint16_t* out, const grub_uint8_t* src, const struct column* columns, grub_uint32_t width)
+{
+  for (grub_uint32_t x = 0; x < width; x++, out += 3)
+  {
+    const grub_uint8_t* a = src + columns[x].offset;
+    const grub_uint8_t* b = src + columns[x].next;
+    grub_uint32_t wb = columns[x].weight, wa = 256 - wb;
+    out[0] = a[0] * wa + b[0] * wb;
+    out[1] = a[1] * wa + b[1] * wb;
+    out[2] = a[2] * wa + b[2] * wb;
+  }
+}
+
+/** Vertical pass: blend two interpolated rows into an output row. */
+static void
+blend_rows (grub_uint8_t* dst, const grub_uint16_t* r0, const grub_uint16_t* r1, grub_uint32_t weight, grub_uint32_t count)
+{
+  grub_uint32_t w0 = 256 - weight;
+  for (grub_uint32_t i = 0; i < count; i++)
+    dst[i] = (r0[i] * w0 + r1[i] * weight + 32768) >> 16;
+}
+
+/** Output row of two identical source rows: blend_rows with r0 == r1. */
+static void
+narrow_row (grub_uint8_t* dst, const grub_uint16_t* r, grub_uint32_t count)
+{
+  for (grub_uint32_t i = 0; i < count; i++)
+    dst[i] = (r[i] + 128) >> 8;
+}
+
+/** Each source pixel repeated factor times. */
+static void
+replicate_row (grub_uint8_t* dst, const grub_uint8_t* src, grub_uint32_t width, unsigned factor)
+{
+  if (factor == 2)
+  {
+    for (grub_uint32_t x = 0; x < width; x++, src += 3, dst += 6)
+    {
+      dst[0] = dst[3] = src[0];
+      dst[1] = dst[4] = src[1];
+      dst[2] = dst[5] = src[2];
+    }
+    return;
+  }
+  for (grub_uint32_t x = 0; x < width; x++, src += 3)
+    for (unsigned k = 0; k < factor; k++, dst += 3)
+    {
+      dst[0] = src[0];
+      dst[1] = src[1];
+      dst[2] = src[2];
+    }
+}
+
+/**
+ * A scaling run, shared by the bands.
+ */
+struct scale_job
+{
+  const grub_uint8_t* src_pixels;
+  grub_uint8_t* dst_pixels;
+  grub_uint32_t src_stride;
+  grub_uint32_t dst_stride;
+  grub_uint32_t src_width;
+  grub_uint32_t width;
+  grub_uint32_t height;
+  grub_uint32_t x0, y0, w, h; // the source rectangle
+  unsigned factor;            // replication
+  const struct column* columns;
+  grub_uint16_t* rows;        // 2 interpolated rows per worker
+};
+
+/** Replication, over source rows. */
+static void
+replicate_band (void* context, unsigned worker __attribute__ ((unused)), grub_uint32_t first, grub_uint32_t count)
+{
+  const struct scale_job* job = context;
+  for (grub_uint32_t y = first; y < first + count; y++)
+  {
+    const grub_uint8_t* row = job->src_pixels + (grub_size_t) y * job->src_stride;
+    grub_uint8_t* out = job->dst_pixels + (grub_size_t) y * job->factor * job->dst_stride;
+    if (y > first && grub_memcmp (row - job->src_stride, row, 3 * job->src_width) == 0)
+      grub_memcpy (out, out - job->dst_stride, job->dst_stride);
+    else
+    {
+      replicate_row (out, row, job->src_width, job->factor);
+      grub_memset (out + 3 * job->width, 0, job->dst_stride - 3 * job->width);
+    }
+    for (unsigned k = 1; k < job->factor; k++)
+      grub_memcpy (out + (grub_size_t) k * job->dst_stride, out, job->dst_stride);
+  }
+}
+
+/** Bilinear filtering, over output rows. */
+static void
+filter_band (void* context, unsigned worker, grub_uint32_t first, grub_uint32_t count)
+{
+  const struct scale_job* job = context;
+  const grub_uint8_t* src_pixels = job->src_pixels;
+  grub_uint32_t src_stride = job->src_stride, x0 = job->x0, w = job->w;
+  grub_uint16_t* rows[2] = {
+    job->rows + (grub_size_t) 2 * worker * 3 * job->width,
+    job->rows + (grub_size_t) (2 * worker + 1) * 3 * job->width,
+  };
+  grub_int64_t cached[2] = { -1, -1 };
+  grub_int64_t flat_y = -1;
+  grub_uint32_t flat_top = 0;
+
+  for (grub_uint32_t y = first; y < first + count; y++)
+  {
+    grub_uint64_t pos = source_position (y, job->height, job->y0, job->h);
+    grub_uint32_t top = grub_min (pos >> 16, job->y0 + job->h - 1);
+    grub_uint32_t bottom = grub_min (top + 1, job->y0 + job->h - 1);
+    const grub_uint8_t* top_pixels = src_pixels + (grub_size_t) top * src_stride;
+    grub_uint8_t* dst_row = job->dst_pixels + (grub_size_t) y * job->dst_stride;
+    // splashes are mostly flat: two equal source rows give the row already built from their content
+    int flat = top == bottom || grub_memcmp (top_pixels + 3 * x0, src_pixels + (grub_size_t) bottom * src_stride + 3 * x0, 3 * w) == 0;
+    if (flat && flat_y >= 0
+        && (flat_top == top || grub_memcmp (src_pixels + (grub_size_t) flat_top * src_stride + 3 * x0, top_pixels + 3 * x0, 3 * w) == 0))
+    {
+      grub_memcpy (dst_row, job->dst_pixels + (grub_size_t) flat_y * job->dst_stride, job->dst_stride);
+      continue;
+    }
+    // keep the interpolated rows while the output walks between them
+    if (cached[0] != top)
+    {
+      if (cached[1] == top)
+      {
+        grub_uint16_t* t = rows[0];
+        rows[0] = rows[1];
+        rows[1] = t;
+        cached[0] = top;
+        cached[1] = -1;
+      }
+      else
+      {
+        interpolate_row (rows[0], top_pixels, job->columns, job->width);
+        cached[0] = top;
+      }
+    }
+    if (flat)
+    {
+      narrow_row (dst_row, rows[0], 3 * job->width);
+      flat_y = y;
+      flat_top = top;
+    }
+    else
+    {
+      if (cached[1] != bottom)
+      {
+        interpolate_row (rows[1], src_pixels + (grub_size_t) bottom * src_stride, job->columns, job->width);
+        cached[1] = bottom;
+      }
+      blend_rows (dst_row, rows[0], rows[1], (pos >> 8) & 0xff, 3 * job->width);
+    }
+    grub_memset (dst_row + 3 * job->width, 0, job->dst_stride - 3 * job->width);
+  }
+}
+
+grub_err_t
+hackbgrt_scale_bitmap (const bitmap_t src, bitmap_t dst, grub_uint32_t width, grub_uint32_t height, int crop)
+{
+  grub_uint32_t src_width = src->header.width, src_height = src->header.height;
+  struct scale_job job = {
+    .src_pixels = (const grub_uint8_t*) src + BMP_PIXEL_DATA_OFFSET,
+    .dst_pixels = (grub_uint8_t*) dst + BMP_PIXEL_DATA_OFFSET,
+    .src_stride = get_bitmap_pixels_size (src_width, 1),
+    .dst_stride = get_bitmap_pixels_size (width, 1),
+    .src_width = src_width,
+    .width = width,
+    .height = height,
+    .w = src_width,
+    .h = src_height,
+  };
+  struct column* columns;
+
+  hackbgrt_bmp_init_header (&dst->header, width, height);
+  if (crop)
+  {
+    // the largest centered source rectangle with the output aspect ratio
+    if ((grub_uint64_t) src_width * height > (grub_uint64_t) src_height * width)
+      job.w = grub_max (grub_divmod64 ((grub_uint64_t) src_height * width, height, 0), 1);
+    else
+      job.h = grub_max (grub_divmod64 ((grub_uint64_t) src_width * height, width, 0), 1);
+    job.x0 = (src_width - job.w) / 2;
+    job.y0 = (src_height - job.h) / 2;
+  }
+
+  if (!crop && width % src_width == 0 && height % src_height == 0 && width / src_width == height / src_height)
+  {
+    job.factor = width / src_width;
+    hackbgrt_parallel_rows (src_height, (grub_size_t) job.factor * job.dst_stride, replicate_band, &job);
+    return GRUB_ERR_NONE;
+  }
+
+  columns = grub_malloc (sizeof (*columns) * width);
+  job.rows = grub_malloc (sizeof (grub_uint16_t) * 2 * 3 * width * hackbgrt_parallel_workers ());
+  if (!columns || !job.rows)
+  {
+    grub_free (columns);
+    grub_free (job.rows);
+    return grub_errno;
+  }
+  for (grub_uint32_t x = 0; x < width; x++)
+  {
+    grub_uint64_t pos = source_position (x, width, job.x0, job.w);
+    grub_uint32_t left = grub_min (pos >> 16, job.x0 + job.w - 1);
+    columns[x].offset = 3 * left;
+    columns[x].next = 3 * grub_min (left + 1, job.x0 + job.w - 1);
+    columns[x].weight = (pos >> 8) & 0xff;
+  }
+  job.columns = columns;
+  hackbgrt_parallel_rows (height, job.dst_stride, filter_band, &job);
+  grub_free (columns);
+  grub_free (job.rows);
+  return GRUB_ERR_NONE;
+}
+#endif
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <grub/err.h>
+#include <grub/types.h>
+#include "types.h"
+
+/**
+ * How to size the image for the screen.
+ */
+enum hackbgrt_scale
+{
+  HACKBGRT_SCALE_NONE = 0, // as is
+  HACKBGRT_SCALE_FIT,      // as large as the screen allows, keeping the aspect ratio
+  HACKBGRT_SCALE_FILL,     // covering the whole screen, keeping the aspect ratio, cropped at the center
+  HACKBGRT_SCALE_2X,       // pixels doubled
+  HACKBGRT_SCALE_3X        // pixels tripled
+};
+
+/**
+ * Parse a scale name: none, fit, fill, 2x or 3x.
+ *
+ * @param name The name, not necessarily NUL-terminated.
+ * @param length Its length.
+ * @return The scale, or -1 if unknown.
+ */
+extern int
+hackbgrt_parse_scale (const char* name, grub_size_t length);
+
+extern const char*
+hackbgrt_scale_name (enum hackbgrt_scale scale);
+
+/**
+ * Compute the size of the scaled image.
+ *
+ * @param scale The scale.
+ * @param width The source width, updated.
+ * @param height The source height, updated.
+ * @param screen_width The GOP resolution; FIT and FILL keep the size if 0.
+ * @param screen_height
+ */
+extern void
+hackbgrt_scale_size (enum hackbgrt_scale scale, grub_uint32_t* width, grub_uint32_t* height,
+                     grub_uint32_t screen_width, grub_uint32_t screen_height);
+
+/**
+ * Resample a bitmap into another one of a given size.
+ *
+ * Integer only and row by row: two horizontally interpolated source rows are
+ * kept and blended for each output row (bilinear, 8-bit weights). When the
+ * output is an exact multiple of the whole source, pixels are replicated and
+ * each row built once is copied to the following ones. Output rows whose
+ * source rows match the ones of an earlier row are copied from it.
+ *
+ * @param src The source bitmap.
+ * @param dst The output, get_bitmap_total_size (width, height) bytes; its header is filled.
+ * @param width The output width.
+ * @param height The output height.
+ * @param crop 1 to take the center of the source with the aspect ratio of the output (FILL).
+ * @return GRUB_ERR_NONE, or GRUB_ERR_OUT_OF_MEMORY.
+ */
+extern grub_err_t
+hackbgrt_scale_bitmap (const bitmap_t src, bitmap_t dst, grub_uint32_t width, grub_uint32_t height, int crop);
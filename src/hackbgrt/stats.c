@@ -0,0 +1,132 @@
+#include <grub/env.h>
+#include <grub/misc.h>
+#include <grub/time.h>
+#include <grub/types.h>
+#if defined (__i386__) || defined (__x86_64__)
+#include <grub/i386/tsc.h>
+#define HACKBGRT_STATS_TSC 1
+#endif
+#include "alloc.h"
+#include "io.h"
+#include "stats.h"
+#include "tier.h"
+
+static const char* const phase_names[HACKBGRT_PHASES] = {
+  "config", "acpi_scan", "gop", "gallery", "load", "fit", "acpi_commit", "total",
+};
+
+static grub_uint64_t ticks[HACKBGRT_PHASES];
+static grub_uint64_t xsdt_entries;
+// the counters of the other modules when the run began
+static grub_uint64_t bytes_before;
+static struct hackbgrt_alloc_stats alloc_before;
+static struct hackbgrt_stats last;
+
+grub_uint64_t
+hackbgrt_stats_now (void)
+{
+#ifdef HACKBGRT_STATS_TSC
+  // GRUB calibrated the TSC at boot, unless it keeps time some other way
+  if (grub_tsc_rate)
+    return grub_get_tsc ();
+#endif
+  return grub_get_time_ms ();
+}
+
+grub_uint64_t
+hackbgrt_stats_us (grub_uint64_t ticks)
+{
+#ifdef HACKBGRT_STATS_TSC
+  // grub_tsc_rate is in ms per 2^32 ticks: split the ticks as GRUB's own clock does
+  if (grub_tsc_rate)
+    return (ticks >> 32) * grub_tsc_rate * 1000 + (((ticks & 0xffffffff) * grub_tsc_rate * 1000) >> 32);
+#endif
+  return ticks * 1000;
+}
+
+void
+hackbgrt_stats_init (void)
+{
+  hackbgrt_stats_begin ();
+  grub_memset (&last, 0, sizeof (last));
+}
+
+static grub_uint64_t
+io_bytes (void)
+{
+  grub_uint64_t bytes = 0;
+  for (int backend = 0; backend < HACKBGRT_IO_BACKENDS; backend++)
+  {
+    struct hackbgrt_io_stats io;
+    hackbgrt_io_get_stats (backend, &io);
+    bytes += io.bytes;
+  }
+  return bytes;
+}
+
+void
+hackbgrt_stats_begin (void)
+{
+  grub_memset (ticks, 0, sizeof (ticks));
+  xsdt_entries = 0;
+  bytes_before = io_bytes ();
+  hackbgrt_alloc_get_stats (&alloc_before);
+}
+
+void
+hackbgrt_stats_add (enum hackbgrt_stats_phase phase, grub_uint64_t start)
+{
+  ticks[phase] += hackbgrt_stats_now () - start;
+}
+
+void
+hackbgrt_stats_count_xsdt (grub_uint64_t entries)
+{
+  xsdt_entries += entries;
+}
+
+static void
+set_env (const char* name, const char* suffix, grub_uint64_t value)
+{
+  char var[48], buf[24];
+  grub_snprintf (var, sizeof (var), "hackbgrt_%s%s", name, suffix);
+  grub_snprintf (buf, sizeof (buf), "%llu", (unsigned long long) value);
+  grub_env_set (var, buf);
+}
+
+void
+hackbgrt_stats_end (void)
+{
+  struct hackbgrt_alloc_stats alloc;
+
+  for (int phase = 0; phase < HACKBGRT_PHASES; phase++)
+    last.us[phase] = hackbgrt_stats_us (ticks[phase]);
+  last.bytes_read = io_bytes () - bytes_before;
+  hackbgrt_alloc_get_stats (&alloc);
+  last.allocations = alloc.allocated - alloc_before.allocated;
+  last.allocated_bytes = alloc.allocated_bytes - alloc_before.allocated_bytes;
+  last.xsdt_entries = xsdt_entries;
+  for (int phase = 0; phase < HACKBGRT_PHASES; phase++)
+  {
+    set_env (phase_names[phase], "_ms", grub_divmod64 (last.us[phase], 1000, 0));
+    set_env (phase_names[phase], "_us", last.us[phase]);
+  }
+  set_env ("bytes_read", "", last.bytes_read);
+  set_env ("allocations", "", last.allocations);
+  set_env ("xsdt_entries", "", last.xsdt_entries);
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "stats: %llu us, %llu bytes read, %u allocations, %llu XSDT entries\n",
+                  (unsigned long long) last.us[HACKBGRT_PHASE_TOTAL], (unsigned long long) last.bytes_read,
+                  last.allocations, (unsigned long long) last.xsdt_entries);
+}
+
+void
+hackbgrt_stats_get (struct hackbgrt_stats* stats)
+{
+  *stats = last;
+}
+
+const char*
+hackbgrt_stats_phase_name (enum hackbgrt_stats_phase phase)
+{
+  return phase_names[phase];
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <grub/types.h>
+
+/**
+ * The timed phases of a hackbgrt run.
+ */
+enum hackbgrt_stats_phase
+{
+  HACKBGRT_PHASE_CONFIG = 0,  // parsing the arguments, profile table included
+  HACKBGRT_PHASE_ACPI_SCAN,   // indexing the RSDPs and XSDTs
+  HACKBGRT_PHASE_GOP,         // probing the screen resolution
+  HACKBGRT_PHASE_GALLERY,     // drawing the image of a gallery
+  HACKBGRT_PHASE_LOAD,        // opening, reading and decoding the image, or finding it in the cache
+  HACKBGRT_PHASE_FIT,         // scaling and trimming
+  HACKBGRT_PHASE_ACPI_COMMIT, // writing the XSDTs, releasing the old bitmaps
+  HACKBGRT_PHASE_TOTAL,       // the whole run, the time between a deferred command and the boot excluded
+  HACKBGRT_PHASES
+};
+
+/**
+ * What the last run cost.
+ */
+struct hackbgrt_stats
+{
+  grub_uint64_t us[HACKBGRT_PHASES];
+  grub_uint64_t bytes_read;       // through the I/O backends
+  grub_uint32_t allocations;      // ACPI reclaim page allocations for bitmaps
+  grub_uint64_t allocated_bytes;
+  grub_uint64_t xsdt_entries;     // XSDT entries read, by the scan and the commit
+};
+
+/**
+ * Clear the figures, from GRUB_MOD_INIT.
+ */
+extern void
+hackbgrt_stats_init (void);
+
+/**
+ * Forget the last run, at the start of a command.
+ */
+extern void
+hackbgrt_stats_begin (void);
+
+/**
+ * The current time, in ticks of the TSC where GRUB calibrated one, in ms elsewhere.
+ */
+extern grub_uint64_t
+hackbgrt_stats_now (void);
+
+/**
+ * Convert a difference of hackbgrt_stats_now to microseconds.
+ */
+extern grub_uint64_t
+hackbgrt_stats_us (grub_uint64_t ticks);
+
+/**
+ * Add the time elapsed since start to a phase.
+ *
+ * @param start A value of hackbgrt_stats_now.
+ */
+extern void
+hackbgrt_stats_add (enum hackbgrt_stats_phase phase, grub_uint64_t start);
+
+extern void
+hackbgrt_stats_count_xsdt (grub_uint64_t entries);
+
+/**
+ * Close the run: count the bytes read and the allocations since
+ * hackbgrt_stats_begin, and publish the figures as GRUB environment
+ * variables: hackbgrt_<phase>_ms and _us, hackbgrt_bytes_read,
+ * hackbgrt_allocations and hackbgrt_xsdt_entries.
+ */
+extern void
+hackbgrt_stats_end (void);
+
+extern void
+hackbgrt_stats_get (struct hackbgrt_stats* stats);
+
+/**
+ * The name of a phase, as in the environment variables.
+ */
+extern const char*
+hackbgrt_stats_phase_name (enum hackbgrt_stats_phase phase);
@@ -0,0 +1,128 @@
+#include <grub/efi/api.h>
+#include <grub/efi/efi.h>
+#include <grub/err.h>
+#include <grub/misc.h>
+#include <grub/types.h>
+#include "builtin.h"
+#include "io.h"
+#include "stats.h"
+#include "telemetry.h"
+#include "tier.h"
+
+// 1c8a1ba4-5b0f-4cf5-9d3e-4a6f7b2c8e91, TELEMETRY_GUID_STRING
+#define HACKBGRT_TELEMETRY_GUID \
+  { 0x1c8a1ba4, 0x5b0f, 0x4cf5, { 0x9d, 0x3e, 0x4a, 0x6f, 0x7b, 0x2c, 0x8e, 0x91 } }
+
+static struct telemetry_record record;
+// the message of record.error, gone once printed
+static char message[GRUB_MAX_ERRMSG];
+
+void
+hackbgrt_telemetry_begin (void)
+{
+  grub_memset (&record, 0, sizeof (record));
+  message[0] = '\0';
+}
+
+void
+hackbgrt_telemetry_error (grub_err_t err)
+{
+  if (err == GRUB_ERR_NONE)
+    return;
+  // only budget= raises a timeout
+  if (err == GRUB_ERR_TIMEOUT)
+    record.flags |= TELEMETRY_FLAG_OUT_OF_BUDGET;
+  if (!record.error_count++)
+  {
+    record.error = err;
+    grub_size_t len = grub_strlen (grub_errmsg);
+    // without the newline of the HackBGRT messages, as a variable
+    if (len && grub_errmsg[len - 1] == '\n')
+      len--;
+    len = grub_min (len, sizeof (message) - 1);
+    grub_memcpy (message, grub_errmsg, len);
+    message[len] = '\0';
+  }
+}
+
+const char*
+hackbgrt_telemetry_message (void)
+{
+  return record.error_count ? message : 0;
+}
+
+void
+hackbgrt_telemetry_screen (grub_uint32_t width, grub_uint32_t height)
+{
+  record.screen_width = width;
+  record.screen_height = height;
+}
+
+#if HACKBGRT_WITH_DIAGNOSTICS
+grub_err_t
+hackbgrt_telemetry_write (hackbgrt_config_t config, grub_acpi_bgrt_t bgrt)
+{
+  static grub_efi_guid_t guid = HACKBGRT_TELEMETRY_GUID;
+  grub_efi_char16_t name[sizeof (TELEMETRY_VARIABLE)];
+  struct hackbgrt_stats stats;
+  enum hackbgrt_io_backend backend = config->io_backend;
+  grub_efi_status_t status;
+
+  COMPILE_TIME_ASSERT (TELEMETRY_PHASES == HACKBGRT_PHASES);
+  grub_memcpy (record.signature, TELEMETRY_MAGIC, TELEMETRY_MAGIC_SIZE);
+  record.version = TELEMETRY_VERSION;
+  record.size = sizeof (record);
+  hackbgrt_stats_get (&stats);
+  for (int phase = 0; phase < TELEMETRY_PHASES; phase++)
+    record.us[phase] = (grub_uint32_t) grub_min (stats.us[phase], 0xffffffffULL);
+  record.bytes_read = stats.bytes_read;
+  record.allocations = stats.allocations;
+  record.xsdt_entries = (grub_uint32_t) grub_min (stats.xsdt_entries, 0xffffffffULL);
+  record.action = config->action;
+  record.image_index = config->action == HACKBGRT_REPLACE ? config->image_index : TELEMETRY_NO_IMAGE;
+  if (backend == HACKBGRT_IO_AUTO)
+    backend = hackbgrt_io_auto_choice ();
+  record.io_backend = backend;
+  record.flags = (config->deferred ? TELEMETRY_FLAG_DEFERRED : 0)
+               | (config->image_gallery ? TELEMETRY_FLAG_GALLERY : 0)
+               | (config->image_path && grub_strcmp (config->image_path, HACKBGRT_BUILTIN_PATH) == 0
+                  ? TELEMETRY_FLAG_BUILTIN : 0)
+               | (config->screen_width ? TELEMETRY_FLAG_SCREEN_GIVEN : 0)
+               | (config->parallel ? TELEMETRY_FLAG_PARALLEL : 0)
+               | (config->image_overlay ? TELEMETRY_FLAG_OVERLAY : 0)
+               | (record.flags & TELEMETRY_FLAG_OUT_OF_BUDGET);
+  if (bgrt && bgrt->image_address)
+  {
+    bitmap_t bmp = (bitmap_t) (grub_addr_t) bgrt->image_address;
+    record.image_address = bgrt->image_address;
+    record.image_size = bmp->header.size;
+    record.image_offset_x = bgrt->image_offset_x;
+    record.image_offset_y = bgrt->image_offset_y;
+  }
+  // the variable name is ASCII
+  for (grub_size_t i = 0; i < sizeof (TELEMETRY_VARIABLE); i++)
+    name[i] = TELEMETRY_VARIABLE[i];
+  // volatile: gone at the next boot, but readable by the OS through the runtime services
+  status = efi_call_5 (grub_efi_system_table->runtime_services->set_variable, name, &guid,
+                       GRUB_EFI_VARIABLE_BOOTSERVICE_ACCESS | GRUB_EFI_VARIABLE_RUNTIME_ACCESS,
+                       sizeof (record), &record);
+  if (status != GRUB_EFI_SUCCESS)
+    return grub_error (GRUB_ERR_IO, "HackBGRT: Failed to write the telemetry variable (%s)!\n", TELEMETRY_VARIABLE);
+  hackbgrt_trace (HACKBGRT_TRACE_RESULTS, "telemetry: %u bytes written to %s-%s\n", (unsigned) sizeof (record),
+                  TELEMETRY_VARIABLE, TELEMETRY_GUID_STRING);
+  return GRUB_ERR_NONE;
+}
+#else
+grub_err_t
+hackbgrt_telemetry_write (hackbgrt_config_t config __attribute__ ((unused)),
+                          grub_acpi_bgrt_t bgrt __attribute__ ((unused)))
+{
+  return hackbgrt_not_in_build ("--telemetry");
+}
+#endif
+
+void
+hackbgrt_telemetry_get (struct telemetry_record* copy)
+{
+  *copy = record;
+}
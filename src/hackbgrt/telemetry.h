@@ -0,0 +1,49 @@
+#pragma once
+
+#include <grub/err.h>
+#include <grub/types.h>
+#include "config.h"
+#include "types.h"
+
+/**
+ * Start the record of a run, along with hackbgrt_stats_begin.
+ */
+extern void
+hackbgrt_telemetry_begin (void);
+
+/**
+ * Note an error of the run before it is printed: the first one is kept,
+ * all are counted.
+ */
+extern void
+hackbgrt_telemetry_error (grub_err_t err);
+
+/**
+ * The message of the first error of the run, which outlives its printing,
+ * or 0 if there was none.
+ */
+extern const char*
+hackbgrt_telemetry_message (void);
+
+/**
+ * Note the screen resolution the run used.
+ */
+extern void
+hackbgrt_telemetry_screen (grub_uint32_t width, grub_uint32_t height);
+
+/**
+ * Complete the record with the stats of the run, the configuration and
+ * the BGRT left, and write it to the volatile TELEMETRY_VARIABLE, which the
+ * OS reads from its EFI variables.
+ *
+ * @param bgrt The BGRT now published, or 0.
+ * @return GRUB_ERR_NONE, or the error also set in grub_errno.
+ */
+extern grub_err_t
+hackbgrt_telemetry_write (hackbgrt_config_t config, grub_acpi_bgrt_t bgrt);
+
+/**
+ * The record last written.
+ */
+extern void
+hackbgrt_telemetry_get (struct telemetry_record* record);
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <grub/err.h>
+#include <grub/misc.h>
+
+/*
+ * What hackbgrt.mod is built with, chosen by TIER= in the top-level
+ * Makefile, which passes -DHACKBGRT_TIER=... (and -DHACKBGRT_TRACE_LEVEL=...
+ * with TRACE=) through the cflags of the module. Any HACKBGRT_WITH_* can
+ * also be given on its own. A parameter or an option left out of the build
+ * is refused when it is read, with hackbgrt_not_in_build.
+ *
+ * The host bench and the tools build the full tier.
+ */
+#define HACKBGRT_TIER_MINIMAL  0 // 24-bit BMPs, image=keep|remove, x, y, weight, seed, screen, budget, --defer, --stats
+#define HACKBGRT_TIER_STANDARD 1 // + other BMP encodings, PNG, .bmz, packs, galleries, scale, trim, overlays, --io
+#define HACKBGRT_TIER_FULL     2 // + image=builtin, profiles, --parallel, --cache-stats, --telemetry
+
+#ifndef HACKBGRT_TIER
+#define HACKBGRT_TIER HACKBGRT_TIER_FULL
+#endif
+
+#define HACKBGRT_TIER_NAME \
+  (HACKBGRT_TIER == HACKBGRT_TIER_MINIMAL ? "minimal" : HACKBGRT_TIER == HACKBGRT_TIER_STANDARD ? "standard" : "full")
+
+// decoders
+#ifndef HACKBGRT_WITH_CONVERT
+#define HACKBGRT_WITH_CONVERT (HACKBGRT_TIER >= HACKBGRT_TIER_STANDARD) // BMPs other than 24-bit bottom-up
+#endif
+#ifndef HACKBGRT_WITH_PNG
+#define HACKBGRT_WITH_PNG (HACKBGRT_TIER >= HACKBGRT_TIER_STANDARD)
+#endif
+#ifndef HACKBGRT_WITH_BMZ
+#define HACKBGRT_WITH_BMZ (HACKBGRT_TIER >= HACKBGRT_TIER_STANDARD) // .bmz, and the LZ4 decoder
+#endif
+#ifndef HACKBGRT_WITH_PACK
+#define HACKBGRT_WITH_PACK (HACKBGRT_TIER >= HACKBGRT_TIER_STANDARD)
+#endif
+#ifndef HACKBGRT_WITH_BUILTIN
+#define HACKBGRT_WITH_BUILTIN (HACKBGRT_TIER >= HACKBGRT_TIER_FULL)
+#endif
+
+// selection modes and image processing
+#ifndef HACKBGRT_WITH_GALLERY
+#define HACKBGRT_WITH_GALLERY (HACKBGRT_TIER >= HACKBGRT_TIER_STANDARD)
+#endif
+#ifndef HACKBGRT_WITH_PROFILE
+#define HACKBGRT_WITH_PROFILE (HACKBGRT_TIER >= HACKBGRT_TIER_FULL)
+#endif
+#ifndef HACKBGRT_WITH_SCALE
+#define HACKBGRT_WITH_SCALE (HACKBGRT_TIER >= HACKBGRT_TIER_STANDARD) // scale= and trim=
+#endif
+#ifndef HACKBGRT_WITH_OVERLAY
+#define HACKBGRT_WITH_OVERLAY (HACKBGRT_TIER >= HACKBGRT_TIER_STANDARD)
+#endif
+#ifndef HACKBGRT_WITH_PARALLEL
+#define HACKBGRT_WITH_PARALLEL (HACKBGRT_TIER >= HACKBGRT_TIER_FULL)
+#endif
+#ifndef HACKBGRT_WITH_IO
+#define HACKBGRT_WITH_IO (HACKBGRT_TIER >= HACKBGRT_TIER_STANDARD) // --io=efi|blocklist|auto
+#endif
+
+// diagnostics
+#ifndef HACKBGRT_WITH_DIAGNOSTICS
+#define HACKBGRT_WITH_DIAGNOSTICS (HACKBGRT_TIER >= HACKBGRT_TIER_FULL) // --cache-stats and --telemetry
+#endif
+
+/*
+ * The grub_dprintf traces ("set debug=hackbgrt") kept in the build. Those
+ * above the level are compiled out with their format strings, and their
+ * arguments are not evaluated.
+ */
+#define HACKBGRT_TRACE_NONE    0
+#define HACKBGRT_TRACE_RESULTS 1 // what a run found and chose: the image, the cache, the tables, the backends
+#define HACKBGRT_TRACE_STEPS   2 // every step on the way
+
+// by default: none in the minimal tier, the results in the standard one, the steps in the full one
+#ifndef HACKBGRT_TRACE_LEVEL
+#define HACKBGRT_TRACE_LEVEL HACKBGRT_TIER
+#endif
+
+#define hackbgrt_trace(level, ...) \
+  do { if (HACKBGRT_TRACE_LEVEL >= (level)) grub_dprintf ("hackbgrt", __VA_ARGS__); } while (0)
+
+/**
+ * Refuse a feature left out of this build.
+ *
+ * @param what The feature, as the user wrote it.
+ * @return The error, also set in grub_errno.
+ */
+#define hackbgrt_not_in_build(what) \
+  grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET, "HackBGRT: %s is not in this build (tier %s)!\n", (what), HACKBGRT_TIER_NAME)
@@ -12,7 +12,9 @@ void
 set_acpi_rsdp2_checksums (void* data)
 {
   struct grub_acpi_rsdp_v20* rsdp = (struct grub_acpi_rsdp_v20*) data;
+  rsdp->rsdpv1.checksum = 0;
   rsdp->rsdpv1.checksum = -grub_byte_checksum(data, sizeof (rsdp->rsdpv1));
+  rsdp->checksum = 0;
   rsdp->checksum = -grub_byte_checksum(data, rsdp->length);
 }
 
@@ -27,5 +29,6 @@ void
 set_acpi_sdt_checksum (void* data)
 {
   struct grub_acpi_table_header* acpi_table_header = (struct grub_acpi_table_header*) data;
+  acpi_table_header->checksum = 0;
   acpi_table_header->checksum = -grub_byte_checksum(data, acpi_table_header->length);
 }
@@ -54,16 +54,154 @@ typedef struct bitmap_header* bitmap_header_t;
 #define BMP_DIB_HEADER_SIZE   40
 #define BMP_888_BPP           24
 #define BMP_NO_COMPRESSION    0
+#define BMP_RLE8              1
+#define BMP_RLE4              2
+#define BMP_BITFIELDS         3
+#define BMP_ALPHABITFIELDS    6
 #define BMP_72_DPI            2835
 #define BMP_NO_PALETTE        0
 
+/** Compressed splash container (.bmz) */
+// a whole bitmap file compressed as one raw LZ4 block, written by tools/hackbgrt-bmz
+// all int are in little endian format
+struct splash_header {
+    grub_uint8_t signature[4]; // HBZ1
+    grub_uint32_t codec; // SPLASH_CODEC_LZ4
+    grub_uint32_t bmp_size; // size of the decompressed bitmap file
+    grub_uint32_t payload_size; // size of the compressed data following this header
+} GRUB_PACKED;
+typedef struct splash_header* splash_header_t;
+
+#define SPLASH_MAGIC        "HBZ1"
+#define SPLASH_MAGIC_SIZE   (sizeof (SPLASH_MAGIC) - 1)
+#define SPLASH_CODEC_LZ4    1
+#define SPLASH_MAX_BMP_SIZE (256 * 1024 * 1024) // sanity limit for bmp_size
+
+/** Multi-resolution splash pack (.bpk) */
+// a fixed-size index, then the variants, each a whole BMP or .bmz file, written by tools/hackbgrt-pack
+// all int are in little endian format
+struct splash_pack_entry {
+    grub_uint32_t screen_width; // screen resolution the variant is drawn for, 0x0 = any screen
+    grub_uint32_t screen_height;
+    grub_uint32_t offset; // from the start of the pack
+    grub_uint32_t length;
+    grub_uint32_t format; // SPLASH_FORMAT_*
+} GRUB_PACKED;
+
+#define SPLASH_PACK_MAGIC       "HBPK"
+#define SPLASH_PACK_MAGIC_SIZE  (sizeof (SPLASH_PACK_MAGIC) - 1)
+#define SPLASH_PACK_MAX_ENTRIES 16
+#define SPLASH_PACK_ALIGN       4096 // variants start on a cluster boundary
+#define SPLASH_FORMAT_BMP       0
+#define SPLASH_FORMAT_BMZ       1
+
+struct splash_pack_header {
+    grub_uint8_t signature[4]; // HBPK
+    grub_uint32_t count; // used entries
+    struct splash_pack_entry entries[SPLASH_PACK_MAX_ENTRIES];
+} GRUB_PACKED;
+
+/** Fleet profile table (profile=) */
+// SMBIOS identities mapped to image parameters, written by tools/hackbgrt-profile
+// all int are in little endian format
+struct profile_header {
+    grub_uint8_t signature[4]; // HBPF
+    grub_uint32_t count; // entries, following this header
+    grub_uint32_t strings_offset; // NUL-terminated strings, from the start of the table
+    grub_uint32_t strings_size;
+} GRUB_PACKED;
+
+struct profile_entry {
+    grub_uint64_t hash; // profile_key_hash of the key; the entries are sorted by hash, then key
+    grub_uint32_t key; // offset in the strings, see PROFILE_KEY_*; shared by the entries of a key
+    grub_uint32_t param; // offset in the strings: image=...[,x=...][,y=...][,weight=...]
+} GRUB_PACKED;
+
+#define PROFILE_MAGIC         "HBPF"
+#define PROFILE_MAGIC_SIZE    (sizeof (PROFILE_MAGIC) - 1)
+#define PROFILE_PARAM_MAX     256 // longest key or parameter, NUL included
+#define PROFILE_KEY_SYSTEM    "system"   // system\tMANUFACTURER\tPRODUCT, SMBIOS type 1
+#define PROFILE_KEY_BOARD     "board"    // board\tMANUFACTURER\tPRODUCT, SMBIOS type 2
+#define PROFILE_KEY_DEFAULT   "default"  // any other machine
+
+/** 64-bit FNV-1a of a profile key. */
+static inline grub_uint64_t
+profile_key_hash (const char* key)
+{
+    grub_uint64_t hash = 0xcbf29ce484222325ULL;
+    for (; *key; key++)
+        hash = (hash ^ (grub_uint8_t) *key) * 0x100000001b3ULL;
+    return hash;
+}
+
+/** Header of an SMBIOS structure, followed by its formatted area then its strings */
+// https://www.dmtf.org/standards/smbios; the entry points are GRUB's, from <grub/smbios.h>
+struct smbios_header {
+    grub_uint8_t type;
+    grub_uint8_t length; // of the formatted area, header included
+    grub_uint16_t handle;
+} GRUB_PACKED;
+
+#define SMBIOS_ANCHOR            "_SM_"
+#define SMBIOS3_ANCHOR           "_SM3_"
+#define SMBIOS_TYPE_SYSTEM       1
+#define SMBIOS_TYPE_BASEBOARD    2
+#define SMBIOS_TYPE_END          127
+#define SMBIOS_MANUFACTURER      4 // string numbers in the formatted area of types 1 and 2
+#define SMBIOS_PRODUCT           5
+
+/** Boot telemetry (--telemetry) */
+// the cost and outcome of the last run, written to a volatile EFI variable for the OS,
+// read by tools/hackbgrt-telemetry
+// all int are in little endian format
+#define TELEMETRY_PHASES 8
+
+struct telemetry_record {
+    grub_uint8_t signature[4]; // HBTM
+    grub_uint16_t version; // TELEMETRY_VERSION
+    grub_uint16_t size; // of the record: a later version only appends fields
+    grub_uint32_t us[TELEMETRY_PHASES]; // config, acpi_scan, gop, gallery, load, fit, acpi_commit, total
+    grub_uint64_t bytes_read;
+    grub_uint32_t allocations; // ACPI reclaim page allocations for bitmaps
+    grub_uint32_t xsdt_entries;
+    grub_uint32_t image_index; // the drawn image parameter, profile entries first; TELEMETRY_NO_IMAGE if none
+    grub_uint8_t action; // 0 keep, 1 replace, 2 remove
+    grub_uint8_t io_backend; // 0 grub, 1 efi, 2 blocklist; 3 auto before it settled on one
+    grub_uint16_t flags; // TELEMETRY_FLAG_*
+    grub_uint64_t image_address; // of the BGRT left, 0 if there is none
+    grub_uint32_t image_size;
+    grub_uint32_t image_offset_x;
+    grub_uint32_t image_offset_y;
+    grub_uint32_t screen_width; // 0 if unknown
+    grub_uint32_t screen_height;
+    grub_uint32_t error; // the first GRUB error of the run, 0 if none
+    grub_uint32_t error_count;
+} GRUB_PACKED;
+
+#define TELEMETRY_MAGIC              "HBTM"
+#define TELEMETRY_MAGIC_SIZE         (sizeof (TELEMETRY_MAGIC) - 1)
+#define TELEMETRY_VERSION            1
+#define TELEMETRY_NO_IMAGE           0xffffffff
+#define TELEMETRY_FLAG_DEFERRED      0x0001 // applied from the preboot hook
+#define TELEMETRY_FLAG_GALLERY       0x0002
+#define TELEMETRY_FLAG_BUILTIN       0x0004
+#define TELEMETRY_FLAG_SCREEN_GIVEN  0x0008 // screen=, the GOP not probed
+#define TELEMETRY_FLAG_PARALLEL      0x0010
+#define TELEMETRY_FLAG_OUT_OF_BUDGET 0x0020 // budget= ran out, the BGRT kept or removed
+#define TELEMETRY_FLAG_OVERLAY       0x0040 // mode=overlay, on the firmware's logo
+#define TELEMETRY_VARIABLE           "HackBGRTTelemetry"
+#define TELEMETRY_GUID_STRING        "1c8a1ba4-5b0f-4cf5-9d3e-4a6f7b2c8e91"
+
+#define PNG_MAGIC      "\x89PNG\r\n\x1a\n"
+#define PNG_MAGIC_SIZE (sizeof (PNG_MAGIC) - 1)
+
 struct bitmap {
     struct bitmap_header header;
     grub_uint8_t* pixels;
 } GRUB_PACKED;
 typedef struct bitmap* bitmap_t;
 
-inline grub_uint32_t
+static inline grub_uint32_t
 get_bitmap_pixels_size (grub_uint32_t width, grub_uint32_t height)
 {
     // each row is padded to 4 bytes
@@ -71,7 +209,7 @@ get_bitmap_pixels_size (grub_uint32_t width, grub_uint32_t height)
     return (BMP_888_BPP / 8 * width + width % 4) * height;
 }
 
-inline grub_uint32_t
+static inline grub_uint32_t
 get_bitmap_total_size (grub_uint32_t width, grub_uint32_t height)
 {
     return BMP_PIXEL_DATA_OFFSET + get_bitmap_pixels_size (width, height);
@@ -0,0 +1,136 @@
+/*
+ * hackbgrt-bmz: convert a 24-bit BMP splash to the compressed container
+ * read by the hackbgrt module, and back.
+ *
+ *   hackbgrt-bmz [-d] INPUT OUTPUT
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <grub/types.h>
+#include "lz4.h"
+#include "lz4enc.h"
+#include "types.h"
+
+static uint8_t*
+read_file (const char* path, size_t* size)
+{
+  FILE* fp = fopen (path, "rb");
+  uint8_t* data = NULL;
+  long len;
+
+  if (!fp)
+    return NULL;
+  if (fseek (fp, 0, SEEK_END) == 0 && (len = ftell (fp)) >= 0 && fseek (fp, 0, SEEK_SET) == 0
+      && (data = malloc (len ? len : 1)) && fread (data, 1, len, fp) == (size_t) len)
+    *size = len;
+  else
+  {
+    free (data);
+    data = NULL;
+  }
+  fclose (fp);
+  return data;
+}
+
+static int
+write_file (const char* path, const uint8_t* data, size_t size)
+{
+  FILE* fp = fopen (path, "wb");
+
+  if (!fp)
+    return -1;
+  if (fwrite (data, 1, size, fp) != size)
+  {
+    fclose (fp);
+    return -1;
+  }
+  return fclose (fp);
+}
+
+static uint8_t*
+decode (const uint8_t* data, size_t size, size_t* out_size)
+{
+  struct splash_header header;
+  uint8_t* bmp;
+
+  if (size < sizeof (header))
+    return NULL;
+  memcpy (&header, data, sizeof (header));
+  if (memcmp (header.signature, SPLASH_MAGIC, SPLASH_MAGIC_SIZE) != 0
+      || header.codec != SPLASH_CODEC_LZ4
+      || header.bmp_size > SPLASH_MAX_BMP_SIZE
+      || header.payload_size != size - sizeof (header))
+    return NULL;
+  bmp = malloc (header.bmp_size ? header.bmp_size : 1);
+  if (bmp && hackbgrt_lz4_decode (data + sizeof (header), header.payload_size, bmp, header.bmp_size)
+             != (grub_ssize_t) header.bmp_size)
+  {
+    free (bmp);
+    return NULL;
+  }
+  *out_size = header.bmp_size;
+  return bmp;
+}
+
+static void
+usage (const char* prog)
+{
+  fprintf (stderr, "usage: %s [-d] INPUT OUTPUT\n"
+           "  Compress a 24-bit BMP into a .bmz splash container for hackbgrt.\n"
+           "  -d  decompress a .bmz back to BMP\n", prog);
+}
+
+int
+main (int argc, char** argv)
+{
+  int decompress = 0;
+  int opt;
+  size_t in_size, out_size;
+  uint8_t* in;
+  uint8_t* out;
+
+  while ((opt = getopt (argc, argv, "dh")) != -1)
+  {
+    switch (opt)
+    {
+      case 'd':
+        decompress = 1;
+        break;
+      default:
+        usage (argv[0]);
+        return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (argc - optind != 2)
+  {
+    usage (argv[0]);
+    return 2;
+  }
+  in = read_file (argv[optind], &in_size);
+  if (!in)
+  {
+    perror (argv[optind]);
+    return 1;
+  }
+  out = decompress ? decode (in, in_size, &out_size) : bmz_encode (in, in_size, &out_size);
+  if (!out)
+  {
+    fprintf (stderr, "%s: not a %s\n", argv[optind], decompress ? "valid splash container" : "BMP file");
+    free (in);
+    return 1;
+  }
+  if (write_file (argv[optind + 1], out, out_size) != 0)
+  {
+    perror (argv[optind + 1]);
+    free (in);
+    free (out);
+    return 1;
+  }
+  fprintf (stderr, "%s: %zu -> %zu bytes (%.1fx)\n", argv[optind], in_size, out_size,
+           decompress ? (double) out_size / in_size : (double) in_size / out_size);
+  free (in);
+  free (out);
+  return 0;
+}
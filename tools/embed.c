@@ -0,0 +1,192 @@
+/*
+ * hackbgrt-embed: turn a splash into the builtin_image.c linked into
+ * hackbgrt.mod, for image=builtin.
+ *
+ *   hackbgrt-embed [-z] IMAGE OUTPUT.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <grub/types.h>
+#include "lz4.h"
+#include "lz4enc.h"
+#include "types.h"
+
+static uint8_t*
+read_file (const char* path, size_t* size)
+{
+  FILE* fp = fopen (path, "rb");
+  uint8_t* data = NULL;
+  long len;
+
+  if (!fp)
+    return NULL;
+  if (fseek (fp, 0, SEEK_END) == 0 && (len = ftell (fp)) >= 0 && fseek (fp, 0, SEEK_SET) == 0
+      && (data = malloc (len ? len : 1)) && fread (data, 1, len, fp) == (size_t) len)
+    *size = len;
+  else
+  {
+    free (data);
+    data = NULL;
+  }
+  fclose (fp);
+  return data;
+}
+
+/**
+ * Decompress a .bmz container.
+ *
+ * @return The bitmap file, to free(), or NULL if the container is not valid.
+ */
+static uint8_t*
+decode (const uint8_t* data, size_t size, size_t* out_size)
+{
+  struct splash_header header;
+  uint8_t* bmp;
+
+  memcpy (&header, data, sizeof (header));
+  if (header.codec != SPLASH_CODEC_LZ4 || header.bmp_size > SPLASH_MAX_BMP_SIZE
+      || header.payload_size != size - sizeof (header))
+    return NULL;
+  bmp = malloc (header.bmp_size ? header.bmp_size : 1);
+  if (bmp && hackbgrt_lz4_decode (data + sizeof (header), header.payload_size, bmp, header.bmp_size)
+             != (grub_ssize_t) header.bmp_size)
+  {
+    free (bmp);
+    return NULL;
+  }
+  *out_size = header.bmp_size;
+  return bmp;
+}
+
+/**
+ * Check that a bitmap file can be published as is, like check_bmp_header of
+ * the module, which then copies it with no conversion.
+ *
+ * @return NULL, or what is wrong.
+ */
+static const char*
+check_bgrt_bitmap (const uint8_t* data, size_t size)
+{
+  struct bitmap_header header;
+
+  if (size < sizeof (header))
+    return "too short for a BMP";
+  memcpy (&header, data, sizeof (header));
+  if (memcmp (&header.signature, BMP_MAGIC, BMP_MAGIC_SIZE) != 0)
+    return "not a BMP";
+  if (header.pixel_data_offset != BMP_PIXEL_DATA_OFFSET || header.dib_header_size != BMP_DIB_HEADER_SIZE
+      || header.planes != 1 || header.bpp != BMP_888_BPP || header.compression != BMP_NO_COMPRESSION
+      || header.palette_colors != BMP_NO_PALETTE || header.important_colors != BMP_NO_PALETTE)
+    return "not a BGRT bitmap: a 24-bit BMP with a 40-byte header and no palette is expected";
+  if ((int32_t) header.width <= 0 || (int32_t) header.height <= 0)
+    return "not a bottom-up bitmap";
+  if (header.data_size < get_bitmap_pixels_size (header.width, header.height)
+      || header.size < BMP_PIXEL_DATA_OFFSET || header.data_size > header.size - BMP_PIXEL_DATA_OFFSET
+      || header.size > size)
+    return "truncated pixels or inconsistent sizes";
+  return NULL;
+}
+
+static void
+usage (const char* prog)
+{
+  fprintf (stderr, "usage: %s [-z] IMAGE OUTPUT.c\n"
+           "  Write the C source embedding a splash into hackbgrt.mod, for image=builtin.\n"
+           "  IMAGE is a 24-bit bottom-up BMP with a 40-byte header, or a .bmz of one.\n"
+           "  -z  compress a BMP with LZ4, decompressed at boot instead of copied\n", prog);
+}
+
+int
+main (int argc, char** argv)
+{
+  int compress = 0;
+  int opt;
+  size_t size, bmp_size;
+  uint8_t* data;
+  uint8_t* bmp;
+  const char* error;
+  struct bitmap_header header;
+  FILE* fp;
+
+  while ((opt = getopt (argc, argv, "zh")) != -1)
+  {
+    switch (opt)
+    {
+      case 'z':
+        compress = 1;
+        break;
+      default:
+        usage (argv[0]);
+        return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (argc - optind != 2)
+  {
+    usage (argv[0]);
+    return 2;
+  }
+  data = read_file (argv[optind], &size);
+  if (!data)
+  {
+    perror (argv[optind]);
+    return 1;
+  }
+  // the bitmap the module will publish
+  if (size >= sizeof (struct splash_header) && memcmp (data, SPLASH_MAGIC, SPLASH_MAGIC_SIZE) == 0)
+    bmp = decode (data, size, &bmp_size);
+  else
+  {
+    bmp = data;
+    bmp_size = size;
+  }
+  error = bmp ? check_bgrt_bitmap (bmp, bmp_size) : "not a valid splash container";
+  if (error)
+  {
+    fprintf (stderr, "%s: %s\n", argv[optind], error);
+    return 1;
+  }
+  memcpy (&header, bmp, sizeof (header));
+  // only the bitmap, not what may trail it in the file
+  size = bmp == data ? header.size : size;
+  if (compress && bmp == data)
+  {
+    data = bmz_encode (bmp, header.size, &size);
+    if (!data)
+    {
+      fprintf (stderr, "%s: out of memory\n", argv[optind]);
+      return 1;
+    }
+  }
+  if (size > UINT32_MAX)
+  {
+    fprintf (stderr, "%s: too large\n", argv[optind]);
+    return 1;
+  }
+  fp = fopen (argv[optind + 1], "w");
+  if (!fp)
+  {
+    perror (argv[optind + 1]);
+    return 1;
+  }
+  fprintf (fp, "/*\n"
+           " * The image of image=builtin: %s, %ux%u%s.\n"
+           " * Generated by tools/hackbgrt-embed; do not edit.\n"
+           " */\n"
+           "#include <grub/types.h>\n"
+           "#include \"builtin.h\"\n\n"
+           "const grub_uint8_t hackbgrt_builtin_image[] __attribute__ ((aligned (16))) = {\n",
+           argv[optind], header.width, header.height, bmp == data ? "" : ", LZ4-compressed");
+  for (size_t i = 0; i < size; i++)
+    fprintf (fp, "%s0x%02x,%s", i % 16 ? " " : "  ", data[i], i % 16 == 15 || i + 1 == size ? "\n" : "");
+  fprintf (fp, "};\nconst grub_uint32_t hackbgrt_builtin_image_size = %zu;\n", size);
+  if (fclose (fp) != 0)
+  {
+    perror (argv[optind + 1]);
+    return 1;
+  }
+  fprintf (stderr, "%s: %ux%u, %zu bytes embedded%s\n", argv[optind], header.width, header.height, size,
+           bmp == data ? "" : " compressed");
+  return 0;
+}
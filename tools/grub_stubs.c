@@ -0,0 +1,67 @@
+/*
+ * The few GRUB services the module's bitmap code calls, for the host tools
+ * that link it: plain malloc, errors kept in grub_errmsg, serial kernels.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <grub/err.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/types.h>
+#include "parallel.h"
+
+grub_err_t grub_errno;
+char grub_errmsg[GRUB_MAX_ERRMSG];
+
+grub_err_t
+grub_error (grub_err_t n, const char* fmt, ...)
+{
+  va_list ap;
+  va_start (ap, fmt);
+  vsnprintf (grub_errmsg, sizeof (grub_errmsg), fmt, ap);
+  va_end (ap);
+  grub_errno = n;
+  return n;
+}
+
+void
+grub_real_dprintf (const char* file, const int line, const char* condition, const char* fmt, ...)
+{
+}
+
+void*
+grub_malloc (grub_size_t size)
+{
+  void* p = malloc (size ? size : 1);
+  if (!p)
+    grub_error (GRUB_ERR_OUT_OF_MEMORY, "out of memory");
+  return p;
+}
+
+void*
+grub_zalloc (grub_size_t size)
+{
+  void* p = calloc (1, size ? size : 1);
+  if (!p)
+    grub_error (GRUB_ERR_OUT_OF_MEMORY, "out of memory");
+  return p;
+}
+
+void
+grub_free (void* p)
+{
+  free (p);
+}
+
+unsigned
+hackbgrt_parallel_workers (void)
+{
+  return 1;
+}
+
+void
+hackbgrt_parallel_rows (grub_uint32_t rows, grub_size_t row_bytes, hackbgrt_parallel_band_t band, void* context)
+{
+  band (context, 0, 0, rows);
+}
@@ -0,0 +1,127 @@
+/*
+ * LZ4 block encoder and splash container writer, for the host tools only;
+ * the module carries the decoder (src/hackbgrt/lz4.c).
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <grub/types.h>
+#include "lz4enc.h"
+#include "types.h"
+
+#define MIN_MATCH     4
+#define LAST_LITERALS 5
+#define MF_LIMIT      12
+#define MAX_OFFSET    65535
+#define HASH_BITS     16
+
+static inline uint32_t
+read32 (const uint8_t* p)
+{
+  uint32_t v;
+  memcpy (&v, p, sizeof (v));
+  return v;
+}
+
+static inline uint32_t
+hash32 (uint32_t v)
+{
+  return (v * 2654435761U) >> (32 - HASH_BITS);
+}
+
+static uint8_t*
+put_length (uint8_t* op, size_t len)
+{
+  for (; len >= 255; len -= 255)
+    *op++ = 255;
+  *op++ = (uint8_t) len;
+  return op;
+}
+
+static uint8_t*
+put_sequence (uint8_t* op, const uint8_t* literals, size_t literal_len, size_t offset, size_t match_len)
+{
+  uint8_t* token = op++;
+  *token = (uint8_t) ((literal_len < 15 ? literal_len : 15) << 4);
+  if (literal_len >= 15)
+    op = put_length (op, literal_len - 15);
+  memcpy (op, literals, literal_len);
+  op += literal_len;
+  if (!match_len)
+    return op;
+  *op++ = (uint8_t) offset;
+  *op++ = (uint8_t) (offset >> 8);
+  match_len -= MIN_MATCH;
+  *token |= (uint8_t) (match_len < 15 ? match_len : 15);
+  if (match_len >= 15)
+    op = put_length (op, match_len - 15);
+  return op;
+}
+
+size_t
+lz4_encode (const uint8_t* src, size_t size, uint8_t* dst)
+{
+  uint32_t* table = calloc ((size_t) 1 << HASH_BITS, sizeof (*table)); // position + 1, 0 = empty
+  uint8_t* op = dst;
+  size_t anchor = 0;
+  size_t ip = 0;
+
+  if (!table)
+    return 0;
+  if (size > MF_LIMIT)
+  {
+    size_t match_limit = size - LAST_LITERALS;
+    while (ip < size - MF_LIMIT)
+    {
+      uint32_t seq = read32 (src + ip);
+      uint32_t h = hash32 (seq);
+      size_t ref = table[h];
+      table[h] = (uint32_t) ip + 1;
+      if (!ref || ip - (ref - 1) > MAX_OFFSET || read32 (src + ref - 1) != seq)
+      {
+        ip++;
+        continue;
+      }
+      ref--;
+      size_t len = MIN_MATCH;
+      while (ip + len < match_limit && src[ref + len] == src[ip + len])
+        len++;
+      op = put_sequence (op, src + anchor, ip - anchor, ip - ref, len);
+      ip += len;
+      anchor = ip;
+      // seed the position just before, so the next repeat is found at once
+      if (ip - 2 + MIN_MATCH <= size)
+        table[hash32 (read32 (src + ip - 2))] = (uint32_t) (ip - 2) + 1;
+    }
+  }
+  op = put_sequence (op, src + anchor, size - anchor, 0, 0);
+  free (table);
+  return op - dst;
+}
+
+uint8_t*
+bmz_encode (const uint8_t* bmp, size_t size, size_t* out_size)
+{
+  struct splash_header header;
+  uint8_t* out;
+  size_t payload_size;
+
+  if (size < BMP_PIXEL_DATA_OFFSET || size > SPLASH_MAX_BMP_SIZE
+      || memcmp (bmp, BMP_MAGIC, BMP_MAGIC_SIZE) != 0)
+    return NULL;
+  out = malloc (sizeof (header) + lz4_bound (size));
+  if (!out)
+    return NULL;
+  payload_size = lz4_encode (bmp, size, out + sizeof (header));
+  if (!payload_size)
+  {
+    free (out);
+    return NULL;
+  }
+  memcpy (header.signature, SPLASH_MAGIC, SPLASH_MAGIC_SIZE);
+  header.codec = SPLASH_CODEC_LZ4;
+  header.bmp_size = (uint32_t) size;
+  header.payload_size = (uint32_t) payload_size;
+  memcpy (out, &header, sizeof (header));
+  *out_size = sizeof (header) + payload_size;
+  return out;
+}
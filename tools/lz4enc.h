@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Worst-case size of an LZ4 block for an input of the given size.
+ */
+static inline size_t
+lz4_bound (size_t size)
+{
+  return size + size / 255 + 16;
+}
+
+/**
+ * Compress a buffer as one raw LZ4 block, greedily, with a 64K-entry hash of
+ * 4-byte sequences. The output follows the end-of-block rules (the last 5
+ * bytes are literals, no match starts in the last 12), so any LZ4 decoder
+ * accepts it.
+ *
+ * @param src The data to compress.
+ * @param size The size of the data.
+ * @param dst The output, at least lz4_bound(size) bytes.
+ * @return The size of the block, or 0 if out of memory.
+ */
+size_t lz4_encode (const uint8_t* src, size_t size, uint8_t* dst);
+
+/**
+ * Build a splash container (struct splash_header + LZ4 block) from a bitmap file.
+ *
+ * @param bmp The whole bitmap file.
+ * @param size The size of the bitmap file.
+ * @param out_size Set to the size of the container.
+ * @return The container, to free(), or NULL if the input is not a BMP or out of memory.
+ */
+uint8_t* bmz_encode (const uint8_t* bmp, size_t size, size_t* out_size);
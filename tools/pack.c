@@ -0,0 +1,67 @@
+/*
+ * hackbgrt-pack: bundle splash variants drawn for different screens into
+ * one pack; the module reads the index and the variant for the GOP mode.
+ *
+ *   hackbgrt-pack OUTPUT WIDTHxHEIGHT=FILE|any=FILE...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <grub/types.h>
+#include "pack_build.h"
+#include "types.h"
+
+static void
+usage (const char* prog)
+{
+  fprintf (stderr, "usage: %s OUTPUT WIDTHxHEIGHT=FILE|any=FILE...\n"
+           "  Bundle BMP or .bmz variants, each drawn for a screen resolution, into a splash pack.\n"
+           "  hackbgrt picks the exact resolution, else the largest smaller one, else any, else the smallest.\n",
+           prog);
+}
+
+int
+main (int argc, char** argv)
+{
+  struct pack_input inputs[SPLASH_PACK_MAX_ENTRIES];
+  unsigned count = 0;
+  const char* error;
+
+  if (argc < 3 || strcmp (argv[1], "-h") == 0)
+  {
+    usage (argv[0]);
+    return argc < 3 ? 2 : 0;
+  }
+  for (int i = 2; i < argc; i++)
+  {
+    char* eq = strchr (argv[i], '=');
+    unsigned w = 0, h = 0;
+    char x;
+    if (count == SPLASH_PACK_MAX_ENTRIES)
+    {
+      fprintf (stderr, "at most %d variants\n", SPLASH_PACK_MAX_ENTRIES);
+      return 2;
+    }
+    if (!eq || (strncmp (argv[i], "any=", 4) != 0
+                && (sscanf (argv[i], "%u%c%u=", &w, &x, &h) != 3 || x != 'x' || !w || !h)))
+    {
+      fprintf (stderr, "bad variant `%s', WIDTHxHEIGHT=FILE or any=FILE expected\n", argv[i]);
+      return 2;
+    }
+    inputs[count].screen_width = w;
+    inputs[count].screen_height = h;
+    inputs[count].path = eq + 1;
+    count++;
+  }
+  if (pack_build (argv[1], inputs, count, &error) != 0)
+  {
+    fprintf (stderr, "%s: %s\n", argv[1], error);
+    return 1;
+  }
+  for (unsigned i = 0; i < count; i++)
+    if (inputs[i].screen_width)
+      fprintf (stderr, "%ux%u: %s\n", inputs[i].screen_width, inputs[i].screen_height, inputs[i].path);
+    else
+      fprintf (stderr, "any: %s\n", inputs[i].path);
+  return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * Splash pack writer, for the host tools only; the module reads the index
+ * and one variant (src/hackbgrt/hackbgrt.c).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <grub/types.h>
+#include "pack_build.h"
+#include "types.h"
+
+static uint8_t*
+read_variant (const char* path, size_t* size)
+{
+  FILE* fp = fopen (path, "rb");
+  uint8_t* data = NULL;
+  long len;
+
+  if (!fp)
+    return NULL;
+  if (fseek (fp, 0, SEEK_END) == 0 && (len = ftell (fp)) > 0 && fseek (fp, 0, SEEK_SET) == 0
+      && (data = malloc (len)) && fread (data, 1, len, fp) == (size_t) len)
+    *size = len;
+  else
+  {
+    free (data);
+    data = NULL;
+  }
+  fclose (fp);
+  return data;
+}
+
+int
+pack_build (const char* out_path, const struct pack_input* inputs, unsigned count, const char** error)
+{
+  static const uint8_t zeros[SPLASH_PACK_ALIGN];
+  struct splash_pack_header header;
+  uint64_t offset = SPLASH_PACK_ALIGN;
+  FILE* fp;
+
+  if (count == 0 || count > SPLASH_PACK_MAX_ENTRIES)
+  {
+    *error = "between 1 and 16 variants expected";
+    return -1;
+  }
+  fp = fopen (out_path, "wb");
+  if (!fp)
+  {
+    *error = "cannot create the pack";
+    return -1;
+  }
+  memset (&header, 0, sizeof (header));
+  memcpy (header.signature, SPLASH_PACK_MAGIC, SPLASH_PACK_MAGIC_SIZE);
+  header.count = count;
+  // the index is written last, once the offsets are known
+  fwrite (zeros, 1, SPLASH_PACK_ALIGN, fp);
+  for (unsigned i = 0; i < count; i++)
+  {
+    struct splash_pack_entry* e = &header.entries[i];
+    size_t size;
+    uint8_t* data = read_variant (inputs[i].path, &size);
+    if (!data)
+    {
+      *error = "cannot read a variant";
+      goto fail;
+    }
+    if (size >= SPLASH_MAGIC_SIZE && memcmp (data, SPLASH_MAGIC, SPLASH_MAGIC_SIZE) == 0)
+      e->format = SPLASH_FORMAT_BMZ;
+    else if (size >= BMP_MAGIC_SIZE && memcmp (data, BMP_MAGIC, BMP_MAGIC_SIZE) == 0)
+      e->format = SPLASH_FORMAT_BMP;
+    else
+    {
+      free (data);
+      *error = "a variant is neither a BMP nor a .bmz (PNG cannot be packed)";
+      goto fail;
+    }
+    if (offset + size > UINT32_MAX)
+    {
+      free (data);
+      *error = "the pack would exceed 4 GiB";
+      goto fail;
+    }
+    e->screen_width = inputs[i].screen_width;
+    e->screen_height = inputs[i].screen_height;
+    e->offset = offset;
+    e->length = size;
+    fwrite (data, 1, size, fp);
+    free (data);
+    offset += size;
+    if (i + 1 < count && offset % SPLASH_PACK_ALIGN)
+    {
+      fwrite (zeros, 1, SPLASH_PACK_ALIGN - offset % SPLASH_PACK_ALIGN, fp);
+      offset += SPLASH_PACK_ALIGN - offset % SPLASH_PACK_ALIGN;
+    }
+  }
+  if (fseek (fp, 0, SEEK_SET) != 0 || fwrite (&header, sizeof (header), 1, fp) != 1)
+  {
+    *error = "cannot write the index";
+    goto fail;
+  }
+  if (fclose (fp) != 0)
+  {
+    *error = "cannot write the pack";
+    return -1;
+  }
+  return 0;
+
+fail:
+  fclose (fp);
+  remove (out_path);
+  return -1;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+/** One variant to put in a splash pack. */
+struct pack_input
+{
+  uint32_t screen_width;  // resolution the variant is drawn for, 0x0 = any screen
+  uint32_t screen_height;
+  const char* path;       // a BMP or .bmz file
+};
+
+/**
+ * Write a splash pack: the fixed-size index, then each variant on a
+ * SPLASH_PACK_ALIGN boundary so a block-level read of it starts aligned.
+ *
+ * @param out_path The pack to write.
+ * @param inputs The variants, at most SPLASH_PACK_MAX_ENTRIES.
+ * @param count The number of variants.
+ * @param error Set to a message on failure.
+ * @return 0 on success, -1 on failure.
+ */
+int pack_build (const char* out_path, const struct pack_input* inputs, unsigned count, const char** error);
@@ -0,0 +1,464 @@
+/*
+ * hackbgrt-prepare: check the image parameters of hackbgrt against the ESP
+ * when grub.cfg is generated (01_hackbgrt), rather than at boot.
+ *
+ *   hackbgrt-prepare [-n] [-s WIDTHxHEIGHT] ESP_DIR PARAM...
+ *
+ * Missing or unreadable images are dropped. BMPs the module would have to
+ * convert, or that carry more than their pixels, are rewritten next to
+ * them as BITMAPINFOHEADER 24-bit bottom-up files it reads straight into
+ * the BGRT. For the screen of the running system, centered coordinates are
+ * computed and screen= is added, so the boot does not probe the GOP.
+ * Overlays (mode=overlay) are left as they are, once checked to have alpha:
+ * a 32-bit BMP or a PNG, placed on the firmware's logo at boot.
+ */
+#define _GNU_SOURCE
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <grub/types.h>
+#include "bmp.h"
+#include "lz4.h"
+#include "types.h"
+
+#define MAX_VARIABLES 16
+
+/** The name=value variables of a parameter. */
+struct param
+{
+  unsigned count;
+  char* names[MAX_VARIABLES];
+  char* values[MAX_VARIABLES];
+};
+
+/** What is known of an image once checked. */
+struct image_facts
+{
+  uint32_t width;  // 0 if it depends on the screen, like a pack
+  uint32_t height;
+};
+
+static int dry_run;
+
+static uint8_t*
+read_file (const char* path, size_t* size)
+{
+  FILE* fp = fopen (path, "rb");
+  uint8_t* data = NULL;
+  long len;
+
+  if (!fp)
+    return NULL;
+  if (fseek (fp, 0, SEEK_END) == 0 && (len = ftell (fp)) >= 0 && fseek (fp, 0, SEEK_SET) == 0
+      && (data = malloc (len ? len : 1)) && fread (data, 1, len, fp) == (size_t) len)
+    *size = len;
+  else
+  {
+    free (data);
+    data = NULL;
+  }
+  fclose (fp);
+  return data;
+}
+
+static int
+split_param (char* param, struct param* p)
+{
+  p->count = 0;
+  for (char* var = strtok (param, ","); var; var = strtok (NULL, ","))
+  {
+    char* equal = strchr (var, '=');
+    if (!equal || p->count == MAX_VARIABLES - 3) // room for x, y and screen
+      return -1;
+    *equal = '\0';
+    p->names[p->count] = var;
+    p->values[p->count++] = equal + 1;
+  }
+  return p->count ? 0 : -1;
+}
+
+static char*
+get_variable (const struct param* p, const char* name)
+{
+  for (unsigned i = 0; i < p->count; i++)
+    if (strcmp (p->names[i], name) == 0)
+      return p->values[i];
+  return NULL;
+}
+
+/** Set a variable; the value must outlive the parameter. */
+static void
+set_variable (struct param* p, const char* name, char* value)
+{
+  for (unsigned i = 0; i < p->count; i++)
+    if (strcmp (p->names[i], name) == 0)
+    {
+      p->values[i] = value;
+      return;
+    }
+  p->names[p->count] = (char*) name;
+  p->values[p->count++] = value;
+}
+
+/**
+ * Tell whether a bitmap is exactly what the fast path of load_bmp reads:
+ * a BITMAPINFOHEADER, 24-bit bottom-up pixels, nothing before or after them.
+ */
+static int
+is_tight_bgrt_bitmap (const uint8_t* data, size_t size)
+{
+  struct bitmap_header header;
+
+  if (size < sizeof (header))
+    return 0;
+  memcpy (&header, data, sizeof (header));
+  return memcmp (&header.signature, BMP_MAGIC, BMP_MAGIC_SIZE) == 0
+      && header.pixel_data_offset == BMP_PIXEL_DATA_OFFSET && header.dib_header_size == BMP_DIB_HEADER_SIZE
+      && header.planes == 1 && header.bpp == BMP_888_BPP && header.compression == BMP_NO_COMPRESSION
+      && header.palette_colors == BMP_NO_PALETTE && header.important_colors == BMP_NO_PALETTE
+      && (int32_t) header.width > 0 && (int32_t) header.height > 0
+      && header.data_size == get_bitmap_pixels_size (header.width, header.height)
+      && header.size == BMP_PIXEL_DATA_OFFSET + header.data_size && header.size == size;
+}
+
+/**
+ * Write a file unless it already has this content, so the ESP is not
+ * rewritten by every update-grub.
+ */
+static int
+write_if_changed (const char* path, const uint8_t* data, size_t size)
+{
+  size_t old_size;
+  uint8_t* old = read_file (path, &old_size);
+  int same = old && old_size == size && memcmp (old, data, size) == 0;
+  FILE* fp;
+
+  free (old);
+  if (same || dry_run)
+    return 0;
+  fp = fopen (path, "wb");
+  if (!fp)
+    return -1;
+  if (fwrite (data, 1, size, fp) != size)
+  {
+    fclose (fp);
+    return -1;
+  }
+  return fclose (fp);
+}
+
+/**
+ * Rewrite a BMP the module would convert as one it reads as is, next to it:
+ * logo.bmp gives logo.bgrt.bmp.
+ *
+ * @return The ESP-relative path of the normalized image, to free, or NULL.
+ */
+static char*
+normalize_bmp (const char* esp, const char* image, const uint8_t* data, size_t size, struct image_facts* facts)
+{
+  struct hackbgrt_bmp_info info;
+  const char* dot = strrchr (image, '.');
+  size_t base = dot && !strchr (dot, '/') ? (size_t) (dot - image) : strlen (image);
+  char* normalized = NULL;
+  char* path = NULL;
+  bitmap_t bmp;
+
+  if (hackbgrt_bmp_parse (data, size, &info) != GRUB_ERR_NONE)
+    return NULL;
+  bmp = malloc (get_bitmap_total_size (info.width, info.height));
+  if (!bmp || hackbgrt_bmp_convert (&info, data, bmp) != GRUB_ERR_NONE)
+  {
+    free (bmp);
+    return NULL;
+  }
+  if (base > 5 && strncmp (image + base - 5, ".bgrt", 5) == 0)
+    base -= 5;
+  if (asprintf (&normalized, "%.*s.bgrt.bmp", (int) base, image) < 0
+      || asprintf (&path, "%s%s", esp, normalized) < 0
+      || write_if_changed (path, (const uint8_t*) bmp, bmp->header.size) != 0)
+  {
+    perror (path ? path : image);
+    free (normalized);
+    normalized = NULL;
+  }
+  else
+  {
+    facts->width = info.width;
+    facts->height = info.height;
+    fprintf (stderr, "hackbgrt-prepare: %s: %u-bit%s %ux%u normalized as %s\n", image, info.bpp,
+             info.compression == BMP_NO_COMPRESSION ? "" : " compressed", info.width, info.height, normalized);
+  }
+  free (path);
+  free (bmp);
+  return normalized;
+}
+
+/**
+ * Check an image of the ESP.
+ *
+ * @param image The ESP-relative path.
+ * @param overlay Whether the image is composited on the firmware's logo, mode=overlay.
+ * @param normalized Set to the path of a normalized copy to use instead, or NULL.
+ * @return NULL, or why the image cannot be shown.
+ */
+static const char*
+check_image (const char* esp, const char* image, int overlay, char** normalized, struct image_facts* facts)
+{
+  char* path;
+  uint8_t* data;
+  size_t size;
+  const char* error = NULL;
+
+  *normalized = NULL;
+  facts->width = 0;
+  facts->height = 0;
+  if (asprintf (&path, "%s%s", esp, image) < 0)
+    return "out of memory";
+  data = read_file (path, &size);
+  free (path);
+  if (!data)
+    return "cannot be read";
+  if (overlay && !(size >= 2 && memcmp (data, BMP_MAGIC, BMP_MAGIC_SIZE) == 0)
+      && !(size >= PNG_MAGIC_SIZE && memcmp (data, PNG_MAGIC, PNG_MAGIC_SIZE) == 0))
+    error = "an overlay must be a 32-bit BMP or a PNG";
+  else if (size >= sizeof (struct splash_header) && memcmp (data, SPLASH_MAGIC, SPLASH_MAGIC_SIZE) == 0)
+  {
+    struct splash_header splash;
+    struct bitmap_header header;
+    uint8_t* bmp;
+    memcpy (&splash, data, sizeof (splash));
+    bmp = splash.codec == SPLASH_CODEC_LZ4 && splash.bmp_size >= sizeof (header) && splash.bmp_size <= SPLASH_MAX_BMP_SIZE
+          && splash.payload_size == size - sizeof (splash) ? malloc (splash.bmp_size) : NULL;
+    if (!bmp || hackbgrt_lz4_decode (data + sizeof (splash), splash.payload_size, bmp, splash.bmp_size)
+                != (grub_ssize_t) splash.bmp_size)
+      error = "bad compressed splash";
+    else
+    {
+      memcpy (&header, bmp, sizeof (header));
+      facts->width = header.width;
+      facts->height = (int32_t) header.height < 0 ? -header.height : header.height;
+    }
+    free (bmp);
+  }
+  else if (size >= sizeof (struct splash_pack_header)
+           && memcmp (data, SPLASH_PACK_MAGIC, SPLASH_PACK_MAGIC_SIZE) == 0)
+  {
+    struct splash_pack_header pack;
+    memcpy (&pack, data, sizeof (pack));
+    // the variant, and so the size, is picked at boot
+    if (pack.count == 0 || pack.count > SPLASH_PACK_MAX_ENTRIES)
+      error = "bad splash pack";
+  }
+  else if (size >= 24 && memcmp (data, PNG_MAGIC, PNG_MAGIC_SIZE) == 0 && memcmp (data + 12, "IHDR", 4) == 0)
+  {
+    if (strlen (image) < 4 || strcasecmp (image + strlen (image) - 4, ".png") != 0)
+      error = "a PNG must be named *.png for GRUB to decode it";
+    facts->width = (uint32_t) data[16] << 24 | data[17] << 16 | data[18] << 8 | data[19];
+    facts->height = (uint32_t) data[20] << 24 | data[21] << 16 | data[22] << 8 | data[23];
+  }
+  else if (size >= 2 && memcmp (data, BMP_MAGIC, BMP_MAGIC_SIZE) == 0 && overlay)
+  {
+    struct hackbgrt_bmp_info info;
+    // its alpha is what the module composites with: no 24-bit copy
+    if (hackbgrt_bmp_parse (data, size, &info) != GRUB_ERR_NONE || info.bpp != 32)
+      error = "an overlay must be a 32-bit BMP or a PNG";
+  }
+  else if (size >= 2 && memcmp (data, BMP_MAGIC, BMP_MAGIC_SIZE) == 0)
+  {
+    if (is_tight_bgrt_bitmap (data, size))
+    {
+      struct bitmap_header header;
+      memcpy (&header, data, sizeof (header));
+      facts->width = header.width;
+      facts->height = header.height;
+    }
+    else if (!(*normalized = normalize_bmp (esp, image, data, size, facts)))
+      error = "not a supported BMP";
+  }
+  else
+    error = "not a BMP, .bmz, pack or PNG";
+  free (data);
+  return error;
+}
+
+/**
+ * Read the resolution the firmware left the screen in: efifb or simpledrm
+ * report the GOP mode; else the mode of the first connected DRM output,
+ * usually the native one the firmware also picks.
+ *
+ * @return 1 if found.
+ */
+static int
+detect_screen (uint32_t* width, uint32_t* height)
+{
+  char line[128];
+  FILE* fp;
+  glob_t outputs;
+  int found = 0;
+
+  fp = fopen ("/sys/class/graphics/fb0/name", "r");
+  if (fp && fgets (line, sizeof (line), fp) && (strstr (line, "EFI VGA") || strstr (line, "simpledrm")))
+  {
+    fclose (fp);
+    fp = fopen ("/sys/class/graphics/fb0/virtual_size", "r");
+    if (fp && fgets (line, sizeof (line), fp) && sscanf (line, "%u,%u", width, height) == 2)
+      found = 1;
+  }
+  if (fp)
+    fclose (fp);
+  if (found || glob ("/sys/class/drm/card*-*/status", 0, NULL, &outputs) != 0)
+    return found;
+  for (size_t i = 0; i < outputs.gl_pathc && !found; i++)
+  {
+    char* modes;
+    fp = fopen (outputs.gl_pathv[i], "r");
+    if (!fp)
+      continue;
+    if (fgets (line, sizeof (line), fp) && strncmp (line, "connected", 9) == 0
+        && asprintf (&modes, "%.*s/modes", (int) (strrchr (outputs.gl_pathv[i], '/') - outputs.gl_pathv[i]),
+                     outputs.gl_pathv[i]) >= 0)
+    {
+      FILE* mp = fopen (modes, "r");
+      if (mp && fgets (line, sizeof (line), mp) && sscanf (line, "%ux%u", width, height) == 2)
+        found = 1;
+      if (mp)
+        fclose (mp);
+      free (modes);
+    }
+    fclose (fp);
+  }
+  globfree (&outputs);
+  return found;
+}
+
+/**
+ * The automatic position of hack_bgrt: centered horizontally, in the upper
+ * two thirds vertically.
+ */
+static char*
+auto_coordinate (uint32_t screen, uint32_t image, int vertical)
+{
+  char* value;
+  int64_t c = vertical ? ((int64_t) screen * 2 / 3 - image) / 2 : ((int64_t) screen - image) / 2;
+  // 0 reads as automatic, which gives 0 again once screen= is set
+  if (asprintf (&value, "%lld", (long long) (c > 0 ? c : 0)) < 0)
+    exit (1);
+  return value;
+}
+
+static void
+usage (const char* prog)
+{
+  fprintf (stderr, "usage: %s [-n] [-s WIDTHxHEIGHT] ESP_DIR PARAM...\n"
+           "  Check the image parameters of hackbgrt against the ESP mounted at ESP_DIR and print them\n"
+           "  for grub.cfg: unreadable images dropped, BMPs normalized, positions computed for the screen.\n"
+           "  -n  do not write the normalized BMPs\n"
+           "  -s  the screen resolution at boot, instead of the one of efifb or DRM\n", prog);
+}
+
+int
+main (int argc, char** argv)
+{
+  uint32_t screen_width = 0, screen_height = 0;
+  char* screen = NULL;
+  const char* esp;
+  int opt, images = 0, printed = 0;
+
+  while ((opt = getopt (argc, argv, "ns:h")) != -1)
+  {
+    char x;
+    switch (opt)
+    {
+      case 'n':
+        dry_run = 1;
+        break;
+      case 's':
+        if (sscanf (optarg, "%u%c%u", &screen_width, &x, &screen_height) != 3 || x != 'x' || !screen_width
+            || !screen_height)
+        {
+          fprintf (stderr, "bad screen `%s', WIDTHxHEIGHT expected\n", optarg);
+          return 2;
+        }
+        break;
+      default:
+        usage (argv[0]);
+        return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (argc - optind < 2)
+  {
+    usage (argv[0]);
+    return 2;
+  }
+  esp = argv[optind];
+  if (!screen_width && !detect_screen (&screen_width, &screen_height))
+    fprintf (stderr, "hackbgrt-prepare: screen resolution unknown, the GOP will be probed at boot\n");
+  if (screen_width && asprintf (&screen, "%ux%u", screen_width, screen_height) < 0)
+    return 1;
+  for (int i = optind + 1; i < argc; i++)
+  {
+    char* copy = strdup (argv[i]);
+    struct param p;
+    struct image_facts facts = { 0, 0 };
+    char* normalized = NULL;
+    char* image;
+    char* mode;
+    int overlay = 0;
+    const char* error = NULL;
+
+    if (strncmp (argv[i], "image=", 6) != 0)
+    {
+      // seed=, profile=, budget=: as is
+      printf ("%s%s", printed++ ? " " : "", argv[i]);
+      free (copy);
+      continue;
+    }
+    if (split_param (copy, &p) != 0 || !(image = get_variable (&p, "image")))
+      error = "not a name=value list";
+    else if ((mode = get_variable (&p, "mode")) && strcmp (mode, "replace") != 0
+             && !(overlay = strcmp (mode, "overlay") == 0))
+      error = "mode is not replace or overlay";
+    else if (strncmp (image, "dir:/", 5) == 0)
+    {
+      struct stat st;
+      char* dir;
+      if (asprintf (&dir, "%s%s", esp, image + 4) < 0 || stat (dir, &st) != 0 || !S_ISDIR (st.st_mode))
+        error = "not a directory";
+      free (dir);
+    }
+    else if (image[0] == '/')
+      error = check_image (esp, image, overlay, &normalized, &facts);
+    if (error)
+    {
+      fprintf (stderr, "hackbgrt-prepare: %s: %s, left out\n", argv[i], error);
+      free (copy);
+      continue;
+    }
+    if (normalized)
+      set_variable (&p, "image", normalized);
+    // the position hack_bgrt would compute, unless scaled or trimmed at boot, or on the logo
+    if (screen && facts.width && !overlay && !get_variable (&p, "scale") && !get_variable (&p, "trim"))
+    {
+      char* x = get_variable (&p, "x");
+      char* y = get_variable (&p, "y");
+      if (!x || strcmp (x, "center") == 0)
+        set_variable (&p, "x", auto_coordinate (screen_width, facts.width, 0));
+      if (!y || strcmp (y, "center") == 0)
+        set_variable (&p, "y", auto_coordinate (screen_height, facts.height, 1));
+    }
+    if (screen && !get_variable (&p, "screen") && image[0] != 'k' && image[0] != 'r')
+      set_variable (&p, "screen", screen);
+    printf ("%s", printed++ ? " " : "");
+    for (unsigned v = 0; v < p.count; v++)
+      printf ("%s%s=%s", v ? "," : "", p.names[v], p.values[v]);
+    images++;
+  }
+  // nothing left to show: the firmware's logo rather than none
+  if (!images)
+    printf ("%simage=keep", printed ? " " : "");
+  printf ("\n");
+  return 0;
+}
@@ -0,0 +1,159 @@
+/*
+ * hackbgrt-profile: compile a CSV of machines and their splash images into
+ * the profile table read by profile=.
+ *
+ *   hackbgrt-profile OUTPUT INPUT.csv
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <grub/types.h>
+#include "profile_build.h"
+#include "types.h"
+
+enum column
+{
+  COLUMN_MATCH = 0,
+  COLUMN_MANUFACTURER,
+  COLUMN_PRODUCT,
+  COLUMN_IMAGE,
+  COLUMN_X,
+  COLUMN_Y,
+  COLUMN_WEIGHT,
+  COLUMNS
+};
+
+static void
+usage (const char* prog)
+{
+  fprintf (stderr, "usage: %s OUTPUT INPUT.csv\n"
+           "  Compile a CSV of match,manufacturer,product,image,x,y,weight lines into a profile table.\n"
+           "  match is system (SMBIOS type 1), board (type 2) or default; x, y and weight may be empty.\n"
+           "  A machine may have several lines, drawn by weight. Lines starting with # are ignored.\n",
+           prog);
+}
+
+/**
+ * Split a CSV line in place, with "quoted" fields and "" for a quote.
+ *
+ * @return The number of fields, COLUMNS + 1 if there are too many.
+ */
+static unsigned
+split_line (char* line, char* fields[COLUMNS])
+{
+  unsigned n = 0;
+  char* p = line;
+  for (;;)
+  {
+    char* out = p;
+    if (n == COLUMNS)
+      return COLUMNS + 1;
+    fields[n++] = out;
+    if (*p == '"')
+    {
+      for (p++; *p && !(p[0] == '"' && p[1] != '"'); p++)
+        *out++ = (*p == '"') ? *++p : *p;
+      if (*p == '"')
+        p++;
+    }
+    while (*p && *p != ',')
+      *out++ = *p++;
+    if (!*p)
+    {
+      *out = '\0';
+      return n;
+    }
+    *out = '\0';
+    p++;
+  }
+}
+
+int
+main (int argc, char** argv)
+{
+  struct profile_input* inputs = NULL;
+  unsigned count = 0, capacity = 0, line_number = 0;
+  char* line = NULL;
+  size_t line_size = 0;
+  const char* error;
+  FILE* fp;
+
+  if (argc != 3 || strcmp (argv[1], "-h") == 0)
+  {
+    usage (argv[0]);
+    return argc != 3 ? 2 : 0;
+  }
+  fp = fopen (argv[2], "r");
+  if (!fp)
+  {
+    perror (argv[2]);
+    return 1;
+  }
+  while (getline (&line, &line_size, fp) >= 0)
+  {
+    char* fields[COLUMNS];
+    char* key;
+    char* param;
+    unsigned n;
+    line_number++;
+    line[strcspn (line, "\r\n")] = '\0';
+    if (!line[0] || line[0] == '#')
+      continue;
+    n = split_line (line, fields);
+    // the header row, if any
+    if (line_number == 1 && strcmp (fields[COLUMN_MATCH], "match") == 0)
+      continue;
+    if (n < COLUMN_IMAGE + 1 || n > COLUMNS || !fields[COLUMN_IMAGE][0])
+    {
+      fprintf (stderr, "%s:%u: match,manufacturer,product,image[,x[,y[,weight]]] expected\n", argv[2], line_number);
+      return 2;
+    }
+    if (strcmp (fields[COLUMN_MATCH], PROFILE_KEY_DEFAULT) == 0)
+      key = strdup (PROFILE_KEY_DEFAULT);
+    else if (strcmp (fields[COLUMN_MATCH], PROFILE_KEY_SYSTEM) == 0 || strcmp (fields[COLUMN_MATCH], PROFILE_KEY_BOARD) == 0)
+    {
+      if (!fields[COLUMN_MANUFACTURER][0] || !fields[COLUMN_PRODUCT][0])
+      {
+        fprintf (stderr, "%s:%u: a manufacturer and a product are expected\n", argv[2], line_number);
+        return 2;
+      }
+      if (asprintf (&key, "%s\t%s\t%s", fields[COLUMN_MATCH], fields[COLUMN_MANUFACTURER], fields[COLUMN_PRODUCT]) < 0)
+        key = NULL;
+    }
+    else
+    {
+      fprintf (stderr, "%s:%u: bad match `%s', system, board or default expected\n", argv[2], line_number,
+               fields[COLUMN_MATCH]);
+      return 2;
+    }
+    if (asprintf (&param, "image=%s%s%s%s%s%s%s", fields[COLUMN_IMAGE],
+                  n > COLUMN_X && fields[COLUMN_X][0] ? ",x=" : "", n > COLUMN_X ? fields[COLUMN_X] : "",
+                  n > COLUMN_Y && fields[COLUMN_Y][0] ? ",y=" : "", n > COLUMN_Y ? fields[COLUMN_Y] : "",
+                  n > COLUMN_WEIGHT && fields[COLUMN_WEIGHT][0] ? ",weight=" : "",
+                  n > COLUMN_WEIGHT ? fields[COLUMN_WEIGHT] : "") < 0)
+      param = NULL;
+    if (count == capacity)
+    {
+      capacity = capacity ? capacity * 2 : 64;
+      inputs = realloc (inputs, capacity * sizeof (*inputs));
+    }
+    if (!key || !param || !inputs)
+    {
+      fprintf (stderr, "out of memory\n");
+      return 1;
+    }
+    inputs[count].key = key;
+    inputs[count].param = param;
+    count++;
+  }
+  free (line);
+  fclose (fp);
+  if (profile_build (argv[1], inputs, count, &error) != 0)
+  {
+    fprintf (stderr, "%s: %s\n", argv[1], error);
+    return 1;
+  }
+  fprintf (stderr, "%u entries\n", count);
+  return 0;
+}
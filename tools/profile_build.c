@@ -0,0 +1,123 @@
+/*
+ * Profile table writer, for the host tools and the benchmark; the module
+ * looks the machine up in it (src/hackbgrt/profile.c).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <grub/types.h>
+#include "profile_build.h"
+#include "types.h"
+
+struct sorted_input
+{
+  uint64_t hash;
+  unsigned index;
+  const struct profile_input* input;
+};
+
+static int
+compare_inputs (const void* a, const void* b)
+{
+  const struct sorted_input* x = a;
+  const struct sorted_input* y = b;
+  int c;
+  if (x->hash != y->hash)
+    return x->hash < y->hash ? -1 : 1;
+  c = strcmp (x->input->key, y->input->key);
+  if (c)
+    return c;
+  // stable: the entries of a machine keep their order
+  return x->index < y->index ? -1 : x->index > y->index;
+}
+
+int
+profile_build (const char* out_path, const struct profile_input* inputs, unsigned count, const char** error)
+{
+  struct profile_header header;
+  struct sorted_input* sorted = NULL;
+  struct profile_entry* entries = NULL;
+  char* strings = NULL;
+  size_t strings_size = 0, strings_max = 1;
+  FILE* fp = NULL;
+  int ret = -1;
+
+  if (count == 0)
+  {
+    *error = "no entry";
+    return -1;
+  }
+  for (unsigned i = 0; i < count; i++)
+  {
+    if (strlen (inputs[i].key) >= PROFILE_PARAM_MAX || strlen (inputs[i].param) >= PROFILE_PARAM_MAX)
+    {
+      *error = "a key or an image parameter is longer than 255 bytes";
+      return -1;
+    }
+    strings_max += strlen (inputs[i].key) + strlen (inputs[i].param) + 2;
+  }
+  if (sizeof (header) + (uint64_t) count * sizeof (*entries) + strings_max > UINT32_MAX)
+  {
+    *error = "the table would be larger than 4 GiB";
+    return -1;
+  }
+  sorted = malloc (count * sizeof (*sorted));
+  entries = calloc (count, sizeof (*entries));
+  strings = malloc (strings_max);
+  if (!sorted || !entries || !strings)
+  {
+    *error = "out of memory";
+    goto done;
+  }
+  for (unsigned i = 0; i < count; i++)
+  {
+    sorted[i].hash = profile_key_hash (inputs[i].key);
+    sorted[i].index = i;
+    sorted[i].input = &inputs[i];
+  }
+  qsort (sorted, count, sizeof (*sorted), compare_inputs);
+  // offset 0 is the empty string
+  strings[strings_size++] = '\0';
+  for (unsigned i = 0; i < count; i++)
+  {
+    const struct profile_input* input = sorted[i].input;
+    entries[i].hash = sorted[i].hash;
+    if (i && strcmp (input->key, sorted[i - 1].input->key) == 0)
+      entries[i].key = entries[i - 1].key;
+    else
+    {
+      entries[i].key = strings_size;
+      strings_size += stpcpy (strings + strings_size, input->key) - (strings + strings_size) + 1;
+    }
+    entries[i].param = strings_size;
+    strings_size += stpcpy (strings + strings_size, input->param) - (strings + strings_size) + 1;
+  }
+  memset (&header, 0, sizeof (header));
+  memcpy (header.signature, PROFILE_MAGIC, PROFILE_MAGIC_SIZE);
+  header.count = count;
+  header.strings_offset = sizeof (header) + count * sizeof (*entries);
+  header.strings_size = strings_size;
+  fp = fopen (out_path, "wb");
+  if (!fp)
+  {
+    *error = "cannot create the table";
+    goto done;
+  }
+  if (fwrite (&header, sizeof (header), 1, fp) != 1 || fwrite (entries, sizeof (*entries), count, fp) != count
+      || fwrite (strings, 1, strings_size, fp) != strings_size)
+  {
+    *error = "write failed";
+    goto done;
+  }
+  ret = 0;
+done:
+  if (fp && fclose (fp) != 0 && ret == 0)
+  {
+    *error = "write failed";
+    ret = -1;
+  }
+  free (strings);
+  free (entries);
+  free (sorted);
+  return ret;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+/** One line of a profile table. */
+struct profile_input
+{
+  const char* key;    // system\tMANUFACTURER\tPRODUCT, board\tMANUFACTURER\tPRODUCT or default
+  const char* param;  // image=...[,x=...][,y=...][,weight=...]
+};
+
+/**
+ * Write a profile table: the header, the entries sorted by key hash then
+ * key, so the module finds a machine by a binary search, then the strings,
+ * each key stored once.
+ *
+ * @param out_path The table to write.
+ * @param inputs The lines; those of the same key are kept in order.
+ * @param count The number of lines.
+ * @param error Set to a message on failure.
+ * @return 0 on success, -1 on failure.
+ */
+int profile_build (const char* out_path, const struct profile_input* inputs, unsigned count, const char** error);
@@ -0,0 +1,154 @@
+/*
+ * hackbgrt-telemetry: decode the record hackbgrt --telemetry leaves in a
+ * volatile EFI variable, for the monitoring of the OS.
+ *
+ *   hackbgrt-telemetry [-1] [FILE]
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <grub/types.h>
+#include "types.h"
+
+#define EFIVARS_PATH "/sys/firmware/efi/efivars/" TELEMETRY_VARIABLE "-" TELEMETRY_GUID_STRING
+#define EFIVARS_ATTRIBUTES_SIZE 4 // efivarfs files start with the attributes
+
+static const char* const phase_names[TELEMETRY_PHASES] = {
+  "config", "acpi_scan", "gop", "gallery", "load", "fit", "acpi_commit", "total",
+};
+
+static const char* const action_names[] = { "keep", "replace", "remove" };
+static const char* const backend_names[] = { "grub", "efi", "blocklist", "auto" };
+
+static const struct
+{
+  grub_uint16_t flag;
+  const char* name;
+} flag_names[] = {
+  { TELEMETRY_FLAG_DEFERRED, "deferred" },
+  { TELEMETRY_FLAG_GALLERY, "gallery" },
+  { TELEMETRY_FLAG_BUILTIN, "builtin" },
+  { TELEMETRY_FLAG_SCREEN_GIVEN, "screen-given" },
+  { TELEMETRY_FLAG_PARALLEL, "parallel" },
+  { TELEMETRY_FLAG_OUT_OF_BUDGET, "out-of-budget" },
+  { TELEMETRY_FLAG_OVERLAY, "overlay" },
+};
+
+static const char* separator = "\n";
+static const char* assign = " ";
+
+static void
+field (const char* name, const char* fmt, ...) __attribute__ ((format (printf, 2, 3)));
+
+static void
+field (const char* name, const char* fmt, ...)
+{
+  va_list ap;
+  printf ("%s%s", name, assign);
+  va_start (ap, fmt);
+  vprintf (fmt, ap);
+  va_end (ap);
+  printf ("%s", separator);
+}
+
+static void
+usage (const char* prog)
+{
+  fprintf (stderr, "usage: %s [-1] [FILE]\n"
+           "  Decode the telemetry record of the last hackbgrt run, from %s\n"
+           "  or FILE, with or without the 4 bytes of attributes of efivarfs.\n"
+           "  -1  print the fields as name=value on one line, for logs\n", prog, EFIVARS_PATH);
+}
+
+int
+main (int argc, char** argv)
+{
+  struct telemetry_record record;
+  unsigned char data[sizeof (record) + EFIVARS_ATTRIBUTES_SIZE + 256];
+  const unsigned char* r = data;
+  const char* path = EFIVARS_PATH;
+  size_t size;
+  FILE* fp;
+  int opt;
+
+  while ((opt = getopt (argc, argv, "1h")) != -1)
+  {
+    switch (opt)
+    {
+      case '1':
+        separator = " ";
+        assign = "=";
+        break;
+      default:
+        usage (argv[0]);
+        return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (argc - optind > 1)
+  {
+    usage (argv[0]);
+    return 2;
+  }
+  if (optind < argc)
+    path = argv[optind];
+  fp = fopen (path, "rb");
+  if (!fp)
+  {
+    perror (path);
+    return 1;
+  }
+  size = fread (data, 1, sizeof (data), fp);
+  fclose (fp);
+  if (size >= EFIVARS_ATTRIBUTES_SIZE + TELEMETRY_MAGIC_SIZE
+      && memcmp (data, TELEMETRY_MAGIC, TELEMETRY_MAGIC_SIZE) != 0
+      && memcmp (data + EFIVARS_ATTRIBUTES_SIZE, TELEMETRY_MAGIC, TELEMETRY_MAGIC_SIZE) == 0)
+  {
+    r += EFIVARS_ATTRIBUTES_SIZE;
+    size -= EFIVARS_ATTRIBUTES_SIZE;
+  }
+  // a later version appends fields: read what this one knows
+  memset (&record, 0, sizeof (record));
+  memcpy (&record, r, size < sizeof (record) ? size : sizeof (record));
+  if (size < offsetof (struct telemetry_record, us) || memcmp (record.signature, TELEMETRY_MAGIC, TELEMETRY_MAGIC_SIZE) != 0
+      || record.size > size || record.size < sizeof (record) || record.version < TELEMETRY_VERSION)
+  {
+    fprintf (stderr, "%s: not a telemetry record of version %d or later\n", path, TELEMETRY_VERSION);
+    return 1;
+  }
+  field ("version", "%u", record.version);
+  for (int phase = 0; phase < TELEMETRY_PHASES; phase++)
+  {
+    char name[32];
+    snprintf (name, sizeof (name), "%s_us", phase_names[phase]);
+    field (name, "%u", record.us[phase]);
+  }
+  field ("bytes_read", "%llu", (unsigned long long) record.bytes_read);
+  field ("allocations", "%u", record.allocations);
+  field ("xsdt_entries", "%u", record.xsdt_entries);
+  field ("action", "%s", record.action < 3 ? action_names[record.action] : "?");
+  if (record.image_index == TELEMETRY_NO_IMAGE)
+    field ("image_index", "none");
+  else
+    field ("image_index", "%u", record.image_index);
+  field ("io", "%s", backend_names[record.io_backend < 3 ? record.io_backend : 3]);
+  printf ("flags%s", assign);
+  if (!record.flags)
+    printf ("none");
+  for (unsigned i = 0, first = 1; i < sizeof (flag_names) / sizeof (flag_names[0]); i++)
+    if (record.flags & flag_names[i].flag)
+    {
+      printf ("%s%s", first ? "" : ",", flag_names[i].name);
+      first = 0;
+    }
+  printf ("%s", separator);
+  field ("image_address", "0x%llx", (unsigned long long) record.image_address);
+  field ("image_size", "%u", record.image_size);
+  field ("image_offset", "%u,%u", record.image_offset_x, record.image_offset_y);
+  field ("screen", "%ux%u", record.screen_width, record.screen_height);
+  field ("error", "%u", record.error);
+  printf ("error_count%s%u\n", assign, record.error_count);
+  return 0;
+}